@@ -786,8 +786,8 @@ class DB(RqlTopLevelQuery):
     def table_list(self):
         return TableList(self)
 
-    def table_create(self, table_name, primary_key=(), datacenter=(), cache_size=(), durability=()):
-        return TableCreate(self, table_name, primary_key=primary_key, datacenter=datacenter, cache_size=cache_size, durability=durability)
+    def table_create(self, table_name, primary_key=(), datacenter=(), cache_size=(), compress_blocks=(), durability=()):
+        return TableCreate(self, table_name, primary_key=primary_key, datacenter=datacenter, cache_size=cache_size, compress_blocks=compress_blocks, durability=durability)
 
     def table_drop(self, table_name):
         return TableDrop(self, table_name)
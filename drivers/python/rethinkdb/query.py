@@ -35,8 +35,8 @@ def db_drop(db_name):
 def db_list():
     return DbList()
 
-def table_create(table_name, primary_key=(), datacenter=(), cache_size=(), durability=()):
-    return TableCreateTL(table_name, primary_key=primary_key, datacenter=datacenter, cache_size=cache_size, durability=durability)
+def table_create(table_name, primary_key=(), datacenter=(), cache_size=(), compress_blocks=(), durability=()):
+    return TableCreateTL(table_name, primary_key=primary_key, datacenter=datacenter, cache_size=cache_size, compress_blocks=compress_blocks, durability=durability)
 
 def table_drop(table_name):
     return TableDropTL(table_name)
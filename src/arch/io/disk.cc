@@ -16,6 +16,7 @@
 #include "config/args.hpp"
 #include "backtrace.hpp"
 #include "arch/runtime/runtime.hpp"
+#include "arch/io/disk/aio.hpp"
 #include "arch/io/disk/filestat.hpp"
 #include "arch/io/disk/pool.hpp"
 #include "arch/io/disk/conflict_resolving.hpp"
@@ -45,12 +46,12 @@ public:
     linux_disk_manager_t(linux_event_queue_t *queue,
                          int batch_factor,
                          int max_concurrent_io_requests,
+                         io_backend_t io_backend,
                          perfmon_collection_t *stats) :
         stack_stats(stats, "stack"),
         conflict_resolver(stats),
         accounter(batch_factor),
         backend_stats(stats, "backend", accounter.producer),
-        backend(queue, backend_stats.producer, max_concurrent_io_requests),
         outstanding_txn(0)
     {
         /* Hook up the `submit_fun`s of the parts of the IO stack that are above the
@@ -62,12 +63,30 @@ public:
                                                  &accounter, _1);
 
         /* Hook up everything's `done_fun`. */
-        backend.done_fun = std::bind(&stats_diskmgr_2_t::done, &backend_stats, _1);
         backend_stats.done_fun = std::bind(&accounting_diskmgr_t::done, &accounter, _1);
         accounter.done_fun = std::bind(&conflict_resolving_diskmgr_t::done,
                                        &conflict_resolver, _1);
         conflict_resolver.done_fun = std::bind(&stats_diskmgr_t::done, &stack_stats, _1);
         stack_stats.done_fun = std::bind(&linux_disk_manager_t::done, this, _1);
+
+        /* Set up the backend. Either kind pops its actions from
+        `backend_stats.producer` and reports them done to `backend_stats`. */
+#if USE_NATIVE_AIO
+        if (io_backend == io_backend_t::native_aio && aio_diskmgr_t::is_available()) {
+            aio_backend.init(new aio_diskmgr_t(queue, backend_stats.producer,
+                                               max_concurrent_io_requests));
+            aio_backend->done_fun = std::bind(&stats_diskmgr_2_t::done,
+                                              &backend_stats, _1);
+            return;
+        }
+#endif
+        if (io_backend == io_backend_t::native_aio) {
+            logWRN("Native AIO is not available on this system, using the thread "
+                   "pool IO backend instead.\n");
+        }
+        pool_backend.init(new pool_diskmgr_t(queue, backend_stats.producer,
+                                             max_concurrent_io_requests));
+        pool_backend->done_fun = std::bind(&stats_diskmgr_2_t::done, &backend_stats, _1);
     }
 
     ~linux_disk_manager_t() {
@@ -169,13 +188,19 @@ private:
     will tell you how many IO operations are queued. The "backend stats" will tell you
     how long the OS takes to perform the operations. Note that it's not perfect, because
     it counts operations that have been queued by the backend but not sent to the OS yet
-    as having been sent to the OS. */
+    as having been sent to the OS.
+
+    Exactly one of the backends is initialized, depending on the `io_backend_t` we
+    were constructed with. */
 
     stats_diskmgr_t stack_stats;
     conflict_resolving_diskmgr_t conflict_resolver;
     accounting_diskmgr_t accounter;
     stats_diskmgr_2_t backend_stats;
-    pool_diskmgr_t backend;
+    scoped_ptr_t<pool_diskmgr_t> pool_backend;
+#if USE_NATIVE_AIO
+    scoped_ptr_t<aio_diskmgr_t> aio_backend;
+#endif
 
 
     int outstanding_txn;
@@ -184,11 +209,13 @@ private:
 };
 
 io_backender_t::io_backender_t(file_direct_io_mode_t _direct_io_mode,
-                               int max_concurrent_io_requests)
+                               int max_concurrent_io_requests,
+                               io_backend_t io_backend)
     : direct_io_mode(_direct_io_mode),
       diskmgr(new linux_disk_manager_t(&linux_thread_pool_t::thread->queue,
                                        DEFAULT_IO_BATCH_FACTOR,
                                        max_concurrent_io_requests,
+                                       io_backend,
                                        &stats)) { }
 
 io_backender_t::~io_backender_t() { }
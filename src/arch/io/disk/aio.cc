@@ -0,0 +1,309 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "arch/io/disk/aio.hpp"
+
+#if USE_NATIVE_AIO
+
+#include <limits.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "arch/io/disk.hpp"
+#include "config/args.hpp"
+#include "containers/scoped.hpp"
+
+/* glibc doesn't provide wrappers for the kernel AIO system calls, and we don't
+want to depend on libaio just for these. */
+
+static int sys_io_setup(unsigned int nr_events, aio_context_t *ctx) {
+    return syscall(SYS_io_setup, nr_events, ctx);
+}
+
+static int sys_io_destroy(aio_context_t ctx) {
+    return syscall(SYS_io_destroy, ctx);
+}
+
+static int sys_io_submit(aio_context_t ctx, int64_t nr, iocb **iocbs) {
+    return syscall(SYS_io_submit, ctx, nr, iocbs);
+}
+
+static int sys_io_getevents(aio_context_t ctx, int64_t min_nr, int64_t nr,
+                            io_event *events, timespec *timeout) {
+    return syscall(SYS_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+// The number of completion events we pull from the kernel with one io_getevents()
+// call.
+const int64_t AIO_GETEVENTS_BATCH = 64;
+
+// Actions wrapped in datasyncs only come from metablock and static header writes,
+// which are serialized anyway, so one blocker thread is plenty.
+const int AIO_DATASYNC_POOL_THREADS = 1;
+
+// How long we wait before retrying an `io_submit()` that the kernel refused for
+// lack of resources when we have no requests in flight.
+const int64_t AIO_EAGAIN_RETRY_MS = 5;
+
+/* One `aio_diskmgr_request_t` is allocated for each action that goes through the
+kernel. Writes with more than `IOV_MAX` buffers are split into several iocbs; the
+action completes once all of them have come back. */
+struct aio_diskmgr_request_t {
+    aio_diskmgr_request_t(aio_diskmgr_t::action_t *_action, size_t n_iocbs)
+        : action(_action), iocbs(n_iocbs), n_outstanding(n_iocbs), io_result(0) {
+        memset(iocbs.data(), 0, sizeof(iocb) * iocbs.size());
+    }
+
+    void complete_iocb(int64_t res) {
+        rassert(n_outstanding > 0);
+        --n_outstanding;
+        if (res < 0) {
+            io_result = res;
+        } else if (io_result >= 0) {
+            io_result += res;
+        }
+    }
+
+    aio_diskmgr_t::action_t *action;
+    scoped_array_t<iocb> iocbs;
+    size_t n_outstanding;
+    int64_t io_result;
+
+private:
+    DISABLE_COPYING(aio_diskmgr_request_t);
+};
+
+class aio_diskmgr_t::datasync_job_t : public blocker_pool_t::job_t {
+public:
+    datasync_job_t(aio_diskmgr_t *_parent, action_t *_action)
+        : parent(_parent), action(_action) { }
+
+    void run() {
+        action->run();
+    }
+
+    void done() {
+        aio_diskmgr_t *p = parent;
+        action_t *a = action;
+        delete this;
+        --p->n_datasyncs_in_flight;
+        p->pump();
+        p->finish_action(a, a->io_result);
+    }
+
+private:
+    aio_diskmgr_t *parent;
+    action_t *action;
+};
+
+bool aio_diskmgr_t::is_available() {
+    aio_context_t ctx = 0;
+    int res = sys_io_setup(1, &ctx);
+    if (res != 0) {
+        return false;
+    }
+    res = sys_io_destroy(ctx);
+    guarantee_err(res == 0, "Could not destroy AIO context");
+    return true;
+}
+
+aio_diskmgr_t::aio_diskmgr_t(linux_event_queue_t *_queue,
+                             passive_producer_t<action_t *> *_source,
+                             int max_concurrent_io_requests)
+    : queue_depth(max_concurrent_io_requests),
+      queue(_queue),
+      source(_source),
+      aio_context(0),
+      datasync_pool(AIO_DATASYNC_POOL_THREADS, _queue),
+      n_iocbs_in_flight(0),
+      n_datasyncs_in_flight(0),
+      retry_timer(NULL),
+      n_actions_pending(0) {
+    guarantee(max_concurrent_io_requests > 0);
+    guarantee(max_concurrent_io_requests < MAXIMUM_MAX_CONCURRENT_IO_REQUESTS);
+
+    int res = sys_io_setup(queue_depth, &aio_context);
+    guarantee_err(res == 0, "Could not set up AIO context");
+
+    queue->watch_resource(completion_event.get_notify_fd(), poll_event_in, this);
+
+    if (source->available->get()) { pump(); }
+    source->available->set_callback(this);
+}
+
+aio_diskmgr_t::~aio_diskmgr_t() {
+    assert_thread();
+    rassert(n_actions_pending == 0);
+    if (retry_timer != NULL) {
+        cancel_timer(retry_timer);
+    }
+    source->available->unset_callback();
+    queue->forget_resource(completion_event.get_notify_fd(), this);
+    int res = sys_io_destroy(aio_context);
+    guarantee_err(res == 0, "Could not destroy AIO context");
+}
+
+void aio_diskmgr_t::on_source_availability_changed() {
+    assert_thread();
+    if (source->available->get()) pump();
+}
+
+void aio_diskmgr_t::pump() {
+    assert_thread();
+    // Actions wrapped in datasyncs take up a slot of the queue depth too, even
+    // though they don't go through the kernel's queue.
+    while (source->available->get()
+           && n_iocbs_in_flight + static_cast<int>(pending_iocbs.size())
+              + n_datasyncs_in_flight < queue_depth) {
+        action_t *a = source->pop();
+        ++n_actions_pending;
+
+        if (a->wrap_in_datasyncs) {
+            ++n_datasyncs_in_flight;
+            datasync_pool.do_job(new datasync_job_t(this, a));
+            continue;
+        }
+
+        iovec *vecs;
+        size_t vecs_len;
+        a->get_bufs(&vecs, &vecs_len);
+
+        const size_t n_iocbs = std::max<size_t>(1, ceil_divide(vecs_len, IOV_MAX));
+        aio_diskmgr_request_t *request = new aio_diskmgr_request_t(a, n_iocbs);
+
+        int64_t partial_offset = a->offset;
+        for (size_t i = 0; i < n_iocbs; ++i) {
+            iocb *cb = &request->iocbs[i];
+            cb->aio_data = reinterpret_cast<uint64_t>(request);
+            cb->aio_fildes = a->fd;
+            cb->aio_offset = partial_offset;
+            cb->aio_flags = IOCB_FLAG_RESFD;
+            cb->aio_resfd = completion_event.get_notify_fd();
+
+            if (vecs == &a->buf_and_count) {
+                rassert(n_iocbs == 1);
+                cb->aio_lio_opcode = a->is_read ? IOCB_CMD_PREAD : IOCB_CMD_PWRITE;
+                cb->aio_buf = reinterpret_cast<uint64_t>(vecs[0].iov_base);
+                cb->aio_nbytes = vecs[0].iov_len;
+            } else {
+                const size_t begin = i * IOV_MAX;
+                const size_t len = std::min<size_t>(IOV_MAX, vecs_len - begin);
+                cb->aio_lio_opcode = a->is_read ? IOCB_CMD_PREADV : IOCB_CMD_PWRITEV;
+                cb->aio_buf = reinterpret_cast<uint64_t>(vecs + begin);
+                cb->aio_nbytes = len;
+                for (size_t j = begin; j < begin + len; ++j) {
+                    partial_offset += vecs[j].iov_len;
+                }
+            }
+            pending_iocbs.push_back(cb);
+        }
+    }
+
+    submit_pending_iocbs();
+}
+
+void aio_diskmgr_t::submit_pending_iocbs() {
+    assert_thread();
+    // Requests the kernel refused outright.  We fail them only once we're done
+    // touching `pending_iocbs`, because `done_fun` may call back into `pump()`.
+    std::vector<aio_diskmgr_request_t *> failed;
+
+    while (!pending_iocbs.empty()) {
+        std::vector<iocb *> batch(pending_iocbs.begin(), pending_iocbs.end());
+        int res;
+        do {
+            res = sys_io_submit(aio_context, batch.size(), batch.data());
+        } while (res == -1 && errno == EINTR);
+
+        if (res == -1) {
+            if (errno == EAGAIN) {
+                // The kernel is short on resources. We'll try again when some of
+                // the requests in flight complete, or after a short delay if
+                // there aren't any.
+                if (n_iocbs_in_flight == 0 && retry_timer == NULL) {
+                    retry_timer = fire_timer_once(AIO_EAGAIN_RETRY_MS, this);
+                }
+                break;
+            }
+            // The first iocb was rejected (e.g. bad file descriptor or bad
+            // alignment). Fail it and move on to the rest of the batch.
+            const int errsv = errno;
+            aio_diskmgr_request_t *request =
+                reinterpret_cast<aio_diskmgr_request_t *>(pending_iocbs.front()->aio_data);
+            pending_iocbs.pop_front();
+            request->complete_iocb(-errsv);
+            if (request->n_outstanding == 0) {
+                failed.push_back(request);
+            }
+        } else {
+            guarantee(res > 0);
+            n_iocbs_in_flight += res;
+            pending_iocbs.erase(pending_iocbs.begin(), pending_iocbs.begin() + res);
+        }
+    }
+
+    for (size_t i = 0; i < failed.size(); ++i) {
+        action_t *a = failed[i]->action;
+        int64_t io_result = failed[i]->io_result;
+        delete failed[i];
+        finish_action(a, io_result);
+    }
+}
+
+void aio_diskmgr_t::on_event(DEBUG_VAR int event) {
+    assert_thread();
+    rassert(event == poll_event_in);
+    completion_event.consume_wakey_wakeys();
+
+    std::vector<aio_diskmgr_request_t *> completed;
+
+    io_event events[AIO_GETEVENTS_BATCH];
+    int res;
+    do {
+        timespec no_wait = { 0, 0 };
+        do {
+            res = sys_io_getevents(aio_context, 0, AIO_GETEVENTS_BATCH, events, &no_wait);
+        } while (res == -1 && errno == EINTR);
+        guarantee_err(res >= 0, "io_getevents() failed");
+
+        for (int i = 0; i < res; ++i) {
+            aio_diskmgr_request_t *request =
+                reinterpret_cast<aio_diskmgr_request_t *>(events[i].data);
+            --n_iocbs_in_flight;
+            request->complete_iocb(events[i].res);
+            if (request->n_outstanding == 0) {
+                completed.push_back(request);
+            }
+        }
+    } while (res == AIO_GETEVENTS_BATCH);
+
+    // Refill the kernel's queue before running the callbacks, like
+    // `pool_diskmgr_t` does.
+    pump();
+
+    for (size_t i = 0; i < completed.size(); ++i) {
+        action_t *a = completed[i]->action;
+        int64_t io_result = completed[i]->io_result;
+        delete completed[i];
+        finish_action(a, io_result);
+    }
+}
+
+void aio_diskmgr_t::on_timer() {
+    assert_thread();
+    retry_timer = NULL;
+    pump();
+}
+
+void aio_diskmgr_t::finish_action(action_t *action, int64_t io_result) {
+    assert_thread();
+    action->io_result = io_result;
+    --n_actions_pending;
+    done_fun(action);
+}
+
+#endif  // USE_NATIVE_AIO
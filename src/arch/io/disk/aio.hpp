@@ -0,0 +1,107 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef ARCH_IO_DISK_AIO_HPP_
+#define ARCH_IO_DISK_AIO_HPP_
+
+#include <deque>
+
+#include "errors.hpp"
+#include <boost/function.hpp>
+
+#include "arch/io/blocker_pool.hpp"
+#include "arch/io/disk/pool.hpp"
+#include "arch/timer.hpp"
+#include "arch/runtime/event_queue.hpp"
+#include "arch/runtime/system_event.hpp"
+#include "concurrency/queue/passive_producer.hpp"
+
+#if defined(__linux) && !defined(NO_EVENTFD)
+#define USE_NATIVE_AIO 1
+#else
+#define USE_NATIVE_AIO 0
+#endif
+
+#if USE_NATIVE_AIO
+
+#include <linux/aio_abi.h>
+
+struct aio_diskmgr_request_t;
+
+/* The native AIO disk manager hands IO requests directly to the kernel with
+`io_submit()`, batching everything that is available on `source` into a single
+system call. The kernel reports completions on an eventfd that is watched by the
+thread's `linux_event_queue_t`, so unlike `pool_diskmgr_t` a request doesn't cost
+any context switches, and the number of requests in flight isn't bounded by the
+number of blocker threads.
+
+It takes the same actions as `pool_diskmgr_t`, so it can be swapped in below
+`stats_diskmgr_2_t` without touching the rest of the IO stack. Writes that must be
+wrapped in datasyncs are rare (metablock and static header writes) and are run on
+a small blocker pool instead, because not all filesystems support `IOCB_CMD_FDSYNC`.
+
+Note that the kernel only performs the IO asynchronously for files opened with
+`O_DIRECT`; for buffered files `io_submit()` may block the calling thread. */
+
+class aio_diskmgr_t :
+    private availability_callback_t,
+    private linux_event_callback_t,
+    private timer_callback_t,
+    public home_thread_mixin_debug_only_t {
+public:
+    typedef pool_diskmgr_action_t action_t;
+
+    /* Returns true if the running kernel lets us set up an AIO context. */
+    static bool is_available();
+
+    /* The `aio_diskmgr_t` will draw actions to run from `source`. It will call
+    `done_fun` on each one when it's done. */
+    aio_diskmgr_t(linux_event_queue_t *queue, passive_producer_t<action_t *> *source,
+                  int max_concurrent_io_requests);
+    boost::function<void(action_t *)> done_fun;
+    ~aio_diskmgr_t();
+
+private:
+    friend struct aio_diskmgr_request_t;
+    class datasync_job_t;
+
+    void on_source_availability_changed();
+    void on_event(int event);
+    void on_timer();
+    void pump();
+    void submit_pending_iocbs();
+    void finish_action(action_t *action, int64_t io_result);
+
+    const int queue_depth;
+    linux_event_queue_t *const queue;
+    passive_producer_t<action_t *> *const source;
+
+    aio_context_t aio_context;
+    system_event_t completion_event;
+
+    // Used for actions that are wrapped in datasyncs.
+    blocker_pool_t datasync_pool;
+
+    // iocbs that have been prepared but that the kernel didn't accept yet.
+    std::deque<iocb *> pending_iocbs;
+
+    // The number of iocbs that have been handed to the kernel but haven't
+    // completed yet.
+    int n_iocbs_in_flight;
+
+    // The number of actions wrapped in datasyncs that are running on
+    // `datasync_pool`.
+    int n_datasyncs_in_flight;
+
+    // Set while we're waiting to retry an `io_submit()` that failed with EAGAIN
+    // while nothing was in flight, so no completion would have woken us up.
+    timer_token_t *retry_timer;
+
+    // The number of actions that we've popped from `source` but haven't yet
+    // passed to `done_fun`.
+    int n_actions_pending;
+
+    DISABLE_COPYING(aio_diskmgr_t);
+};
+
+#endif  // USE_NATIVE_AIO
+
+#endif  // ARCH_IO_DISK_AIO_HPP_
@@ -4,6 +4,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
@@ -11,6 +12,10 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <vector>
 
 #include "utils.hpp"
 #include <boost/bind.hpp>
@@ -24,6 +29,136 @@
 #include "containers/printf_buffer.hpp"
 #include "logger.hpp"
 #include "perfmon/perfmon.hpp"
+#include "thread_local.hpp"
+
+/* `tcp_write_ops` counts the writes, flushes and responses that go through
+`linux_tcp_conn_t`'s write queue; `tcp_write_syscalls` counts the `writev()`s it
+takes to send them. */
+static perfmon_counter_t pm_tcp_write_ops, pm_tcp_write_syscalls;
+static perfmon_sampler_t pm_tcp_bytes_per_write_syscall(secs_to_ticks(1), false);
+static perfmon_multi_membership_t pm_tcp_membership(&get_global_perfmon_collection(),
+    &pm_tcp_write_ops, "tcp_write_ops",
+    &pm_tcp_write_syscalls, "tcp_write_syscalls",
+    &pm_tcp_bytes_per_write_syscall, "tcp_bytes_per_write_syscall",
+    NULLPTR);
+
+/* How much buffer memory the open connections hold, and how much more sits in
+the per-thread buffer pools below. Divide by `tcp_connections` to get the
+memory per connection. */
+static perfmon_counter_t pm_tcp_connections, pm_tcp_read_buffer_bytes,
+    pm_tcp_write_buffer_bytes, pm_tcp_pooled_buffer_bytes;
+static perfmon_multi_membership_t pm_tcp_memory_membership(&get_global_perfmon_collection(),
+    &pm_tcp_connections, "tcp_connections",
+    &pm_tcp_read_buffer_bytes, "tcp_read_buffer_bytes",
+    &pm_tcp_write_buffer_bytes, "tcp_write_buffer_bytes",
+    &pm_tcp_pooled_buffer_bytes, "tcp_pooled_buffer_bytes",
+    NULLPTR);
+
+/* A free list of connection buffers of one size, chained through the start of
+the buffers themselves. It holds at most TCP_BUFFER_POOL_MAX_BYTES_PER_SIZE
+bytes' worth of them (but always at least one). */
+class tcp_buffer_free_list_t {
+public:
+    tcp_buffer_free_list_t() : head(NULL), count(0) { }
+
+    void *pop(size_t buffer_size) {
+        if (head == NULL) {
+            return NULL;
+        }
+        void *buffer = head;
+        memcpy(&head, buffer, sizeof(head));
+        --count;
+        pm_tcp_pooled_buffer_bytes -= buffer_size;
+        return buffer;
+    }
+
+    // Returns false if the list is full, in which case the caller frees `buffer`.
+    bool push(void *buffer, size_t buffer_size) {
+        if (count > 0 && (count + 1) * buffer_size > TCP_BUFFER_POOL_MAX_BYTES_PER_SIZE) {
+            return false;
+        }
+        memcpy(buffer, &head, sizeof(head));
+        head = buffer;
+        ++count;
+        pm_tcp_pooled_buffer_bytes += buffer_size;
+        return true;
+    }
+
+private:
+    void *head;
+    size_t count;
+};
+
+/* Read buffers come in sizes of IO_BUFFER_SIZE << i for i < TCP_READ_BUFFER_SIZES.
+Bigger ones aren't pooled. */
+struct tcp_buffer_pool_t {
+    ~tcp_buffer_pool_t() {
+        size_t size = IO_BUFFER_SIZE;
+        for (int size_index = 0; size_index < TCP_READ_BUFFER_SIZES; ++size_index) {
+            while (void *buffer = read_buffers[size_index].pop(size)) {
+                delete[] static_cast<char *>(buffer);
+            }
+            size <<= 1;
+        }
+        typedef linux_tcp_conn_t::write_buffer_t write_buffer_t;
+        while (void *buffer = write_buffers.pop(sizeof(write_buffer_t))) {
+            delete static_cast<write_buffer_t *>(buffer);
+        }
+    }
+
+    tcp_buffer_free_list_t read_buffers[TCP_READ_BUFFER_SIZES];
+    tcp_buffer_free_list_t write_buffers;
+};
+
+TLS_with_init(tcp_buffer_pool_t *, tcp_buffer_pool, NULL)
+
+static tcp_buffer_pool_t *get_tcp_buffer_pool() {
+    tcp_buffer_pool_t *pool = TLS_get_tcp_buffer_pool();
+    if (pool == NULL) {
+        pool = new tcp_buffer_pool_t;
+        TLS_set_tcp_buffer_pool(pool);
+    }
+    return pool;
+}
+
+void free_tcp_buffer_pool() {
+    delete TLS_get_tcp_buffer_pool();
+    TLS_set_tcp_buffer_pool(NULL);
+}
+
+/* Returns a read buffer of at least `min_size` bytes, and its actual size in
+`*size_out`. */
+static char *allocate_read_buffer(size_t min_size, size_t *size_out) {
+    size_t size = IO_BUFFER_SIZE;
+    int size_index = 0;
+    while (size < min_size && size_index < TCP_READ_BUFFER_SIZES - 1) {
+        size <<= 1;
+        ++size_index;
+    }
+    pm_tcp_read_buffer_bytes += std::max(size, min_size);
+    if (size < min_size) {
+        *size_out = min_size;
+        return new char[min_size];
+    }
+    *size_out = size;
+    void *buffer = get_tcp_buffer_pool()->read_buffers[size_index].pop(size);
+    return buffer != NULL ? static_cast<char *>(buffer) : new char[size];
+}
+
+static void release_read_buffer(char *buffer, size_t size) {
+    pm_tcp_read_buffer_bytes -= size;
+    size_t pooled_size = IO_BUFFER_SIZE;
+    for (int size_index = 0; size_index < TCP_READ_BUFFER_SIZES; ++size_index) {
+        if (pooled_size == size) {
+            if (get_tcp_buffer_pool()->read_buffers[size_index].push(buffer, size)) {
+                return;
+            }
+            break;
+        }
+        pooled_size <<= 1;
+    }
+    delete[] buffer;
+}
 
 int connect_ipv4_internal(fd_t socket, int local_port, const in_addr &addr, int port) {
     struct sockaddr_in sa;
@@ -82,10 +217,11 @@ linux_tcp_conn_t::linux_tcp_conn_t(const ip_address_t &peer,
         sock(socket(peer.get_address_family(), SOCK_STREAM, 0)),
         event_watcher(new linux_event_watcher_t(sock.get(), this)),
         read_in_progress(false), write_in_progress(false),
+        read_buffer(NULL), read_buffer_capacity(0), read_buffer_start(0), read_buffer_end(0),
         write_handler(this),
         write_queue_limiter(WRITE_QUEUE_MAX_SIZE),
         write_coro_pool(1, &write_queue, &write_handler),
-        current_write_buffer(get_write_buffer()),
+        is_corked(false),
         drainer(new auto_drainer_t) {
     guarantee_err(fcntl(sock.get(), F_SETFL, O_NONBLOCK) == 0, "Could not make socket non-blocking");
 
@@ -120,6 +256,8 @@ linux_tcp_conn_t::linux_tcp_conn_t(const ip_address_t &peer,
             throw linux_tcp_conn_t::connect_failed_exc_t(errno);
         }
     }
+
+    ++pm_tcp_connections;
 }
 
 linux_tcp_conn_t::linux_tcp_conn_t(fd_t s) :
@@ -127,27 +265,25 @@ linux_tcp_conn_t::linux_tcp_conn_t(fd_t s) :
     sock(s),
     event_watcher(new linux_event_watcher_t(sock.get(), this)),
     read_in_progress(false), write_in_progress(false),
+    read_buffer(NULL), read_buffer_capacity(0), read_buffer_start(0), read_buffer_end(0),
     write_handler(this),
     write_queue_limiter(WRITE_QUEUE_MAX_SIZE),
     write_coro_pool(1, &write_queue, &write_handler),
-    current_write_buffer(get_write_buffer()),
+    is_corked(false),
     drainer(new auto_drainer_t)
 {
     rassert(sock.get() != INVALID_FD);
 
     int res = fcntl(sock.get(), F_SETFL, O_NONBLOCK);
     guarantee_err(res == 0, "Could not make socket non-blocking");
+
+    ++pm_tcp_connections;
 }
 
 linux_tcp_conn_t::write_buffer_t * linux_tcp_conn_t::get_write_buffer() {
-    write_buffer_t *buffer;
-
-    if (unused_write_buffers.empty()) {
-        buffer = new write_buffer_t;
-    } else {
-        buffer = unused_write_buffers.head();
-        unused_write_buffers.pop_front();
-    }
+    void *pooled = get_tcp_buffer_pool()->write_buffers.pop(sizeof(write_buffer_t));
+    write_buffer_t *buffer = pooled != NULL ? static_cast<write_buffer_t *>(pooled) : new write_buffer_t;
+    pm_tcp_write_buffer_bytes += sizeof(write_buffer_t);
     buffer->size = 0;
     return buffer;
 }
@@ -160,12 +296,71 @@ linux_tcp_conn_t::write_queue_op_t * linux_tcp_conn_t::get_write_queue_op() {
     } else {
         op = unused_write_queue_ops.head();
         unused_write_queue_ops.pop_front();
+        op->clear();
     }
+    op->pooled = true;
     return op;
 }
 
 void linux_tcp_conn_t::release_write_buffer(write_buffer_t *buffer) {
-    unused_write_buffers.push_front(buffer);
+    pm_tcp_write_buffer_bytes -= sizeof(write_buffer_t);
+    if (!get_tcp_buffer_pool()->write_buffers.push(buffer, sizeof(write_buffer_t))) {
+        delete buffer;
+    }
+}
+
+void linux_tcp_conn_t::reserve_read_buffer(size_t size) {
+    if (read_buffer_capacity - read_buffer_end >= size) {
+        return;
+    }
+    const size_t unconsumed = read_buffer_size();
+    if (unconsumed + size <= read_buffer_capacity) {
+        memmove(read_buffer, read_buffer + read_buffer_start, unconsumed);
+    } else {
+        size_t new_capacity;
+        char *new_buffer = allocate_read_buffer(unconsumed + size, &new_capacity);
+        if (read_buffer != NULL) {
+            memcpy(new_buffer, read_buffer + read_buffer_start, unconsumed);
+            release_read_buffer(read_buffer, read_buffer_capacity);
+        }
+        read_buffer = new_buffer;
+        read_buffer_capacity = new_capacity;
+    }
+    read_buffer_start = 0;
+    read_buffer_end = unconsumed;
+}
+
+void linux_tcp_conn_t::consume_read_buffer(size_t size) {
+    rassert(size <= read_buffer_size());
+    read_buffer_start += size;
+    if (read_buffer_start == read_buffer_end && read_buffer != NULL) {
+        release_read_buffer(read_buffer, read_buffer_capacity);
+        read_buffer = NULL;
+        read_buffer_capacity = read_buffer_start = read_buffer_end = 0;
+    }
+}
+
+void linux_tcp_conn_t::fill_read_buffer() THROWS_ONLY(tcp_conn_read_closed_exc_t) {
+    reserve_read_buffer(IO_BUFFER_SIZE);
+    size_t delta;
+    try {
+        delta = read_internal(read_buffer + read_buffer_end,
+                              read_buffer_capacity - read_buffer_end);
+    } catch (const tcp_conn_read_closed_exc_t &) {
+        // Don't keep an empty buffer around on a closed connection.
+        consume_read_buffer(0);
+        throw;
+    }
+    read_buffer_end += delta;
+}
+
+size_t linux_tcp_conn_t::take_from_read_buffer(void *buf, size_t size) {
+    const size_t bytes = std::min(read_buffer_size(), size);
+    if (bytes > 0) {
+        memcpy(buf, read_buffer_data(), bytes);
+        consume_read_buffer(bytes);
+    }
+    return bytes;
 }
 
 void linux_tcp_conn_t::release_write_queue_op(write_queue_op_t *op) {
@@ -220,12 +415,15 @@ size_t linux_tcp_conn_t::read_some(void *buf, size_t size, signal_t *closer) THR
     rassert(size > 0);
     read_op_wrapper_t sentry(this, closer);
 
-    if (read_buffer.size()) {
+    if (read_buffer_size() == 0 && size < IO_BUFFER_SIZE) {
+        /* Go to the kernel _once_, but for as much as it has; whatever doesn't
+        fit in `buf` will be there for the next read. */
+        fill_read_buffer();
+    }
+
+    if (read_buffer_size() > 0) {
         /* Return the data from the peek buffer */
-        size_t read_buffer_bytes = std::min(read_buffer.size(), size);
-        memcpy(buf, read_buffer.data(), read_buffer_bytes);
-        read_buffer.erase(read_buffer.begin(), read_buffer.begin() + read_buffer_bytes);
-        return read_buffer_bytes;
+        return take_from_read_buffer(buf, size);
     } else {
         /* Go to the kernel _once_. */
         return read_internal(buf, size);
@@ -236,15 +434,21 @@ void linux_tcp_conn_t::read(void *buf, size_t size, signal_t *closer) THROWS_ONL
     read_op_wrapper_t sentry(this, closer);
 
     /* First, consume any data in the peek buffer */
-    int read_buffer_bytes = std::min(read_buffer.size(), size);
-    memcpy(buf, read_buffer.data(), read_buffer_bytes);
-    read_buffer.erase(read_buffer.begin(), read_buffer.begin() + read_buffer_bytes);
+    size_t read_buffer_bytes = take_from_read_buffer(buf, size);
     buf = reinterpret_cast<void *>(reinterpret_cast<char *>(buf) + read_buffer_bytes);
     size -= read_buffer_bytes;
 
-    /* Now go to the kernel for any more data that we need */
+    /* Now go to the kernel for any more data that we need. Small reads go
+    through the read buffer, so that the syscall that gets a request's header
+    usually gets its body (and maybe the next request) too. */
     while (size > 0) {
-        size_t delta = read_internal(buf, size);
+        size_t delta;
+        if (size < IO_BUFFER_SIZE) {
+            fill_read_buffer();
+            delta = take_from_read_buffer(buf, size);
+        } else {
+            delta = read_internal(buf, size);
+        }
         rassert(delta <= size);
         buf = reinterpret_cast<void *>(reinterpret_cast<char *>(buf) + delta);
         size -= delta;
@@ -254,11 +458,7 @@ void linux_tcp_conn_t::read(void *buf, size_t size, signal_t *closer) THROWS_ONL
 void linux_tcp_conn_t::read_more_buffered(signal_t *closer) THROWS_ONLY(tcp_conn_read_closed_exc_t) {
     read_op_wrapper_t sentry(this, closer);
 
-    size_t old_size = read_buffer.size();
-    read_buffer.resize(old_size + IO_BUFFER_SIZE);
-    size_t delta = read_internal(read_buffer.data() + old_size, IO_BUFFER_SIZE);
-
-    read_buffer.resize(old_size + delta);
+    fill_read_buffer();
 }
 
 const_charslice linux_tcp_conn_t::peek() const THROWS_ONLY(tcp_conn_read_closed_exc_t) {
@@ -266,14 +466,19 @@ const_charslice linux_tcp_conn_t::peek() const THROWS_ONLY(tcp_conn_read_closed_
     rassert(!read_in_progress);   // Is there a read already in progress?
     if (read_closed.is_pulsed()) throw tcp_conn_read_closed_exc_t();
 
-    return const_charslice(read_buffer.data(), read_buffer.data() + read_buffer.size());
+    return const_charslice(read_buffer_data(), read_buffer_data() + read_buffer_size());
 }
 
 const_charslice linux_tcp_conn_t::peek(size_t size, signal_t *closer) THROWS_ONLY(tcp_conn_read_closed_exc_t) {
-    while (read_buffer.size() < size) {
+    if (read_buffer_size() < size) {
+        /* Make room for all of it up front, rather than growing the buffer a bit
+        at a time. */
+        reserve_read_buffer(size - read_buffer_size());
+    }
+    while (read_buffer_size() < size) {
         read_more_buffered(closer);
     }
-    return const_charslice(read_buffer.data(), read_buffer.data() + size);
+    return const_charslice(read_buffer_data(), read_buffer_data() + size);
 }
 
 void linux_tcp_conn_t::pop(size_t len, signal_t *closer) THROWS_ONLY(tcp_conn_read_closed_exc_t) {
@@ -282,7 +487,7 @@ void linux_tcp_conn_t::pop(size_t len, signal_t *closer) THROWS_ONLY(tcp_conn_re
     if (read_closed.is_pulsed()) throw tcp_conn_read_closed_exc_t();
 
     peek(len, closer);
-    read_buffer.erase(read_buffer.begin(), read_buffer.begin() + len);  // INEFFICIENT
+    consume_read_buffer(len);
 }
 
 void linux_tcp_conn_t::shutdown_read() {
@@ -310,19 +515,61 @@ linux_tcp_conn_t::write_handler_t::write_handler_t(linux_tcp_conn_t *_parent) :
 { }
 
 void linux_tcp_conn_t::write_handler_t::coro_pool_callback(write_queue_op_t *operation, UNUSED signal_t *interruptor) {
-    if (operation->buffer != NULL) {
-        parent->perform_write(operation->buffer, operation->size);
-        if (operation->dealloc != NULL) {
-            parent->release_write_buffer(operation->dealloc);
-            parent->write_queue_limiter.unlock(operation->size);
+    /* Whatever got queued up while we were busy goes out together with
+    `operation`, so that many small writes cost one syscall. */
+    batch_ops.clear();
+    batch_iovecs.clear();
+    for (;;) {
+        batch_ops.push_back(operation);
+        if (operation->iov != NULL) {
+            batch_iovecs.insert(batch_iovecs.end(),
+                                operation->iov, operation->iov + operation->iovcnt);
+        } else if (operation->buffer != NULL && operation->size > 0) {
+            iovec iov;
+            iov.iov_base = const_cast<void *>(operation->buffer);
+            iov.iov_len = operation->size;
+            batch_iovecs.push_back(iov);
         }
+        if (batch_iovecs.size() >= IOV_MAX || !parent->write_queue.available->get()) {
+            break;
+        }
+        operation = parent->write_queue.pop();
+    }
+
+    if (!batch_iovecs.empty()) {
+        parent->perform_writev(batch_iovecs.data(), batch_iovecs.size());
     }
 
-    if (operation->cond != NULL) {
-        operation->cond->pulse();
+    /* If more data showed up while we were writing, we're streaming; cork the
+    socket until we catch up. */
+    if (!parent->write_closed.is_pulsed()) {
+        parent->set_corked(parent->write_queue.available->get());
     }
-    if (operation->dealloc != NULL) {
-        parent->release_write_queue_op(operation);
+
+    for (size_t i = 0; i < batch_ops.size(); ++i) {
+        write_queue_op_t *op = batch_ops[i];
+        if (op->iov != NULL || op->buffer != NULL) {
+            ++pm_tcp_write_ops;
+        }
+        if (op->dealloc != NULL) {
+            parent->release_write_buffer(op->dealloc);
+        }
+        if (op->queue_limiter_count > 0) {
+            parent->write_queue_limiter.unlock(op->queue_limiter_count);
+        }
+
+        /* Once the op's owner hears about it, the op may go away. */
+        cond_t *cond = op->cond;
+        write_callback_t *callback = op->callback;
+        if (op->pooled) {
+            parent->release_write_queue_op(op);
+        }
+        if (cond != NULL) {
+            cond->pulse();
+        }
+        if (callback != NULL) {
+            callback->on_write_done();
+        }
     }
 }
 
@@ -336,9 +583,8 @@ void linux_tcp_conn_t::internal_flush_write_buffer() {
     op->buffer = current_write_buffer->buffer;
     op->size = current_write_buffer->size;
     op->dealloc = current_write_buffer.release();
-    op->cond = NULL;
+    op->queue_limiter_count = op->size;
     op->keepalive = auto_drainer_t::lock_t(drainer.get());
-    current_write_buffer.init(get_write_buffer());
 
     /* Acquire the write semaphore so the write queue doesn't get too long
     to be released once the write is completed by the coroutine pool */
@@ -350,6 +596,13 @@ void linux_tcp_conn_t::internal_flush_write_buffer() {
 }
 
 void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
+    iovec iov;
+    iov.iov_base = const_cast<void *>(buf);
+    iov.iov_len = size;
+    perform_writev(&iov, 1);
+}
+
+void linux_tcp_conn_t::perform_writev(iovec *iov, size_t iovcnt) {
     assert_thread();
 
     if (write_closed.is_pulsed()) {
@@ -359,8 +612,18 @@ void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
         return;
     }
 
-    while (size > 0) {
-        ssize_t res = ::write(sock.get(), buf, size);
+    while (true) {
+        /* Skip over the buffers that have been written completely */
+        while (iovcnt > 0 && iov->iov_len == 0) {
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt == 0) {
+            break;
+        }
+
+        ssize_t res = ::writev(sock.get(), iov, std::min<size_t>(iovcnt, IOV_MAX));
+        ++pm_tcp_write_syscalls;
 
         if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
             /* Wait for a notification from the event queue, or for an order to
@@ -398,10 +661,20 @@ void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
             break;
 
         } else {
-            rassert(res <= static_cast<ssize_t>(size));
-            buf = reinterpret_cast<const void *>(reinterpret_cast<const char *>(buf) + res);
-            size -= res;
             if (write_perfmon) write_perfmon->record(res);
+            pm_tcp_bytes_per_write_syscall.record(res);
+            size_t written = res;
+            while (written > 0) {
+                rassert(iovcnt > 0);
+                const size_t chunk = std::min(written, iov->iov_len);
+                iov->iov_base = static_cast<char *>(iov->iov_base) + chunk;
+                iov->iov_len -= chunk;
+                written -= chunk;
+                if (iov->iov_len == 0) {
+                    ++iov;
+                    --iovcnt;
+                }
+            }
         }
     }
 }
@@ -413,7 +686,7 @@ void linux_tcp_conn_t::write(const void *buf, size_t size, signal_t *closer) THR
     cond_t to_signal_when_done;
 
     /* Flush out any data that's been buffered, so that things don't get out of order */
-    if (current_write_buffer->size > 0) internal_flush_write_buffer();
+    if (current_write_buffer.has()) internal_flush_write_buffer();
 
     /* Don't bother acquiring the write semaphore because we're going to block
     until the write is done anyway */
@@ -421,7 +694,6 @@ void linux_tcp_conn_t::write(const void *buf, size_t size, signal_t *closer) THR
     /* Enqueue the write so it will happen eventually */
     op.buffer = buf;
     op.size = size;
-    op.dealloc = NULL;
     op.cond = &to_signal_when_done;
     write_queue.push(&op);
 
@@ -433,6 +705,76 @@ void linux_tcp_conn_t::write(const void *buf, size_t size, signal_t *closer) THR
     if (write_closed.is_pulsed()) throw tcp_conn_write_closed_exc_t();
 }
 
+void linux_tcp_conn_t::writev(const iovec *iov, size_t iovcnt, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
+    write_op_wrapper_t sentry(this, closer);
+
+    /* `perform_writev()` consumes the iovecs as it goes, so it gets a copy. */
+    std::vector<iovec> iovecs(iov, iov + iovcnt);
+    size_t size = 0;
+    for (size_t i = 0; i < iovcnt; ++i) {
+        size += iov[i].iov_len;
+    }
+
+    write_queue_op_t op;
+    cond_t to_signal_when_done;
+
+    /* Flush out any data that's been buffered, so that things don't get out of order */
+    if (current_write_buffer.has()) internal_flush_write_buffer();
+
+    op.size = size;
+    op.iov = iovecs.data();
+    op.iovcnt = iovecs.size();
+    op.cond = &to_signal_when_done;
+    write_queue.push(&op);
+
+    /* As in `write()`, the cond gets pulsed even if the connection is closed. */
+    to_signal_when_done.wait();
+
+    if (write_closed.is_pulsed()) throw tcp_conn_write_closed_exc_t();
+}
+
+void linux_tcp_conn_t::write_nocopy(const void *buf, size_t size, write_callback_t *cb, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
+    scoped_ptr_t<write_op_wrapper_t> sentry;
+    try {
+        sentry.init(new write_op_wrapper_t(this, closer));
+    } catch (const tcp_conn_write_closed_exc_t &) {
+        /* The data will never be queued, so we're done with it already. */
+        cb->on_write_done();
+        throw;
+    }
+
+    /* Flush out any data that's been buffered, so that things don't get out of order */
+    if (current_write_buffer.has()) internal_flush_write_buffer();
+
+    write_queue_op_t *op = get_write_queue_op();
+    op->buffer = buf;
+    op->size = size;
+    op->callback = cb;
+    op->keepalive = auto_drainer_t::lock_t(drainer.get());
+
+    /* As in `internal_flush_write_buffer()`, hold the write semaphore so the
+    write queue doesn't get too long. A single write bigger than the whole queue
+    just takes up all of it. */
+    op->queue_limiter_count = size < WRITE_QUEUE_MAX_SIZE ? size : WRITE_QUEUE_MAX_SIZE;
+    write_queue_limiter.co_lock(op->queue_limiter_count);
+
+    write_queue.push(op);
+
+    if (write_closed.is_pulsed()) throw tcp_conn_write_closed_exc_t();
+}
+
+void linux_tcp_conn_t::set_corked(bool corked) {
+    if (corked == is_corked) {
+        return;
+    }
+    int sockoptval = corked ? 1 : 0;
+    int res = setsockopt(sock.get(), IPPROTO_TCP, TCP_CORK, &sockoptval, sizeof(sockoptval));
+    if (res != 0) {
+        logWRN("Could not %s socket: %s", corked ? "cork" : "uncork", errno_string(errno).c_str());
+    }
+    is_corked = corked;
+}
+
 void linux_tcp_conn_t::write_buffered(const void *vbuf, size_t size, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
     write_op_wrapper_t sentry(this, closer);
 
@@ -440,6 +782,10 @@ void linux_tcp_conn_t::write_buffered(const void *vbuf, size_t size, signal_t *c
     const char *buf = reinterpret_cast<const char *>(vbuf);
 
     while (size > 0) {
+        if (!current_write_buffer.has()) {
+            current_write_buffer.init(get_write_buffer());
+        }
+
         /* Insert the largest chunk that fits in this block */
         size_t chunk = std::min(size, WRITE_CHUNK_SIZE - current_write_buffer->size);
 
@@ -470,7 +816,7 @@ void linux_tcp_conn_t::flush_buffer(signal_t *closer) THROWS_ONLY(tcp_conn_write
     write_op_wrapper_t sentry(this, closer);
 
     /* Flush the write buffer; it might be half-full. */
-    if (current_write_buffer->size > 0) internal_flush_write_buffer();
+    if (current_write_buffer.has()) internal_flush_write_buffer();
 
     /* Wait until we know that the write buffer has gone out over the network.
     If the write half of the connection is closed, then the call to
@@ -479,8 +825,6 @@ void linux_tcp_conn_t::flush_buffer(signal_t *closer) THROWS_ONLY(tcp_conn_write
     pulsed. */
     write_queue_op_t op;
     cond_t to_signal_when_done;
-    op.buffer = NULL;
-    op.dealloc = NULL;
     op.cond = &to_signal_when_done;
     write_queue.push(&op);
     to_signal_when_done.wait();
@@ -492,7 +836,7 @@ void linux_tcp_conn_t::flush_buffer_eventually(signal_t *closer) THROWS_ONLY(tcp
     write_op_wrapper_t sentry(this, closer);
 
     /* Flush the write buffer; it might be half-full. */
-    if (current_write_buffer->size > 0) internal_flush_write_buffer();
+    if (current_write_buffer.has()) internal_flush_write_buffer();
 
     if (write_closed.is_pulsed()) throw tcp_conn_write_closed_exc_t();
 }
@@ -530,6 +874,14 @@ linux_tcp_conn_t::~linux_tcp_conn_t() THROWS_NOTHING {
     // wait for them to stop.
     if (is_read_open()) shutdown_read();
     if (is_write_open()) shutdown_write();
+
+    if (read_buffer != NULL) {
+        release_read_buffer(read_buffer, read_buffer_capacity);
+    }
+    if (current_write_buffer.has()) {
+        release_write_buffer(current_write_buffer.release());
+    }
+    --pm_tcp_connections;
 }
 
 void linux_tcp_conn_t::rethread(threadnum_t new_thread) {
@@ -580,6 +932,10 @@ int linux_tcp_conn_t::getpeername(ip_address_t *ip) {
     return res;
 }
 
+int linux_tcp_conn_t::set_priority(int priority) {
+    return setsockopt(sock.get(), SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority));
+}
+
 void linux_tcp_conn_t::on_event(int /* events */) {
     assert_thread();
 
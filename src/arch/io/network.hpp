@@ -5,6 +5,7 @@
 #include <stdarg.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <ifaddrs.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -38,6 +39,7 @@ class linux_tcp_conn_t :
     private linux_event_callback_t {
 public:
     friend class linux_tcp_conn_descriptor_t;
+    friend struct tcp_buffer_pool_t;
 
     class connect_failed_exc_t : public std::exception {
     public:
@@ -104,6 +106,27 @@ public:
     pipe and throws `tcp_conn_write_closed_exc_t`. */
     void write(const void *buf, size_t size, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
 
+    /* writev() is like write(), but sends the `iovcnt` buffers in `iov` one after
+    the other without copying them anywhere first. */
+    void writev(const iovec *iov, size_t iovcnt, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
+
+    /* A `write_callback_t` hears when the connection is done with the data that
+    was passed to `write_nocopy()`. */
+    class write_callback_t {
+    public:
+        virtual void on_write_done() = 0;
+    protected:
+        virtual ~write_callback_t() { }
+    };
+
+    /* write_nocopy() queues up `size` bytes from `buf` to be sent after whatever
+    was written before, without copying them and without waiting for them to be
+    sent; it only blocks if the write queue is backed up. `buf` must stay valid
+    until `cb->on_write_done()` is called on the connection's thread, which
+    happens even if the write half of the connection gets closed in between, or
+    is already closed and write_nocopy() throws. */
+    void write_nocopy(const void *buf, size_t size, write_callback_t *cb, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
+
     /* write_buffered() is like write(), but it might not send the data until
     flush_buffer*() or write() is called. Internally, it bundles together the
     buffered writes; this may improve performance. */
@@ -134,6 +157,11 @@ public:
     int getsockname(ip_address_t *addr);
     int getpeername(ip_address_t *addr);
 
+    /* Sets the socket's `SO_PRIORITY`, which decides the order in which the
+    kernel sends our packets when the network interface is backed up. Returns 0
+    upon success. */
+    int set_priority(int priority);
+
     linux_event_watcher_t *get_event_watcher() {
         return event_watcher.get();
     }
@@ -223,8 +251,30 @@ private:
     /* These are pulsed if and only if the read/write end of the connection has been closed. */
     cond_t read_closed, write_closed;
 
-    /* Holds data that we read from the socket but hasn't been consumed yet */
-    std::vector<char> read_buffer;
+    /* Holds data that we read from the socket but hasn't been consumed yet, in
+    `read_buffer[read_buffer_start, read_buffer_end)`. The buffer comes from a
+    per-thread pool and goes back there as soon as it's empty, so a connection
+    that is waiting for its next request doesn't hold on to one. */
+    char *read_buffer;
+    size_t read_buffer_capacity, read_buffer_start, read_buffer_end;
+
+    size_t read_buffer_size() const { return read_buffer_end - read_buffer_start; }
+    const char *read_buffer_data() const { return read_buffer + read_buffer_start; }
+
+    /* Makes room for at least `size` more bytes after the unconsumed data, moving
+    it to a bigger buffer if need be. */
+    void reserve_read_buffer(size_t size);
+
+    /* Drops `size` bytes from the front of the unconsumed data. */
+    void consume_read_buffer(size_t size);
+
+    /* Reads as much as the kernel has for us into the read buffer, with a single
+    call to ::read(). */
+    void fill_read_buffer() THROWS_ONLY(tcp_conn_read_closed_exc_t);
+
+    /* Copies up to `size` bytes of unconsumed data to `buf` and consumes them.
+    Returns how many bytes it copied. */
+    size_t take_from_read_buffer(void *buf, size_t size);
 
     /* Reads up to the given number of bytes, but not necessarily that many. Simple wrapper around
     ::read(). Returns the number of bytes read or throws tcp_conn_read_closed_exc_t. Bypasses read_buffer. */
@@ -233,26 +283,57 @@ private:
     static const size_t WRITE_QUEUE_MAX_SIZE = 128 * KILOBYTE;
     static const size_t WRITE_CHUNK_SIZE = 8 * KILOBYTE;
 
-    /* Structs to avoid over-using dynamic allocation */
-    struct write_buffer_t : public intrusive_list_node_t<write_buffer_t> {
+    /* Structs to avoid over-using dynamic allocation. Write buffers come from
+    the same per-thread pool as read buffers. */
+    struct write_buffer_t {
         char buffer[WRITE_CHUNK_SIZE];
         size_t size;
     };
 
     struct write_queue_op_t : public intrusive_list_node_t<write_queue_op_t> {
+        write_queue_op_t() { clear(); }
+        void clear() {
+            dealloc = NULL;
+            buffer = NULL;
+            size = 0;
+            iov = NULL;
+            iovcnt = 0;
+            queue_limiter_count = 0;
+            cond = NULL;
+            callback = NULL;
+            pooled = false;
+        }
+
+        // The write buffer that `buffer` points into, to be released once it's
+        // been written.
         write_buffer_t *dealloc;
         const void *buffer;
         size_t size;
+        // If `iov` isn't NULL, the op writes these buffers instead of `buffer`.
+        // `perform_writev()` modifies them as it goes.
+        iovec *iov;
+        size_t iovcnt;
+        // How much of `write_queue_limiter` to give back once the op is done.
+        size_t queue_limiter_count;
         cond_t *cond;
+        write_callback_t *callback;
+        // True if the op came from `get_write_queue_op()` and goes back there.
+        bool pooled;
         auto_drainer_t::lock_t keepalive;
     };
 
+    /* Takes the op it's handed plus whatever else is already in `write_queue`,
+    and writes all of it with as few `writev()`s as it can. */
     class write_handler_t : public coro_pool_callback_t<write_queue_op_t*> {
     public:
         explicit write_handler_t(linux_tcp_conn_t *_parent);
     private:
         linux_tcp_conn_t *parent;
         void coro_pool_callback(write_queue_op_t *operation, signal_t *interruptor);
+
+        // Reused from one batch to the next.
+        std::vector<write_queue_op_t *> batch_ops;
+        std::vector<iovec> batch_iovecs;
     } write_handler;
 
     template <class T>
@@ -266,9 +347,8 @@ private:
         }
     };
 
-    /* Lists of unused buffers, new buffers will be put on this list until needed again, reducing
-       the use of dynamic memory.  TODO: decay over time? */
-    deleting_intrusive_list_t<write_buffer_t> unused_write_buffers;
+    /* List of unused ops, new ops will be put on this list until needed again, reducing
+       the use of dynamic memory. */
     deleting_intrusive_list_t<write_queue_op_t> unused_write_queue_ops;
 
     write_buffer_t * get_write_buffer();
@@ -294,13 +374,25 @@ private:
     coro_pool_t<write_queue_op_t*> write_coro_pool;
 
     /* Buffer we are currently filling up with data that we want to write. When it reaches a
-    certain size, we push it onto `write_queue`. */
+    certain size, we push it onto `write_queue`. It's empty (and we don't hold on to a
+    buffer) whenever there's no buffered data. */
     scoped_ptr_t<write_buffer_t> current_write_buffer;
 
     /* Used to actually perform a write. If the write end of the connection is open, then writes
     `size` bytes from `buffer` to the socket. */
     void perform_write(const void *buffer, size_t size);
 
+    /* Like `perform_write()`, but for a sequence of buffers. Uses up `iov` in the
+    process. */
+    void perform_writev(iovec *iov, size_t iovcnt);
+
+    /* Sets `TCP_CORK` on the socket if it isn't set that way already. The write
+    handler corks the socket while data is queued up faster than it can send it,
+    so that the kernel sends full segments, and uncorks it as soon as it catches
+    up, so that the tail end goes out right away. */
+    void set_corked(bool corked);
+    bool is_corked;
+
     scoped_ptr_t<auto_drainer_t> drainer;
 };
 
@@ -432,4 +524,8 @@ private:
 
 std::vector<std::string> get_ips();
 
+/* Frees the calling thread's pool of connection buffers. `linux_thread_pool_t`
+calls it when each of its threads shuts down. */
+void free_tcp_buffer_pool();
+
 #endif // ARCH_IO_NETWORK_HPP_
@@ -4,6 +4,8 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <vector>
+
 #ifndef NDEBUG
 #include <cxxabi.h>   // For __cxa_current_exception_type (see below)
 #endif
@@ -32,9 +34,12 @@ bool context_ref_t::is_nil() {
 }
 
 artificial_stack_t::artificial_stack_t(void (*initial_fun)(void), size_t _stack_size)
-    : stack_size(_stack_size) {
-    /* Allocate the stack */
-    stack = malloc_aligned(stack_size, getpagesize());
+    : stack_size(ceil_aligned(_stack_size, getpagesize())) {
+    /* Map the stack. We don't reserve swap space for it, because most of it
+    usually never gets touched. */
+    stack = mmap(NULL, stack_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    guarantee_err(stack != MAP_FAILED, "could not map a coroutine stack");
 
     /* Protect the end of the stack so that we crash when we get a stack
     overflow instead of corrupting memory. */
@@ -124,11 +129,51 @@ artificial_stack_t::~artificial_stack_t() {
 #endif
 #endif
 
-    /* Undo protections changes */
-    mprotect(stack, getpagesize(), PROT_READ | PROT_WRITE);
+    /* Release the stack we mapped, protection page included */
+    int res = munmap(stack, stack_size);
+    guarantee_err(res == 0, "could not unmap a coroutine stack");
+}
+
+void artificial_stack_t::release_unused_pages() {
+    char dummy;
+    rassert(address_in_stack(&dummy), "not running on this stack");
+
+    /* Leave a page of room below us for the frame of `madvise()` itself. */
+    const uintptr_t page_size = getpagesize();
+    release_pages_below(floor_aligned(uintptr_t(&dummy), page_size) - page_size);
+}
+
+void artificial_stack_t::release_unused_pages_below_context() {
+    rassert(!context.is_nil(), "the stack is running");
+    rassert(address_in_stack(context.pointer));
+
+    /* The saved registers start at `context.pointer`, so its page stays. */
+    release_pages_below(floor_aligned(uintptr_t(context.pointer), getpagesize()));
+}
+
+void artificial_stack_t::release_pages_below(uintptr_t end) {
+    /* Don't touch the protection page. */
+    const uintptr_t begin = uintptr_t(stack) + getpagesize();
+    if (end > begin) {
+        int res = madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+        guarantee_err(res == 0, "could not release unused coroutine stack pages");
+    }
+}
 
-    /* Release the stack we allocated */
-    free(stack);
+size_t artificial_stack_t::touched_size() {
+    const size_t page_size = getpagesize();
+    std::vector<unsigned char> resident(stack_size / page_size);
+    int res = mincore(stack, stack_size, resident.data());
+    guarantee_err(res == 0, "could not check which coroutine stack pages are resident");
+
+    /* The stack grows down, so the lowest resident page (after the protection
+    page) tells us how deep it went. */
+    for (size_t i = 1; i < resident.size(); ++i) {
+        if (resident[i] & 1) {
+            return stack_size - i * page_size;
+        }
+    }
+    return 0;
 }
 
 bool artificial_stack_t::address_in_stack(void *addr) {
@@ -2,6 +2,8 @@
 #ifndef ARCH_RUNTIME_CONTEXT_SWITCHING_HPP_
 #define ARCH_RUNTIME_CONTEXT_SWITCHING_HPP_
 
+#include <stdint.h>
+
 #include "errors.hpp"
 
 /* Note that `context_ref_t` is not a POD type. We could make it a POD type, but
@@ -39,7 +41,10 @@ public:
     /* `artificial_stack_t()` sets up an artificial context. Once it is set up,
     you can use `context` to swap into and out of it. When you call
     `~artificial_stack_t()`, the original context must have been returned to
-    `context` again. */
+    `context` again.
+
+    The stack is mapped, but its pages only take up memory once they get
+    touched. */
     artificial_stack_t(void (*initial_fun)(void), size_t stack_size);
     ~artificial_stack_t();
 
@@ -58,7 +63,23 @@ public:
     /* Returns the end of the stack */
     void* get_stack_bound() { return stack; }
 
+    /* Gives the memory of the pages below the current stack pointer, which must be
+    on this stack, back to the OS. The pages stay mapped and get zero-filled when
+    they're touched again. */
+    void release_unused_pages();
+
+    /* Like `release_unused_pages()`, but for a stack that isn't running: gives
+    back the pages below the point where its context was saved. */
+    void release_unused_pages_below_context();
+
+    /* Returns how much of the stack has been touched since it was set up or since
+    the last call to `release_unused_pages()`, in whole pages. */
+    size_t touched_size();
+
 private:
+    /* Gives the pages from the protection page up to `end` back to the OS. */
+    void release_pages_below(uintptr_t end);
+
     void *stack;
     size_t stack_size;
 #ifdef VALGRIND
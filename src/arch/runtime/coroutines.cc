@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+
 #ifndef NDEBUG
 #include <stack>   /* the data structure, not the run-time concept */
 #endif
@@ -21,13 +23,28 @@
 #include "utils.hpp"
 
 static perfmon_counter_t pm_active_coroutines, pm_allocated_coroutines;
+static perfmon_sampler_t pm_coroutine_stack_usage(secs_to_ticks(60), false);
 static perfmon_multi_membership_t pm_coroutines_membership(&get_global_perfmon_collection(),
     &pm_active_coroutines, "active_coroutines",
     &pm_allocated_coroutines, "allocated_coroutines",
+    &pm_coroutine_stack_usage, "coroutine_stack_usage",
     NULLPTR);
 
 size_t coro_stack_size = COROUTINE_STACK_SIZE; //Default, setable by command-line parameter
 
+static size_t coro_stack_class_size(coro_stack_class_t stack_class) {
+    switch (stack_class) {
+    case coro_stack_class_t::small:
+        return std::min<size_t>(SMALL_COROUTINE_STACK_SIZE, coro_stack_size);
+    case coro_stack_class_t::normal:
+        return coro_stack_size;
+    case coro_stack_class_t::large:
+        return std::max<size_t>(LARGE_COROUTINE_STACK_SIZE, coro_stack_size);
+    default:
+        unreachable();
+    }
+}
+
 /* `coro_globals_t` holds all of the thread-local variables that coroutines need
 to operate. There is one per thread; it is constructed by the constructor for
 `coro_runtime_t` and destroyed by the destructor. If one exists, you can find
@@ -44,8 +61,16 @@ struct coro_globals_t {
     /* The previous context. */
     coro_t *prev_coro;
 
-    /* A list of coro_t objects that are not in use. */
-    intrusive_list_t<coro_t> free_coros;
+    /* Lists of coro_t objects that are not in use, one for each stack class. */
+    intrusive_list_t<coro_t> free_coros[NUM_CORO_STACK_CLASSES];
+
+    /* How many more coroutines will run before we measure the stack usage of
+    one. */
+    int stack_usage_sample_countdown;
+
+    /* How many more coroutines will go back to the free lists before we release
+    the memory of the idle stacks beyond the warm ones. */
+    int stack_trim_countdown;
 
 #ifndef NDEBUG
 
@@ -67,11 +92,16 @@ struct coro_globals_t {
 
     std::set<coro_t*> active_coroutines;
 
+    /* The most stack that we saw a coroutine of each type use */
+    std::map<std::string, size_t> peak_stack_usage;
+
 #endif  // NDEBUG
 
     coro_globals_t()
         : current_coro(NULL)
         , prev_coro(NULL)
+        , stack_usage_sample_countdown(COROUTINE_STACK_USAGE_SAMPLE_INTERVAL)
+        , stack_trim_countdown(COROUTINE_STACK_TRIM_INTERVAL)
 #ifndef NDEBUG
         , coro_count(0)
         , assert_no_coro_waiting_counter(0)
@@ -84,9 +114,11 @@ struct coro_globals_t {
         rassert(!current_coro);
 
         /* Destroy remaining coroutines */
-        while (coro_t *s = free_coros.head()) {
-            free_coros.remove(s);
-            delete s;
+        for (int i = 0; i < NUM_CORO_STACK_CLASSES; ++i) {
+            while (coro_t *s = free_coros[i].head()) {
+                free_coros[i].remove(s);
+                delete s;
+            }
         }
     }
 
@@ -110,6 +142,11 @@ void coro_runtime_t::get_coroutine_counts(std::map<std::string, size_t> *dest) {
     dest->clear();
     dest->insert(cglobals->total_coroutine_counts.begin(), cglobals->total_coroutine_counts.end());
 }
+
+void coro_runtime_t::get_peak_stack_usage(std::map<std::string, size_t> *dest) {
+    dest->clear();
+    dest->insert(cglobals->peak_stack_usage.begin(), cglobals->peak_stack_usage.end());
+}
 #endif
 
 /* coro_t */
@@ -118,11 +155,14 @@ void coro_runtime_t::get_coroutine_counts(std::map<std::string, size_t> *dest) {
 static __thread int64_t coro_selfname_counter = 0;
 #endif
 
-coro_t::coro_t() :
-    stack(&coro_t::run, coro_stack_size),
+coro_t::coro_t(coro_stack_class_t stack_class) :
+    stack_class_(stack_class),
+    stack(&coro_t::run, coro_stack_class_size(stack_class)),
     current_thread_(linux_thread_pool_t::thread_id),
+    stealable_(false),
     notified_(false),
-    waiting_(false)
+    waiting_(false),
+    stack_released_(false)
 #ifndef NDEBUG
     , selfname_number(get_thread_id().threadnum + MAX_THREADS * ++coro_selfname_counter)
 #endif
@@ -138,7 +178,35 @@ coro_t::coro_t() :
 }
 
 void coro_t::return_coro_to_free_list(coro_t *coro) {
-    cglobals->free_coros.push_back(coro);
+    cglobals->free_coros[static_cast<int>(coro->stack_class_)].push_back(coro);
+
+    if (--cglobals->stack_trim_countdown == 0) {
+        cglobals->stack_trim_countdown = COROUTINE_STACK_TRIM_INTERVAL;
+        release_cold_stacks();
+    }
+}
+
+void coro_t::release_cold_stacks() {
+    /* `get_coro()` takes coroutines from the tail of the free lists, so the ones
+    at the head have been idle the longest. After a spike, the lists hold more
+    of them than this thread is likely to need soon. Their stacks stay mapped so
+    that we don't have to set them up again, but the memory they touched goes
+    back to the OS. The warm ones at the tail have all switched out of their
+    stacks by now. */
+    for (int i = 0; i < NUM_CORO_STACK_CLASSES; ++i) {
+        intrusive_list_t<coro_t> *free_coros = &cglobals->free_coros[i];
+        if (free_coros->size() <= COROUTINE_WARM_STACKS_PER_CLASS) {
+            continue;
+        }
+        size_t num_cold = free_coros->size() - COROUTINE_WARM_STACKS_PER_CLASS;
+        for (coro_t *coro = free_coros->head(); num_cold > 0;
+             coro = free_coros->next(coro), --num_cold) {
+            if (!coro->stack_released_) {
+                coro->stack.release_unused_pages_below_context();
+                coro->stack_released_ = true;
+            }
+        }
+    }
 }
 
 coro_t::~coro_t() {
@@ -166,6 +234,14 @@ void coro_t::run() {
         rassert(coro->waiting_ == true);
         coro->waiting_ = false;
 
+        /* Every so often we measure how much stack a coroutine uses. For that, none
+        of the stack below us may be resident when the action starts. */
+        const bool sample_stack_usage = --cglobals->stack_usage_sample_countdown == 0;
+        if (sample_stack_usage) {
+            cglobals->stack_usage_sample_countdown = COROUTINE_STACK_USAGE_SAMPLE_INTERVAL;
+            coro->stack.release_unused_pages();
+        }
+
 #ifndef NDEBUG
         // Keep track of how many coroutines of each type ran
         cglobals->running_coroutine_counts[coro->coroutine_type.c_str()]++;
@@ -185,6 +261,8 @@ void coro_t::run() {
         // Destroy the Callable object which was either allocated within the coro_t or on the heap
         coro->action_wrapper.reset();
 
+        coro->check_stack_usage(sample_stack_usage);
+
         /* Return the context to the free-contexts list we took it from. */
         do_on_thread(coro->home_thread(), boost::bind(coro_t::return_coro_to_free_list, coro));
         --pm_active_coroutines;
@@ -307,6 +385,14 @@ void coro_t::notify_later_ordered() {
     linux_thread_pool_t::thread->message_hub.store_message(current_thread_, this);
 }
 
+void coro_t::notify_stealable() {
+    rassert(!notified_);
+    rassert(current_thread_.threadnum == linux_thread_pool_t::thread_id);
+    notified_ = true;
+    stealable_ = true;
+    linux_thread_pool_t::thread->message_hub.store_stealable_message(this);
+}
+
 void coro_t::move_to_thread(threadnum_t thread) {
     assert_good_thread_id(thread);
     rassert(coro_t::self(), "coro_t::move_to_thread() called when not in a coroutine.");
@@ -323,11 +409,28 @@ void coro_t::on_thread_switch() {
     rassert(notified_);
     notified_ = false;
 
+    if (stealable_) {
+        // Another thread may have stolen us
+        stealable_ = false;
+        current_thread_ = get_thread_id();
+    }
+
     /* TODO: When `notify_now_deprecated()` is finally removed, just fold it
     into this function. */
     notify_now_deprecated();
 }
 
+void coro_t::check_stack_usage(bool sampled) {
+    if (sampled) {
+        const size_t usage = stack.touched_size();
+        pm_coroutine_stack_usage.record(usage);
+#ifndef NDEBUG
+        size_t *peak = &cglobals->peak_stack_usage[coroutine_type];
+        *peak = std::max(*peak, usage);
+#endif
+    }
+}
+
 void coro_t::set_coroutine_stack_size(size_t size) {
     coro_stack_size = size;
 }
@@ -348,22 +451,26 @@ bool coroutines_have_been_initialized() {
     return cglobals != NULL;
 }
 
-coro_t * coro_t::get_coro() {
+coro_t * coro_t::get_coro(coro_stack_class_t stack_class) {
     rassert(coroutines_have_been_initialized());
     coro_t *coro;
 
-    if (cglobals->free_coros.size() == 0) {
-        coro = new coro_t();
+    intrusive_list_t<coro_t> *free_coros
+        = &cglobals->free_coros[static_cast<int>(stack_class)];
+    if (free_coros->size() == 0) {
+        coro = new coro_t(stack_class);
     } else {
-        coro = cglobals->free_coros.tail();
-        cglobals->free_coros.remove(coro);
+        coro = free_coros->tail();
+        free_coros->remove(coro);
     }
 
     rassert(!coro->intrusive_list_node_t<coro_t>::in_a_list());
 
     coro->current_thread_ = get_thread_id();
+    coro->stealable_ = false;
     coro->notified_ = false;
     coro->waiting_ = true;
+    coro->stack_released_ = false;
 
     ++pm_active_coroutines;
     return coro;
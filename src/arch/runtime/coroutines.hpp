@@ -13,6 +13,13 @@
 
 const size_t MAX_COROUTINE_STACK_SIZE = 8*1024*1024;
 
+/* The size class of a coroutine's stack. Most coroutines should get a `normal`
+stack; `small` is for coroutines that are known to stay shallow, and `large` is for
+ones that can recurse deeply, like query evaluation. Each thread keeps a separate
+pool of idle coroutines for each class. */
+enum class coro_stack_class_t { small, normal, large };
+const int NUM_CORO_STACK_CLASSES = 3;
+
 threadnum_t get_thread_id();
 struct coro_globals_t;
 
@@ -28,21 +35,34 @@ public:
     friend bool is_coroutine_stack_overflow(void *);
 
     template<class Callable>
-    static void spawn_now_dangerously(const Callable &action) {
-        get_and_init_coro(action)->notify_now_deprecated();
+    static void spawn_now_dangerously(const Callable &action,
+                                      coro_stack_class_t stack_class = coro_stack_class_t::normal) {
+        get_and_init_coro(action, stack_class)->notify_now_deprecated();
     }
 
     template<class Callable>
-    static void spawn_sometime(const Callable &action) {
-        get_and_init_coro(action)->notify_sometime();
+    static void spawn_sometime(const Callable &action,
+                               coro_stack_class_t stack_class = coro_stack_class_t::normal) {
+        get_and_init_coro(action, stack_class)->notify_sometime();
     }
 
     // TODO: spawn_later_ordered is usually what naive people want,
     // but it's such a long and onerous name.  It should have the
     // shortest name.
     template<class Callable>
-    static void spawn_later_ordered(const Callable &action) {
-        get_and_init_coro(action)->notify_later_ordered();
+    static void spawn_later_ordered(const Callable &action,
+                                    coro_stack_class_t stack_class = coro_stack_class_t::normal) {
+        get_and_init_coro(action, stack_class)->notify_later_ordered();
+    }
+
+    /* `spawn_stealable()` is like `spawn_sometime()`, except that if this thread
+    is busy, an idle thread may steal the coroutine and run it instead. The action
+    must not depend on which thread it starts on; it can use `get_thread_id()` to
+    find out, and `on_thread_t` to get back to a thread it needs. */
+    template<class Callable>
+    static void spawn_stealable(const Callable &action,
+                                coro_stack_class_t stack_class = coro_stack_class_t::normal) {
+        get_and_init_coro(action, stack_class)->notify_stealable();
     }
 
     // Use coro_t::spawn_*(boost::bind(...)) for spawning with parameters.
@@ -94,6 +114,10 @@ public:
     `notify_later_ordered()` in. */
     void notify_later_ordered();
 
+    /* Queues a coroutine that hasn't started yet so that the first thread to get
+    to it runs it; see `spawn_stealable()`. */
+    void notify_stealable();
+
 #ifndef NDEBUG
     // A unique identifier for this particular instance of coro_t over
     // the lifetime of the process.
@@ -118,12 +142,12 @@ private:
 
     // Contructor sets up the stack, get_and_init_coro will load a function to be run
     //  at which point the coroutine can be notified
-    coro_t();
+    explicit coro_t(coro_stack_class_t stack_class);
 
     // If this function footprint ever changes, you may need to update the parse_coroutine_info function
     template<class Callable>
-    static coro_t * get_and_init_coro(const Callable &action) {
-        coro_t *coro = get_coro();
+    static coro_t * get_and_init_coro(const Callable &action, coro_stack_class_t stack_class) {
+        coro_t *coro = get_coro(stack_class);
 #ifndef NDEBUG
         coro->parse_coroutine_type(__PRETTY_FUNCTION__);
 #endif
@@ -131,10 +155,14 @@ private:
         return coro;
     }
 
-    static coro_t * get_coro();
+    static coro_t * get_coro(coro_stack_class_t stack_class);
 
     static void return_coro_to_free_list(coro_t *coro);
 
+    // Releases the memory of the idle stacks beyond the warm ones that each free
+    // list keeps.
+    static void release_cold_stacks();
+
     static void run() NORETURN;
 
     friend struct coro_globals_t;
@@ -142,14 +170,24 @@ private:
 
     virtual void on_thread_switch();
 
+    // Measures how much of the stack the coroutine's action used.
+    void check_stack_usage(bool sampled);
+
+    const coro_stack_class_t stack_class_;
     artificial_stack_t stack;
 
     threadnum_t current_thread_;
 
+    // Whether the coroutine is waiting to start on whichever thread gets to it first
+    bool stealable_;
+
     // Sanity check variables
     bool notified_;
     bool waiting_;
 
+    // Whether the stack's memory went back to the OS while the coroutine was idle
+    bool stack_released_;
+
     callable_action_wrapper_t action_wrapper;
 
 #ifndef NDEBUG
@@ -58,8 +58,11 @@ void epoll_event_queue_t::run() {
 
     // Now, start the loop
     while (!parent->should_shut_down()) {
-        // Grab the events from the kernel!
-        res = epoll_wait(epoll_fd, events, MAX_IO_EVENT_PROCESSING_BATCH_SIZE, -1);
+        // Grab the events from the kernel! We only wait for them if there's
+        // nothing else to do.
+        const int timeout = parent->prepare_to_wait() ? -1 : 0;
+        res = epoll_wait(epoll_fd, events, MAX_IO_EVENT_PROCESSING_BATCH_SIZE, timeout);
+        parent->done_waiting();
 
         // epoll_wait might return with EINTR in some cases (in
         // particular under GDB), we just need to retry.
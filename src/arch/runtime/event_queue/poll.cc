@@ -99,14 +99,19 @@ void poll_event_queue_t::run() {
 
     // Now, start the loop
     while (!parent->should_shut_down()) {
-        // Grab the events from the kernel!
+        // Grab the events from the kernel! We only wait for them if there's
+        // nothing else to do.
+        const bool wait = parent->prepare_to_wait();
 #ifndef RDB_TIMER_PROVIDER
 #error "RDB_TIMER_PROVIDER not defined."
 #elif RDB_TIMER_PROVIDER == RDB_TIMER_PROVIDER_SIGNAL
-        res = ppoll(&watched_fds[0], watched_fds.size(), NULL, &sigmask_restricted);
+        struct timespec no_wait = { 0, 0 };
+        res = ppoll(&watched_fds[0], watched_fds.size(), wait ? NULL : &no_wait,
+                    &sigmask_restricted);
 #else
-        res = poll(&watched_fds[0], watched_fds.size(), -1);
+        res = poll(&watched_fds[0], watched_fds.size(), wait ? -1 : 0);
 #endif
+        parent->done_waiting();
         // ppoll might return with EINTR in some cases (in particular
         // under GDB), we just need to retry.
         if (res == -1 && errno == EINTR) {
@@ -15,6 +15,12 @@ struct linux_event_callback_t {
 struct linux_queue_parent_t {
     virtual void pump() = 0;
     virtual bool should_shut_down() = 0;
+    /* Called before the event queue waits for events. Returns false if there is
+    still work to do, in which case the queue only polls for events instead of
+    blocking. */
+    virtual bool prepare_to_wait() = 0;
+    /* Called when the event queue is done waiting (or polling) for events. */
+    virtual void done_waiting() = 0;
     virtual ~linux_queue_parent_t() {}
 };
 
@@ -17,7 +17,9 @@
 linux_message_hub_t::linux_message_hub_t(linux_event_queue_t *queue,
                                          linux_thread_pool_t *thread_pool,
                                          threadnum_t current_thread)
-    : queue_(queue), thread_pool_(thread_pool), current_thread_(current_thread) {
+    : queue_(queue), thread_pool_(thread_pool),
+      stealable_messages_count_(0), last_batch_size_(0),
+      current_thread_(current_thread) {
 
     queue_->watch_resource(event_.get_notify_fd(), poll_event_in, this);
 }
@@ -28,6 +30,7 @@ linux_message_hub_t::~linux_message_hub_t() {
     }
 
     guarantee(incoming_messages_.empty());
+    guarantee(stealable_messages_.empty());
 }
 
 void linux_message_hub_t::do_store_message(threadnum_t nthread, linux_thread_message_t *msg) {
@@ -83,6 +86,58 @@ void linux_message_hub_t::insert_external_message(linux_thread_message_t *msg) {
     }
 }
 
+void linux_message_hub_t::store_stealable_message(linux_thread_message_t *msg) {
+    {
+        spinlock_acq_t acq(&stealable_messages_lock_);
+        stealable_messages_.push_back(msg);
+        ++stealable_messages_count_;
+    }
+
+    thread_pool_->wake_up_idle_thread(current_thread_);
+}
+
+bool linux_message_hub_t::run_stealable_messages() {
+    msg_list_t msg_list;
+    {
+        spinlock_acq_t acq(&stealable_messages_lock_);
+        msg_list.append_and_clear(&stealable_messages_);
+        stealable_messages_count_ = 0;
+    }
+
+    if (msg_list.empty()) {
+        return false;
+    }
+
+#ifndef NDEBUG
+    start_watchdog();
+#endif
+
+    // Messages that these messages store go to the back of stealable_messages_,
+    // so that they don't starve the event queue.
+    while (linux_thread_message_t *m = msg_list.head()) {
+        msg_list.remove(m);
+        m->on_thread_switch();
+#ifndef NDEBUG
+        pet_watchdog();
+#endif
+    }
+    return true;
+}
+
+linux_thread_message_t *linux_message_hub_t::steal_message() {
+    spinlock_acq_t acq(&stealable_messages_lock_);
+    linux_thread_message_t *m = stealable_messages_.head();
+    if (m != NULL) {
+        stealable_messages_.remove(m);
+        --stealable_messages_count_;
+    }
+    return m;
+}
+
+void linux_message_hub_t::wake_up() {
+    event_.wakey_wakey();
+}
+
 void linux_message_hub_t::on_event(int events) {
     if (events != poll_event_in) {
         logERR("Unexpected event mask: %d", events);
@@ -99,6 +154,7 @@ void linux_message_hub_t::on_event(int events) {
         spinlock_acq_t acq(&incoming_messages_lock_);
         msg_list.append_and_clear(&incoming_messages_);
     }
+    last_batch_size_ = msg_list.size();
 
 #ifndef NDEBUG
     start_watchdog(); // Initialize watchdog before handling messages
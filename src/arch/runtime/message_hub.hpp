@@ -43,6 +43,33 @@ public:
     // (which does not have an event queue)
     void insert_external_message(linux_thread_message_t *msg);
 
+    /* Stealable messages are work that can run on any thread. They are stored on
+    the thread that creates them, which runs them the next time it gets around to
+    it, unless an idle thread steals them first. */
+
+    // Stores a stealable message on this thread and wakes up an idle thread, if
+    // there is one, to steal it.
+    void store_stealable_message(linux_thread_message_t *msg);
+
+    // Runs the stealable messages that were stored on this thread and that nobody
+    // stole. Returns false if there were none.
+    bool run_stealable_messages();
+
+    // Takes the oldest stealable message stored on this thread, or returns NULL.
+    // Can be called from any thread.
+    linux_thread_message_t *steal_message();
+
+    // How many messages this thread has to get through: the stealable messages
+    // waiting on it, and the messages that it received in its last batch. Can be
+    // read from any thread, but only approximately.
+    int run_queue_length() const {
+        return stealable_messages_count_ + last_batch_size_;
+    }
+    int stealable_message_count() const { return stealable_messages_count_; }
+
+    // Makes this thread's event queue wake up. Can be called from any thread.
+    void wake_up();
+
     ~linux_message_hub_t();
 
 private:
@@ -72,6 +99,13 @@ private:
     msg_list_t incoming_messages_;
     spinlock_t incoming_messages_lock_;
 
+    msg_list_t stealable_messages_;
+    spinlock_t stealable_messages_lock_;
+    volatile int stealable_messages_count_;
+
+    // How many messages on_event() delivered the last time it ran
+    volatile int last_batch_size_;
+
     void on_event(int events);
 
     // The eventfd (or pipe-based alternative) notified after the first incoming
@@ -19,6 +19,29 @@ int get_num_threads() {
     return linux_thread_pool_t::thread_pool->n_threads;
 }
 
+double get_thread_utilization(threadnum_t thread) {
+    assert_good_thread_id(thread);
+    return linux_thread_pool_t::thread_pool->threads[thread.threadnum]->utilization();
+}
+
+threadnum_t get_least_loaded_thread(int num_threads) {
+    rassert(num_threads > 0 && num_threads <= get_num_threads());
+    linux_thread_t **threads = linux_thread_pool_t::thread_pool->threads;
+
+    int best = 0;
+    for (int i = 1; i < num_threads; ++i) {
+        const double utilization = threads[i]->utilization();
+        const double best_utilization = threads[best]->utilization();
+        if (utilization < best_utilization
+            || (utilization == best_utilization
+                && threads[i]->message_hub.run_queue_length()
+                   < threads[best]->message_hub.run_queue_length())) {
+            best = i;
+        }
+    }
+    return threadnum_t(best);
+}
+
 #ifndef NDEBUG
 void assert_good_thread_id(threadnum_t thread) {
     rassert(thread.threadnum >= 0, "(thread = %" PRIi32 ")", thread.threadnum);
@@ -11,6 +11,13 @@ threadnum_t get_thread_id();
 
 int get_num_threads();
 
+// How busy the thread was lately, from 0 (idle) to 1 (never waited for events).
+// The estimate is updated every THREAD_UTILIZATION_INTERVAL_TICKS.
+double get_thread_utilization(threadnum_t thread);
+
+// Returns whichever of the first `num_threads` threads is the least busy.
+threadnum_t get_least_loaded_thread(int num_threads);
+
 #ifndef NDEBUG
 void assert_good_thread_id(threadnum_t thread);
 #else
@@ -7,15 +7,54 @@
 #include <unistd.h>
 #include <sys/time.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "arch/barrier.hpp"
+#include "arch/io/network.hpp"
 #include "arch/io/timer_provider.hpp"
 #include "arch/runtime/event_queue.hpp"
 #include "arch/runtime/runtime.hpp"
 #include "errors.hpp"
 #include "logger.hpp"
+#include "perfmon/perfmon.hpp"
 
 const int SEGV_STACK_SIZE = SIGSTKSZ;
 
+/* Reports how busy each thread is and how much work it has stolen. */
+struct thread_load_t {
+    double utilization;
+    int run_queue_length;
+    int64_t messages_stolen;
+};
+
+class perfmon_thread_load_t : public perfmon_perthread_t<thread_load_t, std::vector<thread_load_t> > {
+private:
+    void get_thread_stat(thread_load_t *stat) {
+        linux_thread_t *thread = linux_thread_pool_t::thread;
+        stat->utilization = thread->utilization();
+        stat->run_queue_length = thread->message_hub.run_queue_length();
+        stat->messages_stolen = thread->messages_stolen;
+    }
+    std::vector<thread_load_t> combine_stats(const thread_load_t *stats) {
+        return std::vector<thread_load_t>(stats, stats + get_num_threads());
+    }
+    scoped_ptr_t<perfmon_result_t> output_stat(const std::vector<thread_load_t> &stats) {
+        scoped_ptr_t<perfmon_result_t> result = perfmon_result_t::alloc_map_result();
+        for (size_t i = 0; i < stats.size(); ++i) {
+            perfmon_result_t *thread = perfmon_result_t::alloc_map_result().release();
+            thread->insert("utilization", new perfmon_result_t(strprintf("%.3f", stats[i].utilization)));
+            thread->insert("run_queue_length", new perfmon_result_t(strprintf("%d", stats[i].run_queue_length)));
+            thread->insert("messages_stolen", new perfmon_result_t(strprintf("%" PRIi64, stats[i].messages_stolen)));
+            result->insert(strprintf("%zu", i), thread);
+        }
+        return result;
+    }
+};
+
+static perfmon_thread_load_t pm_thread_load;
+static perfmon_membership_t pm_thread_load_membership(&get_global_perfmon_collection(), &pm_thread_load, "threads");
+
 __thread linux_thread_pool_t *linux_thread_pool_t::thread_pool;
 __thread int linux_thread_pool_t::thread_id;
 __thread linux_thread_t *linux_thread_pool_t::thread;
@@ -141,6 +180,9 @@ void *linux_thread_pool_t::start_thread(void *arg) {
         free(segv_stack.ss_sp);
 #endif
 
+        // The thread's connections are all gone by now.
+        free_tcp_buffer_pool();
+
         // If this thread created the generic blocker pool, clean it up
         if (generic_blocker_pool != NULL) {
             delete generic_blocker_pool;
@@ -245,13 +287,14 @@ void linux_thread_pool_t::run_thread_pool(linux_thread_message_t *initial_messag
 #ifndef NDEBUG
     // Save each thread's coroutine counters before shutting down
     std::vector<std::map<std::string, size_t> > coroutine_counts(n_threads);
+    std::vector<std::map<std::string, size_t> > peak_stack_usage(n_threads);
 #endif
 
     // Shut down child threads
     for (int i = 0; i < n_threads; i++) {
         // Cause child thread to break out of its loop
 #ifndef NDEBUG
-        threads[i]->initiate_shut_down(&coroutine_counts[i]);
+        threads[i]->initiate_shut_down(&coroutine_counts[i], &peak_stack_usage[i]);
 #else
         threads[i]->initiate_shut_down();
 #endif
@@ -284,6 +327,21 @@ void linux_thread_pool_t::run_thread_pool(linux_thread_message_t *initial_messag
              i != total_coroutine_counts.end(); ++i) {
             logDBG("%zu coroutines ran with type %s", i->second, i->first.c_str());
         }
+
+        // Likewise for the peak stack usage, which is only sampled
+        std::map<std::string, size_t> total_peak_stack_usage;
+        for (int i = 0; i < n_threads; ++i) {
+            for (std::map<std::string, size_t>::iterator j = peak_stack_usage[i].begin();
+                 j != peak_stack_usage[i].end(); ++j) {
+                size_t *peak = &total_peak_stack_usage[j->first];
+                *peak = std::max(*peak, j->second);
+            }
+        }
+
+        for (std::map<std::string, size_t>::iterator i = total_peak_stack_usage.begin();
+             i != total_peak_stack_usage.end(); ++i) {
+            logDBG("coroutines with type %s used up to %zu bytes of stack", i->first.c_str(), i->second);
+        }
     }
 #endif  // NDEBUG
 }
@@ -341,6 +399,32 @@ void linux_thread_pool_t::shutdown_thread_pool() {
     guarantee_xerr(res == 0, res, "Could not unlock shutdown cond mutex");
 }
 
+void linux_thread_pool_t::wake_up_idle_thread(threadnum_t waker) {
+    __sync_synchronize();
+    for (int i = 1; i < n_threads; ++i) {
+        linux_thread_t *thread = threads[(waker.threadnum + i) % n_threads];
+        if (thread->idle && __sync_bool_compare_and_swap(&thread->idle, true, false)) {
+            thread->message_hub.wake_up();
+            return;
+        }
+    }
+}
+
+linux_thread_message_t *linux_thread_pool_t::steal_message(threadnum_t thief) {
+    // Rob the thread that has the most to do
+    int victim = -1;
+    int victim_count = 0;
+    for (int i = 0; i < n_threads; ++i) {
+        const int count = threads[i]->message_hub.stealable_message_count();
+        if (i != thief.threadnum && count > victim_count) {
+            victim = i;
+            victim_count = count;
+        }
+    }
+
+    return victim == -1 ? NULL : threads[victim]->message_hub.steal_message();
+}
+
 linux_thread_pool_t::~linux_thread_pool_t() {
     int res;
 
@@ -355,9 +439,18 @@ linux_thread_t::linux_thread_t(linux_thread_pool_t *parent_pool, int thread_id)
     : queue(this),
       message_hub(&queue, parent_pool, threadnum_t(thread_id)),
       timer_handler(&queue),
+      idle(false),
+      messages_stolen(0),
+      parent_pool_(parent_pool),
+      thread_id_(thread_id),
+      wait_start_ticks_(get_ticks()),
+      utilization_interval_start_ticks_(wait_start_ticks_),
+      utilization_interval_wait_ticks_(0),
+      utilization_millionths_(0),
       do_shutdown(false)
 #ifndef NDEBUG
       , coroutine_counts_at_shutdown(NULL)
+      , peak_stack_usage_at_shutdown(NULL)
 #endif
 {
     // Initialize the mutex which synchronizes access to the do_shutdown variable
@@ -375,6 +468,8 @@ linux_thread_t::~linux_thread_t() {
     rassert(coroutine_counts_at_shutdown != NULL);
     coroutine_counts_at_shutdown->clear();
     coro_runtime.get_coroutine_counts(coroutine_counts_at_shutdown);
+    rassert(peak_stack_usage_at_shutdown != NULL);
+    coro_runtime.get_peak_stack_usage(peak_stack_usage_at_shutdown);
 #endif
 
     int res = pthread_mutex_destroy(&do_shutdown_mutex);
@@ -382,9 +477,52 @@ linux_thread_t::~linux_thread_t() {
 }
 
 void linux_thread_t::pump() {
+    message_hub.run_stealable_messages();
     message_hub.push_messages();
 }
 
+bool linux_thread_t::prepare_to_wait() {
+    bool have_work = message_hub.stealable_message_count() > 0;
+
+    if (!have_work) {
+        /* Look for work to steal. We must say that we're idle before we look, so
+        that a thread that stores a stealable message after we've looked sees that
+        it has to wake us up. */
+        idle = true;
+        __sync_synchronize();
+        if (linux_thread_message_t *m = parent_pool_->steal_message(thread_id_)) {
+            idle = false;
+            ++messages_stolen;
+            m->on_thread_switch();
+            message_hub.push_messages();
+            have_work = true;
+        }
+    }
+
+    wait_start_ticks_ = get_ticks();
+    return !have_work;
+}
+
+void linux_thread_t::done_waiting() {
+    idle = false;
+
+    const ticks_t now = get_ticks();
+    utilization_interval_wait_ticks_ += now - wait_start_ticks_;
+
+    const ticks_t interval = now - utilization_interval_start_ticks_;
+    if (interval >= THREAD_UTILIZATION_INTERVAL_TICKS) {
+        const double busy = 1.0 - static_cast<double>(utilization_interval_wait_ticks_) / interval;
+        const int64_t millionths = (utilization_millionths_ + busy * MILLION) / 2;
+        __sync_lock_test_and_set(&utilization_millionths_, millionths);
+        utilization_interval_start_ticks_ = now;
+        utilization_interval_wait_ticks_ = 0;
+    }
+}
+
+double linux_thread_t::utilization() {
+    return static_cast<double>(__sync_fetch_and_add(&utilization_millionths_, 0)) / MILLION;
+}
+
 void linux_thread_t::on_event(int events) {
     // No-op. This is just to make sure that the event queue wakes up
     // so it can shut down.
@@ -404,7 +542,8 @@ bool linux_thread_t::should_shut_down() {
 }
 
 #ifndef NDEBUG
-void linux_thread_t::initiate_shut_down(std::map<std::string, size_t> *coroutine_counts) {
+void linux_thread_t::initiate_shut_down(std::map<std::string, size_t> *coroutine_counts,
+                                        std::map<std::string, size_t> *peak_stack_usage) {
 #else
 void linux_thread_t::initiate_shut_down() {
 #endif
@@ -412,6 +551,7 @@ void linux_thread_t::initiate_shut_down() {
     guarantee_xerr(res == 0, res, "could not lock do_shutdown_mutex");
 #ifndef NDEBUG
     coroutine_counts_at_shutdown = coroutine_counts;
+    peak_stack_usage_at_shutdown = peak_stack_usage;
 #endif
     do_shutdown = true;
     shutdown_notify_event.wakey_wakey();
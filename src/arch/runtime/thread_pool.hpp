@@ -28,6 +28,7 @@ struct coro_runtime_t {
 
 #ifndef NDEBUG
     void get_coroutine_counts(std::map<std::string, size_t> *dest);
+    void get_peak_stack_usage(std::map<std::string, size_t> *dest);
 #endif
 };
 
@@ -58,6 +59,14 @@ public:
     // Shut down all the threads. Can be called from any thread.
     void shutdown_thread_pool();
 
+    // Wakes up one idle thread other than `waker`, if there is one, so that it
+    // can steal work. Can be called from any thread.
+    void wake_up_idle_thread(threadnum_t waker);
+
+    // Steals a stealable message for `thief` from the thread that has the most
+    // of them. Returns NULL if there are none.
+    linux_thread_message_t *steal_message(threadnum_t thief);
+
     ~linux_thread_pool_t();
 
 private:
@@ -158,20 +167,44 @@ public:
 
     void pump();   // Called by the event queue
     bool should_shut_down();   // Called by the event queue
+    bool prepare_to_wait();   // Called by the event queue
+    void done_waiting();   // Called by the event queue
 #ifndef NDEBUG
-    void initiate_shut_down(std::map<std::string, size_t> *coroutine_counts); // Can be called from any thread
+    void initiate_shut_down(std::map<std::string, size_t> *coroutine_counts,
+                            std::map<std::string, size_t> *peak_stack_usage); // Can be called from any thread
 #else
     void initiate_shut_down(); // Can be called from any thread
 #endif
     void on_event(int events);
 
+    /* Load statistics. Only this thread writes them, but other threads read them
+    (approximately) to decide where work should go. */
+
+    // True while the thread waits for events with nothing else to do. Other
+    // threads clear it when they wake the thread up to steal work.
+    volatile bool idle;
+    // The fraction of the time that the thread was busy lately
+    double utilization();
+    // How many stealable messages the thread has stolen from other threads
+    int64_t messages_stolen;
+
 private:
+    linux_thread_pool_t *const parent_pool_;
+    const threadnum_t thread_id_;
+
+    ticks_t wait_start_ticks_;
+    ticks_t utilization_interval_start_ticks_;
+    ticks_t utilization_interval_wait_ticks_;
+    // `utilization()` in millionths, which other threads can read atomically
+    int64_t utilization_millionths_;
+
     volatile bool do_shutdown;
     pthread_mutex_t do_shutdown_mutex;
     system_event_t shutdown_notify_event;
 
 #ifndef NDEBUG
     std::map<std::string, size_t> *coroutine_counts_at_shutdown;
+    std::map<std::string, size_t> *peak_stack_usage_at_shutdown;
 #endif
 };
 
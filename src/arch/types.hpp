@@ -94,6 +94,14 @@ enum class file_direct_io_mode_t {
     buffered_desired
 };
 
+// Which disk manager actually performs the IO requests.  `pool` runs blocking
+// syscalls on a thread pool, `native_aio` submits them to the kernel's AIO
+// interface (and falls back to `pool` if that isn't available).
+enum class io_backend_t {
+    pool,
+    native_aio
+};
+
 
 
 class semantic_checking_file_t {
@@ -8,6 +8,16 @@
 
 #define NEVER_FLUSH (-1)
 
+// Which algorithm the cache uses to choose blocks to evict.  See page_repl_random.hpp
+// and page_repl_2q.hpp.
+enum class page_repl_policy_t {
+    random = 0,
+    two_queue = 1
+};
+ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(page_repl_policy_t, int8_t,
+                                      page_repl_policy_t::random,
+                                      page_repl_policy_t::two_queue);
+
 /* Configuration for the cache (it can all change from run to run) */
 
 struct mirrored_cache_config_t {
@@ -20,6 +30,7 @@ struct mirrored_cache_config_t {
         max_concurrent_flushes = DEFAULT_MAX_CONCURRENT_FLUSHES;
         io_priority_reads = CACHE_READS_IO_PRIORITY;
         io_priority_writes = CACHE_WRITES_IO_PRIORITY;
+        page_repl_policy = DEFAULT_PAGE_REPL_POLICY;
     }
 
     // Max amount of memory that will be used for the cache, in bytes.
@@ -49,6 +60,9 @@ struct mirrored_cache_config_t {
     int io_priority_reads;
     int io_priority_writes;
 
+    // The page replacement algorithm.
+    page_repl_policy_t page_repl_policy;
+
     void rdb_serialize(write_message_t &msg /* NOLINT */) const {
         msg << max_size;
         msg << flush_timer_ms;
@@ -57,6 +71,7 @@ struct mirrored_cache_config_t {
         msg << max_concurrent_flushes;
         msg << io_priority_reads;
         msg << io_priority_writes;
+        msg << page_repl_policy;
     }
 
     archive_result_t rdb_deserialize(read_stream_t *s) {
@@ -74,6 +89,8 @@ struct mirrored_cache_config_t {
         res = deserialize(s, &io_priority_reads);
         if (res) { return res; }
         res = deserialize(s, &io_priority_writes);
+        if (res) { return res; }
+        res = deserialize(s, &page_repl_policy);
         return res;
     }
 };
@@ -213,7 +213,7 @@ mc_inner_buf_t::mc_inner_buf_t(mc_cache_t *_cache, block_id_t _block_id, file_ac
     ++_cache->stats->pm_n_blocks_in_memory;
     refcount++; // Make the refcount nonzero so this block won't be considered safe to unload.
 
-    _cache->page_repl.make_space();
+    _cache->page_repl->make_space();
     _cache->maybe_unregister_read_ahead_callback();
 
     refcount--;
@@ -244,7 +244,7 @@ mc_inner_buf_t::mc_inner_buf_t(mc_cache_t *_cache, block_id_t _block_id,
 
     ++_cache->stats->pm_n_blocks_in_memory;
     refcount++; // Make the refcount nonzero so this block won't be considered safe to unload.
-    _cache->page_repl.make_space();
+    _cache->page_repl->make_space();
     _cache->maybe_unregister_read_ahead_callback();
     refcount--;
 }
@@ -321,7 +321,7 @@ mc_inner_buf_t::mc_inner_buf_t(mc_cache_t *_cache, block_id_t _block_id, version
     ++_cache->stats->pm_n_blocks_in_memory;
     ++refcount; // Make the refcount nonzero so this block won't be considered safe to unload.
 
-    _cache->page_repl.make_space();
+    _cache->page_repl->make_space();
     _cache->maybe_unregister_read_ahead_callback();
 
     --refcount;
@@ -503,6 +503,10 @@ mc_buf_lock_t::mc_buf_lock_t(mc_transaction_t *transaction,
     transaction->assert_thread();
     rassert(block_id != NULL_BLOCK_ID);
 
+    // Only real acquisitions count towards the hit ratio, not read-ahead or
+    // `contains_block` probes.
+    transaction->cache->stats->pm_cache_hit_ratio.record(inner_buf ? 1 : 0);
+
     // Note that it is critical that between here and creating our buf_lock_t wrapper that we do nothing
     // blocking (unless it acquires a lock on inner_buf or otherwise prevents it from being
     // unloaded), or else inner_buf could be selected for deletion from the cache, then recreated,
@@ -519,6 +523,10 @@ mc_buf_lock_t::mc_buf_lock_t(mc_transaction_t *transaction,
         // scattered around everywhere (eg: here). consolidate it, perhaps in mc_buf_lock_t.
         rassert(!inner_buf->do_delete || snapshotted);
 
+        if (inner_buf->in_page_repl()) {
+            transaction->cache->page_repl->on_access(inner_buf);
+        }
+
         // ensures we're using the top version
         if (!inner_buf->data.has() && !inner_buf->do_delete &&
             // if we're accessing a snapshot rather than the top version, no need to load it here
@@ -1221,10 +1229,11 @@ mc_cache_t::mc_cache_t(serializer_t *_serializer,
     dynamic_config(_dynamic_config),
     serializer(_serializer),
     stats(new mc_cache_stats_t(perfmon_parent)),
-    page_repl(
+    page_repl(create_page_repl(
+        dynamic_config.page_repl_policy,
         // Launch page replacement if the user-specified maximum number of blocks is reached
         dynamic_config.max_size / _serializer->get_block_size().ser_value(),
-        this),
+        this)),
     writeback(
         this,
         dynamic_config.flush_timer_ms,
@@ -1292,7 +1301,7 @@ mc_cache_t::~mc_cache_t() {
     }
 
     /* Delete all the buffers */
-    while (evictable_t *buf = page_repl.get_first_buf()) {
+    while (evictable_t *buf = page_repl->get_first_buf()) {
         // TODO(rntz) check that buf is actually a mc_inner_buf_t
         delete buf;
     }
@@ -1452,7 +1461,7 @@ bool mc_cache_t::can_read_ahead_block_be_accepted(block_id_t block_id) {
 
 void mc_cache_t::maybe_unregister_read_ahead_callback() {
     // Unregister when 90 % of the cache are filled up.
-    if (read_ahead_registered && page_repl.is_full(dynamic_config.max_size / serializer->get_block_size().ser_value() / 10 + 1)) {
+    if (read_ahead_registered && page_repl->is_full(dynamic_config.max_size / serializer->get_block_size().ser_value() / 10 + 1)) {
         read_ahead_registered = false;
         // unregister_read_ahead_cb requires a coro context, but we might not be in any
         coro_t::spawn_now_dangerously(boost::bind(&serializer_t::unregister_read_ahead_cb, serializer, this));
@@ -23,7 +23,7 @@
 
 #include "buffer_cache/mirrored/writeback.hpp"
 
-#include "buffer_cache/mirrored/page_repl_random.hpp"
+#include "buffer_cache/mirrored/page_repl.hpp"
 
 #include "buffer_cache/mirrored/free_list.hpp"
 
@@ -42,7 +42,7 @@ class mc_inner_buf_t : public evictable_t,
     friend class mc_buf_lock_t;
     friend class writeback_t;
     friend class writeback_t::local_buf_t;
-    friend class page_repl_random_t;
+    friend class page_repl_t;
     friend class array_map_t;
 
     typedef uint64_t version_id_t;
@@ -316,7 +316,7 @@ class mc_cache_t : public home_thread_mixin_t, public serializer_read_ahead_call
     friend class mc_transaction_t;
     friend class writeback_t;
     friend class writeback_t::local_buf_t;
-    friend class page_repl_random_t;
+    friend class page_repl_t;
     friend class evictable_t;
     friend class array_map_t;
 
@@ -405,7 +405,7 @@ private:
     scoped_ptr_t<file_account_t> writes_io_account;
 
     array_map_t page_map;
-    page_repl_random_t page_repl;
+    scoped_ptr_t<page_repl_t> page_repl;
     writeback_t writeback;
     array_free_list_t free_list;
 
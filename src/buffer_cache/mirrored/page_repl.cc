@@ -0,0 +1,105 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "buffer_cache/mirrored/page_repl.hpp"
+
+#include "buffer_cache/mirrored/mirrored.hpp"
+#include "buffer_cache/mirrored/page_repl_2q.hpp"
+#include "buffer_cache/mirrored/page_repl_random.hpp"
+#include "logger.hpp"
+#include "perfmon/perfmon.hpp"
+
+evictable_t::evictable_t(mc_cache_t *_cache, bool loaded)
+    : eviction_priority(DEFAULT_EVICTION_PRIORITY), cache(_cache),
+      page_repl_index(static_cast<size_t>(-1)),
+      page_repl_prev(NULL), page_repl_next(NULL)
+{
+    cache->assert_thread();
+    if (loaded) {
+        insert_into_page_repl();
+    }
+}
+
+evictable_t::~evictable_t() {
+    cache->assert_thread();
+
+    // It's the subclass destructor's responsibility to run
+    //
+    //     if (in_page_repl()) { remove_from_page_repl(); }
+    rassert(!in_page_repl());
+}
+
+bool evictable_t::in_page_repl() {
+    return page_repl_index != static_cast<size_t>(-1);
+}
+
+void evictable_t::insert_into_page_repl() {
+    cache->assert_thread();
+    rassert(!in_page_repl());
+    cache->page_repl->insert(this);
+    rassert(in_page_repl());
+}
+
+void evictable_t::remove_from_page_repl() {
+    cache->assert_thread();
+    rassert(in_page_repl());
+    cache->page_repl->remove(this);
+    rassert(!in_page_repl());
+}
+
+page_repl_t::page_repl_t(size_t _unload_threshold, mc_cache_t *_cache)
+    : unload_threshold(_unload_threshold),
+      cache(_cache)
+    {}
+
+bool page_repl_t::is_full(size_t space_needed) {
+    cache->assert_thread();
+    return size() + space_needed > unload_threshold;
+}
+
+// make_space tries to make sure that the number of blocks currently in memory is at least
+// 'space_needed' less than the user-specified memory limit.
+void page_repl_t::make_space(size_t space_needed) {
+    cache->assert_thread();
+    size_t target;
+    // TODO(rntz): why, if more space is needed than unload_threshold, do we set the target number
+    // of pages in cache to unload_threshold rather than 0? (note: git blames this on tim)
+    if (space_needed > unload_threshold) {
+        target = unload_threshold;
+    } else {
+        target = unload_threshold - space_needed;
+    }
+
+    while (size() > target) {
+        // Blocks are ineligible to be unloaded if they are dirty or in use.
+        evictable_t *block_to_unload = choose_victim();
+
+        if (!block_to_unload) {
+            // The following log message blows the corostack because it has propensity to overlog.
+            // Commenting it out for 1.2. TODO: we might want to address it later in a different
+            // way (i.e. spawn_maybe?)
+            /*
+            if (size() > target + (target / 100) + 10)
+                logWRN("cache %p exceeding memory target. %d blocks in memory, %d dirty, target is %d.",
+                       cache, size(), cache->writeback.num_dirty_blocks(), target);
+            */
+            break;
+        }
+
+        // Remove it from the page repl and call its callback. Need to remove it from the repl first
+        // because its callback could delete it.
+        block_to_unload->remove_from_page_repl();
+        block_to_unload->unload();
+        ++cache->stats->pm_n_blocks_evicted;
+    }
+}
+
+page_repl_t *create_page_repl(page_repl_policy_t policy, size_t unload_threshold,
+                              mc_cache_t *cache) {
+    switch (policy) {
+    case page_repl_policy_t::random:
+        return new page_repl_random_t(unload_threshold, cache);
+    case page_repl_policy_t::two_queue:
+        return new page_repl_2q_t(unload_threshold, cache);
+    default:
+        unreachable();
+    }
+}
@@ -0,0 +1,99 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef BUFFER_CACHE_MIRRORED_PAGE_REPL_HPP_
+#define BUFFER_CACHE_MIRRORED_PAGE_REPL_HPP_
+
+#include "buffer_cache/mirrored/config.hpp"
+#include "buffer_cache/types.hpp"
+#include "containers/scoped.hpp"
+
+/* The page replacement component decides which bufs to kick out of memory when the
+cache grows past its size limit. Everything that can be kicked out is an
+`evictable_t`; the policy that picks the victims is a `page_repl_t`. Which policy a
+cache uses is set by `mirrored_cache_config_t::page_repl_policy`. */
+
+class mc_cache_t;
+
+class evictable_t {
+public:
+    explicit evictable_t(mc_cache_t *cache, bool loaded = true);
+    // removes us from the page repl if necessary; does not call unload()
+    virtual ~evictable_t();
+    // Returns true if this object can be unloaded from the cache.
+    virtual bool safe_to_unload() = 0;
+    // Called when the page replacement policy decides to evict this object. Must
+    // relinquish the buf associated with this object.
+    virtual void unload() = 0;
+
+    bool in_page_repl();
+    void insert_into_page_repl();
+    void remove_from_page_repl(); // does *not* call unload()
+
+    /* The eviction priority represents how bad of a choice a buf is for
+     * eviction the buffer cache will (probabalistically) evict blocks of
+     * lower priority first. */
+    eviction_priority_t eviction_priority;
+
+protected:
+    mc_cache_t *cache;
+private:
+    friend class page_repl_random_t;
+    friend class page_repl_2q_t;
+
+    // The meaning of `page_repl_index` is up to the page replacement policy, except
+    // that it's -1 when we aren't in the page repl.  `page_repl_prev` and
+    // `page_repl_next` are for policies that keep bufs in lists.
+    size_t page_repl_index;
+    evictable_t *page_repl_prev;
+    evictable_t *page_repl_next;
+};
+
+class page_repl_t {
+public:
+    page_repl_t(size_t _unload_threshold, mc_cache_t *_cache);
+    virtual ~page_repl_t() { }
+
+    // If is_full(space_needed), the next call to make_space(space_needed) probably
+    // has to evict something
+    bool is_full(size_t space_needed);
+
+    // make_space tries to make sure that the number of blocks currently in memory is
+    // at least 'space_needed' less than the user-specified memory limit.
+    void make_space(size_t space_needed = 0);
+
+    // Tells the policy that `buf`, which is in the page repl, has been acquired again.
+    virtual void on_access(evictable_t *buf) = 0;
+
+    /* The page replacement component actually serves two roles. In addition to its
+    primary role as a mechanism for kicking out buffers when memory runs low, it also
+    has the job of keeping track of all of the buffers in memory in such a way that
+    the cache can quickly request a pointer to the next buffer in memory. This is
+    used during the cache's destructor. The rationale is that any reasonable
+    implementation of a page replacement system will need to keep track of all of the
+    buffers in memory anyway, so the cache can depend on the page replacement
+    system's buffer list rather than keeping a buffer list of its own. */
+    virtual evictable_t *get_first_buf() = 0;
+
+protected:
+    friend class evictable_t;
+
+    // The number of bufs in the page repl.
+    virtual size_t size() = 0;
+    // These must set `buf->page_repl_index` to something other than -1 and back.
+    virtual void insert(evictable_t *buf) = 0;
+    virtual void remove(evictable_t *buf) = 0;
+    // Picks the next buf to evict.  Returns NULL if nothing can be unloaded right
+    // now.  Candidates must be `safe_to_unload()`, and among comparable candidates
+    // ones with a higher `eviction_priority` should go first.
+    virtual evictable_t *choose_victim() = 0;
+
+    size_t unload_threshold;
+    mc_cache_t *cache;
+
+private:
+    DISABLE_COPYING(page_repl_t);
+};
+
+page_repl_t *create_page_repl(page_repl_policy_t policy, size_t unload_threshold,
+                              mc_cache_t *cache);
+
+#endif  // BUFFER_CACHE_MIRRORED_PAGE_REPL_HPP_
@@ -0,0 +1,111 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "buffer_cache/mirrored/page_repl_2q.hpp"
+
+#include "buffer_cache/mirrored/mirrored.hpp"
+#include "config/args.hpp"
+
+void page_repl_2q_t::queue_t::push_front(evictable_t *buf) {
+    rassert(buf->page_repl_prev == NULL && buf->page_repl_next == NULL);
+    buf->page_repl_next = head;
+    if (head != NULL) {
+        head->page_repl_prev = buf;
+    } else {
+        tail = buf;
+    }
+    head = buf;
+    ++count;
+}
+
+void page_repl_2q_t::queue_t::remove(evictable_t *buf) {
+    if (buf->page_repl_prev != NULL) {
+        buf->page_repl_prev->page_repl_next = buf->page_repl_next;
+    } else {
+        rassert(head == buf);
+        head = buf->page_repl_next;
+    }
+    if (buf->page_repl_next != NULL) {
+        buf->page_repl_next->page_repl_prev = buf->page_repl_prev;
+    } else {
+        rassert(tail == buf);
+        tail = buf->page_repl_prev;
+    }
+    buf->page_repl_prev = NULL;
+    buf->page_repl_next = NULL;
+    rassert(count > 0);
+    --count;
+}
+
+page_repl_2q_t::page_repl_2q_t(size_t _unload_threshold, mc_cache_t *_cache)
+    : page_repl_t(_unload_threshold, _cache),
+      a1_target(_unload_threshold * PAGE_REPL_2Q_A1_FRACTION) { }
+
+page_repl_2q_t::~page_repl_2q_t() {
+    rassert(a1.count == 0 && am.count == 0);
+}
+
+page_repl_2q_t::queue_t *page_repl_2q_t::queue_of(evictable_t *buf) {
+    rassert(buf->page_repl_index == A1_QUEUE || buf->page_repl_index == AM_QUEUE);
+    return buf->page_repl_index == A1_QUEUE ? &a1 : &am;
+}
+
+size_t page_repl_2q_t::size() {
+    return a1.count + am.count;
+}
+
+void page_repl_2q_t::insert(evictable_t *buf) {
+    a1.push_front(buf);
+    buf->page_repl_index = A1_QUEUE;
+}
+
+void page_repl_2q_t::remove(evictable_t *buf) {
+    queue_of(buf)->remove(buf);
+    buf->page_repl_index = static_cast<size_t>(-1);
+}
+
+void page_repl_2q_t::on_access(evictable_t *buf) {
+    cache->assert_thread();
+    queue_of(buf)->remove(buf);
+    am.push_front(buf);
+    buf->page_repl_index = AM_QUEUE;
+}
+
+evictable_t *page_repl_2q_t::choose_victim_from(queue_t *queue) {
+    // We look at up to PAGE_REPL_NUM_TRIES bufs from the back of the queue and take
+    // the one with the highest eviction priority.  Bufs that can't be unloaded right
+    // now are moved to the front, so they don't keep blocking the back of the queue.
+    evictable_t *block_to_unload = NULL;
+    evictable_t *block = queue->tail;
+    for (int tries = PAGE_REPL_NUM_TRIES; tries > 0 && block != NULL; tries--) {
+        evictable_t *next = block->page_repl_prev;
+        if (!block->safe_to_unload()) {
+            if (block != queue->head) {
+                queue->remove(block);
+                queue->push_front(block);
+            }
+        } else if (block_to_unload == NULL
+                   || block_to_unload->eviction_priority < block->eviction_priority) {
+            block_to_unload = block;
+        }
+        block = next;
+    }
+    return block_to_unload;
+}
+
+evictable_t *page_repl_2q_t::choose_victim() {
+    evictable_t *block_to_unload = NULL;
+    if (a1.count > a1_target) {
+        block_to_unload = choose_victim_from(&a1);
+    }
+    if (block_to_unload == NULL) {
+        block_to_unload = choose_victim_from(&am);
+    }
+    if (block_to_unload == NULL) {
+        block_to_unload = choose_victim_from(&a1);
+    }
+    return block_to_unload;
+}
+
+evictable_t *page_repl_2q_t::get_first_buf() {
+    cache->assert_thread();
+    return a1.head != NULL ? a1.head : am.head;
+}
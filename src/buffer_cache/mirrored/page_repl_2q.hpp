@@ -0,0 +1,59 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef BUFFER_CACHE_MIRRORED_PAGE_REPL_2Q_HPP_
+#define BUFFER_CACHE_MIRRORED_PAGE_REPL_2Q_HPP_
+
+#include "buffer_cache/mirrored/page_repl.hpp"
+
+/* A simplified version of the 2Q algorithm (Johnson and Shasha, VLDB '94). Newly
+loaded bufs enter the FIFO queue `a1`. A buf that is acquired again while it is in
+`a1` gets promoted to the LRU queue `am`, and acquiring a buf in `am` moves it to the
+front of `am`. Victims are taken from `a1` as long as it holds more than its share
+(`PAGE_REPL_2Q_A1_FRACTION`) of the cache, so blocks that a table scan or a backfill
+touches only once flow through `a1` without pushing the frequently used blocks in
+`am` out of memory.
+
+Unlike full 2Q we keep no ghost queue of recently evicted block ids, so a block only
+gets promoted if its second access comes while it is still in memory. */
+
+class page_repl_2q_t : public page_repl_t {
+public:
+    page_repl_2q_t(size_t _unload_threshold, mc_cache_t *_cache);
+    ~page_repl_2q_t();
+
+    void on_access(evictable_t *buf);
+    evictable_t *get_first_buf();
+
+private:
+    // A doubly linked list threaded through `evictable_t::page_repl_prev` and
+    // `page_repl_next`.  The front is the most recently inserted buf.
+    class queue_t {
+    public:
+        queue_t() : head(NULL), tail(NULL), count(0) { }
+        void push_front(evictable_t *buf);
+        void remove(evictable_t *buf);
+
+        evictable_t *head;
+        evictable_t *tail;
+        size_t count;
+    private:
+        DISABLE_COPYING(queue_t);
+    };
+
+    // The values of `evictable_t::page_repl_index` for bufs in each queue.
+    static const size_t A1_QUEUE = 0;
+    static const size_t AM_QUEUE = 1;
+
+    size_t size();
+    void insert(evictable_t *buf);
+    void remove(evictable_t *buf);
+    evictable_t *choose_victim();
+
+    evictable_t *choose_victim_from(queue_t *queue);
+    queue_t *queue_of(evictable_t *buf);
+
+    const size_t a1_target;
+    queue_t a1;
+    queue_t am;
+};
+
+#endif  // BUFFER_CACHE_MIRRORED_PAGE_REPL_2Q_HPP_
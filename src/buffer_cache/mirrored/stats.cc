@@ -29,6 +29,7 @@ mc_cache_stats_t::mc_cache_stats_t(perfmon_collection_t *parent)
       pm_snapshots_per_transaction(secs_to_ticks(1), false),
       pm_cache_hits(),
       pm_cache_misses(),
+      pm_cache_hit_ratio(secs_to_ticks(1), false),
       pm_bufs_acquiring(secs_to_ticks(1)),
       pm_bufs_held(secs_to_ticks(1)),
       pm_transactions_starting(secs_to_ticks(1)),
@@ -50,6 +51,7 @@ mc_cache_stats_t::mc_cache_stats_t(perfmon_collection_t *parent)
           &pm_snapshots_per_transaction, "snapshots_per_transaction",
           &pm_cache_hits, "cache_hits",
           &pm_cache_misses, "cache_misses",
+          &pm_cache_hit_ratio, "cache_hit_ratio",
           &pm_bufs_acquiring, "bufs_acquiring",
           &pm_bufs_held, "bufs_held",
           &pm_transactions_starting, "transactions_starting",
@@ -21,6 +21,10 @@ struct mc_cache_stats_t {
         pm_cache_hits,
         pm_cache_misses;
 
+    // Records 1 for every buf acquisition that hits the cache and 0 for every one
+    // that misses, so its mean is the hit ratio.
+    perfmon_sampler_t pm_cache_hit_ratio;
+
     perfmon_duration_sampler_t
         pm_bufs_acquiring,
         pm_bufs_held;
@@ -48,7 +52,7 @@ struct mc_cache_stats_t {
         pm_n_blocks_dirty,
         pm_n_blocks_total;
 
-    // used in buffer_cache/mirrored/page_repl_random.cc
+    // used in buffer_cache/mirrored/page_repl.cc
     perfmon_counter_t pm_n_blocks_evicted;
 
     /* This is for exposing the block size */
@@ -601,6 +601,7 @@ void run_rethinkdb_create(const base_path_t &base_path,
                           const name_string_t &machine_name,
                           const file_direct_io_mode_t direct_io_mode,
                           const int max_concurrent_io_requests,
+                          const io_backend_t io_backend,
                           bool *const result_out) {
     machine_id_t our_machine_id = generate_uuid();
 
@@ -612,7 +613,7 @@ void run_rethinkdb_create(const base_path_t &base_path,
     machine_semilattice_metadata.datacenter = vclock_t<datacenter_id_t>(nil_uuid(), our_machine_id);
     cluster_metadata.machines.machines.insert(std::make_pair(our_machine_id, make_deletable(machine_semilattice_metadata)));
 
-    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests);
+    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests, io_backend);
 
     perfmon_collection_t metadata_perfmon_collection;
     perfmon_membership_t metadata_perfmon_membership(&get_global_perfmon_collection(), &metadata_perfmon_collection, "metadata");
@@ -704,6 +705,7 @@ void run_rethinkdb_serve(const base_path_t &base_path,
                          const serve_info_t &serve_info,
                          const file_direct_io_mode_t direct_io_mode,
                          const int max_concurrent_io_requests,
+                         const io_backend_t io_backend,
                          const machine_id_t *our_machine_id,
                          const cluster_semilattice_metadata_t *cluster_metadata,
                          directory_lock_t *data_directory_lock,
@@ -714,7 +716,7 @@ void run_rethinkdb_serve(const base_path_t &base_path,
 
     logINF("Loading data from directory %s\n", base_path.path().c_str());
 
-    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests);
+    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests, io_backend);
 
     perfmon_collection_t metadata_perfmon_collection;
     perfmon_membership_t metadata_perfmon_membership(&get_global_perfmon_collection(), &metadata_perfmon_collection, "metadata");
@@ -775,13 +777,14 @@ void run_rethinkdb_porcelain(const base_path_t &base_path,
                              const name_string_t &machine_name,
                              const file_direct_io_mode_t direct_io_mode,
                              const int max_concurrent_io_requests,
+                             const io_backend_t io_backend,
                              const bool new_directory,
                              const serve_info_t &serve_info,
                              directory_lock_t *data_directory_lock,
                              bool *const result_out) {
     if (!new_directory) {
         run_rethinkdb_serve(base_path, serve_info,
-                            direct_io_mode, max_concurrent_io_requests,
+                            direct_io_mode, max_concurrent_io_requests, io_backend,
                             NULL, NULL, data_directory_lock,
                             result_out);
     } else {
@@ -814,7 +817,7 @@ void run_rethinkdb_porcelain(const base_path_t &base_path,
         }
 
         run_rethinkdb_serve(base_path, serve_info,
-                            direct_io_mode, max_concurrent_io_requests,
+                            direct_io_mode, max_concurrent_io_requests, io_backend,
                             &our_machine_id, &cluster_metadata,
                             data_directory_lock, result_out);
     }
@@ -867,6 +870,11 @@ options::help_section_t get_file_options(std::vector<options::option_t> *options
                                              strprintf("%d", DEFAULT_MAX_CONCURRENT_IO_REQUESTS)));
     help.add("--io-threads n",
              "how many simultaneous I/O operations can happen at the same time");
+    options_out->push_back(options::option_t(options::names_t("--io-backend"),
+                                             options::OPTIONAL,
+                                             "pool"));
+    help.add("--io-backend {pool|native}",
+             "perform I/O using a thread pool or the kernel's native AIO interface");
     options_out->push_back(options::option_t(options::names_t("--no-direct-io"),
                                              options::OPTIONAL_NO_PARAMETER));
     help.add("--no-direct-io", "disable direct I/O");
@@ -1141,6 +1149,20 @@ MUST_USE bool parse_io_threads_option(const std::map<std::string, options::value
     return true;
 }
 
+MUST_USE bool parse_io_backend_option(const std::map<std::string, options::values_t> &opts,
+                                      io_backend_t *io_backend_out) {
+    const std::string io_backend = get_single_option(opts, "--io-backend");
+    if (io_backend == "pool") {
+        *io_backend_out = io_backend_t::pool;
+    } else if (io_backend == "native") {
+        *io_backend_out = io_backend_t::native_aio;
+    } else {
+        fprintf(stderr, "ERROR: io-backend must be either 'pool' or 'native'\n");
+        return false;
+    }
+    return true;
+}
+
 file_direct_io_mode_t parse_direct_io_mode_option(const std::map<std::string, options::values_t> &opts) {
     return exists_option(opts, "--no-direct-io") ?
         file_direct_io_mode_t::buffered_desired :
@@ -1177,6 +1199,11 @@ int main_rethinkdb_create(int argc, char *argv[]) {
             return EXIT_FAILURE;
         }
 
+        io_backend_t io_backend;
+        if (!parse_io_backend_option(opts, &io_backend)) {
+            return EXIT_FAILURE;
+        }
+
         const int num_workers = get_cpu_count();
 
         bool is_new_directory = false;
@@ -1198,6 +1225,7 @@ int main_rethinkdb_create(int argc, char *argv[]) {
                                      machine_name,
                                      direct_io_mode,
                                      max_concurrent_io_requests,
+                                     io_backend,
                                      &result),
                            num_workers);
 
@@ -1288,6 +1316,11 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
             return EXIT_FAILURE;
         }
 
+        io_backend_t io_backend;
+        if (!parse_io_backend_option(opts, &io_backend)) {
+            return EXIT_FAILURE;
+        }
+
         // Open and lock the directory, but do not create it
         bool is_new_directory = false;
         directory_lock_t data_directory_lock(base_path, false, &is_new_directory);
@@ -1323,6 +1356,7 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
                                      serve_info,
                                      direct_io_mode,
                                      max_concurrent_io_requests,
+                                     io_backend,
                                      static_cast<machine_id_t*>(NULL),
                                      static_cast<cluster_semilattice_metadata_t*>(NULL),
                                      &data_directory_lock,
@@ -1545,6 +1579,11 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
             return EXIT_FAILURE;
         }
 
+        io_backend_t io_backend;
+        if (!parse_io_backend_option(opts, &io_backend)) {
+            return EXIT_FAILURE;
+        }
+
         // Attempt to create the directory early so that the log file can use it.
         // If we create the file, it will be cleaned up unless directory_initialized()
         // is called on it.  This will be done after the metadata files have been created.
@@ -1585,6 +1624,7 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
                                      machine_name,
                                      direct_io_mode,
                                      max_concurrent_io_requests,
+                                     io_backend,
                                      is_new_directory,
                                      serve_info,
                                      &data_directory_lock,
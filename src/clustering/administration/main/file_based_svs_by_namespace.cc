@@ -79,6 +79,7 @@ file_based_svs_by_namespace_t<protocol_t>::get_svs(
             perfmon_collection_t *serializers_perfmon_collection,
             namespace_id_t namespace_id,
             int64_t cache_size,
+            bool compress_blocks,
             stores_lifetimer_t<protocol_t> *stores_out,
             scoped_ptr_t<multistore_ptr_t<protocol_t> > *svs_out,
             typename protocol_t::context_t *ctx) {
@@ -119,11 +120,13 @@ file_based_svs_by_namespace_t<protocol_t>::get_svs(
                                             namespace_id, cache_size,
                                             serializers_perfmon_collection, ctx);
         filepath_file_opener_t file_opener(serializer_filepath, io_backender_);
+        standard_serializer_t::dynamic_config_t serializer_config;
+        serializer_config.compress_blocks = compress_blocks;
         if (res == 0) {
             // TODO: Could we handle failure when loading the serializer?  Right
             // now, we don't.
             serializer.init(new standard_serializer_t(
-                                standard_serializer_t::dynamic_config_t(),
+                                serializer_config,
                                 &file_opener,
                                 serializers_perfmon_collection));
 
@@ -143,7 +146,7 @@ file_based_svs_by_namespace_t<protocol_t>::get_svs(
             standard_serializer_t::create(&file_opener,
                                           standard_serializer_t::static_config_t());
             serializer.init(new standard_serializer_t(
-                                standard_serializer_t::dynamic_config_t(),
+                                serializer_config,
                                 &file_opener,
                                 serializers_perfmon_collection));
 
@@ -16,6 +16,7 @@ public:
     void get_svs(perfmon_collection_t *serializers_perfmon_collection,
                  namespace_id_t namespace_id,
                  int64_t cache_size,
+                 bool compress_blocks,
                  stores_lifetimer_t<protocol_t> *stores_out,
                  scoped_ptr_t<multistore_ptr_t<protocol_t> > *svs_out,
                  typename protocol_t::context_t *);
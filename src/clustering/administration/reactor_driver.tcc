@@ -115,6 +115,7 @@ public:
                             reactor_driver_t<protocol_t> *parent,
                             namespace_id_t namespace_id,
                             int64_t _cache_size,
+                            bool _compress_blocks,
                             const blueprint_t<protocol_t> &bp,
                             svs_by_namespace_t<protocol_t> *svs_by_namespace,
                             typename protocol_t::context_t *_ctx) :
@@ -124,7 +125,8 @@ public:
         parent_(parent),
         namespace_id_(namespace_id),
         svs_by_namespace_(svs_by_namespace),
-        cache_size(_cache_size)
+        cache_size(_cache_size),
+        compress_blocks(_compress_blocks)
     {
         coro_t::spawn_sometime(boost::bind(&watchable_and_reactor_t<protocol_t>::initialize_reactor, this, io_backender));
     }
@@ -307,7 +309,7 @@ private:
         perfmon_collection_t *serializers_collection = &perfmon_collections->serializers_collection;
 
         // TODO: We probably shouldn't have to pass in this perfmon collection.
-        svs_by_namespace_->get_svs(serializers_collection, namespace_id_, cache_size, &stores_lifetimer_, &svs_, ctx);
+        svs_by_namespace_->get_svs(serializers_collection, namespace_id_, cache_size, compress_blocks, &stores_lifetimer_, &svs_, ctx);
 
         reactor_.init(new reactor_t<protocol_t>(
             base_path,
@@ -356,6 +358,7 @@ private:
 
     scoped_ptr_t<typename watchable_t<directory_echo_wrapper_t<cow_ptr_t<reactor_business_card_t<protocol_t> > > >::subscription_t> reactor_directory_subscription_;
     int64_t cache_size;
+    bool compress_blocks;
 
     DISABLE_COPYING(watchable_and_reactor_t);
 };
@@ -471,8 +474,13 @@ void reactor_driver_t<protocol_t>::on_change() {
                                 it->second.get_ref().name.in_conflict() ? "Name in conflict" : it->second.get_ref().name.get().c_str());
                     }
 
+                    bool compress_blocks = false;
+                    if (!it->second.get_ref().compress_blocks.in_conflict()) {
+                        compress_blocks = it->second.get_ref().compress_blocks.get();
+                    }
+
                     namespace_id_t tmp = it->first;
-                    reactor_data.insert(tmp, new watchable_and_reactor_t<protocol_t>(base_path, io_backender, this, it->first, cache_size, bp, svs_by_namespace, ctx));
+                    reactor_data.insert(tmp, new watchable_and_reactor_t<protocol_t>(base_path, io_backender, this, it->first, cache_size, compress_blocks, bp, svs_by_namespace, ctx));
                 } else {
                     reactor_data.find(it->first)->second->watchable.set_value(bp);
                 }
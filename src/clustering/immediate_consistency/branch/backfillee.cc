@@ -196,12 +196,15 @@ void backfillee(
         and the version described in `end_point_mailbox` has been achieved. */
         mailbox_t<void(fifo_enforcer_write_token_t)> done_mailbox(
             mailbox_manager,
-            boost::bind(&push_finish_on_queue<protocol_t>, &chunk_queue, _1));
+            boost::bind(&push_finish_on_queue<protocol_t>, &chunk_queue, _1),
+            message_class_t::backfill);
 
         /* The backfiller will send individual chunks of the backfill to
-        `chunk_mailbox`. */
+        `chunk_mailbox`. Chunks go on the backfill stream so they don't delay
+        other traffic to this peer; `chunk_queue` puts them back in order. */
         mailbox_t<void(backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_mailbox(
-            mailbox_manager, boost::bind(&push_chunk_on_queue<protocol_t>, &chunk_queue, _1, _2));
+            mailbox_manager, boost::bind(&push_chunk_on_queue<protocol_t>, &chunk_queue, _1, _2),
+            message_class_t::backfill);
 
         /* The backfiller will register for allocations on the allocation
          * registration box. */
@@ -8,7 +8,8 @@
 #include "rpc/semilattice/view.hpp"
 #include "stl_utils.hpp"
 
-#define MAX_CHUNKS_OUT 5000
+// Chunks can carry up to BACKFILL_CHUNK_MAX_SIZE of data each.
+#define MAX_CHUNKS_OUT 1000
 
 inline state_timestamp_t get_earliest_timestamp_of_version_range(const version_range_t &vr) {
     return vr.earliest.timestamp;
@@ -105,6 +106,7 @@ public:
                                         mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_cont,
                                         fifo_enforcer_source_t *fifo_src,
                                         semaphore_t *chunk_semaphore,
+                                        backfill_throughput_t *throughput,
                                         backfiller_t<protocol_t> *backfiller)
         : start_point_(start_point),
           end_point_cont_(end_point_cont),
@@ -112,6 +114,7 @@ public:
           chunk_cont_(chunk_cont),
           fifo_src_(fifo_src),
           chunk_semaphore_(chunk_semaphore),
+          throughput_(throughput),
           backfiller_(backfiller) { }
 
     bool should_backfill_impl(const typename store_view_t<protocol_t>::metainfo_t &metainfo) {
@@ -120,6 +123,7 @@ public:
 
     void send_chunk(const typename protocol_t::backfill_chunk_t &chunk, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
         do_send_chunk<protocol_t>(mailbox_manager_, chunk_cont_, chunk, fifo_src_, chunk_semaphore_, interruptor);
+        throughput_->bytes_sent += chunk.get_data_size();
     }
 private:
     const region_map_t<protocol_t, version_range_t> *start_point_;
@@ -128,6 +132,7 @@ private:
     mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_cont_;
     fifo_enforcer_source_t *fifo_src_;
     semaphore_t *chunk_semaphore_;
+    backfill_throughput_t *throughput_;
     backfiller_t<protocol_t> *backfiller_;
 
     DISABLE_COPYING(backfiller_send_backfill_callback_t);
@@ -154,6 +159,8 @@ void backfiller_t<protocol_t>::on_backfill(backfill_session_id_t session_id,
     /* Set up a local progress monitor so people can query us for progress. */
     traversal_progress_combiner_t local_progress;
     map_insertion_sentry_t<backfill_session_id_t, traversal_progress_combiner_t *> display_progress(&local_backfill_progress, session_id, &local_progress);
+    backfill_throughput_t local_throughput;
+    map_insertion_sentry_t<backfill_session_id_t, backfill_throughput_t *> display_throughput(&local_backfill_throughput, session_id, &local_throughput);
 
     /* Set up a cond that gets pulsed if we're interrupted by either the
        backfillee stopping or the backfiller destructor being called, but don't
@@ -177,7 +184,7 @@ void backfiller_t<protocol_t>::on_backfill(backfill_session_id_t session_id,
         svs->new_read_token_pair(&send_backfill_token_pair);
 
         backfiller_send_backfill_callback_t<protocol_t>
-            send_backfill_cb(&start_point, end_point_cont, mailbox_manager, chunk_cont, &fifo_src, &chunk_semaphore, this);
+            send_backfill_cb(&start_point, end_point_cont, mailbox_manager, chunk_cont, &fifo_src, &chunk_semaphore, &local_throughput, this);
 
         /* Actually perform the backfill */
         svs->send_backfill(
@@ -223,14 +230,16 @@ void backfiller_t<protocol_t>::on_cancel_backfill(backfill_session_id_t session_
 
 template <class protocol_t>
 void backfiller_t<protocol_t>::request_backfill_progress(backfill_session_id_t session_id,
-                                                         mailbox_addr_t<void(std::pair<int, int>)> response_mbox,
+                                                         mailbox_addr_t<void(backfill_progress_report_t)> response_mbox,
                                                          auto_drainer_t::lock_t) {
     if (std_contains(local_backfill_progress, session_id) && local_backfill_progress[session_id]) {
         progress_completion_fraction_t fraction = local_backfill_progress[session_id]->guess_completion();
-        std::pair<int, int> pair_fraction = std::make_pair(fraction.estimate_of_released_nodes, fraction.estimate_of_total_nodes);
-        send(mailbox_manager, response_mbox, pair_fraction);
+        backfill_progress_report_t report(fraction.estimate_of_released_nodes,
+                                          fraction.estimate_of_total_nodes,
+                                          local_backfill_throughput[session_id]->bytes_per_sec());
+        send(mailbox_manager, response_mbox, report);
     } else {
-        send(mailbox_manager, response_mbox, std::make_pair(-1, -1));
+        send(mailbox_manager, response_mbox, backfill_progress_report_t());
     }
 
     //TODO indicate an error has occurred
@@ -12,6 +12,20 @@ template <class> class backfiller_send_backfill_callback_t;
 template <class> class semilattice_read_view_t;
 class traversal_progress_combiner_t;
 
+/* How much data a backfill has sent since it started, so that we can tell how
+fast it is going. */
+struct backfill_throughput_t {
+    backfill_throughput_t() : start_time(current_microtime()), bytes_sent(0) { }
+
+    double bytes_per_sec() const {
+        const microtime_t elapsed = current_microtime() - start_time;
+        return elapsed == 0 ? 0 : bytes_sent * static_cast<double>(MILLION) / elapsed;
+    }
+
+    microtime_t start_time;
+    int64_t bytes_sent;
+};
+
 /* If you construct a `backfiller_t` for a given store, then it will advertise
 its existence in the metadata and serve backfills over the network. Generally
 `backfiller_t` is constructed as a member of `replier_t`. */
@@ -46,7 +60,7 @@ private:
     void on_cancel_backfill(backfill_session_id_t session_id, UNUSED auto_drainer_t::lock_t);
 
     void request_backfill_progress(backfill_session_id_t session_id,
-                                   mailbox_addr_t<void(std::pair<int, int>)> response_mbox,
+                                   mailbox_addr_t<void(backfill_progress_report_t)> response_mbox,
                                    auto_drainer_t::lock_t);
 
     mailbox_manager_t *const mailbox_manager;
@@ -56,6 +70,7 @@ private:
 
     std::map<backfill_session_id_t, cond_t *> local_interruptors;
     std::map<backfill_session_id_t, traversal_progress_combiner_t *> local_backfill_progress;
+    std::map<backfill_session_id_t, backfill_throughput_t *> local_backfill_throughput;
     auto_drainer_t drainer;
 
     typename backfiller_business_card_t<protocol_t>::backfill_mailbox_t backfill_mailbox;
@@ -77,11 +77,14 @@ listener_t<protocol_t>::listener_t(const base_path_t &base_path,
         WRITE_QUEUE_SEMAPHORE_TRICKLE_FRACTION),
     enforce_max_outstanding_writes_from_broadcaster_(MAX_OUTSTANDING_WRITES_FROM_BROADCASTER),
     write_mailbox_(mailbox_manager_,
-        boost::bind(&listener_t::on_write, this, _1, _2, _3, _4, _5)),
+        boost::bind(&listener_t::on_write, this, _1, _2, _3, _4, _5),
+        message_class_t::replication),
     writeread_mailbox_(mailbox_manager_,
-        boost::bind(&listener_t::on_writeread, this, _1, _2, _3, _4, _5, _6)),
+        boost::bind(&listener_t::on_writeread, this, _1, _2, _3, _4, _5, _6),
+        message_class_t::replication),
     read_mailbox_(mailbox_manager_,
-        boost::bind(&listener_t::on_read, this, _1, _2, _3, _4, _5))
+        boost::bind(&listener_t::on_read, this, _1, _2, _3, _4, _5),
+        message_class_t::replication)
 {
     boost::optional<boost::optional<broadcaster_business_card_t<protocol_t> > > business_card =
         broadcaster_metadata->get();
@@ -247,11 +250,14 @@ listener_t<protocol_t>::listener_t(const base_path_t &base_path,
         WRITE_QUEUE_SEMAPHORE_TRICKLE_FRACTION),
     enforce_max_outstanding_writes_from_broadcaster_(MAX_OUTSTANDING_WRITES_FROM_BROADCASTER),
     write_mailbox_(mailbox_manager_,
-        boost::bind(&listener_t::on_write, this, _1, _2, _3, _4, _5)),
+        boost::bind(&listener_t::on_write, this, _1, _2, _3, _4, _5),
+        message_class_t::replication),
     writeread_mailbox_(mailbox_manager_,
-        boost::bind(&listener_t::on_writeread, this, _1, _2, _3, _4, _5, _6)),
+        boost::bind(&listener_t::on_writeread, this, _1, _2, _3, _4, _5, _6),
+        message_class_t::replication),
     read_mailbox_(mailbox_manager_,
-        boost::bind(&listener_t::on_read, this, _1, _2, _3, _4, _5))
+        boost::bind(&listener_t::on_read, this, _1, _2, _3, _4, _5),
+        message_class_t::replication)
 {
     branch_birth_certificate_t<protocol_t> this_branch_history;
     {
@@ -92,6 +92,23 @@ public:
 };
 
 
+/* What a backfiller says about how far along a backfill is: roughly how many
+btree nodes it has gone through out of how many (both are -1 if it doesn't know
+about the backfill), and how fast it has been sending data. */
+struct backfill_progress_report_t {
+    backfill_progress_report_t()
+        : released_nodes(-1), total_nodes(-1), bytes_per_sec(0) { }
+    backfill_progress_report_t(int _released_nodes, int _total_nodes, double _bytes_per_sec)
+        : released_nodes(_released_nodes), total_nodes(_total_nodes),
+          bytes_per_sec(_bytes_per_sec) { }
+
+    int released_nodes;
+    int total_nodes;
+    double bytes_per_sec;
+
+    RDB_MAKE_ME_SERIALIZABLE_3(released_nodes, total_nodes, bytes_per_sec);
+};
+
 /* `backfiller_business_card_t` represents a thing that is willing to serve
 backfills over the network. It appears in the directory. */
 
@@ -115,7 +132,7 @@ struct backfiller_business_card_t {
 
 
     /* Mailboxes used for requesting the progress of a backfill */
-    typedef mailbox_t<void(backfill_session_id_t, mailbox_addr_t<void(std::pair<int, int>)>)> request_progress_mailbox_t;
+    typedef mailbox_t<void(backfill_session_id_t, mailbox_addr_t<void(backfill_progress_report_t)>)> request_progress_mailbox_t;
 
     backfiller_business_card_t() { }
     backfiller_business_card_t(
@@ -16,7 +16,10 @@
  */
 
 #define SOFTWARE_NAME_STRING "RethinkDB"
-#define SERIALIZER_VERSION_STRING "1.11"
+// Data files are only opened by the serializer version that created them; there is
+// no in-place upgrade. Files from 1.11 and earlier (before LBA checkpoints) have to
+// be migrated with `rethinkdb dump` and `rethinkdb restore`.
+#define SERIALIZER_VERSION_STRING "1.12"
 
 /**
  * Basic configuration parameters.
@@ -64,12 +67,25 @@
 #define GC_IO_PRIORITY_NICE                       8
 #define GC_IO_PRIORITY_HIGH                       (4 * CACHE_WRITES_IO_PRIORITY)
 
+// Between those two, the GC is paced over GC_IO_PRIORITY_LEVELS accounts whose
+// priorities grow geometrically from GC_IO_PRIORITY_NICE to GC_IO_PRIORITY_HIGH.
+#define GC_IO_PRIORITY_LEVELS                     6
+
 // Size of the buffer used to perform IO operations (in bytes).
 #define IO_BUFFER_SIZE                            (4 * KILOBYTE)
 
 // Size of the device block size (in bytes)
 #define DEVICE_BLOCK_SIZE                         512
 
+// Disk-backed queues start a new segment file when the current one reaches this
+// size, and free a segment's space as soon as everything in it has been popped.
+#define DISK_BACKED_QUEUE_SEGMENT_SIZE            (16 * MEGABYTE)
+
+// How much a disk-backed queue buffers before writing it out, and how much it reads
+// at a time when popping (in bytes; multiples of DEVICE_BLOCK_SIZE)
+#define DISK_BACKED_QUEUE_WRITE_BATCH_SIZE        MEGABYTE
+#define DISK_BACKED_QUEUE_READ_AHEAD_SIZE         MEGABYTE
+
 // Size of the metablock (in bytes)
 #define METABLOCK_SIZE                            (4 * KILOBYTE)
 
@@ -88,6 +104,13 @@
 // TODO: make this dynamic where possible
 #define MAX_THREADS                               128
 
+// How often (in nanosecond ticks) each thread updates its utilization estimate
+#define THREAD_UTILIZATION_INTERVAL_TICKS         (100 * MILLION)
+
+// New client connections go to the least loaded thread instead of the next one in
+// turn if the next one's utilization is higher than that by more than this.
+#define THREAD_OVERLOAD_MARGIN                    0.25
+
 // Ticks (in milliseconds) the internal timed tasks are performed at
 #define TIMER_TICKS_IN_MS                         5
 
@@ -116,6 +139,13 @@
 // then the page replacement algorithm will on average be unable to evict pages from the cache.
 #define PAGE_REPL_NUM_TRIES                       10
 
+// The fraction of the cache that the 2Q page replacement policy sets aside for blocks that
+// have only been accessed once since they were loaded.
+#define PAGE_REPL_2Q_A1_FRACTION                  0.25
+
+// The page replacement algorithm caches use unless told otherwise.
+#define DEFAULT_PAGE_REPL_POLICY                  page_repl_policy_t::two_queue
+
 // How large can the key be, in bytes?  This value needs to fit in a byte.
 #define MAX_KEY_SIZE                              250
 
@@ -172,6 +202,15 @@
 // What's the definition of a "young" extent in microseconds?
 #define GC_YOUNG_EXTENT_TIMELIMIT_MICROS          50000
 
+// How often the GC re-evaluates the ages in its cost-benefit ordering of old extents.
+// In between, extents are ordered as if no time had passed.
+#define GC_SCORE_REFRESH_INTERVAL_MICROS          (1000 * 1000)
+
+// How often the GC samples the garbage ratio to estimate its trend, and how far
+// ahead it projects that trend to decide how hard to work.
+#define GC_TREND_SAMPLE_INTERVAL_MICROS           (100 * 1000)
+#define GC_TREND_HORIZON_SECS                     10.0
+
 // If the size of the LBA on a given disk exceeds LBA_MIN_SIZE_FOR_GC, then the fraction of the
 // entries that are live and not garbage should be at least LBA_MIN_UNGARBAGE_FRACTION.
 // TODO: Maybe change this back to 20 megabytes?
@@ -188,6 +227,15 @@
 // TODO (daniel): Tune
 #define LBA_INLINE_SIZE                           (METABLOCK_SIZE - 512)
 
+// An LBA checkpoint is written once startup would have to replay at least
+// DEFAULT_LBA_CHECKPOINT_MIN_ENTRIES LBA entries, and at least
+// DEFAULT_LBA_CHECKPOINT_REPLAY_RATIO times as many entries as there are blocks.
+#define DEFAULT_LBA_CHECKPOINT_MIN_ENTRIES        (256 * THOUSAND)
+#define DEFAULT_LBA_CHECKPOINT_REPLAY_RATIO       0.5
+
+// I/O priority for writing LBA checkpoints
+#define LBA_CHECKPOINT_IO_PRIORITY                GC_IO_PRIORITY_NICE
+
 // How many bytes of buffering space we can use per disk when reading the LBA. If it's set
 // too high, then RethinkDB will eat a lot of memory at startup. This is bad because tcmalloc
 // doesn't return memory to the OS. If it's set too low, startup will take a longer time.
@@ -195,8 +243,95 @@
 
 #define COROUTINE_STACK_SIZE                      131072
 
+// Stack sizes for coroutines that ask for a small or a large stack; the usual size
+// is COROUTINE_STACK_SIZE, or whatever is set on the command line.
+#define SMALL_COROUTINE_STACK_SIZE                32768
+#define LARGE_COROUTINE_STACK_SIZE                (1024 * 1024)
+
+// Each thread lets this many idle coroutines of each stack size keep the memory
+// their stacks touched; the memory of the others goes back to the OS.
+#define COROUTINE_WARM_STACKS_PER_CLASS           64
+
+// Each thread looks for idle coroutine stacks beyond the warm ones once per this
+// many finished coroutines.
+#define COROUTINE_STACK_TRIM_INTERVAL             1000
+
+// One in this many coroutine runs measures how much of its stack it touched.
+#define COROUTINE_STACK_USAGE_SAMPLE_INTERVAL     1000
+
 #define MAX_COROS_PER_THREAD                      10000
 
+// How many batches of a range read `batched_rget_stream_t` fetches ahead of its
+// consumer, and how much data those batches may add up to before it stops (it
+// always lets at least one read through).  A depth of 0 turns read-ahead off.
+#define RGET_PREFETCH_MAX_BATCHES                 2
+#define RGET_PREFETCH_MAX_SIZE                    (4 * MEGABYTE)
+
+// The bulk secondary index builder sorts index entries in memory until they take
+// up SINDEX_BULK_BUILD_RUN_SIZE bytes, then spills them to disk as a sorted run of
+// SINDEX_BULK_BUILD_SPILL_CHUNK entries per queue element.  It inserts
+// SINDEX_BULK_BUILD_WRITE_BATCH entries per write transaction.
+#define SINDEX_BULK_BUILD_RUN_SIZE                (64 * MEGABYTE)
+#define SINDEX_BULK_BUILD_SPILL_CHUNK             1000
+#define SINDEX_BULK_BUILD_WRITE_BATCH             256
+
+// `orderBy` sorts in memory until the (serialized) documents it holds take up
+// SORT_MEMORY_BUDGET bytes, then spills them to disk as a sorted run of
+// SORT_SPILL_CHUNK documents per queue element, and merges the runs as the
+// result gets read.  The runs' queue buffers count against the same budget; runs
+// get merged together early rather than take up more than half of it.
+#define SORT_MEMORY_BUDGET                        (64 * MEGABYTE)
+#define SORT_SPILL_CHUNK                          1000
+
+// `getAll` and `eqJoin` on a primary key look up to POINT_READ_BATCH_SIZE keys per
+// batched point read; `eqJoin` reads that many rows of its left side at a time.
+#define POINT_READ_BATCH_SIZE                     256
+
+// `innerJoin` and `outerJoin` on an equality of fields hash their right side in
+// memory until its rows take up JOIN_MEMORY_BUDGET bytes serialized.  Past that,
+// both sides get split by key into up to JOIN_SPILL_PARTITIONS partitions, which
+// are spilled to disk JOIN_SPILL_CHUNK rows per queue element and joined one by
+// one.  The partitions' queue buffers take up at most half the budget, which can
+// mean fewer partitions.
+#define JOIN_MEMORY_BUDGET                        (64 * MEGABYTE)
+#define JOIN_SPILL_PARTITIONS                     32
+#define JOIN_SPILL_CHUNK                          1000
+
+// When unsharding a grouped map reduce whose shards returned at least this many
+// groups between them, the shard results are folded together on several threads.
+#define UNSHARD_PARALLEL_GMR_MIN_GROUPS           1024
+
+// Cluster messages at least this big are handed to the socket in place with
+// writev(); smaller ones are copied into the connection's write buffer, where
+// they can share a syscall with the messages sent right after them.
+#define CLUSTER_MESSAGE_ZERO_COPY_SIZE            (16 * KILOBYTE)
+
+// How many TCP connections a node opens to each peer it connects to. Control
+// messages use the first one; replication traffic and backfills get their own
+// while there are enough (see `message_class_t`). 1 sends everything on one.
+#define CLUSTER_STREAMS_PER_PEER                  3
+
+// How many times, and how far apart, we try to attach each of those extra
+// connections before giving up and leaving its messages on the first one.
+#define CLUSTER_STREAM_CONNECT_ATTEMPTS           10
+#define CLUSTER_STREAM_CONNECT_RETRY_MS           100
+
+// The rdb backfiller packs the key/value pairs it finds into chunks of about
+// BACKFILL_CHUNK_MAX_SIZE serialized bytes, and compresses each chunk with zlib at
+// BACKFILL_CHUNK_COMPRESSION_LEVEL if that makes it smaller. 0 turns compression off.
+#define BACKFILL_CHUNK_MAX_SIZE                   (64 * KILOBYTE)
+#define BACKFILL_CHUNK_COMPRESSION_LEVEL          1
+
+// TCP connections get their read buffers from per-thread pools, in sizes of
+// IO_BUFFER_SIZE << i for i < TCP_READ_BUFFER_SIZES; bigger ones aren't pooled.
+// Each thread keeps up to TCP_BUFFER_POOL_MAX_BYTES_PER_SIZE bytes of free buffers
+// of each size (write buffers included), and frees the rest.
+#define TCP_READ_BUFFER_SIZES                     9
+#define TCP_BUFFER_POOL_MAX_BYTES_PER_SIZE        MEGABYTE
+
+// Each thread keeps the REGEX_CACHE_SIZE regular expressions that `match` compiled
+// most recently, so that patterns that aren't constants don't get recompiled per row.
+#define REGEX_CACHE_SIZE                          256
 
 // Size of a cache line (used in cache_line_padded_t).
 #define CACHE_LINE_SIZE                           64
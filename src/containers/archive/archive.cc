@@ -8,6 +8,7 @@
 
 #include "containers/uuid.hpp"
 #include "rpc/serialize_macros.hpp"
+#include "thread_local.hpp"
 
 int64_t force_read(read_stream_t *s, void *p, int64_t n) {
     rassert(n >= 0);
@@ -33,17 +34,56 @@ int64_t force_read(read_stream_t *s, void *p, int64_t n) {
     return written_so_far;
 }
 
+// The most buffers a thread keeps around for reuse.
+const int WRITE_BUFFER_FREE_LIST_MAX = 256;
+
+// Free buffers are chained through the start of their `data`.
+TLS_with_init(write_buffer_t *, free_write_buffers, NULL)
+TLS_with_init(int, num_free_write_buffers, 0)
+
+write_buffer_t *write_buffer_t::allocate() {
+    write_buffer_t *buffer = TLS_get_free_write_buffers();
+    if (buffer == NULL) {
+        return new write_buffer_t;
+    }
+    write_buffer_t *next;
+    memcpy(&next, buffer->data, sizeof(next));
+    TLS_set_free_write_buffers(next);
+    TLS_set_num_free_write_buffers(TLS_get_num_free_write_buffers() - 1);
+    buffer->size = 0;
+    return buffer;
+}
+
+void write_buffer_t::release(write_buffer_t *buffer) {
+    if (TLS_get_num_free_write_buffers() >= WRITE_BUFFER_FREE_LIST_MAX) {
+        delete buffer;
+        return;
+    }
+    write_buffer_t *next = TLS_get_free_write_buffers();
+    memcpy(buffer->data, &next, sizeof(next));
+    TLS_set_free_write_buffers(buffer);
+    TLS_set_num_free_write_buffers(TLS_get_num_free_write_buffers() + 1);
+}
+
 write_message_t::~write_message_t() {
     while (write_buffer_t *buffer = buffers_.head()) {
         buffers_.remove(buffer);
-        delete buffer;
+        write_buffer_t::release(buffer);
+    }
+}
+
+int64_t write_message_t::size() const {
+    int64_t ret = 0;
+    for (write_buffer_t *p = buffers_.head(); p; p = buffers_.next(p)) {
+        ret += p->size;
     }
+    return ret;
 }
 
 void write_message_t::append(const void *p, int64_t n) {
     while (n > 0) {
         if (buffers_.empty() || buffers_.tail()->size == write_buffer_t::DATA_SIZE) {
-            buffers_.push_back(new write_buffer_t);
+            buffers_.push_back(write_buffer_t::allocate());
         }
 
         write_buffer_t *b = buffers_.tail();
@@ -76,6 +76,11 @@ class write_buffer_t : public intrusive_list_node_t<write_buffer_t> {
 public:
     write_buffer_t() : size(0) { }
 
+    // Buffers are recycled through a small per-thread free list, because
+    // messages get built up and torn down all the time.
+    static write_buffer_t *allocate();
+    static void release(write_buffer_t *buffer);
+
     static const int DATA_SIZE = 4096;
     int size;
     char data[DATA_SIZE];
@@ -97,6 +102,9 @@ public:
 
     void append(const void *p, int64_t n);
 
+    // The number of bytes in the message.
+    int64_t size() const;
+
     intrusive_list_t<write_buffer_t> *unsafe_expose_buffers() { return &buffers_; }
 
     template <class T>
@@ -121,6 +129,24 @@ write_message_t &operator<<(write_message_t& msg, const T &x) {
 // Returns 0 upon success, -1 upon failure.
 MUST_USE int send_write_message(write_stream_t *s, const write_message_t *msg);
 
+// A write stream that appends everything written to it to a `write_message_t`,
+// so that code which writes to streams can fill a message's buffers directly.
+class write_message_stream_t : public write_stream_t {
+public:
+    explicit write_message_stream_t(write_message_t *_msg) : msg(_msg) { }
+    virtual ~write_message_stream_t() { }
+
+    virtual int64_t write(const void *p, int64_t n) {
+        msg->append(p, n);
+        return n;
+    }
+
+private:
+    write_message_t *msg;
+
+    DISABLE_COPYING(write_message_stream_t);
+};
+
 template <class T>
 T *deserialize_deref(T &val) {
     return &val;
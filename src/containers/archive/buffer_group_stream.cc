@@ -28,3 +28,18 @@ int64_t buffer_group_read_stream_t::read(void *p, int64_t n) {
 
     return original_n - n;
 }
+
+void buffer_group_read_stream_t::seek(int64_t offset) {
+    rassert(offset >= 0);
+    bufnum_ = 0;
+    bufpos_ = 0;
+    while (bufnum_ < group_->num_buffers()) {
+        const_buffer_group_t::buffer_t buf = group_->get_buffer(bufnum_);
+        if (offset < buf.size) {
+            bufpos_ = offset;
+            return;
+        }
+        offset -= buf.size;
+        ++bufnum_;
+    }
+}
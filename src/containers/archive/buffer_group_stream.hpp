@@ -14,6 +14,10 @@ public:
 
     virtual MUST_USE int64_t read(void *p, int64_t n);
 
+    // Moves the read position to `offset` bytes from the start of the group.  A
+    // position past the end of the group just makes subsequent reads return 0.
+    void seek(int64_t offset);
+
 private:
     const const_buffer_group_t *group_;
     size_t bufnum_;
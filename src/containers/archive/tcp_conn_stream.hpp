@@ -2,6 +2,8 @@
 #ifndef CONTAINERS_ARCHIVE_TCP_CONN_STREAM_HPP_
 #define CONTAINERS_ARCHIVE_TCP_CONN_STREAM_HPP_
 
+#include <sys/uio.h>
+
 #include "containers/archive/archive.hpp"
 #include "arch/address.hpp"
 #include "arch/types.hpp"
@@ -19,6 +21,16 @@ public:
     virtual MUST_USE int64_t read(void *p, int64_t n);
     virtual MUST_USE int64_t write(const void *p, int64_t n);
 
+    // Like `write()`, but sends several buffers without copying them.
+    virtual MUST_USE int64_t writev(const iovec *iov, size_t iovcnt);
+
+    // Like `write()`, but the data may sit in the connection's write buffer
+    // until the next `write()`, `writev()` or `flush_buffer()`.
+    virtual MUST_USE int64_t write_buffered(const void *p, int64_t n);
+
+    // Returns 0, or -1 upon error.
+    MUST_USE int flush_buffer();
+
     void rethread(threadnum_t new_thread);
 
     threadnum_t home_thread() const;
@@ -57,6 +69,8 @@ public:
 
     virtual MUST_USE int64_t read(void *p, int64_t n);
     virtual MUST_USE int64_t write(const void *p, int64_t n);
+    virtual MUST_USE int64_t writev(const iovec *iov, size_t iovcnt);
+    virtual MUST_USE int64_t write_buffered(const void *p, int64_t n);
 
 private:
     keepalive_callback_t *keepalive_callback;
@@ -1,84 +1,62 @@
-// Copyright 2010-2012 RethinkDB, all rights reserved.
+// Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "containers/disk_backed_queue.hpp"
 
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "arch/arch.hpp"
 #include "arch/io/disk.hpp"
-#include "buffer_cache/blob.hpp"
-#include "buffer_cache/buffer_cache.hpp"
-#include "serializer/config.hpp"
 
-internal_disk_backed_queue_t::internal_disk_backed_queue_t(io_backender_t *io_backender,
+internal_disk_backed_queue_t::internal_disk_backed_queue_t(io_backender_t *_io_backender,
                                                            const serializer_filepath_t &filename,
                                                            perfmon_collection_t *stats_parent)
     : perfmon_membership(stats_parent, &perfmon_collection,
                          filename.permanent_path().c_str()),
+      pm_stats_membership(&perfmon_collection,
+                          &pm_segments, "segments",
+                          &pm_bytes_written, "bytes_written",
+                          &pm_bytes_read, "bytes_read",
+                          NULLPTR),
+      io_backender(_io_backender),
+      segment_path_prefix(filename.permanent_path()),
+      next_segment_number(0),
       queue_size(0),
-      head_block_id(NULL_BLOCK_ID),
-      tail_block_id(NULL_BLOCK_ID) {
-    filepath_file_opener_t file_opener(filename, io_backender);
-    standard_serializer_t::create(&file_opener,
-                                  standard_serializer_t::static_config_t());
-
-    serializer.init(new standard_serializer_t(standard_serializer_t::dynamic_config_t(),
-                                              &file_opener,
-                                              &perfmon_collection));
-
-    /* Remove the file we just created from the filesystem, so that it will
-       get deleted as soon as the serializer is destroyed or if the process
-       crashes. */
-    file_opener.unlink_serializer_file();
-
-    /* Create the cache. */
-    cache_t::create(serializer.get());
-
-    mirrored_cache_config_t cache_dynamic_config;
-    cache_dynamic_config.max_size = MEGABYTE;
-    cache_dynamic_config.max_dirty_size = MEGABYTE / 2;
-    cache.init(new cache_t(serializer.get(), cache_dynamic_config, &perfmon_collection));
+      write_buffer(malloc_aligned(DISK_BACKED_QUEUE_WRITE_BATCH_SIZE, DEVICE_BLOCK_SIZE)),
+      write_buffer_offset(0),
+      read_buffer(malloc_aligned(DISK_BACKED_QUEUE_READ_AHEAD_SIZE, DEVICE_BLOCK_SIZE)),
+      read_buffer_offset(0),
+      read_buffer_size(0) {
+    CT_ASSERT(DISK_BACKED_QUEUE_WRITE_BATCH_SIZE % DEVICE_BLOCK_SIZE == 0);
+    CT_ASSERT(DISK_BACKED_QUEUE_READ_AHEAD_SIZE % DEVICE_BLOCK_SIZE == 0);
+    add_segment();
 }
 
-internal_disk_backed_queue_t::~internal_disk_backed_queue_t() { }
+internal_disk_backed_queue_t::~internal_disk_backed_queue_t() {
+    while (!segments.empty()) {
+        remove_front_segment();
+    }
+}
 
 void internal_disk_backed_queue_t::push(const write_message_t &wm) {
     mutex_t::acq_t mutex_acq(&mutex);
 
-    // First, we need a transaction.
-    transaction_t txn(cache.get(),
-                      rwi_write,
-                      2,
-                      repli_timestamp_t::distant_past,
-                      cache_order_source.check_in("push"),
-                      WRITE_DURABILITY_SOFT /* No need for durability with unlinked dbq file. */);
-
-    if (head_block_id == NULL_BLOCK_ID) {
-        add_block_to_head(&txn);
-    }
-
-    scoped_ptr_t<buf_lock_t> _head(new buf_lock_t(&txn, head_block_id, rwi_write));
-    queue_block_t *head = reinterpret_cast<queue_block_t *>(_head->get_data_write());
-
     vector_stream_t stream;
     int res = send_write_message(&stream, &wm);
     guarantee(res == 0);
 
-    char buffer[MAX_REF_SIZE];
-    bzero(buffer, MAX_REF_SIZE);
-
-    blob_t blob(txn.get_cache()->get_block_size(), buffer, MAX_REF_SIZE);
-    blob.append_region(&txn, stream.vector().size());
-    std::string sered_data(stream.vector().begin(), stream.vector().end());
-    blob.write_from_string(sered_data, &txn, 0);
-
-    if (static_cast<size_t>((head->data + head->data_size) - reinterpret_cast<char *>(head)) + blob.refsize(cache->get_block_size()) > cache->get_block_size().value()) {
-        // The data won't fit in our current head block, so it's time to make a new one.
-        head = NULL;
-        _head.reset();
-        add_block_to_head(&txn);
-        _head.init(new buf_lock_t(&txn, head_block_id, rwi_write));
-        head = reinterpret_cast<queue_block_t *>(_head->get_data_write());
+    const uint64_t entry_size = stream.vector().size();
+    segment_t *back = segments.back();
+    if (back->write_offset > 0
+        && back->write_offset + sizeof(entry_size) + entry_size > DISK_BACKED_QUEUE_SEGMENT_SIZE) {
+        // The entry doesn't fit in the back segment, so it's time to start a new one.
+        flush_write_buffer();
+        add_segment();
     }
 
-    memcpy(head->data + head->data_size, buffer, blob.refsize(cache->get_block_size()));
-    head->data_size += blob.refsize(cache->get_block_size());
+    append(reinterpret_cast<const char *>(&entry_size), sizeof(entry_size));
+    append(stream.vector().data(), entry_size);
 
     queue_size++;
 }
@@ -87,50 +65,27 @@ void internal_disk_backed_queue_t::pop(std::vector<char> *buf_out) {
     guarantee(size() != 0);
     mutex_t::acq_t mutex_acq(&mutex);
 
-    char buffer[MAX_REF_SIZE];
-    transaction_t txn(cache.get(),
-                      rwi_write,
-                      2,
-                      repli_timestamp_t::distant_past,
-                      cache_order_source.check_in("pop"),
-                      WRITE_DURABILITY_SOFT /* No durability for unlinked dbq file. */);
-
-    scoped_ptr_t<buf_lock_t> _tail(new buf_lock_t(&txn, tail_block_id, rwi_write));
-    queue_block_t *tail = reinterpret_cast<queue_block_t *>(_tail->get_data_write());
-    rassert(tail->data_size != tail->live_data_offset);
-
-    /* Grab the data from the blob and delete it. */
-
-    memcpy(buffer, tail->data + tail->live_data_offset, blob::ref_size(cache->get_block_size(), tail->data + tail->live_data_offset, MAX_REF_SIZE));
-    std::vector<char> data_vec;
-
-    blob_t blob(txn.get_cache()->get_block_size(), buffer, MAX_REF_SIZE);
-    {
-        blob_acq_t acq_group;
-        buffer_group_t blob_group;
-        blob.expose_all(&txn, rwi_read, &blob_group, &acq_group);
-
-        data_vec.resize(blob_group.get_size());
-        buffer_group_t data_vec_group;
-        data_vec_group.add_buffer(data_vec.size(), data_vec.data());
-        buffer_group_copy_data(&data_vec_group, const_view(&blob_group));
-    }
-
-    /* Record how far along in the blob we are. */
-    tail->live_data_offset += blob.refsize(cache->get_block_size());
-
-    blob.clear(&txn);
+    uint64_t entry_size;
+    read_from_front(reinterpret_cast<char *>(&entry_size), sizeof(entry_size));
+    std::vector<char> data_vec(entry_size);
+    read_from_front(data_vec.data(), entry_size);
 
     queue_size--;
 
-    /* If that was the last blob in this block move on to the next one. */
-    if (tail->live_data_offset == tail->data_size) {
-        _tail.reset();
-        remove_block_from_tail(&txn);
+    segment_t *front = segments.front();
+    if (front->read_offset == front->write_offset) {
+        if (segments.size() > 1) {
+            remove_front_segment();
+        } else {
+            /* The queue is empty; start over at the beginning of the segment
+            instead of letting it grow. */
+            rassert(queue_size == 0);
+            front->write_offset = front->read_offset = 0;
+            write_buffer_offset = 0;
+            read_buffer_size = 0;
+        }
     }
 
-    /* Deserialize the value and return it. */
-
     buf_out->swap(data_vec);
 }
 
@@ -142,37 +97,107 @@ int64_t internal_disk_backed_queue_t::size() {
     return queue_size;
 }
 
-void internal_disk_backed_queue_t::add_block_to_head(transaction_t *txn) {
-    buf_lock_t _new_head(txn);
-    queue_block_t *new_head = reinterpret_cast<queue_block_t *>(_new_head.get_data_write());
-    if (head_block_id == NULL_BLOCK_ID) {
-        rassert(tail_block_id == NULL_BLOCK_ID);
-        head_block_id = tail_block_id = _new_head.get_block_id();
-    } else {
-        buf_lock_t _old_head(txn, head_block_id, rwi_write);
-        queue_block_t *old_head = reinterpret_cast<queue_block_t *>(_old_head.get_data_write());
-        rassert(old_head->next == NULL_BLOCK_ID);
-        old_head->next = _new_head.get_block_id();
-        head_block_id = _new_head.get_block_id();
+void internal_disk_backed_queue_t::add_segment() {
+    const std::string path = strprintf("%s.%" PRIi64, segment_path_prefix.c_str(),
+                                       next_segment_number++);
+
+    scoped_ptr_t<segment_t> segment(new segment_t);
+    const file_open_result_t res = open_file(path.c_str(),
+                                             linux_file_t::mode_read | linux_file_t::mode_write
+                                             | linux_file_t::mode_create | linux_file_t::mode_truncate,
+                                             io_backender,
+                                             &segment->file);
+    if (res.outcome == file_open_result_t::ERROR) {
+        crash_due_to_inaccessible_database_file(path.c_str(), res);
     }
 
-    new_head->next = NULL_BLOCK_ID;
-    new_head->data_size = 0;
-    new_head->live_data_offset = 0;
+    /* Remove the file we just created from the filesystem, so that it will get
+    deleted as soon as we close it or if the process crashes. */
+    const int unlink_res = unlink(path.c_str());
+    guarantee_err(unlink_res == 0, "unlink() failed");
+
+    segment->file->set_size(DISK_BACKED_QUEUE_SEGMENT_SIZE);
+    segment->write_offset = 0;
+    segment->read_offset = 0;
+    segments.push_back(segment.release());
+    write_buffer_offset = 0;
+    ++pm_segments;
 }
 
-void internal_disk_backed_queue_t::remove_block_from_tail(transaction_t *txn) {
-    rassert(tail_block_id != NULL_BLOCK_ID);
-    buf_lock_t _old_tail(txn, tail_block_id, rwi_write);
-    queue_block_t *old_tail = reinterpret_cast<queue_block_t *>(_old_tail.get_data_write());
+void internal_disk_backed_queue_t::remove_front_segment() {
+    delete segments.front();
+    segments.pop_front();
+    read_buffer_size = 0;
+    --pm_segments;
+}
 
-    if (old_tail->next == NULL_BLOCK_ID) {
-        rassert(head_block_id == _old_tail.get_block_id());
-        tail_block_id = head_block_id = NULL_BLOCK_ID;
-    } else {
-        tail_block_id = old_tail->next;
+void internal_disk_backed_queue_t::append(const char *data, size_t size) {
+    segment_t *back = segments.back();
+    while (size > 0) {
+        const int64_t used = back->write_offset - write_buffer_offset;
+        const size_t chunk = std::min<size_t>(size, DISK_BACKED_QUEUE_WRITE_BATCH_SIZE - used);
+        memcpy(write_buffer.get() + used, data, chunk);
+        back->write_offset += chunk;
+        data += chunk;
+        size -= chunk;
+
+        if (back->write_offset - write_buffer_offset == DISK_BACKED_QUEUE_WRITE_BATCH_SIZE) {
+            flush_write_buffer();
+        }
     }
+}
 
-    _old_tail.mark_deleted();
+void internal_disk_backed_queue_t::flush_write_buffer() {
+    segment_t *back = segments.back();
+    const int64_t used = back->write_offset - write_buffer_offset;
+    if (used == 0) {
+        return;
+    }
+
+    // The last block may be partial; it gets written again once it fills up.
+    const int64_t length = ceil_aligned(used, DEVICE_BLOCK_SIZE);
+    back->file->set_size_at_least(write_buffer_offset + length);
+    co_write(back->file.get(), write_buffer_offset, length, write_buffer.get(),
+             DEFAULT_DISK_ACCOUNT, file_t::NO_DATASYNCS);
+    pm_bytes_written += length;
+
+    const int64_t new_write_buffer_offset = floor_aligned(back->write_offset, DEVICE_BLOCK_SIZE);
+    memmove(write_buffer.get(),
+            write_buffer.get() + (new_write_buffer_offset - write_buffer_offset),
+            back->write_offset - new_write_buffer_offset);
+    write_buffer_offset = new_write_buffer_offset;
 }
 
+void internal_disk_backed_queue_t::read_from_front(char *data, size_t size) {
+    segment_t *front = segments.front();
+    rassert(front->read_offset + static_cast<int64_t>(size) <= front->write_offset);
+
+    while (size > 0) {
+        size_t chunk;
+        if (front == segments.back() && front->read_offset >= write_buffer_offset) {
+            // It hasn't been written out yet.
+            chunk = size;
+            memcpy(data, write_buffer.get() + (front->read_offset - write_buffer_offset), chunk);
+        } else {
+            if (front->read_offset < read_buffer_offset
+                || front->read_offset >= read_buffer_offset + read_buffer_size) {
+                /* Read ahead as far as what has been written out, which always
+                ends at a block boundary. */
+                const int64_t written_end = front == segments.back()
+                    ? write_buffer_offset
+                    : ceil_aligned(front->write_offset, DEVICE_BLOCK_SIZE);
+                read_buffer_offset = floor_aligned(front->read_offset, DEVICE_BLOCK_SIZE);
+                read_buffer_size = std::min<int64_t>(DISK_BACKED_QUEUE_READ_AHEAD_SIZE,
+                                                     written_end - read_buffer_offset);
+                co_read(front->file.get(), read_buffer_offset, read_buffer_size,
+                        read_buffer.get(), DEFAULT_DISK_ACCOUNT);
+                pm_bytes_read += read_buffer_size;
+            }
+            chunk = std::min<size_t>(size, read_buffer_offset + read_buffer_size - front->read_offset);
+            memcpy(data, read_buffer.get() + (front->read_offset - read_buffer_offset), chunk);
+        }
+        front->read_offset += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
@@ -2,31 +2,29 @@
 #ifndef CONTAINERS_DISK_BACKED_QUEUE_HPP_
 #define CONTAINERS_DISK_BACKED_QUEUE_HPP_
 
-#define MAX_REF_SIZE 251
-
+#include <deque>
 #include <string>
 #include <vector>
 
-#include "buffer_cache/types.hpp"
-#include "concurrency/fifo_checker.hpp"
 #include "concurrency/mutex.hpp"
 #include "containers/archive/vector_stream.hpp"
 #include "containers/scoped.hpp"
-#include "perfmon/core.hpp"
+#include "perfmon/perfmon.hpp"
 #include "serializer/types.hpp"
 
+class file_t;
 class io_backender_t;
-class perfmon_collection_t;
 
 //TODO there are extra copies all over the place mostly stemming from having a
-//vector<char> from the serialization code and strings from the blob code.
-
-struct queue_block_t {
-    block_id_t next;
-    int data_size, live_data_offset;
-    char data[0];
-};
-
+//vector<char> from the serialization code.
+
+/* `internal_disk_backed_queue_t` appends entries to a sequence of segment files
+and reads them back from the front. Each entry is its size followed by its
+serialized data. Writes are batched in a buffer of DISK_BACKED_QUEUE_WRITE_BATCH_SIZE,
+and reads fetch DISK_BACKED_QUEUE_READ_AHEAD_SIZE at a time. A segment file gets
+closed, which frees its space, as soon as everything in it has been popped. The
+files are unlinked as soon as they are created, so nothing is left behind after a
+crash; for the same reason, nothing is ever synced to disk. */
 class internal_disk_backed_queue_t {
 public:
     internal_disk_backed_queue_t(io_backender_t *io_backender, const serializer_filepath_t& filename, perfmon_collection_t *stats_parent);
@@ -43,21 +41,50 @@ public:
     int64_t size();
 
 private:
-    void add_block_to_head(transaction_t *txn);
+    struct segment_t {
+        scoped_ptr_t<file_t> file;
+        // Where the next entry gets appended
+        int64_t write_offset;
+        // Where the next entry to pop starts
+        int64_t read_offset;
+    };
+
+    void add_segment();
+    void remove_front_segment();
 
-    void remove_block_from_tail(transaction_t *txn);
+    void append(const char *data, size_t size);
+    void flush_write_buffer();
+
+    void read_from_front(char *data, size_t size);
 
     mutex_t mutex;
 
-    // Serves more as sanity-checking for the cache than this type's ordering.
-    order_source_t cache_order_source;
     perfmon_collection_t perfmon_collection;
     perfmon_membership_t perfmon_membership;
+    perfmon_counter_t pm_segments;
+    perfmon_counter_t pm_bytes_written;
+    perfmon_counter_t pm_bytes_read;
+    perfmon_multi_membership_t pm_stats_membership;
+
+    io_backender_t *const io_backender;
+    const std::string segment_path_prefix;
+    int64_t next_segment_number;
 
     int64_t queue_size;
-    block_id_t head_block_id, tail_block_id;
-    scoped_ptr_t<standard_serializer_t> serializer;
-    scoped_ptr_t<cache_t> cache;
+
+    // The segments, oldest first. Entries are only appended to the back one.
+    std::deque<segment_t *> segments;
+
+    // The end of the back segment, from write_buffer_offset (which is aligned to
+    // DEVICE_BLOCK_SIZE) up to its write_offset.
+    scoped_malloc_t<char> write_buffer;
+    int64_t write_buffer_offset;
+
+    // Read ahead from the front segment, starting at read_buffer_offset. Nothing
+    // that has been read into it can change until the segment goes away.
+    scoped_malloc_t<char> read_buffer;
+    int64_t read_buffer_offset;
+    int64_t read_buffer_size;
 
     DISABLE_COPYING(internal_disk_backed_queue_t);
 };
@@ -54,6 +54,10 @@ public:
     void remove(entry_t *);
     T pop();
     void update(int);
+    /* \brief rebuild() restores the order of the whole queue, for when a change
+     * affects the ordering of every element at once
+     */
+    void rebuild();
 public:
     void validate();
 
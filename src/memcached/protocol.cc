@@ -385,6 +385,19 @@ public:
     }
 };
 
+struct backfill_chunk_get_data_size_visitor_t : public boost::static_visitor<int64_t> {
+public:
+    int64_t operator()(const backfill_chunk_t::delete_key_t &del) {
+        return del.key.size();
+    }
+    int64_t operator()(const backfill_chunk_t::delete_range_t &) {
+        return 0;
+    }
+    int64_t operator()(const backfill_chunk_t::key_value_pair_t &kv) {
+        return kv.backfill_atom.key.size() + kv.backfill_atom.value->size();
+    }
+};
+
 }   /* anonymous namespace */
 
 repli_timestamp_t backfill_chunk_t::get_btree_repli_timestamp() const THROWS_NOTHING {
@@ -392,6 +405,11 @@ repli_timestamp_t backfill_chunk_t::get_btree_repli_timestamp() const THROWS_NOT
     return boost::apply_visitor(v, val);
 }
 
+int64_t backfill_chunk_t::get_data_size() const THROWS_NOTHING {
+    backfill_chunk_get_data_size_visitor_t v;
+    return boost::apply_visitor(v, val);
+}
+
 region_t memcached_protocol_t::cpu_sharding_subspace(int subregion_number, int num_cpu_shards) {
     guarantee(subregion_number >= 0);
     guarantee(subregion_number < num_cpu_shards);
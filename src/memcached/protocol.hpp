@@ -147,6 +147,10 @@ public:
         API. */
         repli_timestamp_t get_btree_repli_timestamp() const THROWS_NOTHING;
 
+        /* How many bytes of keys and values this chunk carries; the backfiller
+        uses it to report throughput. */
+        int64_t get_data_size() const THROWS_NOTHING;
+
         boost::variant<delete_range_t, delete_key_t, key_value_pair_t> val;
 
         static backfill_chunk_t delete_range(const region_t &range) {
@@ -87,6 +87,10 @@ public:
         std::string key, value;
         state_timestamp_t timestamp;
 
+        int64_t get_data_size() const THROWS_NOTHING {
+            return key.size() + value.size();
+        }
+
         RDB_MAKE_ME_SERIALIZABLE_3(key, value, timestamp);
     };
 
@@ -3,6 +3,9 @@
 
 #include <stdarg.h>
 #include <math.h>
+#include <string.h>
+
+#include <algorithm>
 #include <map>
 
 #include "utils.hpp"
@@ -231,6 +234,162 @@ void perfmon_stddev_t::record(double value) {
     thread_data[get_thread_id().threadnum].add(value);
 }
 
+/* perfmon_histogram_t */
+
+namespace perfmon_histogram {
+
+buckets_t::buckets_t() : total(0), max_value(0) {
+    memset(counts, 0, sizeof(counts));
+}
+
+size_t buckets_t::bucket_index(uint64_t value) {
+    if (value < (static_cast<uint64_t>(1) << sub_bucket_bits)) {
+        return value;
+    }
+    const int magnitude = 63 - __builtin_clzll(value);
+    const int shift = magnitude - sub_bucket_bits + 1;
+    return (static_cast<size_t>(shift) << (sub_bucket_bits - 1)) + (value >> shift);
+}
+
+uint64_t buckets_t::bucket_highest_value(size_t index) {
+    const size_t half_count = static_cast<size_t>(1) << (sub_bucket_bits - 1);
+    if (index < 2 * half_count) {
+        return index;
+    }
+    const int shift = index / half_count - 1;
+    const uint64_t sub_bucket = index - shift * half_count;
+    // For the very last bucket this wraps around to the maximum uint64_t.
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+void buckets_t::record(uint64_t value) {
+    ++counts[bucket_index(value)];
+    ++total;
+    max_value = std::max(max_value, value);
+}
+
+void buckets_t::aggregate(const buckets_t &other) {
+    for (size_t i = 0; i < num_buckets; ++i) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+    max_value = std::max(max_value, other.max_value);
+}
+
+uint64_t buckets_t::percentile(double percentile) const {
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(ceil(total * percentile / 100.0));
+    target = std::min(std::max<uint64_t>(target, 1), total);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < num_buckets; ++i) {
+        seen += counts[i];
+        if (seen >= target) {
+            return std::min(bucket_highest_value(i), max_value);
+        }
+    }
+    unreachable();
+}
+
+}   /* namespace perfmon_histogram */
+
+perfmon_histogram_t::perfmon_histogram_t(ticks_t _length,
+                                         const std::vector<double> &_percentiles)
+    : perfmon_perthread_t<buckets_t>(), thread_data(new thread_info_t[MAX_THREADS]),
+      length(_length), percentiles(_percentiles)
+{
+    for (int i = 0; i < MAX_THREADS; i++) {
+        thread_data[i].current_interval = get_ticks() / length;
+    }
+}
+
+perfmon_histogram_t::~perfmon_histogram_t() {
+    delete[] thread_data;
+}
+
+std::vector<double> perfmon_histogram_t::default_percentiles() {
+    std::vector<double> res;
+    res.push_back(50);
+    res.push_back(99);
+    res.push_back(99.9);
+    return res;
+}
+
+void perfmon_histogram_t::update(ticks_t now) {
+    int interval = now / length;
+    rassert(get_thread_id().threadnum >= 0);
+    thread_info_t *thread = &thread_data[get_thread_id().threadnum];
+
+    if (thread->current_interval == interval) {
+        /* We're up to date; nothing to do */
+    } else if (thread->current_interval + 1 == interval) {
+        /* We're one step behind */
+        thread->last_buckets.reset();
+        thread->last_buckets.swap(thread->current_buckets);
+        thread->current_interval++;
+    } else {
+        /* We're more than one step behind */
+        thread->last_buckets.reset();
+        thread->current_buckets.reset();
+        thread->current_interval = interval;
+    }
+}
+
+void perfmon_histogram_t::record(ticks_t duration) {
+    update(get_ticks());
+    rassert(get_thread_id().threadnum >= 0);
+    thread_info_t *thread = &thread_data[get_thread_id().threadnum];
+    if (!thread->current_buckets.has()) {
+        thread->current_buckets.init(new buckets_t);
+    }
+    thread->current_buckets->record(duration);
+}
+
+void perfmon_histogram_t::get_thread_stat(buckets_t *stat) {
+    update(get_ticks());
+    /* Like `perfmon_sampler_t`, we report the last complete interval. */
+    rassert(get_thread_id().threadnum >= 0);
+    thread_info_t *thread = &thread_data[get_thread_id().threadnum];
+    if (thread->last_buckets.has()) {
+        *stat = *thread->last_buckets;
+    }
+}
+
+perfmon_histogram::buckets_t perfmon_histogram_t::combine_stats(const buckets_t *stats) {
+    buckets_t aggregated;
+    for (int i = 0; i < get_num_threads(); i++) {
+        aggregated.aggregate(stats[i]);
+    }
+    return aggregated;
+}
+
+scoped_ptr_t<perfmon_result_t> perfmon_histogram_t::output_stat(const buckets_t &aggregated) {
+    scoped_ptr_t<perfmon_result_t> stat = perfmon_result_t::alloc_map_result();
+
+    stat->insert(stat_count, new perfmon_result_t(strprintf("%" PRIu64, aggregated.count())));
+    if (aggregated.count() > 0) {
+        stat->insert(stat_max, new perfmon_result_t(
+            strprintf("%.8f", ticks_to_secs(aggregated.max()))));
+    } else {
+        stat->insert(stat_max, new perfmon_result_t(no_value));
+    }
+
+    for (auto it = percentiles.begin(); it != percentiles.end(); ++it) {
+        std::string name = strprintf("p%g", *it);
+        name.erase(std::remove(name.begin(), name.end(), '.'), name.end());
+        if (aggregated.count() > 0) {
+            stat->insert(name, new perfmon_result_t(
+                strprintf("%.8f", ticks_to_secs(aggregated.percentile(*it)))));
+        } else {
+            stat->insert(name, new perfmon_result_t(no_value));
+        }
+    }
+
+    return stat;
+}
+
 /* perfmon_rate_monitor_t */
 
 perfmon_rate_monitor_t::perfmon_rate_monitor_t(ticks_t _length)
@@ -290,10 +449,11 @@ scoped_ptr_t<perfmon_result_t> perfmon_rate_monitor_t::output_stat(const double
 }
 
 perfmon_duration_sampler_t::perfmon_duration_sampler_t(ticks_t length, bool _ignore_global_full_perfmon)
-    : stat(), active(), total(), recent(length, true),
+    : stat(), active(), total(), recent(length, true), recent_histogram(length),
       active_membership(&stat, &active, "active_count"),
       total_membership(&stat, &total, "total"),
       recent_membership(&stat, &recent, "recent_duration"),
+      recent_histogram_membership(&stat, &recent_histogram, "recent_duration_percentiles"),
       ignore_global_full_perfmon(_ignore_global_full_perfmon)
 { }
 
@@ -310,7 +470,9 @@ void perfmon_duration_sampler_t::begin(ticks_t *v) {
 void perfmon_duration_sampler_t::end(ticks_t *v) {
     --active;
     if (*v != 0) {
-        recent.record(ticks_to_secs(get_ticks() - *v));
+        const ticks_t duration = get_ticks() - *v;
+        recent.record(ticks_to_secs(duration));
+        recent_histogram.record(duration);
     }
 }
 
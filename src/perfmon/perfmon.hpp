@@ -13,6 +13,7 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <vector>
 
 #include "perfmon/types.hpp"
 #include "perfmon/core.hpp"
@@ -177,6 +178,81 @@ private:
     stddev_t thread_data[MAX_THREADS]; // TODO(rntz) should this be cache-line padded?
 };
 
+namespace perfmon_histogram {
+
+/* `buckets_t` counts values in logarithmically sized buckets, like HdrHistogram
+ * does. Values below 2^sub_bucket_bits get a bucket each. Above that, each
+ * power of two is split into 2^(sub_bucket_bits - 1) buckets of equal width,
+ * so the value reported for a bucket is never off by more than
+ * 1 / 2^(sub_bucket_bits - 1) of the real value. Recording is a handful of
+ * integer operations and the size is fixed, regardless of the range of values.
+ */
+class buckets_t {
+public:
+    static const int sub_bucket_bits = 5;
+    static const size_t num_buckets = (66 - sub_bucket_bits) << (sub_bucket_bits - 1);
+
+    buckets_t();
+
+    void record(uint64_t value);
+    void aggregate(const buckets_t &other);
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return max_value; }
+
+    // Returns the highest value that falls into the same bucket as the value
+    // below which `percentile` percent of the values lie, or 0 if nothing has
+    // been recorded.
+    uint64_t percentile(double percentile) const;
+
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_highest_value(size_t index);
+
+private:
+    uint64_t total;
+    uint64_t max_value;
+    // 32 bits is plenty, since a `buckets_t` is only filled for one interval.
+    uint32_t counts[num_buckets];
+};
+
+}   /* namespace perfmon_histogram */
+
+/* `perfmon_histogram_t` keeps track of the distribution of durations, and
+ * reports the count, the maximum and a configurable set of percentiles (in
+ * seconds) of the durations recorded during the last `length` ticks. Like
+ * `perfmon_sampler_t`, every thread records into its own buckets without any
+ * locking, and the buckets are only merged when the stats are collected. The
+ * buckets for a thread are only allocated once it records something.
+ */
+class perfmon_histogram_t : public perfmon_perthread_t<perfmon_histogram::buckets_t> {
+    typedef perfmon_histogram::buckets_t buckets_t;
+    struct thread_info_t {
+        scoped_ptr_t<buckets_t> current_buckets, last_buckets;
+        int current_interval;
+    };
+
+    thread_info_t *thread_data;
+
+    void get_thread_stat(buckets_t *);
+    buckets_t combine_stats(const buckets_t *);
+    scoped_ptr_t<perfmon_result_t> output_stat(const buckets_t &);
+
+    void update(ticks_t now);
+
+    ticks_t length;
+    std::vector<double> percentiles;
+public:
+    // Percentiles are given in percent, e.g. 99.9 is reported as "p999".
+    explicit perfmon_histogram_t(ticks_t _length,
+                                 const std::vector<double> &_percentiles
+                                     = default_percentiles());
+    virtual ~perfmon_histogram_t();
+    void record(ticks_t duration);
+
+    // p50, p99 and p999.
+    static std::vector<double> default_percentiles();
+};
+
 /* `perfmon_rate_monitor_t` keeps track of the number of times some event
  * happens per second. It is different from `perfmon_sampler_t` in that it does
  * not associate a number with each event, but you can record many events at
@@ -205,9 +281,9 @@ public:
 /* perfmon_duration_sampler_t is a perfmon_t that monitors events that have a
  * starting and ending time. When something starts, call begin(); when
  * something ends, call end() with the same value as begin. It will produce
- * stats for the number of active events, the average length of an event, and
- * so on. If `global_full_perfmon` is false, it won't report any timing-related
- * stats because `get_ticks()` is rather slow.
+ * stats for the number of active events, the average length of an event, its
+ * percentiles, and so on. If `global_full_perfmon` is false, it won't report
+ * any timing-related stats because `get_ticks()` is rather slow.
  *
  * Frequently we're in the case where we'd like to have a single slow perfmon
  * up, but don't want the other ones, perfmon_duration_sampler_t has an
@@ -221,9 +297,11 @@ private:
     perfmon_counter_t active;
     perfmon_counter_t total;
     perfmon_sampler_t recent;
+    perfmon_histogram_t recent_histogram;
     perfmon_membership_t active_membership;
     perfmon_membership_t total_membership;
     perfmon_membership_t recent_membership;
+    perfmon_membership_t recent_histogram_membership;
 
     bool ignore_global_full_perfmon;
 public:
@@ -16,6 +16,9 @@
 #include "arch/timing.hpp"
 #include "concurrency/auto_drainer.hpp"
 #include "concurrency/cross_thread_signal.hpp"
+#include "concurrency/mutex.hpp"
+#include "concurrency/semaphore.hpp"
+#include "config/args.hpp"
 #include "containers/archive/archive.hpp"
 #include "http/http.hpp"
 
@@ -115,7 +118,8 @@ public:
                     boost::function<bool(request_t, response_t *, context_t *)> _f,  // NOLINT(readability/casting)
                     response_t (*_on_unparsable_query)(request_t, std::string),
                     boost::shared_ptr<semilattice_readwrite_view_t<auth_semilattice_metadata_t> > _auth_metadata,
-                    protob_server_callback_mode_t _cb_mode = CORO_ORDERED);
+                    protob_server_callback_mode_t _cb_mode = CORO_ORDERED,
+                    int _max_concurrent_queries_per_conn = MAX_CONCURRENT_QUERIES_PER_CONNECTION);
     ~protob_server_t();
 
     int get_port() const;
@@ -123,6 +127,14 @@ private:
 
     void handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &nconn, auto_drainer_t::lock_t);
     void send(const response_t &, tcp_conn_t *conn, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
+
+    /* In `CORO_UNORDERED` mode, `handle_conn()` spawns one of these for each
+    request. It holds one of the connection's `query_slots` until it has
+    written its response, so a client that doesn't read its responses
+    eventually stops us from reading more requests. */
+    void handle_query(request_t request, tcp_conn_t *conn, context_t *ctx,
+                      mutex_t *send_mutex, semaphore_t *query_slots,
+                      signal_t *closer, auto_drainer_t::lock_t conn_keepalive);
     static auth_key_t read_auth_key(tcp_conn_t *conn, signal_t *interruptor);
 
     // For HTTP server
@@ -135,6 +147,10 @@ private:
 
     protob_server_callback_mode_t cb_mode;
 
+    /* How many requests from one connection may run at once in
+    `CORO_UNORDERED` mode */
+    int max_concurrent_queries_per_conn;
+
     /* WARNING: The order here is fragile. */
     cond_t main_shutting_down_cond;
     signal_t *shutdown_signal() { return &shutting_down_conds[get_thread_id().threadnum]; }
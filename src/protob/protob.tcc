@@ -22,6 +22,18 @@
 #include "rpc/semilattice/view.hpp"
 #include "utils.hpp"
 
+/* Holds a serialized response until the connection has sent it, then deletes
+itself. */
+class protob_response_buffer_t : public tcp_conn_t::write_callback_t {
+public:
+    explicit protob_response_buffer_t(size_t size) : data_(size) { }
+    char *data() { return data_.data(); }
+    size_t size() const { return data_.size(); }
+    void on_write_done() { delete this; }
+private:
+    scoped_array_t<char> data_;
+};
+
 template <class request_t, class response_t, class context_t>
 protob_server_t<request_t, response_t, context_t>::protob_server_t(
     const std::set<ip_address_t> &local_addresses,
@@ -29,14 +41,17 @@ protob_server_t<request_t, response_t, context_t>::protob_server_t(
     boost::function<bool(request_t, response_t *, context_t *)> _f,  // NOLINT(readability/casting)
     response_t (*_on_unparsable_query)(request_t, std::string),
     boost::shared_ptr<semilattice_readwrite_view_t<auth_semilattice_metadata_t> > _auth_metadata,
-    protob_server_callback_mode_t _cb_mode)
+    protob_server_callback_mode_t _cb_mode,
+    int _max_concurrent_queries_per_conn)
     : f(_f),
       on_unparsable_query(_on_unparsable_query),
       auth_metadata(_auth_metadata),
       cb_mode(_cb_mode),
+      max_concurrent_queries_per_conn(_max_concurrent_queries_per_conn),
       shutting_down_conds(get_num_threads()),
       pulse_sdc_on_shutdown(&main_shutting_down_cond),
       next_thread(0) {
+    guarantee(max_concurrent_queries_per_conn > 0);
 
     for (int i = 0; i < get_num_threads(); ++i) {
         cross_thread_signal_t *s =
@@ -102,7 +117,14 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
     // This must be read here because of home threads and stuff
     const vclock_t<auth_key_t> auth_vclock = auth_metadata->get().auth_key;
 
+    // Connections are spread round-robin, but one that is long-lived and busy can
+    // make its thread much busier than the rest; new connections skip over it.
     threadnum_t chosen_thread = threadnum_t((next_thread++) % get_num_db_threads());
+    const threadnum_t least_loaded_thread = get_least_loaded_thread(get_num_db_threads());
+    if (get_thread_utilization(chosen_thread)
+        > get_thread_utilization(least_loaded_thread) + THREAD_OVERLOAD_MARGIN) {
+        chosen_thread = least_loaded_thread;
+    }
     cross_thread_signal_t ct_keepalive(keepalive.get_drain_signal(), chosen_thread);
     on_thread_t rethreader(chosen_thread);
 
@@ -120,6 +142,32 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
     ctx.interruptor = shutdown_signal();
 #endif  // __linux
 
+    /* `send()` only queues responses on the connection, and destroying the
+    connection drops whatever is still queued. So before it goes away, and after
+    `query_drainer` has waited for the last response to be queued, we wait for the
+    responses to go out. */
+    struct flush_on_destruct_t {
+        flush_on_destruct_t(tcp_conn_t *_conn, signal_t *_closer)
+            : conn(_conn), closer(_closer) { }
+        ~flush_on_destruct_t() {
+            try {
+                if (conn->is_write_open()) {
+                    conn->flush_buffer(closer);
+                }
+            } catch (const tcp_conn_write_closed_exc_t &) {
+                // The client is gone, so there's nobody to send the responses to.
+            }
+        }
+        tcp_conn_t *conn;
+        signal_t *closer;
+    } flush_responses(conn.get(), &ct_keepalive);
+
+    /* These are only used in `CORO_UNORDERED` mode. The requests' coroutines
+    use `conn` and `ctx`, so `query_drainer` must be destroyed first. */
+    mutex_t send_mutex;
+    semaphore_t query_slots(max_concurrent_queries_per_conn);
+    auto_drainer_t query_drainer;
+
     std::string init_error;
 
     try {
@@ -164,7 +212,6 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
         return;
     }
 
-    //TODO figure out how to do this with less copying
     for (;;) {
         request_t request;
         make_empty_protob_bearer(&request);
@@ -179,11 +226,11 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
                 forced_response = on_unparsable_query(request_t(), err);
                 force_response = true;
             } else {
-                scoped_array_t<char> data(size);
-                conn->read(data.data(), size, &ct_keepalive);
-
+                // Parse the query straight out of the connection's read buffer.
+                const_charslice data = conn->peek(size, &ct_keepalive);
                 const bool res
-                    = underlying_protob_value(&request)->ParseFromArray(data.data(), size);
+                    = underlying_protob_value(&request)->ParseFromArray(data.beg, size);
+                conn->pop(size, &ct_keepalive);
                 if (!res) {
                     err = "Client is buggy (failed to deserialize protobuf).";
                     forced_response = on_unparsable_query(request, err);
@@ -213,7 +260,18 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
                 crash("unimplemented");
                 break;
             case CORO_UNORDERED:
-                crash("unimplemented");
+                if (force_response) {
+                    mutex_t::acq_t send_acq(&send_mutex);
+                    send(forced_response, conn.get(), &ct_keepalive);
+                } else {
+                    query_slots.co_lock_interruptible(&ct_keepalive);
+                    // Evaluating a deeply nested query recurses deeply.
+                    coro_t::spawn_now_dangerously(boost::bind(
+                        &protob_server_t<request_t, response_t, context_t>::handle_query, this,
+                        request, conn.get(), &ctx, &send_mutex, &query_slots,
+                        &ct_keepalive, auto_drainer_t::lock_t(&query_drainer)),
+                        coro_stack_class_t::large);
+                }
                 break;
             default:
                 crash("unreachable");
@@ -223,21 +281,52 @@ void protob_server_t<request_t, response_t, context_t>::handle_conn(
             //TODO need to figure out what blocks us up here in non inline cb
             //mode
             return;
+        } catch (const interrupted_exc_t &) {
+            // We're shutting down.
+            return;
         }
     }
 }
 
+template <class request_t, class response_t, class context_t>
+void protob_server_t<request_t, response_t, context_t>::handle_query(
+    request_t request,
+    tcp_conn_t *conn,
+    context_t *ctx,
+    mutex_t *send_mutex,
+    semaphore_t *query_slots,
+    signal_t *closer,
+    UNUSED auto_drainer_t::lock_t conn_keepalive) {
+    response_t response;
+    bool response_needed = f(request, &response, ctx);
+    try {
+        if (response_needed) {
+            // Responses carry their request's token, so they can go out in
+            // whatever order the requests finish.
+            mutex_t::acq_t send_acq(send_mutex);
+            send(response, conn, closer);
+        }
+    } catch (const tcp_conn_write_closed_exc_t &) {
+        // The client is gone, so `handle_conn()` should stop reading requests.
+        if (conn->is_read_open()) {
+            conn->shutdown_read();
+        }
+    }
+    query_slots->unlock();
+}
+
 template <class request_t, class response_t, class context_t>
 void protob_server_t<request_t, response_t, context_t>::send(
     const response_t &res,
     tcp_conn_t *conn,
     signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
     int size = res.ByteSize();
-    conn->write(&size, sizeof(res.ByteSize()), closer);
-    scoped_array_t<char> data(size);
-
-    res.SerializeToArray(data.data(), size);
-    conn->write(data.data(), size, closer);
+    /* The size and the response go out together, straight from this buffer,
+    and possibly in the same syscall as other responses on this connection. */
+    protob_response_buffer_t *buffer = new protob_response_buffer_t(sizeof(size) + size);
+    memcpy(buffer->data(), &size, sizeof(size));
+    res.SerializeToArray(buffer->data() + sizeof(size), size);
+    conn->write_nocopy(buffer->data(), buffer->size(), buffer, closer);
 }
 
 template <class request_t, class response_t, class context_t>
@@ -296,7 +385,9 @@ http_res_t protob_server_t<request_t, response_t, context_t>::handle(
         bool response_needed;
         response_t response;
         switch (cb_mode) {
-        case INLINE: {
+        // Every HTTP request already gets a coroutine of its own.
+        case INLINE:
+        case CORO_UNORDERED: {
             boost::shared_ptr<typename http_conn_cache_t<context_t>::http_conn_t> conn =
                 http_conn_cache.find(conn_id);
             if (!parseSucceeded) {
@@ -315,7 +406,6 @@ http_res_t protob_server_t<request_t, response_t, context_t>::handle(
             }
         } break;
         case CORO_ORDERED:
-        case CORO_UNORDERED:
             crash("unimplemented");
         default:
             crash("unreachable");
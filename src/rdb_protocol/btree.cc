@@ -1,11 +1,15 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "rdb_protocol/btree.hpp"
 
+#include <algorithm>
+#include <functional>
+#include <queue>
 #include <string>
 #include <vector>
 
 #include "errors.hpp"
 #include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/variant.hpp>
 
 #include "btree/backfill.hpp"
@@ -14,9 +18,12 @@
 #include "btree/get_distribution.hpp"
 #include "btree/operations.hpp"
 #include "btree/parallel_traversal.hpp"
+#include "btree/superblock.hpp"
+#include "concurrency/pmap.hpp"
 #include "containers/archive/boost_types.hpp"
 #include "containers/archive/buffer_group_stream.hpp"
 #include "containers/archive/vector_stream.hpp"
+#include "containers/disk_backed_queue.hpp"
 #include "containers/scoped.hpp"
 #include "rdb_protocol/blob_wrapper.hpp"
 
@@ -79,6 +86,36 @@ void rdb_get(const store_key_t &store_key, btree_slice_t *slice, transaction_t *
     }
 }
 
+void rdb_get_one_of_batch(int i,
+                          const std::vector<store_key_t> *keys,
+                          btree_slice_t *slice,
+                          transaction_t *txn,
+                          superblock_t *superblock,
+                          std::vector<counted_t<const ql::datum_t> > *rows_out) {
+    keyvalue_location_t<rdb_value_t> kv_location;
+    find_keyvalue_location_for_read(txn, superblock, (*keys)[i].btree_key(), &kv_location, slice->root_eviction_priority, &slice->stats);
+
+    if (kv_location.value.has()) {
+        (*rows_out)[i] = get_data(kv_location.value.get(), txn);
+    }
+}
+
+void rdb_batched_get(const std::vector<store_key_t> &keys, btree_slice_t *slice, transaction_t *txn, superblock_t *superblock, batched_point_read_response_t *response) {
+    guarantee(!keys.empty());
+    // Every lookup releases the wrapper once it has the root node, so the real
+    // superblock goes once they all have.
+    refcount_superblock_t refcount_wrapper(superblock, keys.size());
+    std::vector<counted_t<const ql::datum_t> > rows(keys.size());
+    pmap(keys.size(), boost::bind(&rdb_get_one_of_batch, _1,
+        &keys, slice, txn, &refcount_wrapper, &rows));
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (rows[i].has()) {
+            response->rows[keys[i]] = rows[i];
+        }
+    }
+}
+
 void kv_location_delete(keyvalue_location_t<rdb_value_t> *kv_location,
                         const store_key_t &key,
                         btree_slice_t *slice,
@@ -115,7 +152,7 @@ void kv_location_set(keyvalue_location_t<rdb_value_t> *kv_location,
 
     // TODO unnecessary copies they must go away.
     write_message_t wm;
-    wm << data;
+    ql::serialize_indexed(&wm, data);
     vector_stream_t stream;
     int res = send_write_message(&stream, &wm);
     guarantee_err(res == 0,
@@ -390,10 +427,12 @@ void rdb_set(const store_key_t &key,
              transaction_t *txn,
              superblock_t *superblock,
              point_write_response_t *response_out,
-             rdb_modification_info_t *mod_info) {
+             rdb_modification_info_t *mod_info,
+             promise_t<superblock_t *> *pass_back_superblock) {
     keyvalue_location_t<rdb_value_t> kv_location;
     find_keyvalue_location_for_write(txn, superblock, key.btree_key(), &kv_location,
-                                     &slice->root_eviction_priority, &slice->stats);
+                                     &slice->root_eviction_priority, &slice->stats,
+                                     pass_back_superblock);
     const bool had_value = kv_location.value.has();
 
     /* update the modification report */
@@ -677,6 +716,10 @@ public:
           sindex_multi(_sindex_multi)
     {
         sindex_function = _sindex_function.compile_wire_func();
+        std::string field;
+        if (sindex_function->is_simple_selector(&field)) {
+            sindex_field = field;
+        }
         init(range);
     }
 
@@ -696,6 +739,13 @@ public:
             if (terminal) {
                 query_language::terminal_initialize(&*terminal, &response->result);
             }
+
+            ql::field_access_t access;
+            if (!transform.empty()
+                && query_language::transform_field_access(transform.front(),
+                                                          &access)) {
+                first_transform_access = access;
+            }
         } catch (const ql::exc_t &e2) {
             /* Evaluation threw so we're not going to be accepting any more requests. */
             response->result = e2;
@@ -724,7 +774,46 @@ public:
         try {
             lazy_json_t first_value(static_cast<const rdb_value_t *>(keyvalue.value()),
                                     transaction);
-            first_value.get();
+
+            // If the sindex function just picks a field we can check the range
+            // before loading the rest of the row, and skip loading it if we don't
+            // need it.  If the field is missing we leave it to the function to
+            // report the error.
+            counted_t<const ql::datum_t> sindex_value;
+            bool in_sindex_range = true;
+            if (sindex_field) {
+                sindex_value = first_value.get_field(*sindex_field);
+                if (sindex_value.has()) {
+                    in_sindex_range = sindex_value_in_range(store_key, &sindex_value);
+                }
+            }
+
+            // If the first transform only needs some of the row's fields (and the
+            // sindex function doesn't need the whole row), apply it now while the
+            // row is still in its blob.  Errors are reported once it's our turn
+            // to touch `response`.
+            std::vector<lazy_json_t> data;
+            auto first_transform = transform.begin();
+            boost::optional<ql::datum_exc_t> first_transform_exc;
+            if (in_sindex_range) {
+                if (first_transform_access
+                    && (!sindex_function || sindex_value.has())) {
+                    std::vector<counted_t<const ql::datum_t> > tmp;
+                    try {
+                        query_language::field_access_apply(
+                            *first_transform_access, first_value, &tmp);
+                    } catch (const ql::datum_exc_t &e2) {
+                        first_transform_exc = e2;
+                    }
+                    for (auto jt = tmp.begin(); jt != tmp.end(); ++jt) {
+                        data.push_back(lazy_json_t(*jt));
+                    }
+                    ++first_transform;
+                } else {
+                    first_value.get();
+                    data.push_back(first_value);
+                }
+            }
 
             keyvalue.reset();
 
@@ -735,23 +824,21 @@ public:
                 response->last_considered_key = store_key;
             }
 
-            std::vector<lazy_json_t> data;
-            data.push_back(first_value);
+            if (!in_sindex_range) {
+                return true;
+            }
 
-            counted_t<const ql::datum_t> sindex_value;
-            if (sindex_function) {
+            if (first_transform_exc) {
+                /* Evaluation threw so we're not going to be accepting any more
+                   requests. */
+                transform_exception(*first_transform_exc, transform.front(),
+                                    &response->result);
+                return false;
+            }
+
+            if (sindex_function && !sindex_value.has()) {
                 sindex_value = sindex_function->call(ql_env, first_value.get())->as_datum();
-                guarantee(sindex_range);
-                guarantee(sindex_multi);
-
-                if (sindex_multi == MULTI &&
-                    sindex_value->get_type() == ql::datum_t::R_ARRAY) {
-                        boost::optional<uint64_t> tag = ql::datum_t::extract_tag(key_to_unescaped_str(store_key));
-                        guarantee(tag);
-                        guarantee(sindex_value->size() > *tag);
-                        sindex_value = sindex_value->get(*tag);
-                }
-                if (!sindex_range->contains(sindex_value)) {
+                if (!sindex_value_in_range(store_key, &sindex_value)) {
                     return true;
                 }
             }
@@ -759,7 +846,7 @@ public:
             // Apply transforms to the data
             {
                 rdb_protocol_details::transform_t::iterator it;
-                for (it = transform.begin(); it != transform.end(); ++it) {
+                for (it = first_transform; it != transform.end(); ++it) {
                     try {
                         std::vector<counted_t<const ql::datum_t> > tmp;
 
@@ -818,6 +905,23 @@ public:
         }
 
     }
+    // Picks the element of a multi index value that `store_key` is for, and checks
+    // it against `sindex_range`.
+    bool sindex_value_in_range(const store_key_t &store_key,
+                               counted_t<const ql::datum_t> *sindex_value) {
+        guarantee(sindex_range);
+        guarantee(sindex_multi);
+
+        if (sindex_multi == MULTI &&
+            (*sindex_value)->get_type() == ql::datum_t::R_ARRAY) {
+                boost::optional<uint64_t> tag = ql::datum_t::extract_tag(key_to_unescaped_str(store_key));
+                guarantee(tag);
+                guarantee((*sindex_value)->size() > *tag);
+                *sindex_value = (*sindex_value)->get(*tag);
+        }
+        return sindex_range->contains(*sindex_value);
+    }
+
     bool bad_init;
     transaction_t *transaction;
     rget_read_response_t *response;
@@ -827,10 +931,15 @@ public:
     boost::optional<rdb_protocol_details::terminal_t> terminal;
     sorting_t sorting;
 
+    // Set if the first transform only reads some fields of each row.
+    boost::optional<ql::field_access_t> first_transform_access;
+
     /* Only present if we're doing a sindex read.*/
     boost::optional<key_range_t> primary_key_range;
     boost::optional<sindex_range_t> sindex_range;
     counted_t<ql::func_t> sindex_function;
+    // Set if `sindex_function` just returns this field of the row.
+    boost::optional<std::string> sindex_field;
     boost::optional<sindex_multi_bool_t> sindex_multi;
 };
 
@@ -1005,11 +1114,19 @@ void rdb_modification_report_cb_t::on_mod_report(
 typedef btree_store_t<rdb_protocol_t>::sindex_access_vector_t sindex_access_vector_t;
 
 void compute_keys(const store_key_t &primary_key, counted_t<const ql::datum_t> doc,
-                  ql::map_wire_func_t *mapping, sindex_multi_bool_t multi, ql::env_t *env,
-                  std::vector<store_key_t> *keys_out) {
+                  const counted_t<ql::func_t> &func, sindex_multi_bool_t multi,
+                  ql::env_t *env, std::vector<store_key_t> *keys_out) {
     guarantee(keys_out->empty());
-    counted_t<const ql::datum_t> index =
-        mapping->compile_wire_func()->call(env, doc)->as_datum();
+    // Skip evaluating the function if it just picks a field.  If the field is
+    // missing the function call reports the error.
+    counted_t<const ql::datum_t> index;
+    std::string field;
+    if (func->is_simple_selector(&field) && doc->get_type() == ql::datum_t::R_OBJECT) {
+        index = doc->get(field, ql::NOTHROW);
+    }
+    if (!index.has()) {
+        index = func->call(env, doc)->as_datum();
+    }
 
     if (multi == MULTI && index->get_type() == ql::datum_t::R_ARRAY) {
         for (uint64_t i = 0; i < index->size(); ++i) {
@@ -1048,6 +1165,7 @@ void rdb_update_single_sindex(
     // mapping is passed.
     cond_t non_interruptor;
     ql::env_t env(&non_interruptor);
+    counted_t<ql::func_t> func = mapping.compile_wire_func();
 
     superblock_t *super_block = sindex->super_block.get();
 
@@ -1058,7 +1176,7 @@ void rdb_update_single_sindex(
 
             std::vector<store_key_t> keys;
 
-            compute_keys(modification->primary_key, deleted, &mapping, multi, &env, &keys);
+            compute_keys(modification->primary_key, deleted, func, multi, &env, &keys);
 
             for (auto it = keys.begin(); it != keys.end(); ++it) {
                 promise_t<superblock_t *> return_superblock_local;
@@ -1091,7 +1209,7 @@ void rdb_update_single_sindex(
 
             std::vector<store_key_t> keys;
 
-            compute_keys(modification->primary_key, added, &mapping, multi, &env, &keys);
+            compute_keys(modification->primary_key, added, func, multi, &env, &keys);
 
             for (auto it = keys.begin(); it != keys.end(); ++it) {
                 promise_t<superblock_t *> return_superblock_local;
@@ -1258,7 +1376,7 @@ public:
     signal_t *interruptor_;
 };
 
-void post_construct_secondary_indexes(
+void post_construct_secondary_indexes_incrementally(
         btree_store_t<rdb_protocol_t> *store,
         const std::set<uuid_u> &sindexes_to_post_construct,
         signal_t *interruptor)
@@ -1287,3 +1405,371 @@ void post_construct_secondary_indexes(
     btree_parallel_traversal(txn.get(), superblock.get(),
             store->btree.get(), &helper, &wait_any);
 }
+
+/* A secondary index entry waiting to be inserted by `sindex_bulk_builder_t`.
+`value_ref` is the blob reference of the row, which the index shares with the
+primary btree. */
+struct sindex_bulk_pair_t {
+    store_key_t key;
+    std::vector<char> value_ref;
+
+    RDB_MAKE_ME_SERIALIZABLE_2(key, value_ref);
+};
+
+bool sindex_bulk_pair_less(const sindex_bulk_pair_t &left,
+                           const sindex_bulk_pair_t &right) {
+    return left.key < right.key;
+}
+
+/* Builds one secondary index from scratch. Rather than inserting rows into the
+index one at a time in primary key order, it collects the (index key, row) pairs,
+sorts them and inserts them in index key order, `limits.write_batch` pairs per
+write transaction. Consecutive inserts then land on the same leaf node
+instead of on a random one, and writers only have to wait for one short
+transaction at a time.
+
+Pairs are sorted in memory until they take up `limits.run_size` bytes.
+Then they are spilled to a disk-backed queue as a sorted run, and the runs are
+merged at the end. */
+class sindex_bulk_builder_t {
+public:
+    sindex_bulk_builder_t(btree_store_t<rdb_protocol_t> *_store,
+                          const secondary_index_t &_sindex,
+                          const sindex_bulk_build_limits_t &_limits)
+        : store(_store), sindex(_sindex), limits(_limits), env(&non_interruptor),
+          buffer_size(0) {
+        ql::map_wire_func_t mapping;
+        vector_read_stream_t read_stream(&sindex.opaque_definition);
+        int success = deserialize(&read_stream, &mapping);
+        guarantee(success == ARCHIVE_SUCCESS, "Corrupted sindex description.");
+        success = deserialize(&read_stream, &multi);
+        guarantee(success == ARCHIVE_SUCCESS, "Corrupted sindex description.");
+        func = mapping.compile_wire_func();
+    }
+
+    void add_row(const store_key_t &primary_key, counted_t<const ql::datum_t> row,
+                 const std::vector<char> &value_ref) {
+        std::vector<store_key_t> keys;
+        try {
+            compute_keys(primary_key, row, func, multi, &env, &keys);
+        } catch (const ql::base_exc_t &) {
+            // The row doesn't go into the index, like in `rdb_update_single_sindex`.
+            return;
+        }
+
+        for (auto it = keys.begin(); it != keys.end(); ++it) {
+            buffer.push_back(sindex_bulk_pair_t());
+            buffer.back().key = *it;
+            buffer.back().value_ref = value_ref;
+            buffer_size += sizeof(sindex_bulk_pair_t) + value_ref.size();
+        }
+
+        if (buffer_size >= limits.run_size) {
+            spill_run();
+        }
+    }
+
+    // Returns false if the index was dropped while we were building it.
+    bool build(signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        std::vector<sindex_bulk_pair_t> batch;
+
+        if (runs.empty()) {
+            std::sort(buffer.begin(), buffer.end(), &sindex_bulk_pair_less);
+            for (auto it = buffer.begin(); it != buffer.end(); ++it) {
+                batch.push_back(std::move(*it));
+                if (batch.size() >= limits.write_batch) {
+                    if (!insert_batch(&batch, interruptor)) {
+                        return false;
+                    }
+                }
+            }
+            buffer.clear();
+            return insert_batch(&batch, interruptor);
+        }
+
+        spill_run();
+
+        /* Merge the runs. `heads[i]` is the chunk of `runs[i]` we're currently
+        reading, and `positions[i]` is how far we've read into it. */
+        std::vector<std::vector<sindex_bulk_pair_t> > heads(runs.size());
+        std::vector<size_t> positions(runs.size(), 0);
+        std::priority_queue<std::pair<store_key_t, size_t>,
+                            std::vector<std::pair<store_key_t, size_t> >,
+                            std::greater<std::pair<store_key_t, size_t> > > next_keys;
+        for (size_t i = 0; i < runs.size(); ++i) {
+            runs[i].pop(&heads[i]);
+            guarantee(!heads[i].empty());
+            next_keys.push(std::make_pair(heads[i][0].key, i));
+        }
+
+        while (!next_keys.empty()) {
+            const size_t i = next_keys.top().second;
+            next_keys.pop();
+
+            batch.push_back(std::move(heads[i][positions[i]]));
+            ++positions[i];
+            if (positions[i] == heads[i].size()) {
+                heads[i].clear();
+                positions[i] = 0;
+                if (!runs[i].empty()) {
+                    runs[i].pop(&heads[i]);
+                }
+            }
+            if (!heads[i].empty()) {
+                next_keys.push(std::make_pair(heads[i][positions[i]].key, i));
+            }
+
+            if (batch.size() >= limits.write_batch) {
+                if (!insert_batch(&batch, interruptor)) {
+                    return false;
+                }
+            }
+        }
+        return insert_batch(&batch, interruptor);
+    }
+
+private:
+    typedef disk_backed_queue_t<std::vector<sindex_bulk_pair_t> > run_t;
+
+    void spill_run() {
+        if (buffer.empty()) {
+            return;
+        }
+        // We might block while writing the run, so take the pairs out of
+        // `buffer` first; other leaves may keep adding to it in the meantime.
+        std::vector<sindex_bulk_pair_t> pairs;
+        pairs.swap(buffer);
+        buffer_size = 0;
+        std::sort(pairs.begin(), pairs.end(), &sindex_bulk_pair_less);
+
+        run_t *run = new run_t(
+            store->io_backender_,
+            serializer_filepath_t(store->base_path_,
+                                  strprintf("sindex_build_%s_%zu",
+                                            uuid_to_str(sindex.id).c_str(),
+                                            runs.size())),
+            &store->perfmon_collection);
+        runs.push_back(run);
+
+        std::vector<sindex_bulk_pair_t> chunk;
+        for (auto it = pairs.begin(); it != pairs.end(); ++it) {
+            chunk.push_back(std::move(*it));
+            if (chunk.size() == limits.spill_chunk || it + 1 == pairs.end()) {
+                run->push(chunk);
+                chunk.clear();
+            }
+        }
+    }
+
+    // Inserts and clears `*batch`. Returns false if the index doesn't exist
+    // anymore.
+    bool insert_batch(std::vector<sindex_bulk_pair_t> *batch, signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t) {
+        if (batch->empty()) {
+            return true;
+        }
+
+        write_token_pair_t token_pair;
+        store->new_write_token_pair(&token_pair);
+
+        scoped_ptr_t<transaction_t> wtxn;
+        btree_store_t<rdb_protocol_t>::sindex_access_vector_t sindexes;
+
+        object_buffer_t<fifo_enforcer_sink_t::exit_write_t>::destruction_sentinel_t
+            destroyer(&token_pair.sindex_write_token);
+
+        {
+            scoped_ptr_t<real_superblock_t> superblock;
+
+            // Soft durability is fine, a partially constructed secondary index
+            // gets rebuilt from scratch.
+            store->acquire_superblock_for_write(
+                rwi_write,
+                repli_timestamp_t::distant_past,
+                2,
+                WRITE_DURABILITY_SOFT,
+                &token_pair,
+                &wtxn,
+                &superblock,
+                interruptor);
+
+            scoped_ptr_t<buf_lock_t> sindex_block;
+            store->acquire_sindex_block_for_write(
+                &token_pair,
+                wtxn.get(),
+                &sindex_block,
+                superblock->get_sindex_block_id(),
+                interruptor);
+
+            std::set<uuid_u> ids;
+            ids.insert(sindex.id);
+            store->acquire_sindex_superblocks_for_write(
+                    ids,
+                    sindex_block.get(),
+                    wtxn.get(),
+                    &sindexes);
+
+            if (sindexes.empty()) {
+                return false;
+            }
+        }
+
+        btree_store_t<rdb_protocol_t>::sindex_access_t *access = &sindexes[0];
+        superblock_t *super_block = access->super_block.get();
+        for (auto it = batch->begin(); it != batch->end(); ++it) {
+            promise_t<superblock_t *> return_superblock_local;
+            {
+                keyvalue_location_t<rdb_value_t> kv_location;
+
+                find_keyvalue_location_for_write(wtxn.get(), super_block,
+                                                 it->key.btree_key(),
+                                                 &kv_location,
+                                                 &access->btree->root_eviction_priority,
+                                                 &access->btree->stats,
+                                                 &return_superblock_local);
+
+                kv_location_set(&kv_location, it->key, it->value_ref, access->btree,
+                                repli_timestamp_t::distant_past, wtxn.get());
+                // The keyvalue location gets destroyed here.
+            }
+            super_block = return_superblock_local.wait();
+        }
+
+        batch->clear();
+        return true;
+    }
+
+    btree_store_t<rdb_protocol_t> *store;
+    secondary_index_t sindex;
+    const sindex_bulk_build_limits_t limits;
+
+    // We use a NULL environment here, like `rdb_update_single_sindex` does.
+    cond_t non_interruptor;
+    ql::env_t env;
+    counted_t<ql::func_t> func;
+    sindex_multi_bool_t multi;
+
+    std::vector<sindex_bulk_pair_t> buffer;
+    size_t buffer_size;
+    boost::ptr_vector<run_t> runs;
+
+    DISABLE_COPYING(sindex_bulk_builder_t);
+};
+
+class sindex_bulk_extract_helper_t : public btree_traversal_helper_t {
+public:
+    explicit sindex_bulk_extract_helper_t(boost::ptr_vector<sindex_bulk_builder_t> *builders)
+        : builders_(builders) { }
+
+    void process_a_leaf(transaction_t *txn, buf_lock_t *leaf_node_buf,
+                        const btree_key_t *, const btree_key_t *,
+                        signal_t *, int *) THROWS_ONLY(interrupted_exc_t) {
+        const leaf_node_t *leaf_node = static_cast<const leaf_node_t *>(leaf_node_buf->get_data_read());
+        block_size_t block_size = txn->get_cache()->get_block_size();
+
+        for (auto it = leaf::begin(*leaf_node); it != leaf::end(*leaf_node); ++it) {
+            const btree_key_t *key = (*it).first;
+            const rdb_value_t *rdb_value = static_cast<const rdb_value_t *>((*it).second);
+            guarantee(key);
+
+            store_key_t pk(key);
+            counted_t<const ql::datum_t> row = get_data(rdb_value, txn);
+            std::vector<char> value_ref(rdb_value->value_ref(),
+                                        rdb_value->value_ref() + rdb_value->inline_size(block_size));
+
+            for (auto jt = builders_->begin(); jt != builders_->end(); ++jt) {
+                jt->add_row(pk, row, value_ref);
+            }
+        }
+    }
+
+    void postprocess_internal_node(buf_lock_t *) { }
+
+    void filter_interesting_children(UNUSED transaction_t *txn, ranged_block_ids_t *ids_source, interesting_children_callback_t *cb) {
+        for (int i = 0, e = ids_source->num_block_ids(); i < e; ++i) {
+            cb->receive_interesting_child(i);
+        }
+        cb->no_more_interesting_children();
+    }
+
+    access_t btree_superblock_mode() { return rwi_read; }
+    access_t btree_node_mode() { return rwi_read; }
+
+private:
+    boost::ptr_vector<sindex_bulk_builder_t> *builders_;
+};
+
+void post_construct_secondary_indexes_in_bulk(
+        btree_store_t<rdb_protocol_t> *store,
+        const std::set<uuid_u> &sindexes_to_post_construct,
+        signal_t *interruptor,
+        const sindex_bulk_build_limits_t &limits)
+    THROWS_ONLY(interrupted_exc_t) {
+    boost::ptr_vector<sindex_bulk_builder_t> builders;
+
+    /* Extract the index entries from a snapshot of the primary btree. Writes that
+    happen after the snapshot are in the sindex queue, which gets drained after
+    we're done. */
+    {
+        read_token_pair_t token_pair;
+        store->new_read_token_pair(&token_pair);
+
+        scoped_ptr_t<transaction_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+
+        store->acquire_superblock_for_read(
+            rwi_read,
+            &token_pair.main_read_token,
+            &txn,
+            &superblock,
+            interruptor,
+            true /* USE_SNAPSHOT */);
+
+        std::map<std::string, secondary_index_t> sindexes;
+        store->get_sindexes(&token_pair, txn.get(), superblock.get(), &sindexes,
+                            interruptor);
+        for (auto it = sindexes.begin(); it != sindexes.end(); ++it) {
+            if (std_contains(sindexes_to_post_construct, it->second.id)) {
+                builders.push_back(new sindex_bulk_builder_t(store, it->second, limits));
+            }
+        }
+
+        if (builders.empty()) {
+            return;
+        }
+
+        sindex_bulk_extract_helper_t helper(&builders);
+        btree_parallel_traversal(txn.get(), superblock.get(),
+                store->btree.get(), &helper, interruptor);
+    }
+
+    if (interruptor->is_pulsed()) {
+        throw interrupted_exc_t();
+    }
+
+    for (auto it = builders.begin(); it != builders.end(); ++it) {
+        // If the index got dropped there's nothing left to do for it.
+        UNUSED bool exists = it->build(interruptor);
+    }
+}
+
+void post_construct_secondary_indexes(
+        btree_store_t<rdb_protocol_t> *store,
+        const std::set<uuid_u> &sindexes_to_post_construct,
+        signal_t *interruptor,
+        sindex_build_mode_t mode,
+        const sindex_bulk_build_limits_t &bulk_limits)
+    THROWS_ONLY(interrupted_exc_t) {
+    switch (mode) {
+    case sindex_build_mode_t::incremental:
+        post_construct_secondary_indexes_incrementally(
+            store, sindexes_to_post_construct, interruptor);
+        break;
+    case sindex_build_mode_t::bulk:
+        post_construct_secondary_indexes_in_bulk(
+            store, sindexes_to_post_construct, interruptor, bulk_limits);
+        break;
+    default:
+        unreachable();
+    }
+}
@@ -11,6 +11,7 @@
 #include "backfill_progress.hpp"
 #include "btree/btree_store.hpp"
 #include "btree/depth_first_traversal.hpp"
+#include "concurrency/promise.hpp"
 #include "rdb_protocol/datum.hpp"
 #include "rdb_protocol/protocol.hpp"
 
@@ -24,6 +25,8 @@ typedef rdb_protocol_t::read_response_t read_response_t;
 typedef rdb_protocol_t::point_read_t point_read_t;
 typedef rdb_protocol_t::point_read_response_t point_read_response_t;
 
+typedef rdb_protocol_t::batched_point_read_response_t batched_point_read_response_t;
+
 typedef rdb_protocol_t::rget_read_t rget_read_t;
 typedef rdb_protocol_t::rget_read_response_t rget_read_response_t;
 
@@ -86,6 +89,13 @@ void rdb_get(const store_key_t &key,
              superblock_t *superblock,
              point_read_response_t *response);
 
+// Looks up all of `keys` concurrently, sharing the superblock between them.
+void rdb_batched_get(const std::vector<store_key_t> &keys,
+                     btree_slice_t *slice,
+                     transaction_t *txn,
+                     superblock_t *superblock,
+                     batched_point_read_response_t *response);
+
 enum return_vals_t {
     NO_RETURN_VALS = 0,
     RETURN_VALS = 1
@@ -146,7 +156,8 @@ void rdb_set(const store_key_t &key, counted_t<const ql::datum_t> data, bool ove
              btree_slice_t *slice, repli_timestamp_t timestamp,
              transaction_t *txn, superblock_t *superblock,
              point_write_response_t *response,
-             rdb_modification_info_t *mod_info);
+             rdb_modification_info_t *mod_info,
+             promise_t<superblock_t *> *pass_back_superblock = NULL);
 
 class rdb_backfill_callback_t {
 public:
@@ -290,10 +301,32 @@ void rdb_erase_range_sindexes(
         transaction_t *txn,
         signal_t *interruptor);
 
+/* `incremental` inserts the rows of each leaf of the primary btree into the
+indexes as it goes. `bulk` collects all of the index entries first and inserts
+them in sorted order, which is much faster for big tables. */
+enum class sindex_build_mode_t { incremental, bulk };
+
+/* How much a `bulk` build sorts in memory before spilling a run to disk, how many
+entries go into each element of a spilled run, and how many entries it inserts per
+write transaction. The defaults come from `config/args.hpp`; tests make them small
+to exercise the spilling. */
+struct sindex_bulk_build_limits_t {
+    sindex_bulk_build_limits_t()
+        : run_size(SINDEX_BULK_BUILD_RUN_SIZE),
+          spill_chunk(SINDEX_BULK_BUILD_SPILL_CHUNK),
+          write_batch(SINDEX_BULK_BUILD_WRITE_BATCH) { }
+
+    size_t run_size;
+    size_t spill_chunk;
+    size_t write_batch;
+};
+
 void post_construct_secondary_indexes(
         btree_store_t<rdb_protocol_t> *store,
         const std::set<uuid_u> &sindexes_to_post_construct,
-        signal_t *interruptor)
+        signal_t *interruptor,
+        sindex_build_mode_t mode = sindex_build_mode_t::bulk,
+        const sindex_bulk_build_limits_t &bulk_limits = sindex_bulk_build_limits_t())
     THROWS_ONLY(interrupted_exc_t);
 
 class rdb_value_deleter_t : public value_deleter_t {
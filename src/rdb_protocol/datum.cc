@@ -5,12 +5,15 @@
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <algorithm>
+#include <limits>
 
 #include "errors.hpp"
 #include <boost/detail/endian.hpp>
 
+#include "containers/archive/buffer_group_stream.hpp"
 #include "containers/archive/string_stream.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/error.hpp"
@@ -27,11 +30,12 @@ const std::set<std::string> datum_t::_allowed_pts = std::set<std::string>();
 
 const char* const datum_t::reql_type_string = "$reql_type$";
 
-datum_t::datum_t(type_t _type, bool _bool) : type(_type), r_bool(_bool) {
+datum_t::datum_t(type_t _type, bool _bool)
+    : type(_type), is_flat_object(false), r_bool(_bool) {
     r_sanity_check(_type == R_BOOL);
 }
 
-datum_t::datum_t(double _num) : type(R_NUM), r_num(_num) {
+datum_t::datum_t(double _num) : type(R_NUM), is_flat_object(false), r_num(_num) {
     // so we can use `isfinite` in a GCC 4.4.3-compatible way
     using namespace std;  // NOLINT(build/namespaces)
     rcheck(isfinite(r_num), base_exc_t::GENERIC,
@@ -39,23 +43,29 @@ datum_t::datum_t(double _num) : type(R_NUM), r_num(_num) {
 }
 
 datum_t::datum_t(std::string &&_str)
-    : type(R_STR), r_str(new std::string(std::move(_str))) {
+    : type(R_STR), is_flat_object(false), r_str(new std::string(std::move(_str))) {
     check_str_validity(*r_str);
 }
 
 datum_t::datum_t(const char *cstr)
-    : type(R_STR), r_str(new std::string(cstr)) { }
+    : type(R_STR), is_flat_object(false), r_str(new std::string(cstr)) { }
 
 datum_t::datum_t(std::vector<counted_t<const datum_t> > &&_array)
-    : type(R_ARRAY), r_array(new std::vector<counted_t<const datum_t> >(std::move(_array))) { }
+    : type(R_ARRAY), is_flat_object(false),
+      r_array(new std::vector<counted_t<const datum_t> >(std::move(_array))) { }
 
 datum_t::datum_t(std::map<std::string, counted_t<const datum_t> > &&_object)
-    : type(R_OBJECT),
+    : type(R_OBJECT), is_flat_object(false),
       r_object(new std::map<std::string, counted_t<const datum_t> >(std::move(_object))) {
     maybe_sanitize_ptype();
 }
 
-datum_t::datum_t(datum_t::type_t _type) : type(_type) {
+datum_t::datum_t(flat_object_t *object)
+    : type(R_OBJECT), is_flat_object(true), r_flat_object(object) {
+    r_sanity_check(!is_ptype());
+}
+
+datum_t::datum_t(datum_t::type_t _type) : type(_type), is_flat_object(false) {
     r_sanity_check(type == R_ARRAY || type == R_OBJECT || type == R_NULL);
     switch (type) {
     case R_NULL: {
@@ -89,8 +99,13 @@ datum_t::~datum_t() {
         delete r_array;
     } break;
     case R_OBJECT: {
-        r_sanity_check(r_object != NULL);
-        delete r_object;
+        if (is_flat_object) {
+            r_sanity_check(r_flat_object != NULL);
+            flat_object_t::destroy(r_flat_object);
+        } else {
+            r_sanity_check(r_object != NULL);
+            delete r_object;
+        }
     } break;
     case UNINITIALIZED: break;
     default: unreachable();
@@ -168,17 +183,19 @@ void datum_t::check_str_validity(const std::string &str) {
                      str.c_str(), null_offset));
 }
 
-datum_t::datum_t(cJSON *json) {
+datum_t::datum_t(cJSON *json) : is_flat_object(false) {
     init_json(json);
 }
-datum_t::datum_t(const scoped_cJSON_t &json) {
+datum_t::datum_t(const scoped_cJSON_t &json) : is_flat_object(false) {
     init_json(json.get());
 }
 
 datum_t::type_t datum_t::get_type() const { return type; }
 
 bool datum_t::is_ptype() const {
-    return type == R_OBJECT && std_contains(*r_object, reql_type_string);
+    // Pseudotypes are never stored as a `flat_object_t`.
+    return type == R_OBJECT && !is_flat_object
+        && std_contains(*r_object, reql_type_string);
 }
 
 bool datum_t::is_ptype(const std::string &reql_type) const {
@@ -186,7 +203,7 @@ bool datum_t::is_ptype(const std::string &reql_type) const {
 }
 
 std::string datum_t::get_reql_type() const {
-    r_sanity_check(get_type() == R_OBJECT);
+    r_sanity_check(get_type() == R_OBJECT && !is_flat_object);
     auto maybe_reql_type = r_object->find(reql_type_string);
     r_sanity_check(maybe_reql_type != r_object->end());
     rcheck(maybe_reql_type->second->get_type() == R_STR,
@@ -689,9 +706,17 @@ counted_t<const datum_t> datum_t::get(size_t index, throw_bool_t throw_bool) con
 
 counted_t<const datum_t> datum_t::get(const std::string &key,
                                       throw_bool_t throw_bool) const {
-    std::map<std::string, counted_t<const datum_t> >::const_iterator it
-        = as_object().find(key);
-    if (it != as_object().end()) return it->second;
+    check_type(R_OBJECT);
+    if (is_flat_object) {
+        size_t index;
+        if (r_flat_object->find(key, &index)) {
+            return r_flat_object->value(index);
+        }
+    } else {
+        std::map<std::string, counted_t<const datum_t> >::const_iterator it
+            = r_object->find(key);
+        if (it != r_object->end()) return it->second;
+    }
     if (throw_bool == THROW) {
         rfail(base_exc_t::NON_EXISTENCE,
               "No attribute `%s` in object:\n%s", key.c_str(), print().c_str());
@@ -701,7 +726,11 @@ counted_t<const datum_t> datum_t::get(const std::string &key,
 
 const std::map<std::string, counted_t<const datum_t> > &datum_t::as_object() const {
     check_type(R_OBJECT);
-    return *r_object;
+    return is_flat_object ? r_flat_object->as_map() : *r_object;
+}
+
+const flat_object_t *datum_t::as_flat_object() const {
+    return type == R_OBJECT && is_flat_object ? r_flat_object : NULL;
 }
 
 cJSON *datum_t::as_json_raw() const {
@@ -719,9 +748,16 @@ cJSON *datum_t::as_json_raw() const {
     } break;
     case R_OBJECT: {
         scoped_cJSON_t obj(cJSON_CreateObject());
-        for (std::map<std::string, counted_t<const datum_t> >::const_iterator
-                 it = r_object->begin(); it != r_object->end(); ++it) {
-            obj.AddItemToObject(it->first.c_str(), it->second->as_json_raw());
+        if (is_flat_object) {
+            for (size_t i = 0; i < r_flat_object->size(); ++i) {
+                obj.AddItemToObject(r_flat_object->key(i).c_str(),
+                                    r_flat_object->value(i)->as_json_raw());
+            }
+        } else {
+            for (std::map<std::string, counted_t<const datum_t> >::const_iterator
+                     it = r_object->begin(); it != r_object->end(); ++it) {
+                obj.AddItemToObject(it->first.c_str(), it->second->as_json_raw());
+            }
         }
         return obj.release();
     } break;
@@ -764,6 +800,7 @@ void datum_t::add(counted_t<const datum_t> val) {
 MUST_USE bool datum_t::add(const std::string &key, counted_t<const datum_t> val,
                            clobber_bool_t clobber_bool) {
     check_type(R_OBJECT);
+    r_sanity_check(!is_flat_object);
     check_str_validity(key);
     r_sanity_check(val.has());
     bool key_in_obj = r_object->count(key) > 0;
@@ -772,6 +809,7 @@ MUST_USE bool datum_t::add(const std::string &key, counted_t<const datum_t> val,
 }
 
 MUST_USE bool datum_t::delete_field(const std::string &key) {
+    r_sanity_check(type == R_OBJECT && !is_flat_object);
     return r_object->erase(key);
 }
 
@@ -859,6 +897,22 @@ int datum_t::cmp(const datum_t &rhs) const {
                 return derived_cmp(get_reql_type(), rhs.get_reql_type());
             }
             return pseudo_cmp(rhs);
+        } else if (is_flat_object && rhs.is_flat_object) {
+            const flat_object_t *obj = r_flat_object;
+            const flat_object_t *rhs_obj = rhs.r_flat_object;
+            size_t i;
+            for (i = 0; i < obj->size(); ++i) {
+                if (i >= rhs_obj->size()) return 1;
+                int key_cmpval = obj->key(i).compare(rhs_obj->key(i));
+                if (key_cmpval != 0) {
+                    return key_cmpval;
+                }
+                int val_cmpval = obj->value(i)->cmp(*rhs_obj->value(i));
+                if (val_cmpval != 0) {
+                    return val_cmpval;
+                }
+            }
+            return i == rhs_obj->size() ? 0 : -1;
         } else {
             const std::map<std::string, counted_t<const datum_t> > &obj = as_object();
             const std::map<std::string, counted_t<const datum_t> > &rhs_obj
@@ -900,9 +954,9 @@ void datum_t::runtime_fail(base_exc_t::type_t exc_type,
     ql::runtime_fail(exc_type, test, file, line, msg);
 }
 
-datum_t::datum_t() : type(UNINITIALIZED) { }
+datum_t::datum_t() : type(UNINITIALIZED), is_flat_object(false) { }
 
-datum_t::datum_t(const Datum *d) : type(UNINITIALIZED) {
+datum_t::datum_t(const Datum *d) : type(UNINITIALIZED), is_flat_object(false) {
     init_from_pb(d);
 }
 
@@ -1002,12 +1056,20 @@ void datum_t::write_to_protobuf(Datum *d) const {
     } break;
     case R_OBJECT: {
         d->set_type(Datum::R_OBJECT);
-        // We use rbegin and rend so that things print the way we expect.
-        for (std::map<std::string, counted_t<const datum_t> >::const_reverse_iterator
-                 it = r_object->rbegin(); it != r_object->rend(); ++it) {
-            Datum_AssocPair *ap = d->add_r_object();
-            ap->set_key(it->first);
-            it->second->write_to_protobuf(ap->mutable_val());
+        // We go in reverse order so that things print the way we expect.
+        if (is_flat_object) {
+            for (size_t i = r_flat_object->size(); i-- > 0;) {
+                Datum_AssocPair *ap = d->add_r_object();
+                ap->set_key(r_flat_object->key(i));
+                r_flat_object->value(i)->write_to_protobuf(ap->mutable_val());
+            }
+        } else {
+            for (std::map<std::string, counted_t<const datum_t> >::const_reverse_iterator
+                     it = r_object->rbegin(); it != r_object->rend(); ++it) {
+                Datum_AssocPair *ap = d->add_r_object();
+                ap->set_key(it->first);
+                it->second->write_to_protobuf(ap->mutable_val());
+            }
         }
     } break;
     case UNINITIALIZED: // fallthru
@@ -1015,6 +1077,178 @@ void datum_t::write_to_protobuf(Datum *d) const {
     }
 }
 
+struct flat_object_t::field_t {
+    uint32_t key_size;
+    union {
+        char inline_key[inline_key_size];
+        // The offset into the string area, for keys longer than `inline_key_size`.
+        uint32_t key_offset;
+    };
+    // `UNINITIALIZED` if the value is in `datum`.
+    datum_t::type_t scalar_type;
+    union {
+        // We hold a reference to this.
+        const datum_t *datum;
+        // The value of a number, or 0 or 1 for a bool.
+        double num;
+    };
+};
+
+size_t flat_object_t::header_size() {
+    return ceil_aligned(sizeof(flat_object_t), alignof(field_t));
+}
+
+flat_object_t *flat_object_t::create(const std::vector<pending_field_t> &fields) {
+    size_t string_area_size = 0;
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+        if (it->key.size() > inline_key_size) {
+            string_area_size += it->key.size();
+        }
+    }
+    guarantee(string_area_size <= std::numeric_limits<uint32_t>::max(),
+              "Object keys too large.");
+
+    char *buf = new char[header_size() + fields.size() * sizeof(field_t)
+                         + string_area_size];
+    flat_object_t *object = new (buf) flat_object_t();
+    object->num_fields = fields.size();
+    object->map_cache = NULL;
+
+    field_t *out = reinterpret_cast<field_t *>(buf + header_size());
+    char *string_area = buf + header_size() + fields.size() * sizeof(field_t);
+    uint32_t string_area_used = 0;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        const pending_field_t &field = fields[i];
+        rassert(i == 0 || fields[i - 1].key < field.key);
+
+        out[i].key_size = field.key.size();
+        if (field.key.size() > inline_key_size) {
+            out[i].key_offset = string_area_used;
+            memcpy(string_area + string_area_used, field.key.data(), field.key.size());
+            string_area_used += field.key.size();
+        } else {
+            memcpy(out[i].inline_key, field.key.data(), field.key.size());
+        }
+
+        if (field.datum.has()) {
+            out[i].scalar_type = datum_t::UNINITIALIZED;
+            out[i].datum = field.datum.get();
+            counted_add_ref(out[i].datum);
+        } else {
+            r_sanity_check(field.scalar_type == datum_t::R_NULL
+                           || field.scalar_type == datum_t::R_BOOL
+                           || field.scalar_type == datum_t::R_NUM);
+            out[i].scalar_type = field.scalar_type;
+            out[i].num = field.num;
+        }
+    }
+    return object;
+}
+
+void flat_object_t::destroy(flat_object_t *object) {
+    for (size_t i = 0; i < object->num_fields; ++i) {
+        const field_t *f = object->field(i);
+        if (f->scalar_type == datum_t::UNINITIALIZED) {
+            counted_release(f->datum);
+        }
+    }
+    delete object->map_cache;
+    object->~flat_object_t();
+    delete[] reinterpret_cast<char *>(object);
+}
+
+const flat_object_t::field_t *flat_object_t::field(size_t index) const {
+    rassert(index < num_fields);
+    return reinterpret_cast<const field_t *>(
+        reinterpret_cast<const char *>(this) + header_size()) + index;
+}
+
+const char *flat_object_t::key_data(size_t index) const {
+    const field_t *f = field(index);
+    if (f->key_size > inline_key_size) {
+        return reinterpret_cast<const char *>(field(0) + num_fields) + f->key_offset;
+    } else {
+        return f->inline_key;
+    }
+}
+
+std::string flat_object_t::key(size_t index) const {
+    return std::string(key_data(index), field(index)->key_size);
+}
+
+counted_t<const datum_t> flat_object_t::value(size_t index) const {
+    const field_t *f = field(index);
+    switch (f->scalar_type) {
+    case datum_t::UNINITIALIZED:
+        return counted_t<const datum_t>(f->datum);
+    case datum_t::R_NULL:
+        return make_counted<const datum_t>(datum_t::R_NULL);
+    case datum_t::R_BOOL:
+        return make_counted<const datum_t>(datum_t::R_BOOL, f->num != 0);
+    case datum_t::R_NUM:
+        return make_counted<const datum_t>(f->num);
+    case datum_t::R_ARRAY:  // fallthru
+    case datum_t::R_OBJECT:  // fallthru
+    case datum_t::R_STR:  // fallthru
+    default:
+        unreachable();
+    }
+}
+
+int flat_object_t::compare_key(size_t index, const std::string &key) const {
+    const size_t size = field(index)->key_size;
+    int res = memcmp(key_data(index), key.data(), std::min(size, key.size()));
+    if (res != 0) {
+        return res;
+    }
+    return size < key.size() ? -1 : (size > key.size() ? 1 : 0);
+}
+
+bool flat_object_t::find(const std::string &key, size_t *index_out) const {
+    size_t lo = 0;
+    size_t hi = num_fields;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        const int cmp = compare_key(mid, key);
+        if (cmp == 0) {
+            *index_out = mid;
+            return true;
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+bool flat_object_t::inline_value(size_t index, datum_t::type_t *type_out,
+                                 double *num_out) const {
+    const field_t *f = field(index);
+    if (f->scalar_type == datum_t::UNINITIALIZED) {
+        return false;
+    }
+    *type_out = f->scalar_type;
+    *num_out = f->num;
+    return true;
+}
+
+const std::map<std::string, counted_t<const datum_t> > &flat_object_t::as_map() const {
+    typedef std::map<std::string, counted_t<const datum_t> > map_t;
+    map_t *cache = __atomic_load_n(&map_cache, __ATOMIC_ACQUIRE);
+    if (cache == NULL) {
+        scoped_ptr_t<map_t> map(new map_t());
+        for (size_t i = 0; i < num_fields; ++i) {
+            map->insert(map->end(), std::make_pair(key(i), value(i)));
+        }
+        cache = __sync_val_compare_and_swap(&map_cache, NULL, map.get());
+        if (cache == NULL) {
+            cache = map.release();
+        }
+    }
+    return *cache;
+}
+
 enum class datum_serialized_type_t {
     R_ARRAY = 1,
     R_BOOL = 2,
@@ -1024,11 +1258,119 @@ enum class datum_serialized_type_t {
     R_STR = 6,
     INT_NEGATIVE = 7,
     INT_POSITIVE = 8,
+    // Only written by `serialize_indexed`.
+    R_ARRAY_INDEXED = 9,
+    R_OBJECT_INDEXED = 10,
 };
 
 ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(datum_serialized_type_t, int8_t,
                                       datum_serialized_type_t::R_ARRAY,
-                                      datum_serialized_type_t::INT_POSITIVE);
+                                      datum_serialized_type_t::R_OBJECT_INDEXED);
+
+// The entries of the offset tables of the indexed layout.
+typedef uint32_t datum_offset_t;
+
+static size_t number_serialized_size(double d) {
+    int64_t i;
+    if (number_as_integer(d, &i)) {
+        return varint_uint64_serialized_size(abs(i));
+    } else {
+        return serialized_size_t<double>::value;
+    }
+}
+
+static void serialize_number(write_message_t *wm, double value) {
+    int64_t i;
+    if (number_as_integer(value, &i)) {
+        // We serialize the signed-zero double, -0.0, with INT_NEGATIVE.
+
+        // so we can use `signbit` in a GCC 4.4.3-compatible way
+        using namespace std;  // NOLINT(build/namespaces)
+        if (signbit(value)) {
+            *wm << datum_serialized_type_t::INT_NEGATIVE;
+            serialize_varint_uint64(wm, -i);
+        } else {
+            *wm << datum_serialized_type_t::INT_POSITIVE;
+            serialize_varint_uint64(wm, i);
+        }
+    } else {
+        *wm << datum_serialized_type_t::DOUBLE;
+        *wm << value;
+    }
+}
+
+// The numbers, bools and nulls that a `flat_object_t` stores inline are serialized
+// from there, without building a `datum_t` for them.
+static size_t inline_value_serialized_size(datum_t::type_t type, double num) {
+    switch (type) {
+    case datum_t::R_NULL:
+        return 1;
+    case datum_t::R_BOOL:
+        return 1 + serialized_size_t<bool>::value;
+    case datum_t::R_NUM:
+        return 1 + number_serialized_size(num);
+    case datum_t::R_ARRAY:  // fallthru
+    case datum_t::R_OBJECT:  // fallthru
+    case datum_t::R_STR:  // fallthru
+    case datum_t::UNINITIALIZED:  // fallthru
+    default:
+        unreachable();
+    }
+}
+
+static void serialize_inline_value(write_message_t *wm, datum_t::type_t type,
+                                   double num) {
+    switch (type) {
+    case datum_t::R_NULL: {
+        *wm << datum_serialized_type_t::R_NULL;
+    } break;
+    case datum_t::R_BOOL: {
+        *wm << datum_serialized_type_t::R_BOOL;
+        bool value = num != 0;
+        *wm << value;
+    } break;
+    case datum_t::R_NUM: {
+        serialize_number(wm, num);
+    } break;
+    case datum_t::R_ARRAY:  // fallthru
+    case datum_t::R_OBJECT:  // fallthru
+    case datum_t::R_STR:  // fallthru
+    case datum_t::UNINITIALIZED:  // fallthru
+    default:
+        unreachable();
+    }
+}
+
+// The serialized size of field `index` of `object`, in the indexed layout if
+// `indexed` is true.
+static size_t flat_field_serialized_size(const flat_object_t *object, size_t index,
+                                         bool indexed) {
+    size_t sz = serialized_size(object->key(index));
+    datum_t::type_t type;
+    double num;
+    if (object->inline_value(index, &type, &num)) {
+        sz += inline_value_serialized_size(type, num);
+    } else if (indexed) {
+        sz += indexed_serialized_size(object->value(index));
+    } else {
+        sz += serialized_size(object->value(index));
+    }
+    return sz;
+}
+
+static void serialize_flat_field(write_message_t *wm, const flat_object_t *object,
+                                 size_t index, bool indexed) {
+    *wm << object->key(index);
+    datum_t::type_t type;
+    double num;
+    if (object->inline_value(index, &type, &num)) {
+        serialize_inline_value(wm, type, num);
+    } else if (indexed) {
+        serialize_indexed(wm, object->value(index));
+    } else {
+        *wm << object->value(index);
+    }
+}
 
 // This must be kept in sync with operator<<(write_message_t &, const counted_t<const
 // datum_T> &).
@@ -1044,16 +1386,17 @@ size_t serialized_size(const counted_t<const datum_t> &datum) {
     } break;
     case datum_t::R_NULL: break;
     case datum_t::R_NUM: {
-        double d = datum->as_num();
-        int64_t i;
-        if (number_as_integer(d, &i)) {
-            sz += varint_uint64_serialized_size(abs(i));
-        } else {
-            sz += serialized_size_t<double>::value;
-        }
+        sz += number_serialized_size(datum->as_num());
     } break;
     case datum_t::R_OBJECT: {
-        sz += serialized_size(datum->as_object());
+        if (const flat_object_t *object = datum->as_flat_object()) {
+            sz += varint_uint64_serialized_size(object->size());
+            for (size_t i = 0; i < object->size(); ++i) {
+                sz += flat_field_serialized_size(object, i, false);
+            }
+        } else {
+            sz += serialized_size(datum->as_object());
+        }
     } break;
     case datum_t::R_STR: {
         sz += serialized_size(datum->as_str());
@@ -1082,30 +1425,22 @@ write_message_t &operator<<(write_message_t &wm, const counted_t<const datum_t>
         wm << datum_serialized_type_t::R_NULL;
     } break;
     case datum_t::R_NUM: {
-        double value = datum->as_num();
-        int64_t i;
-        if (number_as_integer(value, &i)) {
-            // We serialize the signed-zero double, -0.0, with INT_NEGATIVE.
-
-            // so we can use `signbit` in a GCC 4.4.3-compatible way
-            using namespace std;  // NOLINT(build/namespaces)
-            if (signbit(value)) {
-                wm << datum_serialized_type_t::INT_NEGATIVE;
-                serialize_varint_uint64(&wm, -i);
-            } else {
-                wm << datum_serialized_type_t::INT_POSITIVE;
-                serialize_varint_uint64(&wm, i);
+        serialize_number(&wm, datum->as_num());
+    } break;
+    case datum_t::R_OBJECT: {
+        wm << datum_serialized_type_t::R_OBJECT;
+        if (const flat_object_t *object = datum->as_flat_object()) {
+            // This is the same format `std::map` is serialized in.
+            serialize_varint_uint64(&wm, object->size());
+            for (size_t i = 0; i < object->size(); ++i) {
+                serialize_flat_field(&wm, object, i, false);
             }
         } else {
-            wm << datum_serialized_type_t::DOUBLE;
+            const std::map<std::string, counted_t<const datum_t> > &value
+                = datum->as_object();
             wm << value;
         }
     } break;
-    case datum_t::R_OBJECT: {
-        wm << datum_serialized_type_t::R_OBJECT;
-        const std::map<std::string, counted_t<const datum_t> > &value = datum->as_object();
-        wm << value;
-    } break;
     case datum_t::R_STR: {
         wm << datum_serialized_type_t::R_STR;
         const std::string &value = datum->as_str();
@@ -1118,13 +1453,184 @@ write_message_t &operator<<(write_message_t &wm, const counted_t<const datum_t>
     return wm;
 }
 
+// Reads the number of parts of an indexed compound value and skips its offset
+// table, which sequential readers don't need.
+static archive_result_t deserialize_offset_table(read_stream_t *s, uint64_t *size_out) {
+    archive_result_t res = deserialize_varint_uint64(s, size_out);
+    if (res) {
+        return res;
+    }
+    for (uint64_t i = 0; i < *size_out; ++i) {
+        datum_offset_t offset;
+        res = deserialize(s, &offset);
+        if (res) {
+            return res;
+        }
+    }
+    return ARCHIVE_SUCCESS;
+}
+
+// Reads the rest of a number whose type has been read already.
+static archive_result_t deserialize_number(read_stream_t *s,
+                                           datum_serialized_type_t type,
+                                           double *value_out) {
+    if (type == datum_serialized_type_t::DOUBLE) {
+        archive_result_t res = deserialize(s, value_out);
+        if (res) {
+            return res;
+        }
+    } else {
+        r_sanity_check(type == datum_serialized_type_t::INT_NEGATIVE
+                       || type == datum_serialized_type_t::INT_POSITIVE);
+        uint64_t unsigned_value;
+        archive_result_t res = deserialize_varint_uint64(s, &unsigned_value);
+        if (res) {
+            return res;
+        }
+        if (unsigned_value > max_dbl_int) {
+            return ARCHIVE_RANGE_ERROR;
+        }
+        const double d = unsigned_value;
+        if (type == datum_serialized_type_t::INT_NEGATIVE) {
+            // This might deserialize the signed-zero double, -0.0.
+            *value_out = -d;
+        } else {
+            *value_out = d;
+        }
+    }
+    // so we can use `isfinite` in a GCC 4.4.3-compatible way
+    using namespace std;  // NOLINT(build/namespaces)
+    return isfinite(*value_out) ? ARCHIVE_SUCCESS : ARCHIVE_RANGE_ERROR;
+}
+
+static counted_t<const datum_t> make_pending_field_datum(
+        const flat_object_t::pending_field_t &field) {
+    if (field.datum.has()) {
+        return field.datum;
+    }
+    switch (field.scalar_type) {
+    case datum_t::R_NULL:
+        return make_counted<const datum_t>(datum_t::R_NULL);
+    case datum_t::R_BOOL:
+        return make_counted<const datum_t>(datum_t::R_BOOL, field.num != 0);
+    case datum_t::R_NUM:
+        return make_counted<const datum_t>(field.num);
+    case datum_t::R_ARRAY:  // fallthru
+    case datum_t::R_OBJECT:  // fallthru
+    case datum_t::R_STR:  // fallthru
+    case datum_t::UNINITIALIZED:  // fallthru
+    default:
+        unreachable();
+    }
+}
+
+static archive_result_t deserialize_of_type(read_stream_t *s,
+                                            datum_serialized_type_t type,
+                                            counted_t<const datum_t> *datum);
+
+// Reads a field value, keeping scalars out of `datum_t`s so that they can be
+// stored inline in a `flat_object_t`.
+static archive_result_t deserialize_pending_field_value(
+        read_stream_t *s, flat_object_t::pending_field_t *field) {
+    datum_serialized_type_t type;
+    archive_result_t res = deserialize(s, &type);
+    if (res) {
+        return res;
+    }
+
+    switch (type) {
+    case datum_serialized_type_t::R_BOOL: {
+        bool value;
+        res = deserialize(s, &value);
+        if (res) {
+            return res;
+        }
+        field->scalar_type = datum_t::R_BOOL;
+        field->num = value ? 1 : 0;
+    } break;
+    case datum_serialized_type_t::R_NULL: {
+        field->scalar_type = datum_t::R_NULL;
+    } break;
+    case datum_serialized_type_t::DOUBLE:  // fall through
+    case datum_serialized_type_t::INT_NEGATIVE:  // fall through
+    case datum_serialized_type_t::INT_POSITIVE: {
+        res = deserialize_number(s, type, &field->num);
+        if (res) {
+            return res;
+        }
+        field->scalar_type = datum_t::R_NUM;
+    } break;
+    case datum_serialized_type_t::R_ARRAY:  // fall through
+    case datum_serialized_type_t::R_OBJECT:  // fall through
+    case datum_serialized_type_t::R_STR:  // fall through
+    case datum_serialized_type_t::R_ARRAY_INDEXED:  // fall through
+    case datum_serialized_type_t::R_OBJECT_INDEXED:  // fall through
+    default:
+        return deserialize_of_type(s, type, &field->datum);
+    }
+    return ARCHIVE_SUCCESS;
+}
+
+// Reads the `size` key/value pairs of an object, in either layout. Objects whose
+// keys come sorted, which is all of the ones we write, end up as a
+// `flat_object_t`.
+static archive_result_t deserialize_object_fields(read_stream_t *s, uint64_t size,
+                                                  counted_t<const datum_t> *datum) {
+    std::vector<flat_object_t::pending_field_t> fields;
+    // `size` comes off the wire, so don't trust it too much.
+    fields.reserve(std::min<uint64_t>(size, 1024));
+    bool sorted = true;
+    bool is_ptype = false;
+    for (uint64_t i = 0; i < size; ++i) {
+        flat_object_t::pending_field_t field;
+        archive_result_t res = deserialize(s, &field.key);
+        if (res) {
+            return res;
+        }
+        res = deserialize_pending_field_value(s, &field);
+        if (res) {
+            return res;
+        }
+        if (!fields.empty() && !(fields.back().key < field.key)) {
+            sorted = false;
+        }
+        if (field.key == datum_t::reql_type_string) {
+            is_ptype = true;
+        }
+        fields.push_back(std::move(field));
+    }
+
+    try {
+        if (sorted && !is_ptype) {
+            datum->reset(new datum_t(flat_object_t::create(fields)));
+        } else {
+            // Pseudotypes have to be sanitized, which needs the map.  Like
+            // deserializing a `std::map`, this keeps the first of duplicate keys.
+            std::map<std::string, counted_t<const datum_t> > value;
+            for (auto it = fields.begin(); it != fields.end(); ++it) {
+                value.insert(std::make_pair(it->key, make_pending_field_datum(*it)));
+            }
+            datum->reset(new datum_t(std::move(value)));
+        }
+    } catch (const base_exc_t &) {
+        return ARCHIVE_RANGE_ERROR;
+    }
+    return ARCHIVE_SUCCESS;
+}
+
 archive_result_t deserialize(read_stream_t *s, counted_t<const datum_t> *datum) {
     datum_serialized_type_t type;
     archive_result_t res = deserialize(s, &type);
     if (res) {
         return res;
     }
+    return deserialize_of_type(s, type, datum);
+}
 
+static archive_result_t deserialize_of_type(read_stream_t *s,
+                                            datum_serialized_type_t type,
+                                            counted_t<const datum_t> *datum) {
+    archive_result_t res;
     switch (type) {
     case datum_serialized_type_t::R_ARRAY: {
         std::vector<counted_t<const datum_t> > value;
@@ -1153,9 +1659,11 @@ archive_result_t deserialize(read_stream_t *s, counted_t<const datum_t> *datum)
     case datum_serialized_type_t::R_NULL: {
         datum->reset(new datum_t(datum_t::R_NULL));
     } break;
-    case datum_serialized_type_t::DOUBLE: {
+    case datum_serialized_type_t::DOUBLE:  // fall through
+    case datum_serialized_type_t::INT_NEGATIVE:  // fall through
+    case datum_serialized_type_t::INT_POSITIVE: {
         double value;
-        res = deserialize(s, &value);
+        res = deserialize_number(s, type, &value);
         if (res) {
             return res;
         }
@@ -1165,32 +1673,16 @@ archive_result_t deserialize(read_stream_t *s, counted_t<const datum_t> *datum)
             return ARCHIVE_RANGE_ERROR;
         }
     } break;
-    case datum_serialized_type_t::INT_NEGATIVE:  // fall through
-    case datum_serialized_type_t::INT_POSITIVE: {
-        uint64_t unsigned_value;
-        res = deserialize_varint_uint64(s, &unsigned_value);
+    case datum_serialized_type_t::R_OBJECT: {
+        uint64_t size;
+        res = deserialize_varint_uint64(s, &size);
         if (res) {
             return res;
         }
-        if (unsigned_value > max_dbl_int) {
-            return ARCHIVE_RANGE_ERROR;
-        }
-        const double d = unsigned_value;
-        double value;
-        if (type == datum_serialized_type_t::INT_NEGATIVE) {
-            // This might deserialize the signed-zero double, -0.0.
-            value = -d;
-        } else {
-            value = d;
-        }
-        try {
-            datum->reset(new datum_t(value));
-        } catch (const base_exc_t &) {
-            return ARCHIVE_RANGE_ERROR;
-        }
+        return deserialize_object_fields(s, size, datum);
     } break;
-    case datum_serialized_type_t::R_OBJECT: {
-        std::map<std::string, counted_t<const datum_t> > value;
+    case datum_serialized_type_t::R_STR: {
+        std::string value;
         res = deserialize(s, &value);
         if (res) {
             return res;
@@ -1201,18 +1693,35 @@ archive_result_t deserialize(read_stream_t *s, counted_t<const datum_t> *datum)
             return ARCHIVE_RANGE_ERROR;
         }
     } break;
-    case datum_serialized_type_t::R_STR: {
-        std::string value;
-        res = deserialize(s, &value);
+    case datum_serialized_type_t::R_ARRAY_INDEXED: {
+        uint64_t size;
+        res = deserialize_offset_table(s, &size);
         if (res) {
             return res;
         }
+        std::vector<counted_t<const datum_t> > value;
+        for (uint64_t i = 0; i < size; ++i) {
+            counted_t<const datum_t> element;
+            res = deserialize(s, &element);
+            if (res) {
+                return res;
+            }
+            value.push_back(std::move(element));
+        }
         try {
             datum->reset(new datum_t(std::move(value)));
         } catch (const base_exc_t &) {
             return ARCHIVE_RANGE_ERROR;
         }
     } break;
+    case datum_serialized_type_t::R_OBJECT_INDEXED: {
+        uint64_t size;
+        res = deserialize_offset_table(s, &size);
+        if (res) {
+            return res;
+        }
+        return deserialize_object_fields(s, size, datum);
+    } break;
     default:
         return ARCHIVE_RANGE_ERROR;
     }
@@ -1220,6 +1729,173 @@ archive_result_t deserialize(read_stream_t *s, counted_t<const datum_t> *datum)
     return ARCHIVE_SUCCESS;
 }
 
+// This must be kept in sync with serialize_indexed.
+size_t indexed_serialized_size(const counted_t<const datum_t> &datum) {
+    r_sanity_check(datum.has());
+    switch (datum->get_type()) {
+    case datum_t::R_ARRAY: {
+        const std::vector<counted_t<const datum_t> > &value = datum->as_array();
+        size_t sz = 1 + varint_uint64_serialized_size(value.size())
+            + value.size() * sizeof(datum_offset_t);
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            sz += indexed_serialized_size(*it);
+        }
+        return sz;
+    }
+    case datum_t::R_OBJECT: {
+        if (const flat_object_t *object = datum->as_flat_object()) {
+            size_t sz = 1 + varint_uint64_serialized_size(object->size())
+                + object->size() * sizeof(datum_offset_t);
+            for (size_t i = 0; i < object->size(); ++i) {
+                sz += flat_field_serialized_size(object, i, true);
+            }
+            return sz;
+        }
+        const std::map<std::string, counted_t<const datum_t> > &value = datum->as_object();
+        size_t sz = 1 + varint_uint64_serialized_size(value.size())
+            + value.size() * sizeof(datum_offset_t);
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            sz += serialized_size(it->first) + indexed_serialized_size(it->second);
+        }
+        return sz;
+    }
+    case datum_t::R_NULL:  // fallthru
+    case datum_t::R_BOOL:  // fallthru
+    case datum_t::R_NUM:  // fallthru
+    case datum_t::R_STR:
+        return serialized_size(datum);
+    case datum_t::UNINITIALIZED:  // fallthru
+    default:
+        unreachable();
+    }
+}
+
+// Writes the offset table for a compound value whose parts have the given sizes.
+static void serialize_offset_table(write_message_t *wm,
+                                   const std::vector<size_t> &part_sizes) {
+    serialize_varint_uint64(wm, part_sizes.size());
+    size_t offset = 0;
+    for (auto it = part_sizes.begin(); it != part_sizes.end(); ++it) {
+        guarantee(offset <= std::numeric_limits<datum_offset_t>::max(),
+                  "Datum too large for the indexed layout.");
+        *wm << static_cast<datum_offset_t>(offset);
+        offset += *it;
+    }
+}
+
+void serialize_indexed(write_message_t *wm, const counted_t<const datum_t> &datum) {
+    r_sanity_check(datum.has());
+    switch (datum->get_type()) {
+    case datum_t::R_ARRAY: {
+        *wm << datum_serialized_type_t::R_ARRAY_INDEXED;
+        const std::vector<counted_t<const datum_t> > &value = datum->as_array();
+        std::vector<size_t> part_sizes;
+        part_sizes.reserve(value.size());
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            part_sizes.push_back(indexed_serialized_size(*it));
+        }
+        serialize_offset_table(wm, part_sizes);
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            serialize_indexed(wm, *it);
+        }
+    } break;
+    case datum_t::R_OBJECT: {
+        *wm << datum_serialized_type_t::R_OBJECT_INDEXED;
+        if (const flat_object_t *object = datum->as_flat_object()) {
+            // Serializing straight from the flat layout saves building the map
+            // that `as_object()` would cache on the object.
+            std::vector<size_t> part_sizes;
+            part_sizes.reserve(object->size());
+            for (size_t i = 0; i < object->size(); ++i) {
+                part_sizes.push_back(flat_field_serialized_size(object, i, true));
+            }
+            serialize_offset_table(wm, part_sizes);
+            for (size_t i = 0; i < object->size(); ++i) {
+                serialize_flat_field(wm, object, i, true);
+            }
+            break;
+        }
+        const std::map<std::string, counted_t<const datum_t> > &value = datum->as_object();
+        std::vector<size_t> part_sizes;
+        part_sizes.reserve(value.size());
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            part_sizes.push_back(serialized_size(it->first)
+                                 + indexed_serialized_size(it->second));
+        }
+        serialize_offset_table(wm, part_sizes);
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            *wm << it->first;
+            serialize_indexed(wm, it->second);
+        }
+    } break;
+    case datum_t::R_NULL:  // fallthru
+    case datum_t::R_BOOL:  // fallthru
+    case datum_t::R_NUM:  // fallthru
+    case datum_t::R_STR:
+        *wm << datum;
+        break;
+    case datum_t::UNINITIALIZED:  // fallthru
+    default:
+        unreachable();
+    }
+}
+
+archive_result_t deserialize_indexed_field(buffer_group_read_stream_t *s,
+                                           const std::string &key,
+                                           bool *indexed_out,
+                                           counted_t<const datum_t> *field_out) {
+    field_out->reset();
+
+    datum_serialized_type_t type;
+    archive_result_t res = deserialize(s, &type);
+    if (res) {
+        return res;
+    }
+    if (type != datum_serialized_type_t::R_OBJECT_INDEXED) {
+        *indexed_out = false;
+        return ARCHIVE_SUCCESS;
+    }
+    *indexed_out = true;
+
+    uint64_t size;
+    res = deserialize_varint_uint64(s, &size);
+    if (res) {
+        return res;
+    }
+    const int64_t table_offset = 1 + varint_uint64_serialized_size(size);
+    const int64_t body_offset = table_offset + size * sizeof(datum_offset_t);
+
+    uint64_t lo = 0;
+    uint64_t hi = size;
+    while (lo < hi) {
+        const uint64_t mid = lo + (hi - lo) / 2;
+        s->seek(table_offset + mid * sizeof(datum_offset_t));
+        datum_offset_t pair_offset;
+        res = deserialize(s, &pair_offset);
+        if (res) {
+            return res;
+        }
+
+        s->seek(body_offset + pair_offset);
+        std::string pair_key;
+        res = deserialize(s, &pair_key);
+        if (res) {
+            return res;
+        }
+
+        const int cmp = pair_key.compare(key);
+        if (cmp == 0) {
+            return deserialize(s, field_out);
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return ARCHIVE_SUCCESS;
+}
+
 write_message_t &operator<<(write_message_t &wm, const empty_ok_t<const counted_t<const datum_t> > &datum) {
     const counted_t<const datum_t> *pointer = datum.get();
     const bool has = pointer->has();
@@ -1298,6 +1974,10 @@ counted_t<const datum_t> wire_datum_map_t::to_arr() const {
     return arr.to_counted();
 }
 
+size_t wire_datum_map_t::size() const {
+    return state == COMPILED ? map.size() : map_pb.size();
+}
+
 void wire_datum_map_t::rdb_serialize(write_message_t &msg /* NOLINT */) const {
     r_sanity_check(state == SERIALIZABLE);
     msg << map_pb;
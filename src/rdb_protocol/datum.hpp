@@ -20,12 +20,14 @@
 #include "rdb_protocol/error.hpp"
 
 class Datum;
+class buffer_group_read_stream_t;
 
 RDB_DECLARE_SERIALIZABLE(Datum);
 
 namespace ql {
 class datum_stream_t;
 class env_t;
+class flat_object_t;
 class val_t;
 
 namespace pseudo {
@@ -68,6 +70,8 @@ public:
     explicit datum_t(const char *cstr);
     explicit datum_t(std::vector<counted_t<const datum_t> > &&_array);
     explicit datum_t(std::map<std::string, counted_t<const datum_t> > &&object);
+    // Takes ownership of `object`, which must not be a pseudotype.
+    explicit datum_t(flat_object_t *object);
 
     // These construct a datum from an equivalent representation.
     datum_t();
@@ -111,8 +115,12 @@ public:
     size_t size() const;
     // Access an element of an array.
     counted_t<const datum_t> get(size_t index, throw_bool_t throw_bool = THROW) const;
-    // Use of `get` is preferred to `as_object` when possible.
+    // Use of `get` is preferred to `as_object` when possible.  Objects that were
+    // deserialized are stored as a `flat_object_t`, and have to build the map
+    // the first time `as_object` is called on them.
     const std::map<std::string, counted_t<const datum_t> > &as_object() const;
+    // Returns NULL unless this is an object stored as a `flat_object_t`.
+    const flat_object_t *as_flat_object() const;
 
     // Access an element of an object.
     counted_t<const datum_t> get(const std::string &key,
@@ -195,6 +203,8 @@ private:
     void maybe_sanitize_ptype(const std::set<std::string> &allowed_pts = _allowed_pts);
 
     type_t type;
+    // Whether an R_OBJECT is stored in `r_flat_object` rather than `r_object`.
+    bool is_flat_object;
     union {
         bool r_bool;
         double r_num;
@@ -202,6 +212,7 @@ private:
         std::string *r_str;
         std::vector<counted_t<const datum_t> > *r_array;
         std::map<std::string, counted_t<const datum_t> > *r_object;
+        flat_object_t *r_flat_object;
     };
 
 public:
@@ -211,6 +222,64 @@ private:
     DISABLE_COPYING(datum_t);
 };
 
+/* `flat_object_t` is the compact representation of the objects `deserialize`
+produces. A `std::map` costs an allocation per field for the tree node, plus one for
+the value's `datum_t`. A `flat_object_t` keeps all the fields in a single
+allocation, sorted by key. Keys of up to `inline_key_size` bytes are stored inline,
+longer ones in a string area at the end of the allocation. Numbers, bools and
+nulls are stored inline too, so only strings, arrays and objects need separate
+`datum_t`s. */
+class flat_object_t {
+public:
+    static const size_t inline_key_size = 12;
+
+    // A field that hasn't been put into a `flat_object_t` yet. If `datum` is
+    // empty, the value is the scalar of type `scalar_type`.
+    struct pending_field_t {
+        pending_field_t() : scalar_type(datum_t::UNINITIALIZED), num(0) { }
+        std::string key;
+        counted_t<const datum_t> datum;
+        datum_t::type_t scalar_type;
+        double num;
+    };
+
+    // `fields` must be sorted by key and must not have duplicate keys.
+    static flat_object_t *create(const std::vector<pending_field_t> &fields);
+    static void destroy(flat_object_t *object);
+
+    size_t size() const { return num_fields; }
+    std::string key(size_t index) const;
+    // This allocates a new `datum_t` for inline numbers, bools and nulls.
+    counted_t<const datum_t> value(size_t index) const;
+    // Binary searches for `key`; returns false if there is no such field.
+    bool find(const std::string &key, size_t *index_out) const;
+
+    // Returns false if the value of field `index` is a separate `datum_t`.
+    // Otherwise sets `*type_out` to the type of the inline value and `*num_out`
+    // to the number, or to 0 or 1 for a bool.
+    bool inline_value(size_t index, datum_t::type_t *type_out, double *num_out) const;
+
+    // Builds the map on the first call. Objects are shared between threads, so
+    // threads that race to build it publish theirs with a compare-and-swap and
+    // all but one of them throw theirs away.
+    const std::map<std::string, counted_t<const datum_t> > &as_map() const;
+
+private:
+    struct field_t;
+
+    flat_object_t() { }
+    ~flat_object_t() { }
+    static size_t header_size();
+    const field_t *field(size_t index) const;
+    const char *key_data(size_t index) const;
+    int compare_key(size_t index, const std::string &key) const;
+
+    size_t num_fields;
+    mutable std::map<std::string, counted_t<const datum_t> > *map_cache;
+
+    DISABLE_COPYING(flat_object_t);
+};
+
 size_t serialized_size(const counted_t<const datum_t> &datum);
 
 write_message_t &operator<<(write_message_t &wm, const counted_t<const datum_t> &datum);
@@ -219,6 +288,23 @@ archive_result_t deserialize(read_stream_t *s, counted_t<const datum_t> *datum);
 write_message_t &operator<<(write_message_t &wm, const empty_ok_t<const counted_t<const datum_t> > &datum);
 archive_result_t deserialize(read_stream_t *s, empty_ok_ref_t<counted_t<const datum_t> > datum);
 
+/* The indexed layout is how rows are stored on disk. Objects and arrays start with
+a table of fixed-width offsets to their fields (sorted by key) or elements, so
+`deserialize_indexed_field` can read a single field out of a serialized row without
+building the rest of it. `deserialize` reads both layouts, so rows written before
+the indexed layout existed still load. */
+size_t indexed_serialized_size(const counted_t<const datum_t> &datum);
+void serialize_indexed(write_message_t *wm, const counted_t<const datum_t> &datum);
+
+// Reads the field `key` of an object written by `serialize_indexed` by binary
+// searching its offset table. `*field_out` is left empty if the object has no such
+// field. If the value isn't an object in the indexed layout, sets `*indexed_out` to
+// false and reads nothing; the caller has to deserialize the whole value instead.
+archive_result_t deserialize_indexed_field(buffer_group_read_stream_t *s,
+                                           const std::string &key,
+                                           bool *indexed_out,
+                                           counted_t<const datum_t> *field_out);
+
 // Converts a double to int, but returns false if it's not an integer or out of range.
 bool number_as_integer(double d, int64_t *i_out);
 
@@ -292,6 +378,29 @@ public:
     void finalize();
 
     counted_t<const datum_t> to_arr() const;
+
+    // The number of groups, in either state.
+    size_t size() const;
+
+    // Moves the groups of `other` into this map, leaving `other` empty.  Groups
+    // that are in both maps get the value `reduce(ours, theirs)`.  Both maps must
+    // be compiled.
+    template <class reduce_t>
+    void merge(wire_datum_map_t *other, const reduce_t &reduce) {
+        r_sanity_check(state == COMPILED && other->state == COMPILED);
+        if (map.empty()) {
+            map.swap(other->map);
+            return;
+        }
+        for (auto it = other->map.begin(); it != other->map.end(); ++it) {
+            auto res = map.insert(*it);
+            if (!res.second) {
+                res.first->second = reduce(res.first->second, it->second);
+            }
+        }
+        other->map.clear();
+    }
+
 private:
     struct datum_value_compare_t {
         bool operator()(counted_t<const datum_t> a, counted_t<const datum_t> b) const {
@@ -1,11 +1,16 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "rdb_protocol/datum_stream.hpp"
 
+#include <functional>
 #include <map>
 
 #include "clustering/administration/metadata.hpp"
+#include "config/args.hpp"
+#include "containers/archive/stl_types.hpp"
+#include "containers/disk_backed_queue.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/func.hpp"
+#include "rdb_protocol/pseudo_time.hpp"
 #include "rdb_protocol/term.hpp"
 #include "rdb_protocol/val.hpp"
 
@@ -17,6 +22,7 @@ const char *const empty_stream_msg =
 
 // DATUM_STREAM_T
 counted_t<datum_stream_t> datum_stream_t::slice(size_t l, size_t r) {
+    limit_hint(r);
     return make_counted<slice_datum_stream_t>(l, r, this->counted_from_this());
 }
 counted_t<datum_stream_t> datum_stream_t::zip() {
@@ -61,6 +67,15 @@ hinted_datum_t datum_stream_t::sorting_hint_next(env_t *env) {
     return hinted_datum_t(query_language::CONTINUE, next(env));
 }
 
+std::vector<counted_t<const datum_t> > datum_stream_t::top_k(
+        env_t *env, const top_k_wire_func_t &f) {
+    std::vector<counted_t<const datum_t> > top;
+    while (counted_t<const datum_t> d = next(env)) {
+        f.add(env, d, &top);
+    }
+    return top;
+}
+
 counted_t<const datum_t> eager_datum_stream_t::count(env_t *env) {
     int64_t i = 0;
     for (;;) {
@@ -124,55 +139,60 @@ counted_t<const datum_t> eager_datum_stream_t::as_array(env_t *env) {
 // LAZY_DATUM_STREAM_T
 lazy_datum_stream_t::lazy_datum_stream_t(
     env_t *env, bool use_outdated, namespace_repo_t<rdb_protocol_t>::access_t *ns_access,
-    sorting_t sorting, const protob_t<const Backtrace> &bt_src)
+    sorting_t _sorting, const protob_t<const Backtrace> &bt_src)
     : datum_stream_t(bt_src),
       json_stream(new query_language::batched_rget_stream_t(
                       *ns_access,
                       counted_t<datum_t>(), false, counted_t<const datum_t>(), false,
-                      env->global_optargs.get_all_optargs(), use_outdated, sorting, this))
+                      env->global_optargs.get_all_optargs(), use_outdated, _sorting, this)),
+      sorting(_sorting)
 { }
 
 lazy_datum_stream_t::lazy_datum_stream_t(
         env_t *env, bool use_outdated,
         namespace_repo_t<rdb_protocol_t>::access_t *ns_access,
-        const std::string &sindex_id, sorting_t sorting,
+        const std::string &sindex_id, sorting_t _sorting,
         const protob_t<const Backtrace> &bt_src)
     : datum_stream_t(bt_src),
       json_stream(new query_language::batched_rget_stream_t(
                       *ns_access, sindex_id,
                       counted_t<datum_t>(), false, counted_t<datum_t>(), false,
                       env->global_optargs.get_all_optargs(), use_outdated,
-                      sorting, this))
+                      _sorting, this)),
+      sorting(_sorting)
 { }
 
 lazy_datum_stream_t::lazy_datum_stream_t(
     env_t *env, bool use_outdated, namespace_repo_t<rdb_protocol_t>::access_t *ns_access,
     counted_t<const datum_t> left_bound, bool left_bound_open,
     counted_t<const datum_t> right_bound, bool right_bound_open,
-    sorting_t sorting, const protob_t<const Backtrace> &bt_src)
+    sorting_t _sorting, const protob_t<const Backtrace> &bt_src)
     : datum_stream_t(bt_src),
       json_stream(new query_language::batched_rget_stream_t(
                       *ns_access,
                       left_bound, left_bound_open, right_bound, right_bound_open,
-                      env->global_optargs.get_all_optargs(), use_outdated, sorting,
-                      this))
+                      env->global_optargs.get_all_optargs(), use_outdated, _sorting,
+                      this)),
+      sorting(_sorting)
 { }
 
 lazy_datum_stream_t::lazy_datum_stream_t(
     env_t *env, bool use_outdated, namespace_repo_t<rdb_protocol_t>::access_t *ns_access,
     counted_t<const datum_t> left_bound, bool left_bound_open,
     counted_t<const datum_t> right_bound, bool right_bound_open,
-    const std::string &sindex_id, sorting_t sorting,
+    const std::string &sindex_id, sorting_t _sorting,
     const protob_t<const Backtrace> &bt_src)
     : datum_stream_t(bt_src),
       json_stream(new query_language::batched_rget_stream_t(
                       *ns_access, sindex_id,
                       left_bound, left_bound_open, right_bound, right_bound_open,
-                      env->global_optargs.get_all_optargs(), use_outdated, sorting, this))
+                      env->global_optargs.get_all_optargs(), use_outdated, _sorting, this)),
+      sorting(_sorting)
 { }
 
 lazy_datum_stream_t::lazy_datum_stream_t(const lazy_datum_stream_t *src)
-    : datum_stream_t(src->backtrace()), json_stream(src->json_stream) { }
+    : datum_stream_t(src->backtrace()), json_stream(src->json_stream),
+      sorting(src->sorting) { }
 
 counted_t<datum_stream_t> lazy_datum_stream_t::map(counted_t<func_t> f) {
     scoped_ptr_t<lazy_datum_stream_t> out(new lazy_datum_stream_t(this));
@@ -264,6 +284,15 @@ counted_t<const datum_t> lazy_datum_stream_t::gmr(env_t *env,
     }
 }
 
+std::vector<counted_t<const datum_t> > lazy_datum_stream_t::top_k(
+        env_t *env, const top_k_wire_func_t &f) {
+    rdb_protocol_t::rget_read_response_t::result_t res = run_terminal(env, f);
+    rdb_protocol_t::rget_read_response_t::vec_t *top =
+        boost::get<rdb_protocol_t::rget_read_response_t::vec_t>(&res);
+    r_sanity_check(top);
+    return *top;
+}
+
 hinted_datum_t lazy_datum_stream_t::sorting_hint_next(env_t *env) {
     return json_stream->sorting_hint_next(env);
 }
@@ -415,6 +444,617 @@ counted_t<const datum_t> zip_datum_stream_t::next_impl(env_t *env) {
     return right.has() ? left->merge(right) : left;
 }
 
+// EQ_JOIN_DATUM_STREAM_T
+counted_t<const datum_t> make_join_pair(counted_t<const datum_t> left,
+                                        counted_t<const datum_t> right) {
+    datum_ptr_t pair(datum_t::R_OBJECT);
+    UNUSED bool b1 = pair.add("left", left);
+    UNUSED bool b2 = pair.add("right", right);
+    return pair.to_counted();
+}
+
+eq_join_datum_stream_t::eq_join_datum_stream_t(counted_t<func_t> _left_attr,
+                                               counted_t<table_t> _table,
+                                               const std::string &_index,
+                                               counted_t<datum_stream_t> _source)
+    : wrapper_datum_stream_t(_source), left_attr(_left_attr),
+      table(_table), index(_index) {
+    guarantee(left_attr.has() && table.has());
+}
+
+bool eq_join_datum_stream_t::load_batch(env_t *env) {
+    std::vector<counted_t<const datum_t> > left_rows;
+    std::vector<counted_t<const datum_t> > keys;
+    while (left_rows.size() < POINT_READ_BATCH_SIZE) {
+        counted_t<const datum_t> row;
+        if (pending_left_row.has()) {
+            row.swap(pending_left_row);
+        } else {
+            row = source->next(env);
+            if (!row.has()) {
+                break;
+            }
+        }
+
+        counted_t<const datum_t> key;
+        try {
+            key = left_attr->call(env, row)->as_datum();
+            key->print_primary(); // ERROR CHECKING
+        } catch (const base_exc_t &) {
+            // Hand out the rows before this one first, as a row-at-a-time join
+            // would have.
+            if (left_rows.empty()) {
+                throw;
+            }
+            pending_left_row = row;
+            break;
+        }
+        left_rows.push_back(row);
+        keys.push_back(key);
+    }
+    if (left_rows.empty()) {
+        return false;
+    }
+
+    std::vector<counted_t<const datum_t> > right_rows = table->get_rows(env, keys);
+    r_sanity_check(right_rows.size() == left_rows.size());
+    for (size_t i = 0; i < left_rows.size(); ++i) {
+        if (right_rows[i]->get_type() != datum_t::R_NULL) {
+            batch.push_back(make_join_pair(left_rows[i], right_rows[i]));
+        }
+    }
+    return true;
+}
+
+counted_t<const datum_t> eq_join_datum_stream_t::next_impl(env_t *env) {
+    if (index == table->get_pkey()) {
+        while (batch.empty()) {
+            if (!load_batch(env)) {
+                return counted_t<const datum_t>();
+            }
+        }
+        counted_t<const datum_t> datum = batch.front();
+        batch.pop_front();
+        return datum;
+    }
+
+    for (;;) {
+        if (!right_rows.has()) {
+            left_row = source->next(env);
+            if (!left_row.has()) {
+                return counted_t<const datum_t>();
+            }
+            right_rows = table->get_all(env, left_attr->call(env, left_row)->as_datum(),
+                                        index, backtrace());
+        }
+
+        counted_t<const datum_t> right_row = right_rows->next(env);
+        if (right_row.has()) {
+            return make_join_pair(left_row, right_row);
+        }
+
+        right_rows.reset();
+    }
+}
+
+// How much memory a disk-backed queue holds on to for buffering, whatever is in it.
+static const size_t SPILL_QUEUE_BUFFERS_SIZE
+    = DISK_BACKED_QUEUE_WRITE_BATCH_SIZE + DISK_BACKED_QUEUE_READ_AHEAD_SIZE;
+
+// JOIN_DATUM_STREAM_T
+struct join_datum_stream_t::partition_t {
+    partition_t() : size(0) { }
+
+    // Moves all of the partition's rows to `*rows_out`, in the order they were
+    // added, and drops the queue.
+    void pop_all(std::vector<counted_t<const datum_t> > *rows_out) {
+        rows_out->reserve(size);
+        if (queue.has()) {
+            std::vector<counted_t<const datum_t> > rows;
+            while (!queue->empty()) {
+                queue->pop(&rows);
+                rows_out->insert(rows_out->end(),
+                                 std::make_move_iterator(rows.begin()),
+                                 std::make_move_iterator(rows.end()));
+            }
+            queue.reset();
+        }
+        rows_out->insert(rows_out->end(),
+                         std::make_move_iterator(chunk.begin()),
+                         std::make_move_iterator(chunk.end()));
+        chunk.clear();
+        size = 0;
+    }
+
+    // Moves the partition's next chunk of rows to `*rows_out`, dropping the queue
+    // once it's empty.  Returns false once there are no more.
+    bool pop_chunk(std::vector<counted_t<const datum_t> > *rows_out) {
+        rows_out->clear();
+        if (queue.has()) {
+            if (!queue->empty()) {
+                queue->pop(rows_out);
+                return true;
+            }
+            queue.reset();
+        }
+        if (chunk.empty()) {
+            size = 0;
+            return false;
+        }
+        rows_out->swap(chunk);
+        return true;
+    }
+
+    // Created once the first chunk fills up.
+    scoped_ptr_t<disk_backed_queue_t<std::vector<counted_t<const datum_t> > > > queue;
+    // The rows that aren't in `queue` yet.
+    std::vector<counted_t<const datum_t> > chunk;
+    size_t size;
+};
+
+size_t combine_hashes(size_t seed, size_t hash) {
+    return seed ^ (hash + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+// Agrees with `datum_t::operator==`, which doesn't tell 0 from -0 (even inside
+// arrays and objects) and compares times only by their epoch time.
+size_t hash_join_key(const counted_t<const datum_t> &key) {
+    const datum_t::type_t type = key->get_type();
+    size_t hash = std::hash<int>()(type);
+    switch (type) {
+    case datum_t::R_NULL:
+        return hash;
+    case datum_t::R_BOOL:
+        return combine_hashes(hash, std::hash<bool>()(key->as_bool()));
+    case datum_t::R_NUM: {
+        const double num = key->as_num();
+        return combine_hashes(hash, std::hash<double>()(num == 0 ? 0.0 : num));
+    }
+    case datum_t::R_STR:
+        return combine_hashes(hash, std::hash<std::string>()(key->as_str()));
+    case datum_t::R_ARRAY: {
+        const std::vector<counted_t<const datum_t> > &arr = key->as_array();
+        for (auto it = arr.begin(); it != arr.end(); ++it) {
+            hash = combine_hashes(hash, hash_join_key(*it));
+        }
+        return hash;
+    }
+    case datum_t::R_OBJECT: {
+        if (key->is_ptype(pseudo::time_string)) {
+            const double epoch_time = pseudo::time_to_epoch_time(key);
+            return combine_hashes(
+                hash, std::hash<double>()(epoch_time == 0 ? 0.0 : epoch_time));
+        }
+        const std::map<std::string, counted_t<const datum_t> > &obj = key->as_object();
+        for (auto it = obj.begin(); it != obj.end(); ++it) {
+            hash = combine_hashes(hash, std::hash<std::string>()(it->first));
+            hash = combine_hashes(hash, hash_join_key(it->second));
+        }
+        return hash;
+    }
+    case datum_t::UNINITIALIZED: // fallthru
+    default: unreachable();
+    }
+}
+
+counted_t<const datum_t> make_left_only(counted_t<const datum_t> left) {
+    datum_ptr_t obj(datum_t::R_OBJECT);
+    UNUSED bool b = obj.add("left", left);
+    return obj.to_counted();
+}
+
+join_datum_stream_t::join_datum_stream_t(counted_t<func_t> _predicate, bool _outer,
+                                         counted_t<datum_stream_t> _left,
+                                         counted_t<datum_stream_t> _right)
+    : wrapper_datum_stream_t(_left), predicate(_predicate), outer(_outer),
+      right(_right), started(false), hashed_left(false), partition_index(0),
+      probe_partition(NULL), probe_index(0), spill_id(nil_uuid()) {
+    guarantee(predicate.has() && right.has());
+    std::string left_field;
+    std::string right_field;
+    if (predicate->is_field_equality(&left_field, &right_field)) {
+        left_key = new_get_field_func(
+            make_counted<const datum_t>(std::move(left_field)), backtrace());
+        right_key = new_get_field_func(
+            make_counted<const datum_t>(std::move(right_field)), backtrace());
+    }
+}
+
+join_datum_stream_t::~join_datum_stream_t() {
+    for (size_t i = 0; i < left_partitions.size(); ++i) {
+        delete left_partitions[i];
+        delete right_partitions[i];
+    }
+}
+
+counted_t<const datum_t> join_datum_stream_t::next_impl(env_t *env) {
+    if (!started) {
+        started = true;
+        start(env);
+    }
+    while (results.empty()) {
+        if (!advance(env)) {
+            return counted_t<const datum_t>();
+        }
+    }
+    counted_t<const datum_t> datum = results.front();
+    results.pop_front();
+    return datum;
+}
+
+void join_datum_stream_t::start(env_t *env) {
+    // A join with an empty left side never looks at its right side.
+    first_left_row = source->next(env);
+    if (!first_left_row.has()) {
+        return;
+    }
+
+    const bool can_spill = left_key.has() && external_sort_t::can_spill(env);
+    size_t data_size = 0;
+    while (counted_t<const datum_t> row = right->next(env)) {
+        hashed_rows.push_back(row);
+        if (can_spill) {
+            data_size += serialized_size(row);
+            if (data_size > env->join_memory_budget) {
+                partition(env);
+                return;
+            }
+        }
+    }
+    if (left_key.has()) {
+        hash_rows(right_key, env);
+    }
+}
+
+void join_datum_stream_t::partition(env_t *env) {
+    // Each partition of each side can end up with a queue, and the buffers of all
+    // of them take up at most half the budget; the other half is for hashing one
+    // side of a partition.
+    const size_t queues_per_partition = 2;
+    const size_t num_partitions
+        = std::max<size_t>(1, std::min<size_t>(JOIN_SPILL_PARTITIONS,
+                                               env->join_memory_budget / 2
+                                               / (queues_per_partition
+                                                  * SPILL_QUEUE_BUFFERS_SIZE)));
+    spill_id = generate_uuid();
+    for (size_t i = 0; i < num_partitions; ++i) {
+        left_partitions.push_back(new partition_t);
+        right_partitions.push_back(new partition_t);
+    }
+
+    for (auto it = hashed_rows.begin(); it != hashed_rows.end(); ++it) {
+        spill_row(env, &right_partitions, *it, right_key->call(env, *it)->as_datum());
+    }
+    hashed_rows.clear();
+    while (counted_t<const datum_t> row = right->next(env)) {
+        spill_row(env, &right_partitions, row, right_key->call(env, row)->as_datum());
+    }
+
+    counted_t<const datum_t> row;
+    row.swap(first_left_row);
+    do {
+        spill_row(env, &left_partitions, row, left_key->call(env, row)->as_datum());
+    } while ((row = source->next(env)).has());
+}
+
+void join_datum_stream_t::spill_row(env_t *env, std::vector<partition_t *> *partitions,
+                                    counted_t<const datum_t> row,
+                                    counted_t<const datum_t> key) {
+    const size_t index = hash_join_key(key) % partitions->size();
+    partition_t *part = (*partitions)[index];
+    part->chunk.push_back(row);
+    ++part->size;
+    if (part->chunk.size() < JOIN_SPILL_CHUNK) {
+        return;
+    }
+
+    if (!part->queue.has()) {
+        part->queue.init(new disk_backed_queue_t<std::vector<counted_t<const datum_t> > >(
+            env->io_backender,
+            serializer_filepath_t(*env->spill_path,
+                                  strprintf("join_%s_%s_%zu",
+                                            uuid_to_str(spill_id).c_str(),
+                                            partitions == &left_partitions
+                                                ? "left" : "right",
+                                            index)),
+            &spill_stats));
+    }
+    part->queue->push(part->chunk);
+    part->chunk.clear();
+}
+
+bool join_datum_stream_t::advance(env_t *env) {
+    if (left_partitions.empty()) {
+        counted_t<const datum_t> row;
+        if (first_left_row.has()) {
+            row.swap(first_left_row);
+        } else {
+            row = source->next(env);
+        }
+        if (!row.has()) {
+            return false;
+        }
+        probe(env, row);
+        return true;
+    }
+
+    if (probe_index == probe_rows.size()) {
+        if (probe_partition != NULL && probe_partition->pop_chunk(&probe_rows)) {
+            probe_index = 0;
+            return true;
+        }
+        // The left rows of the partition that never matched go at its end.
+        if (outer && hashed_left) {
+            for (size_t i = 0; i < hashed_rows.size(); ++i) {
+                if (!matched[i]) {
+                    results.push_back(make_left_only(hashed_rows[i]));
+                }
+            }
+        }
+        return load_partition(env) || !results.empty();
+    }
+    probe(env, probe_rows[probe_index]);
+    ++probe_index;
+    return true;
+}
+
+bool join_datum_stream_t::load_partition(env_t *env) {
+    hashed_rows.clear();
+    hashed_left = false;
+    probe_rows.clear();
+    probe_index = 0;
+    probe_partition = NULL;
+    if (partition_index == left_partitions.size()) {
+        hashed_keys.clear();
+        hash_table.clear();
+        matched.clear();
+        return false;
+    }
+
+    partition_t *left_part = left_partitions[partition_index];
+    partition_t *right_part = right_partitions[partition_index];
+    ++partition_index;
+    hashed_left = left_part->size < right_part->size;
+    if (hashed_left) {
+        left_part->pop_all(&hashed_rows);
+        hash_rows(left_key, env);
+        probe_partition = right_part;
+    } else {
+        right_part->pop_all(&hashed_rows);
+        hash_rows(right_key, env);
+        probe_partition = left_part;
+    }
+    // The other side gets read back a chunk at a time, as it's probed for.
+    return true;
+}
+
+void join_datum_stream_t::hash_rows(counted_t<func_t> key_func, env_t *env) {
+    hashed_keys.clear();
+    hash_table.clear();
+    hashed_keys.reserve(hashed_rows.size());
+    for (size_t i = 0; i < hashed_rows.size(); ++i) {
+        counted_t<const datum_t> key = key_func->call(env, hashed_rows[i])->as_datum();
+        hash_table.insert(std::make_pair(hash_join_key(key), i));
+        hashed_keys.push_back(key);
+    }
+    matched.assign(hashed_left ? hashed_rows.size() : 0, false);
+}
+
+void join_datum_stream_t::probe(env_t *env, counted_t<const datum_t> row) {
+    bool any_match = false;
+    if (!left_key.has()) {
+        for (auto it = hashed_rows.begin(); it != hashed_rows.end(); ++it) {
+            if (predicate->call(env, row, *it)->as_bool()) {
+                results.push_back(make_join_pair(row, *it));
+                any_match = true;
+            }
+        }
+    } else if (!hashed_rows.empty()) {
+        counted_t<const datum_t> key
+            = (hashed_left ? right_key : left_key)->call(env, row)->as_datum();
+        auto range = hash_table.equal_range(hash_join_key(key));
+        std::vector<size_t> matches;
+        for (auto it = range.first; it != range.second; ++it) {
+            if (*hashed_keys[it->second] == *key) {
+                matches.push_back(it->second);
+            }
+        }
+        // In the order the hashed rows were read, like a nested loop.
+        std::sort(matches.begin(), matches.end());
+        for (auto it = matches.begin(); it != matches.end(); ++it) {
+            if (hashed_left) {
+                results.push_back(make_join_pair(hashed_rows[*it], row));
+                matched[*it] = true;
+            } else {
+                results.push_back(make_join_pair(row, hashed_rows[*it]));
+            }
+        }
+        any_match = !matches.empty();
+    }
+    if (outer && !hashed_left && !any_match) {
+        results.push_back(make_left_only(row));
+    }
+}
+
+// EXTERNAL_SORT_T
+struct external_sort_t::run_t {
+    // NULL for the run that was still in memory when loading finished.
+    scoped_ptr_t<disk_backed_queue_t<std::vector<counted_t<const datum_t> > > > queue;
+    // The chunk of the run being merged, and the position of its next element.
+    std::vector<counted_t<const datum_t> > chunk;
+    size_t position;
+
+    const counted_t<const datum_t> &head() const { return chunk[position]; }
+};
+
+class external_sort_t::run_greater_t {
+public:
+    run_greater_t(external_sort_t *_parent, env_t *_env)
+        : parent(_parent), env(_env) { }
+    bool operator()(size_t left, size_t right) const {
+        return parent->lt_cmp(env, parent->runs[right]->head(),
+                              parent->runs[left]->head());
+    }
+private:
+    external_sort_t *parent;
+    env_t *env;
+};
+
+external_sort_t::external_sort_t(const lt_cmp_t &_lt_cmp)
+    : lt_cmp(_lt_cmp), data_size(0), chunk_size(0), spill_id(nil_uuid()),
+      num_runs_spilled(0) { }
+
+external_sort_t::~external_sort_t() {
+    for (auto it = runs.begin(); it != runs.end(); ++it) {
+        delete *it;
+    }
+}
+
+bool external_sort_t::can_spill(env_t *env) {
+    return env->io_backender != NULL && env->spill_path != NULL;
+}
+
+void external_sort_t::add(env_t *env, std::deque<counted_t<const datum_t> > *data) {
+    if (!can_spill(env)) {
+        return;
+    }
+    data_size += serialized_size(data->back());
+    // The spilled runs' buffers come out of the same budget.  They're only meant
+    // to take up half of it (see `spill()`), so the elements always get at least
+    // the other half, even when the budget is too small for that.
+    const size_t runs_size = std::min(runs.size() * run_size(),
+                                      env->sort_memory_budget / 2);
+    if (data_size + runs_size > env->sort_memory_budget) {
+        spill(env, data);
+    }
+}
+
+void external_sort_t::finish(env_t *env, std::deque<counted_t<const datum_t> > *data) {
+    sort(env, data);
+    data_size = 0;
+    if (runs.empty()) {
+        return;
+    }
+
+    if (!data->empty()) {
+        run_t *run = new run_t;
+        run->chunk.assign(std::make_move_iterator(data->begin()),
+                          std::make_move_iterator(data->end()));
+        data->clear();
+        runs.push_back(run);
+    }
+    start_merge(env);
+}
+
+counted_t<const datum_t> external_sort_t::next(env_t *env) {
+    r_sanity_check(is_merging());
+    const run_greater_t greater(this, env);
+    std::pop_heap(heap.begin(), heap.end(), greater);
+    run_t *run = runs[heap.back()];
+    counted_t<const datum_t> res = std::move(run->chunk[run->position]);
+
+    ++run->position;
+    if (run->position == run->chunk.size()) {
+        run->chunk.clear();
+        run->position = 0;
+        if (run->queue.has() && !run->queue->empty()) {
+            run->queue->pop(&run->chunk);
+        }
+    }
+    if (run->chunk.empty()) {
+        heap.pop_back();
+    } else {
+        std::push_heap(heap.begin(), heap.end(), greater);
+    }
+
+    if (heap.empty()) {
+        for (auto it = runs.begin(); it != runs.end(); ++it) {
+            delete *it;
+        }
+        runs.clear();
+    }
+    return res;
+}
+
+size_t external_sort_t::run_size() const {
+    return SPILL_QUEUE_BUFFERS_SIZE + chunk_size;
+}
+
+void external_sort_t::start_merge(env_t *env) {
+    for (size_t i = 0; i < runs.size(); ++i) {
+        if (runs[i]->chunk.empty()) {
+            runs[i]->queue->pop(&runs[i]->chunk);
+        }
+        runs[i]->position = 0;
+        heap.push_back(i);
+    }
+    std::make_heap(heap.begin(), heap.end(), run_greater_t(this, env));
+}
+
+external_sort_t::run_t *external_sort_t::new_spilled_run(env_t *env) {
+    if (spill_id.is_nil()) {
+        spill_id = generate_uuid();
+    }
+    run_t *run = new run_t;
+    run->queue.init(new disk_backed_queue_t<std::vector<counted_t<const datum_t> > >(
+        env->io_backender,
+        serializer_filepath_t(*env->spill_path,
+                              strprintf("sort_%s_%zu",
+                                        uuid_to_str(spill_id).c_str(),
+                                        num_runs_spilled)),
+        &spill_stats));
+    ++num_runs_spilled;
+    return run;
+}
+
+void external_sort_t::spill(env_t *env, std::deque<counted_t<const datum_t> > *data) {
+    sort(env, data);
+    // Guess how big a chunk of this run will be when it gets merged.
+    chunk_size = std::max(chunk_size,
+                          data_size / data->size()
+                          * std::min<size_t>(data->size(), SORT_SPILL_CHUNK));
+    data_size = 0;
+
+    run_t *run = new_spilled_run(env);
+    runs.push_back(run);
+
+    std::vector<counted_t<const datum_t> > chunk;
+    for (auto it = data->begin(); it != data->end(); ++it) {
+        chunk.push_back(std::move(*it));
+        if (chunk.size() == SORT_SPILL_CHUNK || it + 1 == data->end()) {
+            run->queue->push(chunk);
+            chunk.clear();
+        }
+    }
+    data->clear();
+
+    // Every run merged at once holds its queue's buffers and a chunk, so once the
+    // runs (and the one they'd be merged into) would take up more than half the
+    // budget, they get merged into a single run ahead of time.
+    if (runs.size() >= 2 && (runs.size() + 1) * run_size() > env->sort_memory_budget / 2) {
+        merge_runs(env);
+    }
+}
+
+void external_sort_t::merge_runs(env_t *env) {
+    scoped_ptr_t<run_t> merged(new_spilled_run(env));
+    start_merge(env);
+    std::vector<counted_t<const datum_t> > chunk;
+    while (is_merging()) {
+        chunk.push_back(next(env));
+        if (chunk.size() == SORT_SPILL_CHUNK || !is_merging()) {
+            merged->queue->push(chunk);
+            chunk.clear();
+        }
+    }
+    runs.push_back(merged.release());
+}
+
+void external_sort_t::sort(env_t *env, std::deque<counted_t<const datum_t> > *data) {
+    std::sort(data->begin(), data->end(),
+              std::bind(lt_cmp, env, std::placeholders::_1, std::placeholders::_2));
+}
+
 // UNION_DATUM_STREAM_T
 counted_t<datum_stream_t> union_datum_stream_t::filter(counted_t<func_t> f,
                                                        counted_t<func_t> default_filter_val) {
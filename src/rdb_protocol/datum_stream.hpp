@@ -4,10 +4,16 @@
 
 #include <algorithm>
 #include <deque>
+#include <functional>
+#include <limits>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "containers/scoped.hpp"
+#include "containers/uuid.hpp"
+#include "perfmon/perfmon.hpp"
 #include "rdb_protocol/stream.hpp"
 
 namespace query_language {
@@ -19,6 +25,7 @@ typedef query_language::sorting_hint_t sorting_hint_t;
 typedef query_language::hinted_datum_t hinted_datum_t;
 
 class scope_env_t;
+class table_t;
 
 class datum_stream_t : public single_threaded_countable_t<datum_stream_t>,
                        public pb_rcheckable_t {
@@ -44,6 +51,7 @@ public:
 
 
     // stream -> stream (always eager)
+    // Nothing reads past element `r` of the stream after this.
     counted_t<datum_stream_t> slice(size_t l, size_t r);
     counted_t<datum_stream_t> zip();
     counted_t<datum_stream_t> indexes_of(counted_t<func_t> f);
@@ -52,6 +60,14 @@ public:
     virtual bool is_array() = 0;
     virtual counted_t<const datum_t> as_array(env_t *env) = 0;
 
+    // Returns the first `f.k` elements of the rest of the stream in the order of
+    // `f`, in no particular order.  Lazy streams run this on the shards.
+    virtual std::vector<counted_t<const datum_t> > top_k(env_t *env,
+                                                         const top_k_wire_func_t &f);
+
+    // Whether the stream comes sorted by an index; see `sorting_hint_next`.
+    virtual bool is_sorted_by_index() { return false; }
+
     // Gets the next element from the stream.  (Wrapper around `next_impl`.)
     counted_t<const datum_t> next(env_t *env);
 
@@ -93,6 +109,9 @@ public:
     virtual hinted_datum_t sorting_hint_next(env_t *env);
 
 protected:
+    // Called by `slice`: only the first `n` elements will be read.
+    virtual void limit_hint(UNUSED size_t n) { }
+
     explicit datum_stream_t(const protob_t<const Backtrace> &bt_src)
         : pb_rcheckable_t(bt_src) { }
 
@@ -231,6 +250,10 @@ public:
         return counted_t<const datum_t>();  // Cannot be converted implicitly.
     }
 
+    virtual std::vector<counted_t<const datum_t> > top_k(env_t *env,
+                                                         const top_k_wire_func_t &f);
+    virtual bool is_sorted_by_index() { return sorting != UNORDERED; }
+
 protected:
     virtual hinted_datum_t sorting_hint_next(env_t *env);
 
@@ -241,6 +264,7 @@ private:
     // To make the 1.4 release, this class was basically made into a shim
     // between the datum logic and the original json streams.
     boost::shared_ptr<query_language::json_stream_t> json_stream;
+    sorting_t sorting;
 
     rdb_protocol_t::rget_read_response_t::result_t run_terminal(
             env_t *env,
@@ -274,37 +298,244 @@ private:
     counted_t<const datum_t> next_impl(env_t *env);
 };
 
+/* `eqJoin`: pairs each row of `source` with the rows of `table` whose `index` (the
+primary key or a secondary index) equals `left_attr` of it, as `{left, right}`
+objects.  On the primary key it reads POINT_READ_BATCH_SIZE rows of `source` at a
+time and looks up all of their matches with one batched point read. */
+class eq_join_datum_stream_t : public wrapper_datum_stream_t {
+public:
+    eq_join_datum_stream_t(counted_t<func_t> _left_attr,
+                           counted_t<table_t> _table,
+                           const std::string &_index,
+                           counted_t<datum_stream_t> _source);
+private:
+    counted_t<const datum_t> next_impl(env_t *env);
+
+    // Fills `batch`; returns false once `source` has run out.
+    bool load_batch(env_t *env);
+
+    counted_t<func_t> left_attr;
+    counted_t<table_t> table;
+    const std::string index;
+
+    // Primary key joins: the joined rows of the current batch, and the row whose
+    // key couldn't be computed, which starts the next batch (and errors there).
+    std::deque<counted_t<const datum_t> > batch;
+    counted_t<const datum_t> pending_left_row;
+
+    // Secondary index joins: the current row of `source` and its matches.
+    counted_t<const datum_t> left_row;
+    counted_t<datum_stream_t> right_rows;
+};
+
+/* `innerJoin` and `outerJoin` of `source` (the left side) with `right`, which gets
+read once, when the first result is asked for -- and not at all if the left side is
+empty.  If the predicate compares a field of each side (see
+`func_t::is_field_equality`), the right rows go in a hash table by their field and
+each left row is looked up in it, which keeps the results in nested loop order.  If
+the right rows take up more than `env->join_memory_budget` bytes serialized (and
+the env can spill), both sides are instead split by key into up to
+JOIN_SPILL_PARTITIONS partitions, as many as leave half the budget after the
+partitions' queue buffers, and spilled to disk.  Then each partition is joined on
+its own, hashing whichever of its two sides is smaller and streaming the other
+side back from disk; that order is by partition.
+Any other predicate gets called on every pair of a left row and a right row, with
+the right rows kept in memory. */
+class join_datum_stream_t : public wrapper_datum_stream_t {
+public:
+    join_datum_stream_t(counted_t<func_t> _predicate, bool _outer,
+                        counted_t<datum_stream_t> _left,
+                        counted_t<datum_stream_t> _right);
+    ~join_datum_stream_t();
+
+private:
+    struct partition_t;
+
+    counted_t<const datum_t> next_impl(env_t *env);
+
+    // Reads the right side, and the left side too if it has to be partitioned.
+    void start(env_t *env);
+    void partition(env_t *env);
+    void spill_row(env_t *env, std::vector<partition_t *> *partitions,
+                   counted_t<const datum_t> row, counted_t<const datum_t> key);
+
+    // Puts the results for the next left row (or, while joining a partition, the
+    // next row on the side that isn't hashed) in `results`.  Returns false once
+    // there are no more.
+    bool advance(env_t *env);
+    bool load_partition(env_t *env);
+    void hash_rows(counted_t<func_t> key_func, env_t *env);
+    void probe(env_t *env, counted_t<const datum_t> row);
+
+    counted_t<func_t> predicate;
+    const bool outer;
+    counted_t<datum_stream_t> right;
+
+    // Set if the predicate compares `left_key` of the left row to `right_key` of
+    // the right row.
+    counted_t<func_t> left_key;
+    counted_t<func_t> right_key;
+
+    bool started;
+    // The first left row, read by `start` to see whether there are any.
+    counted_t<const datum_t> first_left_row;
+    std::deque<counted_t<const datum_t> > results;
+
+    // The rows being probed for: the right side for nested loop joins and hash
+    // joins that fit in memory, and one side of the current partition otherwise.
+    std::vector<counted_t<const datum_t> > hashed_rows;
+    std::vector<counted_t<const datum_t> > hashed_keys;
+    // From hashes of keys to indices in `hashed_rows`.
+    std::unordered_multimap<size_t, size_t> hash_table;
+    // Whether `hashed_rows` are rows of the left side, which happens while joining
+    // a partition whose left side is smaller, and which of them have matched.
+    bool hashed_left;
+    std::vector<bool> matched;
+
+    // Partitioned joins: the partitions of each side, the current partition, the
+    // side of it that isn't hashed, and the chunk of that side being probed for.
+    std::vector<partition_t *> left_partitions;
+    std::vector<partition_t *> right_partitions;
+    size_t partition_index;
+    partition_t *probe_partition;
+    std::vector<counted_t<const datum_t> > probe_rows;
+    size_t probe_index;
+
+    // Names the files of the partitions.
+    uuid_u spill_id;
+    perfmon_collection_t spill_stats;
+};
+
 // This has to be constructed explicitly rather than invoking `.sort()`.  There
 // was a good reason for this involving header dependencies, but I don't
 // remember exactly what it was.
 static const size_t sort_el_limit = 1000000; // maximum number of elements we'll sort
+
+/* Lets `sort_datum_stream_t` sort more than fits in memory.  Once the elements it
+has loaded take up more than `env->sort_memory_budget` bytes serialized, they get
+sorted and spilled to a disk-backed queue as a sorted run.  The runs' buffers
+count against the same budget: once they'd take up half of it, the runs spilled
+so far get merged into one.  When everything has been loaded, the runs (and
+whatever is left in memory) are merged lazily, one element per `next()`.
+Queries whose env has no `io_backender` can't spill. */
+class external_sort_t {
+public:
+    typedef std::function<bool(env_t *,
+                               const counted_t<const datum_t> &,
+                               const counted_t<const datum_t> &)> lt_cmp_t;
+
+    explicit external_sort_t(const lt_cmp_t &_lt_cmp);
+    ~external_sort_t();
+
+    static bool can_spill(env_t *env);
+
+    // Called after an element has been appended to `*data`.  Spills `*data` as a
+    // run, leaving it empty, if it has gotten too big.
+    void add(env_t *env, std::deque<counted_t<const datum_t> > *data);
+
+    // Called once everything has been added.  Sorts `*data`; or, if some runs
+    // were spilled, makes it the last run, leaving it empty, and starts merging.
+    void finish(env_t *env, std::deque<counted_t<const datum_t> > *data);
+
+    bool is_merging() const { return !heap.empty(); }
+
+    // Returns the smallest element left in any run.  Only call this while
+    // `is_merging()`; it stops merging, and drops the runs, once they're all
+    // exhausted.
+    counted_t<const datum_t> next(env_t *env);
+
+private:
+    struct run_t;
+    class run_greater_t;
+
+    // How much memory a run being merged takes up.
+    size_t run_size() const;
+    // Builds `heap` out of every run in `runs`.
+    void start_merge(env_t *env);
+    run_t *new_spilled_run(env_t *env);
+    void spill(env_t *env, std::deque<counted_t<const datum_t> > *data);
+    // Merges every run (they've all been spilled) into a single spilled run.
+    void merge_runs(env_t *env);
+    void sort(env_t *env, std::deque<counted_t<const datum_t> > *data);
+
+    lt_cmp_t lt_cmp;
+
+    // How many bytes the elements added since the last spill take up serialized.
+    size_t data_size;
+    // The most a chunk of a spilled run has been guessed to take up serialized.
+    size_t chunk_size;
+
+    std::vector<run_t *> runs;
+    // Indices into `runs` of the runs that aren't exhausted yet, as a min-heap by
+    // their next element.
+    std::vector<size_t> heap;
+
+    // Names the files of the runs.
+    uuid_u spill_id;
+    size_t num_runs_spilled;
+    perfmon_collection_t spill_stats;
+
+    DISABLE_COPYING(external_sort_t);
+};
+
+// Hands a sort with a limit to `src` as a top K terminal, which it can push down
+// to the shards.  This only works for the ordering of `orderBy`; other sorts
+// keep everything and sort it.
+template <class T>
+bool top_k_terminal(UNUSED env_t *env, UNUSED datum_stream_t *src,
+                    UNUSED const T &lt_cmp, UNUSED size_t k,
+                    UNUSED std::vector<counted_t<const datum_t> > *out) {
+    return false;
+}
+
+inline bool top_k_terminal(env_t *env, datum_stream_t *src,
+                           const order_wire_funcs_t &order, size_t k,
+                           std::vector<counted_t<const datum_t> > *out) {
+    *out = src->top_k(env, top_k_wire_func_t(order, k));
+    return true;
+}
+
+// Nothing gets loaded until the first element is read, so that a `slice` (as in
+// `orderBy(...).limit(n)`) can tell us how much of the sorted result it needs
+// first.  Then we only keep that many elements.
 template<class T>
 class sort_datum_stream_t : public eager_datum_stream_t {
 public:
-    sort_datum_stream_t(env_t *env,
-                        const T &_lt_cmp, counted_t<datum_stream_t> _src,
+    sort_datum_stream_t(const T &_lt_cmp, counted_t<datum_stream_t> _src,
                         const protob_t<const Backtrace> &bt_src)
         : eager_datum_stream_t(bt_src),
-        lt_cmp(_lt_cmp), src(_src), is_arr_(false) {
+          lt_cmp(_lt_cmp), sorter(_lt_cmp), src(_src),
+          limit(std::numeric_limits<size_t>::max()),
+          started(false), exhausted(false), is_arr_(false) {
         r_sanity_check(src.has());
-        load_data(env);
     }
 
     counted_t<const datum_t> next_impl(env_t *env) {
-        if (data.empty()) {
+        if (data.empty() && !sorter.is_merging()) {
             load_data(env);
-            if (data.empty()) {
+            if (data.empty() && !sorter.is_merging()) {
                 return counted_t<const datum_t>();
             }
         }
 
+        if (sorter.is_merging()) {
+            return sorter.next(env);
+        }
         counted_t<const datum_t> res = data.front();
         data.pop_front();
         return res;
     }
 
 private:
+    void limit_hint(size_t n) {
+        if (!started) {
+            limit = std::min(limit, n);
+        }
+    }
     counted_t<const datum_t> as_array(env_t *env) {
+        if (!started) {
+            load_data(env);
+        }
         return is_arr()
             ? eager_datum_stream_t::as_array(env)
             : counted_t<const datum_t>();
@@ -313,14 +544,16 @@ private:
         return is_arr_;
     }
     void load_data(env_t *env) {
-        r_sanity_check(data.empty());
+        r_sanity_check(data.empty() && !sorter.is_merging());
+        started = true;
+        if (exhausted) {
+            return;
+        }
 
+        std::vector<counted_t<const datum_t> > top;
         if (counted_t<const datum_t> arr = src->as_array(env)) {
-            if (is_arr_) {
-                /* We already loaded data from the array which means there's no
-                 * more data. */
-                return;
-            }
+            /* All the data is in the array, so this is the only load. */
+            exhausted = true;
             is_arr_ = true;
             rcheck(arr->size() <= sort_el_limit,
                    base_exc_t::GENERIC,
@@ -329,6 +562,17 @@ private:
             for (size_t i = 0; i < arr->size(); ++i) {
                 data.push_back(arr->get(i));
             }
+            if (data.size() > limit) {
+                std::nth_element(data.begin(), data.begin() + limit, data.end(),
+                                 std::bind(lt_cmp, env, std::placeholders::_1,
+                                           std::placeholders::_2));
+                data.resize(limit);
+            }
+        } else if (limit <= sort_el_limit
+                   && !src->is_sorted_by_index()
+                   && top_k_terminal(env, src.get(), lt_cmp, limit, &top)) {
+            exhausted = true;
+            data.assign(top.begin(), top.end());
         } else {
             if (next_element) {
                 data.push_back(next_element);
@@ -347,21 +591,27 @@ private:
                     break;
                 } else {
                     data.push_back(d.second);
-                    rcheck(data.size() <= sort_el_limit,
+                    rcheck(data.size() <= sort_el_limit
+                           || external_sort_t::can_spill(env),
                            base_exc_t::GENERIC,
                            strprintf("Can only sort at most %zu elements.",
                                      sort_el_limit));
+                    sorter.add(env, &data);
                 }
             }
         }
 
-        std::sort(data.begin(), data.end(), std::bind(lt_cmp, env, std::placeholders::_1, std::placeholders::_2));
+        sorter.finish(env, &data);
     }
-    std::function<bool(env_t *,
-                       const counted_t<const datum_t> &,
-                       const counted_t<const datum_t> &)> lt_cmp;
+    T lt_cmp;
+    external_sort_t sorter;
     counted_t<datum_stream_t> src;
 
+    // How many elements the consumer will read at most.
+    size_t limit;
+    bool started;
+    bool exhausted;
+
     std::deque<counted_t<const datum_t> > data;
     counted_t<const datum_t> next_element;
     bool is_arr_;
@@ -3,6 +3,7 @@
 
 #include "clustering/administration/database_metadata.hpp"
 #include "clustering/administration/metadata.hpp"
+#include "config/args.hpp"
 #include "rdb_protocol/counted_term.hpp"
 #include "rdb_protocol/func.hpp"
 #include "rdb_protocol/minidriver.hpp"
@@ -138,6 +139,8 @@ env_t::env_t(
     directory_read_manager_t<cluster_directory_metadata_t> *_directory_read_manager,
     signal_t *_interruptor,
     uuid_u _this_machine,
+    io_backender_t *_io_backender,
+    const base_path_t *_spill_path,
     const std::map<std::string, wire_func_t> &_optargs)
   : global_optargs(_optargs),
     extproc_pool(_extproc_pool),
@@ -148,6 +151,10 @@ env_t::env_t(
                    _directory_read_manager,
                    _this_machine),
     interruptor(_interruptor),
+    io_backender(_io_backender),
+    spill_path(_spill_path),
+    sort_memory_budget(SORT_MEMORY_BUDGET),
+    join_memory_budget(JOIN_MEMORY_BUDGET),
     eval_callback(NULL) { }
 
 env_t::env_t(signal_t *_interruptor)
@@ -159,6 +166,10 @@ env_t::env_t(signal_t *_interruptor)
                    NULL,
                    uuid_u()),
     interruptor(_interruptor),
+    io_backender(NULL),
+    spill_path(NULL),
+    sort_memory_budget(SORT_MEMORY_BUDGET),
+    join_memory_budget(JOIN_MEMORY_BUDGET),
     eval_callback(NULL) { }
 
 env_t::~env_t() { }
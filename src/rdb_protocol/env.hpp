@@ -16,7 +16,9 @@
 #include "rdb_protocol/stream.hpp"
 #include "rdb_protocol/val.hpp"
 
+class base_path_t;
 class extproc_pool_t;
+class io_backender_t;
 
 namespace ql {
 class datum_t;
@@ -94,6 +96,8 @@ public:
         directory_read_manager_t<cluster_directory_metadata_t> *_directory_read_manager,
         signal_t *_interruptor,
         uuid_u _this_machine,
+        io_backender_t *_io_backender,
+        const base_path_t *_spill_path,
         const std::map<std::string, wire_func_t> &_optargs);
 
     explicit env_t(signal_t *);
@@ -133,6 +137,15 @@ public:
     // The interruptor signal while a query evaluates.  This can get overwritten!
     signal_t *interruptor;
 
+    // Where sorts that don't fit in `sort_memory_budget` bytes spill sorted runs
+    // to, and hash joins that don't fit in `join_memory_budget` bytes spill
+    // partitions to.  If `io_backender` is NULL they can't; sorts fail once they
+    // pass `sort_el_limit` elements instead, and joins stay in memory.
+    io_backender_t *io_backender;
+    const base_path_t *spill_path;
+    size_t sort_memory_budget;
+    size_t join_memory_budget;
+
 private:
     js_runner_t js_runner;
 
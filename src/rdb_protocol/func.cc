@@ -73,6 +73,127 @@ bool reql_func_t::is_deterministic() const {
     return body->is_deterministic();
 }
 
+// Returns true if `src` is the variable `var`.
+bool is_var(const Term &src, sym_t var) {
+    if (src.type() != Term::VAR || src.args_size() != 1
+        || src.args(0).type() != Term::DATUM) {
+        return false;
+    }
+    const Datum &varnum = src.args(0).datum();
+    return varnum.type() == Datum::R_NUM
+        && varnum.r_num() == static_cast<double>(var.value);
+}
+
+// Returns true if `src` is a string literal, and sets `*str_out` to it.
+bool is_string_literal(const Term &src, std::string *str_out) {
+    if (src.type() != Term::DATUM || src.datum().type() != Datum::R_STR) {
+        return false;
+    }
+    *str_out = src.datum().r_str();
+    return true;
+}
+
+// Returns true if `src` is `var(field)` for a string literal `field`.
+bool is_get_field_of_var(const Term &src, sym_t var, std::string *field_out) {
+    if (src.type() != Term::GET_FIELD || src.args_size() != 2
+        || src.optargs_size() != 0) {
+        return false;
+    }
+    return is_var(src.args(0), var) && is_string_literal(src.args(1), field_out);
+}
+
+// Returns true if `src` is a term of type `type` whose first argument is `var` and
+// whose other arguments are string literals, and sets `*fields_out` to them.  The
+// only optarg allowed is the `_NO_RECURSE_` flag `obj_or_seq_op_term_t` adds.
+bool is_fields_term_of_var(const Term &src, Term::TermType type, sym_t var,
+                           std::vector<std::string> *fields_out) {
+    if (src.type() != type || src.args_size() < 2 || !is_var(src.args(0), var)) {
+        return false;
+    }
+    for (int i = 0; i < src.optargs_size(); ++i) {
+        if (src.optargs(i).key() != "_NO_RECURSE_") {
+            return false;
+        }
+    }
+    fields_out->clear();
+    for (int i = 1; i < src.args_size(); ++i) {
+        std::string field;
+        if (!is_string_literal(src.args(i), &field)) {
+            return false;
+        }
+        fields_out->push_back(field);
+    }
+    return true;
+}
+
+bool reql_func_t::is_simple_selector(std::string *field_out) const {
+    if (arg_names.size() != 1) {
+        return false;
+    }
+    return is_get_field_of_var(*body->get_src(), arg_names[0], field_out);
+}
+
+bool reql_func_t::is_field_equality(std::string *left_field_out,
+                                    std::string *right_field_out) const {
+    if (arg_names.size() != 2 || arg_names[0].value == arg_names[1].value) {
+        return false;
+    }
+    protob_t<const Term> src = body->get_src();
+    if (src->type() != Term::EQ || src->args_size() != 2
+        || src->optargs_size() != 0) {
+        return false;
+    }
+    // Either way round.
+    for (int first = 0; first < 2; ++first) {
+        if (is_get_field_of_var(src->args(first), arg_names[0], left_field_out)
+            && is_get_field_of_var(src->args(1 - first), arg_names[1],
+                                   right_field_out)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool reql_func_t::is_field_access(field_access_t *access_out) const {
+    if (arg_names.size() != 1) {
+        return false;
+    }
+    const sym_t var = arg_names[0];
+    const Term *src = body->get_src().get();
+
+    // `get_field` on a sequence is `default([row(field)], [])`.
+    if (src->type() == Term::DEFAULT) {
+        if (src->args_size() != 2 || src->optargs_size() != 0) {
+            return false;
+        }
+        const Term &arr = src->args(0);
+        const Term &fallback = src->args(1);
+        if (arr.type() != Term::MAKE_ARRAY || arr.args_size() != 1
+            || arr.optargs_size() != 0
+            || fallback.type() != Term::MAKE_ARRAY || fallback.args_size() != 0
+            || fallback.optargs_size() != 0) {
+            return false;
+        }
+        if (!is_fields_term_of_var(arr.args(0), Term::GET_FIELD, var,
+                                   &access_out->fields)
+            || access_out->fields.size() != 1) {
+            return false;
+        }
+        access_out->kind = field_access_t::GET_FIELD;
+        return true;
+    }
+
+    if (is_fields_term_of_var(*src, Term::PLUCK, var, &access_out->fields)) {
+        access_out->kind = field_access_t::PLUCK;
+        return true;
+    }
+    if (is_fields_term_of_var(*src, Term::HAS_FIELDS, var, &access_out->fields)) {
+        access_out->kind = field_access_t::HAS_FIELDS;
+        return true;
+    }
+    return false;
+}
+
 js_func_t::js_func_t(const std::string &_js_source,
                      uint64_t timeout_ms,
                      protob_t<const Backtrace> backtrace)
@@ -115,6 +236,18 @@ bool js_func_t::is_deterministic() const {
     return false;
 }
 
+bool js_func_t::is_simple_selector(std::string *) const {
+    return false;
+}
+
+bool js_func_t::is_field_equality(std::string *, std::string *) const {
+    return false;
+}
+
+bool js_func_t::is_field_access(field_access_t *) const {
+    return false;
+}
+
 void reql_func_t::visit(func_visitor_t *visitor) const {
     visitor->on_reql_func(this);
 }
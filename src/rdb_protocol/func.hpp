@@ -24,6 +24,22 @@ namespace ql {
 
 class func_visitor_t;
 
+/* Describes a function that only looks at some top-level fields of its argument:
+the functions that `get_field`, `pluck` and `has_fields` build when they're applied
+to a sequence (see `obj_or_seq_op_term_t`). */
+struct field_access_t {
+    enum kind_t {
+        // Returns `[row(field)]`, or `[]` if the row has no such field.
+        GET_FIELD,
+        // Returns `row.pluck(fields...)`.
+        PLUCK,
+        // Returns `row.has_fields(fields...)`.
+        HAS_FIELDS
+    };
+    kind_t kind;
+    std::vector<std::string> fields;
+};
+
 class func_t : public slow_atomic_countable_t<func_t>, public pb_rcheckable_t {
 public:
     virtual ~func_t();
@@ -33,6 +49,24 @@ public:
 
     virtual bool is_deterministic() const = 0;
 
+    // Returns true if the function just returns a field of its only argument, like
+    // `r.row('foo')` does, and sets `*field_out` to the field's name.  Callers that
+    // have a serialized row can then read that field without loading the whole row.
+    virtual bool is_simple_selector(std::string *field_out) const = 0;
+
+    // Returns true if the function takes two arguments and just compares a field
+    // of the first to a field of the second, like the join predicate
+    // `lambda l, r: l('foo') == r('bar')` does, and sets `*left_field_out` and
+    // `*right_field_out` to their names.  Joins can then hash on the fields.
+    virtual bool is_field_equality(std::string *left_field_out,
+                                   std::string *right_field_out) const = 0;
+
+    // Returns true if the function is one of the field accesses described by
+    // `field_access_t` with string literal field names, and fills in `*access_out`.
+    // Callers that have a serialized row can then evaluate it by reading just those
+    // fields.
+    virtual bool is_field_access(field_access_t *access_out) const = 0;
+
     // Used by info_term_t.
     virtual std::string print_source() const = 0;
 
@@ -71,6 +105,10 @@ public:
     counted_t<val_t> call(
         env_t *env, const std::vector<counted_t<const datum_t> > &args) const;
     bool is_deterministic() const;
+    bool is_simple_selector(std::string *field_out) const;
+    bool is_field_equality(std::string *left_field_out,
+                           std::string *right_field_out) const;
+    bool is_field_access(field_access_t *access_out) const;
 
     std::string print_source() const;
 
@@ -104,6 +142,10 @@ public:
     counted_t<val_t> call(env_t *env, const std::vector<counted_t<const datum_t> > &args) const;
 
     bool is_deterministic() const;
+    bool is_simple_selector(std::string *field_out) const;
+    bool is_field_equality(std::string *left_field_out,
+                           std::string *right_field_out) const;
+    bool is_field_access(field_access_t *access_out) const;
 
     std::string print_source() const;
 
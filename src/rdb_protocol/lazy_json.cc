@@ -21,9 +21,36 @@ counted_t<const ql::datum_t> get_data(const rdb_value_t *value,
     return data;
 }
 
+bool get_data_field(const rdb_value_t *value, const std::string &key,
+                    transaction_t *txn, counted_t<const ql::datum_t> *field_out) {
+    rdb_blob_wrapper_t blob(txn->get_cache()->get_block_size(),
+                            const_cast<rdb_value_t *>(value)->value_ref(), blob::btree_maxreflen);
+
+    blob_acq_t acq_group;
+    buffer_group_t buffer_group;
+    blob.expose_all(txn, rwi_read, &buffer_group, &acq_group);
+    buffer_group_read_stream_t read_stream(const_view(&buffer_group));
+
+    bool indexed;
+    int res = ql::deserialize_indexed_field(&read_stream, key, &indexed, field_out);
+    guarantee_err(res == 0, "disk corruption (or programmer error) detected");
+
+    return indexed;
+}
+
 const counted_t<const ql::datum_t> &lazy_json_t::get() const {
     if (!pointee->ptr) {
         pointee->ptr = get_data(pointee->rdb_value, pointee->txn);
     }
     return pointee->ptr;
 }
+
+counted_t<const ql::datum_t> lazy_json_t::get_field(const std::string &key) const {
+    if (!pointee->ptr) {
+        counted_t<const ql::datum_t> field;
+        if (get_data_field(pointee->rdb_value, key, pointee->txn, &field)) {
+            return field;
+        }
+    }
+    return get()->get(key, ql::NOTHROW);
+}
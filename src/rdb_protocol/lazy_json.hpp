@@ -2,6 +2,8 @@
 #ifndef RDB_PROTOCOL_LAZY_JSON_HPP_
 #define RDB_PROTOCOL_LAZY_JSON_HPP_
 
+#include <string>
+
 #include "buffer_cache/blob.hpp"
 #include "buffer_cache/types.hpp"
 #include "rdb_protocol/datum.hpp"
@@ -30,6 +32,13 @@ public:
 counted_t<const ql::datum_t> get_data(const rdb_value_t *value,
                                       transaction_t *txn);
 
+// Sets `*field_out` to the field `key` of the row stored in `value` (or to an empty
+// pointer if the row has no such field), deserializing only that field. Returns
+// false without setting it if the row predates the indexed layout (see
+// `ql::serialize_indexed`), in which case you have to use `get_data`.
+bool get_data_field(const rdb_value_t *value, const std::string &key,
+                    transaction_t *txn, counted_t<const ql::datum_t> *field_out);
+
 class lazy_json_pointee_t : public single_threaded_countable_t<lazy_json_pointee_t> {
     lazy_json_pointee_t(const rdb_value_t *_rdb_value, transaction_t *_txn)
         : rdb_value(_rdb_value), txn(_txn) {
@@ -65,6 +74,10 @@ public:
 
     const counted_t<const ql::datum_t> &get() const;
 
+    // Like `get()->get(key, ql::NOTHROW)`, but doesn't load the rest of the row if
+    // it hasn't been loaded yet.
+    counted_t<const ql::datum_t> get_field(const std::string &key) const;
+
 private:
     counted_t<lazy_json_pointee_t> pointee;
 };
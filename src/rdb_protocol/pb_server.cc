@@ -1,6 +1,8 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "rdb_protocol/pb_server.hpp"
 
+#include "arch/runtime/coroutines.hpp"
+#include "concurrency/cross_thread_signal.hpp"
 #include "concurrency/cross_thread_watchable.hpp"
 #include "concurrency/watchable.hpp"
 #include "rdb_protocol/counted_term.hpp"
@@ -18,12 +20,15 @@ Response on_unparsable_query2(ql::protob_t<Query> q, std::string msg) {
 query2_server_t::query2_server_t(const std::set<ip_address_t> &local_addresses,
                                  int port,
                                  rdb_protocol_t::context_t *_ctx) :
+    query_latency(secs_to_ticks(1)),
+    query_latency_membership(&get_global_perfmon_collection(), &query_latency,
+                             "query_latency"),
     server(local_addresses,
            port,
            boost::bind(&query2_server_t::handle, this, _1, _2, _3),
            &on_unparsable_query2,
            _ctx->auth_metadata,
-           INLINE),
+           CORO_UNORDERED),
     ctx(_ctx), parser_id(generate_uuid()), thread_counters(0)
 { }
 
@@ -35,6 +40,40 @@ int query2_server_t::get_port() const {
     return server.get_port();
 }
 
+/* Holds the `token_mutex_t` for a query's token in `token_mutexes`, creating it
+if it's not there yet and deleting it when nobody else is waiting for it. */
+class token_mutex_acq_t {
+public:
+    token_mutex_acq_t(boost::ptr_map<int64_t, query2_server_t::token_mutex_t> *_token_mutexes,
+                      int64_t _token)
+        : token_mutexes(_token_mutexes), token(_token) {
+        boost::ptr_map<int64_t, query2_server_t::token_mutex_t>::iterator it =
+            token_mutexes->find(token);
+        if (it == token_mutexes->end()) {
+            it = token_mutexes->insert(token, new query2_server_t::token_mutex_t).first;
+        }
+        token_mutex = it->second;
+        ++token_mutex->refcount;
+        acq.reset(&token_mutex->mutex);
+    }
+
+    ~token_mutex_acq_t() {
+        acq.reset();
+        if (--token_mutex->refcount == 0) {
+            size_t num_erased = token_mutexes->erase(token);
+            guarantee(num_erased == 1);
+        }
+    }
+
+private:
+    boost::ptr_map<int64_t, query2_server_t::token_mutex_t> *token_mutexes;
+    int64_t token;
+    query2_server_t::token_mutex_t *token_mutex;
+    mutex_t::acq_t acq;
+
+    DISABLE_COPYING(token_mutex_acq_t);
+};
+
 bool query2_server_t::handle(ql::protob_t<Query> q,
                              Response *response_out,
                              context_t *query2_context) {
@@ -42,8 +81,62 @@ bool query2_server_t::handle(ql::protob_t<Query> q,
     signal_t *interruptor = query2_context->interruptor;
     guarantee(interruptor);
     response_out->set_token(q->token());
+    const ticks_t start_time = get_ticks();
+
+    // This has to come before anything that blocks, so that queries with the
+    // same token get the mutex in the order they arrived.
+    token_mutex_acq_t token_acq(&query2_context->token_mutexes, q->token());
 
     bool response_needed = true;
+    if (q->type() == Query::START && !stream_cache2->contains(q->token())) {
+        // A new query doesn't depend on this connection's thread until it leaves a
+        // stream in the cache, so a thread with nothing to do can evaluate it.
+        cond_t done;
+        coro_t::spawn_stealable(
+            boost::bind(&query2_server_t::run_stealable_query, this,
+                        q, response_out, stream_cache2, interruptor,
+                        get_thread_id(), &response_needed, &done),
+            coro_stack_class_t::large);
+        done.wait_lazily_unordered();
+    } else {
+        run_query(q, response_out, stream_cache2, interruptor, &response_needed);
+    }
+
+    query_latency.record(get_ticks() - start_time);
+    return response_needed;
+}
+
+void query2_server_t::run_stealable_query(ql::protob_t<Query> q,
+                                          Response *response_out,
+                                          ql::stream_cache2_t *stream_cache2,
+                                          signal_t *interruptor,
+                                          threadnum_t conn_thread,
+                                          bool *response_needed_out,
+                                          cond_t *done) {
+    const threadnum_t eval_thread = get_thread_id();
+    scoped_ptr_t<cross_thread_signal_t> eval_interruptor;
+    {
+        on_thread_t th(conn_thread);
+        eval_interruptor.init(new cross_thread_signal_t(interruptor, eval_thread));
+    }
+
+    // The connection's stream cache can only be used on its own thread, so the
+    // query leaves its stream, if any, in a cache of its own.
+    ql::stream_cache2_t eval_stream_cache2;
+    run_query(q, response_out, &eval_stream_cache2, eval_interruptor.get(),
+              response_needed_out);
+
+    on_thread_t th(conn_thread);
+    stream_cache2->take_streams(&eval_stream_cache2);
+    eval_interruptor.reset();
+    done->pulse();
+}
+
+void query2_server_t::run_query(ql::protob_t<Query> q,
+                                Response *response_out,
+                                ql::stream_cache2_t *stream_cache2,
+                                signal_t *interruptor,
+                                bool *response_needed_out) {
     try {
         threadnum_t thread = get_thread_id();
         guarantee(ctx->directory_read_manager);
@@ -54,9 +147,10 @@ bool query2_server_t::handle(ql::protob_t<Query> q,
                 ctx->cross_thread_database_watchables[thread.threadnum]->get_watchable(),
                 ctx->cluster_metadata, ctx->directory_read_manager,
                 interruptor, ctx->machine_id,
+                ctx->io_backender, ctx->spill_path,
                 std::map<std::string, ql::wire_func_t>()));
         // `ql::run` will set the status code
-        ql::run(q, std::move(env), response_out, stream_cache2, &response_needed);
+        ql::run(q, std::move(env), response_out, stream_cache2, response_needed_out);
     } catch (const interrupted_exc_t &e) {
         ql::fill_error(response_out, Response::RUNTIME_ERROR,
                        "Query interrupted.  Did you shut down the server?");
@@ -64,8 +158,6 @@ bool query2_server_t::handle(ql::protob_t<Query> q,
         ql::fill_error(response_out, Response::RUNTIME_ERROR,
                        strprintf("Unexpected exception: %s\n", e.what()));
     }
-
-    return response_needed;
 }
 
 void make_empty_protob_bearer(ql::protob_t<Query> *request) {
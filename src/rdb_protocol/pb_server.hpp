@@ -6,6 +6,12 @@
 #include <set>
 #include <string>
 
+#include "errors.hpp"
+#include <boost/ptr_container/ptr_map.hpp>
+
+#include "concurrency/cond_var.hpp"
+#include "concurrency/mutex.hpp"
+#include "perfmon/perfmon.hpp"
 #include "protob/protob.hpp"
 #include "protocol_api.hpp"
 #include "rdb_protocol/protocol.hpp"
@@ -27,17 +33,42 @@ public:
 
     int get_port() const;
 
+    /* Queries from one connection run concurrently, except that the queries
+    with the same token (a START and the CONTINUEs and STOP for its stream) run
+    one at a time in the order they arrived, because they share an entry in
+    `stream_cache2`. */
+    struct token_mutex_t {
+        token_mutex_t() : refcount(0) { }
+        mutex_t mutex;
+        int refcount;
+    };
+
     struct context_t {
         context_t() : interruptor(0) { }
         static const int32_t no_auth_magic_number = VersionDummy::V0_1;
         static const int32_t auth_magic_number = VersionDummy::V0_2;
         ql::stream_cache2_t stream_cache2;
+        // The tokens that have a query running or waiting to run.
+        boost::ptr_map<int64_t, token_mutex_t> token_mutexes;
         signal_t *interruptor;
     };
 private:
     MUST_USE bool handle(ql::protob_t<Query> q,
                          Response *response_out,
                          context_t *query2_context);
+    void run_query(ql::protob_t<Query> q, Response *response_out,
+                   ql::stream_cache2_t *stream_cache2, signal_t *interruptor,
+                   bool *response_needed_out);
+    /* Runs a new query on whichever thread gets to it first (see
+    `coro_t::spawn_stealable()`), and pulses `done` on `conn_thread`. */
+    void run_stealable_query(ql::protob_t<Query> q, Response *response_out,
+                             ql::stream_cache2_t *stream_cache2, signal_t *interruptor,
+                             threadnum_t conn_thread, bool *response_needed_out,
+                             cond_t *done);
+    // How long `handle` takes for each query, declared before `server` so that
+    // it outlives the connections.
+    perfmon_histogram_t query_latency;
+    perfmon_membership_t query_latency_membership;
     protob_server_t<ql::protob_t<Query>, Response, context_t> server;
     rdb_protocol_t::context_t *ctx;
     uuid_u parser_id;
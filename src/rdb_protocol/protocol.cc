@@ -1,6 +1,8 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "rdb_protocol/protocol.hpp"
 
+#include <zlib.h>
+
 #include <algorithm>
 
 #include "errors.hpp"
@@ -45,6 +47,9 @@ typedef rdb_protocol_t::read_response_t read_response_t;
 typedef rdb_protocol_t::point_read_t point_read_t;
 typedef rdb_protocol_t::point_read_response_t point_read_response_t;
 
+typedef rdb_protocol_t::batched_point_read_t batched_point_read_t;
+typedef rdb_protocol_t::batched_point_read_response_t batched_point_read_response_t;
+
 typedef rdb_protocol_t::rget_read_t rget_read_t;
 typedef rdb_protocol_t::rget_read_response_t rget_read_response_t;
 
@@ -329,7 +334,9 @@ rdb_protocol_t::context_t::context_t()
     cross_thread_namespace_watchables(get_num_threads()),
     cross_thread_database_watchables(get_num_threads()),
     directory_read_manager(NULL),
-    signals(get_num_threads())
+    signals(get_num_threads()),
+    io_backender(NULL),
+    spill_path(NULL)
 { }
 
 rdb_protocol_t::context_t::context_t(
@@ -341,7 +348,9 @@ rdb_protocol_t::context_t::context_t(
         _auth_metadata,
     directory_read_manager_t<cluster_directory_metadata_t>
         *_directory_read_manager,
-    machine_id_t _machine_id)
+    machine_id_t _machine_id,
+    io_backender_t *_io_backender,
+    const base_path_t *_spill_path)
     : extproc_pool(_extproc_pool), ns_repo(_ns_repo),
       cross_thread_namespace_watchables(get_num_threads()),
       cross_thread_database_watchables(get_num_threads()),
@@ -349,7 +358,9 @@ rdb_protocol_t::context_t::context_t(
       auth_metadata(_auth_metadata),
       directory_read_manager(_directory_read_manager),
       signals(get_num_threads()),
-      machine_id(_machine_id)
+      machine_id(_machine_id),
+      io_backender(_io_backender),
+      spill_path(_spill_path)
 {
     for (int thread = 0; thread < get_num_threads(); ++thread) {
         cross_thread_namespace_watchables[thread].init(new cross_thread_watchable_variable_t<cow_ptr_t<namespaces_semilattice_metadata_t<rdb_protocol_t> > >(
@@ -400,12 +411,54 @@ store_key_t sindex_list_region_key() {
     return store_key_t();
 }
 
+// TODO: This entire type is suspect, given the performance for
+// batched_replaces_t.  Is it used in anything other than assertions?
+region_t region_from_keys(const std::vector<store_key_t> &keys) {
+    // It shouldn't be empty, but we let the places that would break use a
+    // guarantee.
+    rassert(!keys.empty());
+    if (keys.empty()) {
+        return hash_region_t<key_range_t>();
+    }
+
+    store_key_t min_key = store_key_t::max();
+    store_key_t max_key = store_key_t::min();
+    uint64_t min_hash_value = HASH_REGION_HASH_SIZE - 1;
+    uint64_t max_hash_value = 0;
+
+    for (auto it = keys.begin(); it != keys.end(); ++it) {
+        const store_key_t &key = *it;
+        if (key < min_key) {
+            min_key = key;
+        }
+        if (key > max_key) {
+            max_key = key;
+        }
+
+        const uint64_t hash_value = hash_region_hasher(key.contents(), key.size());
+        if (hash_value < min_hash_value) {
+            min_hash_value = hash_value;
+        }
+        if (hash_value > max_hash_value) {
+            max_hash_value = hash_value;
+        }
+    }
+
+    return hash_region_t<key_range_t>(
+        min_hash_value, max_hash_value + 1,
+        key_range_t(key_range_t::closed, min_key, key_range_t::closed, max_key));
+}
+
 /* read_t::get_region implementation */
 struct rdb_r_get_region_visitor : public boost::static_visitor<region_t> {
     region_t operator()(const point_read_t &pr) const {
         return rdb_protocol_t::monokey_region(pr.key);
     }
 
+    region_t operator()(const batched_point_read_t &bpr) const {
+        return region_from_keys(bpr.keys);
+    }
+
     region_t operator()(const rget_read_t &rg) const {
         return rg.region;
     }
@@ -443,6 +496,21 @@ struct rdb_r_shard_visitor_t : public boost::static_visitor<bool> {
         return keyed_read(pr, pr.key);
     }
 
+    bool operator()(const batched_point_read_t &bpr) const {
+        std::vector<store_key_t> shard_keys;
+        for (auto it = bpr.keys.begin(); it != bpr.keys.end(); ++it) {
+            if (region_contains_key(*region, *it)) {
+                shard_keys.push_back(*it);
+            }
+        }
+        if (!shard_keys.empty()) {
+            *read_out = read_t(batched_point_read_t(std::move(shard_keys)));
+            return true;
+        } else {
+            return false;
+        }
+    }
+
     template <class T>
     bool rangey_read(const T &arg) const {
         const hash_region_t<key_range_t> intersection
@@ -518,14 +586,47 @@ void scale_down_distribution(size_t result_limit, std::map<store_key_t, int64_t>
     }
 }
 
+// Orders the unread parts of sorted shard streams so that, in a heap of them, the
+// one whose next key comes first in `sorting` order is on top.
+class stream_cursor_order_t {
+public:
+    typedef std::pair<stream_t::const_iterator, stream_t::const_iterator> cursor_t;
+
+    explicit stream_cursor_order_t(sorting_t _sorting) : sorting(_sorting) { }
+
+    bool operator()(const cursor_t &x, const cursor_t &y) const {
+        return forward(sorting) ? y.first->key < x.first->key : x.first->key < y.first->key;
+    }
+
+private:
+    sorting_t sorting;
+};
+
+// Combines the reductions of a group that more than one shard returned.
+class gmr_reduce_t {
+public:
+    gmr_reduce_t(const counted_t<ql::func_t> &_reduce, ql::env_t *_env)
+        : reduce(_reduce), env(_env) { }
+
+    counted_t<const ql::datum_t> operator()(const counted_t<const ql::datum_t> &lhs,
+                                            const counted_t<const ql::datum_t> &rhs) const {
+        return reduce->call(env, lhs, rhs)->as_datum();
+    }
+
+private:
+    counted_t<ql::func_t> reduce;
+    ql::env_t *env;
+};
+
 class rdb_r_unshard_visitor_t : public boost::static_visitor<void> {
 public:
-    rdb_r_unshard_visitor_t(const read_response_t *_responses,
+    rdb_r_unshard_visitor_t(read_response_t *_responses,
                             size_t _count,
                             read_response_t *_response_out,
-                            rdb_protocol_t::context_t *ctx,
-                            signal_t *interruptor)
+                            rdb_protocol_t::context_t *_ctx,
+                            signal_t *_interruptor)
         : responses(_responses), count(_count), response_out(_response_out),
+          ctx(_ctx), interruptor(_interruptor),
           ql_env(ctx->extproc_pool,
                  ctx->ns_repo,
                  ctx->cross_thread_namespace_watchables[get_thread_id().threadnum].get()
@@ -536,6 +637,8 @@ public:
                  NULL,
                  interruptor,
                  ctx->machine_id,
+                 ctx->io_backender,
+                 ctx->spill_path,
                  std::map<std::string, ql::wire_func_t>())
     { }
 
@@ -545,6 +648,18 @@ public:
         *response_out = responses[0];
     }
 
+    void operator()(const batched_point_read_t &) {
+        response_out->response = batched_point_read_response_t();
+        batched_point_read_response_t *bpr_response
+            = boost::get<batched_point_read_response_t>(&response_out->response);
+        for (size_t i = 0; i < count; ++i) {
+            const batched_point_read_response_t *bpr
+                = boost::get<batched_point_read_response_t>(&responses[i].response);
+            guarantee(bpr != NULL);
+            bpr_response->rows.insert(bpr->rows.begin(), bpr->rows.end());
+        }
+    }
+
     void operator()(const rget_read_t &rg) {
         response_out->response = rget_read_response_t();
         rget_read_response_t *rg_response
@@ -644,11 +759,134 @@ public:
     }
 
 private:
-    const read_response_t *responses;
+    // The grouped results of the shard responses are folded together by several
+    // of these, each on its own thread, and the results of those are then folded
+    // together on the home thread.  Every worker folds a contiguous run of
+    // shards, so reductions are applied in the same order as by a single fold.
+    class gmr_worker_t {
+    public:
+        gmr_worker_t(rdb_r_unshard_visitor_t *_parent,
+                     const ql::gmr_wire_func_t *_gmr_func,
+                     size_t _num_workers,
+                     std::vector<ql::wire_datum_map_t> *_partials,
+                     std::vector<boost::optional<ql::exc_t> > *_exc_errors,
+                     std::vector<boost::optional<ql::datum_exc_t> > *_datum_exc_errors,
+                     bool *_interrupted)
+            : parent(_parent), gmr_func(_gmr_func), num_workers(_num_workers),
+              partials(_partials), exc_errors(_exc_errors),
+              datum_exc_errors(_datum_exc_errors), interrupted(_interrupted) { }
+
+        void operator()(int worker) const {
+            const size_t begin = parent->count * worker / num_workers;
+            const size_t end = parent->count * (worker + 1) / num_workers;
+            const threadnum_t thread((get_thread_id().threadnum + worker)
+                                     % get_num_threads());
+            rdb_protocol_t::context_t *ctx = parent->ctx;
+            try {
+                cross_thread_signal_t ct_interruptor(parent->interruptor, thread);
+                on_thread_t th(thread);
+                ql::env_t env(ctx->extproc_pool,
+                              ctx->ns_repo,
+                              ctx->cross_thread_namespace_watchables[thread.threadnum]
+                                  .get()->get_watchable(),
+                              ctx->cross_thread_database_watchables[thread.threadnum]
+                                  .get()->get_watchable(),
+                              ctx->cluster_metadata,
+                              NULL,
+                              &ct_interruptor,
+                              ctx->machine_id,
+                              ctx->io_backender,
+                              ctx->spill_path,
+                              std::map<std::string, ql::wire_func_t>());
+                parent->fold_gmr_responses(begin, end,
+                                           gmr_reduce_t(gmr_func->compile_reduce(), &env),
+                                           &(*partials)[worker]);
+            } catch (const ql::exc_t &e) {
+                (*exc_errors)[worker] = e;
+            } catch (const ql::datum_exc_t &e) {
+                (*datum_exc_errors)[worker] = e;
+            } catch (const interrupted_exc_t &) {
+                *interrupted = true;
+            }
+        }
+
+    private:
+        rdb_r_unshard_visitor_t *parent;
+        const ql::gmr_wire_func_t *gmr_func;
+        size_t num_workers;
+        std::vector<ql::wire_datum_map_t> *partials;
+        std::vector<boost::optional<ql::exc_t> > *exc_errors;
+        std::vector<boost::optional<ql::datum_exc_t> > *datum_exc_errors;
+        bool *interrupted;
+    };
+
+    read_response_t *responses;
     size_t count;
     read_response_t *response_out;
+    rdb_protocol_t::context_t *ctx;
+    signal_t *interruptor;
     ql::env_t ql_env;
 
+    // Folds the grouped results of `responses[begin, end)` into `out`, which must
+    // be compiled.  This consumes the responses' maps.
+    void fold_gmr_responses(size_t begin, size_t end, const gmr_reduce_t &reduce,
+                            ql::wire_datum_map_t *out) {
+        for (size_t i = begin; i < end; ++i) {
+            rget_read_response_t *rr =
+                boost::get<rget_read_response_t>(&responses[i].response);
+            guarantee(rr);
+            ql::wire_datum_map_t *rhs = boost::get<ql::wire_datum_map_t>(&rr->result);
+            r_sanity_check(rhs);
+            rhs->compile();
+            out->merge(rhs, reduce);
+        }
+    }
+
+    void unshard_gmr(const ql::gmr_wire_func_t &gmr_func, ql::wire_datum_map_t *map) {
+        size_t num_groups = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const rget_read_response_t *rr =
+                boost::get<rget_read_response_t>(&responses[i].response);
+            guarantee(rr);
+            const ql::wire_datum_map_t *rhs =
+                boost::get<ql::wire_datum_map_t>(&rr->result);
+            r_sanity_check(rhs);
+            num_groups += rhs->size();
+        }
+
+        const size_t num_workers =
+            num_groups < UNSHARD_PARALLEL_GMR_MIN_GROUPS
+            ? 1
+            : std::min<size_t>(count, get_num_threads());
+        if (num_workers <= 1) {
+            fold_gmr_responses(0, count, gmr_reduce_t(gmr_func.compile_reduce(), &ql_env),
+                               map);
+            return;
+        }
+
+        std::vector<ql::wire_datum_map_t> partials(num_workers);
+        std::vector<boost::optional<ql::exc_t> > exc_errors(num_workers);
+        std::vector<boost::optional<ql::datum_exc_t> > datum_exc_errors(num_workers);
+        bool interrupted = false;
+        pmap(static_cast<int>(num_workers), gmr_worker_t(this, &gmr_func, num_workers, &partials,
+                                       &exc_errors, &datum_exc_errors, &interrupted));
+        if (interrupted) {
+            throw interrupted_exc_t();
+        }
+        for (size_t i = 0; i < num_workers; ++i) {
+            if (exc_errors[i]) {
+                throw *exc_errors[i];
+            } else if (datum_exc_errors[i]) {
+                throw *datum_exc_errors[i];
+            }
+        }
+
+        gmr_reduce_t reduce(gmr_func.compile_reduce(), &ql_env);
+        for (size_t i = 0; i < num_workers; ++i) {
+            map->merge(&partials[i], reduce);
+        }
+    }
+
     void unshard_range_get(const rget_read_t &rg) {
         rget_read_response_t *rg_response = boost::get<rget_read_response_t>(&response_out->response);
         // A vanilla range get
@@ -686,43 +924,35 @@ private:
                 rg_response->truncated = rg_response->truncated || rr->truncated;
             }
         } else {
-            std::vector<std::pair<stream_t::const_iterator, stream_t::const_iterator> > iterators;
-
+            // A k-way merge of the sorted shard streams.
+            const stream_cursor_order_t order(rg.sorting);
+            std::vector<stream_cursor_order_t::cursor_t> heap;
             for (size_t i = 0; i < count; ++i) {
                 // TODO: we're ignoring the limit when recombining.
                 const rget_read_response_t *rr = boost::get<rget_read_response_t>(&responses[i].response);
                 guarantee(rr != NULL);
 
                 const stream_t *stream = boost::get<stream_t>(&(rr->result));
-                iterators.push_back(std::make_pair(stream->begin(), stream->end()));
+                if (!stream->empty()) {
+                    heap.push_back(std::make_pair(stream->begin(), stream->end()));
+                }
             }
-
-            while (true) {
-                store_key_t key_to_beat = (forward(rg.sorting) ? store_key_t::max() : store_key_t::min());
-                bool found_value = false;
-                stream_t::const_iterator *value = NULL;
-
-                for (auto it = iterators.begin(); it != iterators.end(); ++it) {
-                    if (it->first == it->second) {
-                        continue;
-                    }
-
-                    if ((forward(rg.sorting) &&
-                                it->first->key <= key_to_beat &&
-                                it->first->key <= rg_response->last_considered_key) ||
-                            (backward(rg.sorting) &&
-                             it->first->key >= key_to_beat &&
-                             it->first->key >= rg_response->last_considered_key)) {
-                        key_to_beat = it->first->key;
-                        found_value = true;
-                        value = &it->first;
-                    }
+            std::make_heap(heap.begin(), heap.end(), order);
+
+            while (!heap.empty()) {
+                std::pop_heap(heap.begin(), heap.end(), order);
+                stream_cursor_order_t::cursor_t *next = &heap.back();
+                if ((forward(rg.sorting) && next->first->key > rg_response->last_considered_key) ||
+                        (backward(rg.sorting) && next->first->key < rg_response->last_considered_key)) {
+                    // Every other stream's next key is even further along.
+                    break;
                 }
-                if (found_value) {
-                    res_stream->push_back(**value);
-                    ++(*value);
+                res_stream->push_back(*next->first);
+                ++next->first;
+                if (next->first == next->second) {
+                    heap.pop_back();
                 } else {
-                    break;
+                    std::push_heap(heap.begin(), heap.end(), order);
                 }
             }
         }
@@ -736,6 +966,7 @@ private:
             if (const ql::reduce_wire_func_t *reduce_func =
                     boost::get<ql::reduce_wire_func_t>(&*rg.terminal)) {
                 ql::reduce_wire_func_t local_reduce_func = *reduce_func;
+                counted_t<ql::func_t> reduce = local_reduce_func.compile_wire_func();
                 rg_response->result = rget_read_response_t::empty_t();
                 for (size_t i = 0; i < count; ++i) {
                     const rget_read_response_t *_rr =
@@ -752,8 +983,7 @@ private:
                     } else {
                         if (lhs) {
                             counted_t<const ql::datum_t> reduced_val =
-                                local_reduce_func.compile_wire_func()->call(
-                                    &ql_env, *lhs, *rhs)->as_datum();
+                                reduce->call(&ql_env, *lhs, *rhs)->as_datum();
                             rg_response->result = reduced_val;
                         } else {
                             guarantee(boost::get<rget_read_response_t::empty_t>(
@@ -778,37 +1008,27 @@ private:
                 }
             } else if (const ql::gmr_wire_func_t *gmr_func =
                     boost::get<ql::gmr_wire_func_t>(&*rg.terminal)) {
-                ql::gmr_wire_func_t local_gmr_func = *gmr_func;
                 rg_response->result = ql::wire_datum_map_t();
                 ql::wire_datum_map_t *map =
                     boost::get<ql::wire_datum_map_t>(&rg_response->result);
-
-                  for (size_t i = 0; i < count; ++i) {
+                unshard_gmr(*gmr_func, map);
+                map->finalize();
+            } else if (const ql::top_k_wire_func_t *top_k_func =
+                    boost::get<ql::top_k_wire_func_t>(&*rg.terminal)) {
+                rg_response->result = rget_read_response_t::vec_t();
+                rget_read_response_t::vec_t *top =
+                    boost::get<rget_read_response_t::vec_t>(&rg_response->result);
+                for (size_t i = 0; i < count; ++i) {
                     const rget_read_response_t *_rr =
                         boost::get<rget_read_response_t>(&responses[i].response);
                     guarantee(_rr);
-                    const ql::wire_datum_map_t *rhs =
-                        boost::get<ql::wire_datum_map_t>(&(_rr->result));
-                    r_sanity_check(rhs);
-                    ql::wire_datum_map_t local_rhs = *rhs;
-                    local_rhs.compile();
-
-                    counted_t<const ql::datum_t> rhs_arr = local_rhs.to_arr();
-                    for (size_t f = 0; f < rhs_arr->size(); ++f) {
-                        counted_t<const ql::datum_t> key
-                            = rhs_arr->get(f)->get("group");
-                        counted_t<const ql::datum_t> val
-                            = rhs_arr->get(f)->get("reduction");
-                        if (!map->has(key)) {
-                            map->set(key, val);
-                        } else {
-                            counted_t<ql::func_t> r
-                                = local_gmr_func.compile_reduce();
-                            map->set(key, r->call(&ql_env, map->get(key), val)->as_datum());
-                        }
+                    const rget_read_response_t::vec_t *shard_top =
+                        boost::get<rget_read_response_t::vec_t>(&_rr->result);
+                    guarantee(shard_top);
+                    for (auto it = shard_top->begin(); it != shard_top->end(); ++it) {
+                        top_k_func->add(&ql_env, *it, top);
                     }
                 }
-                boost::get<ql::wire_datum_map_t>(rg_response->result).finalize();
             } else {
                 unreachable();
             }
@@ -830,44 +1050,6 @@ void read_t::unshard(read_response_t *responses, size_t count,
 
 /* write_t::get_region() implementation */
 
-// TODO: This entire type is suspect, given the performance for
-// batched_replaces_t.  Is it used in anything other than assertions?
-region_t region_from_keys(const std::vector<store_key_t> &keys) {
-    // It shouldn't be empty, but we let the places that would break use a
-    // guarantee.
-    rassert(!keys.empty());
-    if (keys.empty()) {
-        return hash_region_t<key_range_t>();
-    }
-
-    store_key_t min_key = store_key_t::max();
-    store_key_t max_key = store_key_t::min();
-    uint64_t min_hash_value = HASH_REGION_HASH_SIZE - 1;
-    uint64_t max_hash_value = 0;
-
-    for (auto it = keys.begin(); it != keys.end(); ++it) {
-        const store_key_t &key = *it;
-        if (key < min_key) {
-            min_key = key;
-        }
-        if (key > max_key) {
-            max_key = key;
-        }
-
-        const uint64_t hash_value = hash_region_hasher(key.contents(), key.size());
-        if (hash_value < min_hash_value) {
-            min_hash_value = hash_value;
-        }
-        if (hash_value > max_hash_value) {
-            max_hash_value = hash_value;
-        }
-    }
-
-    return hash_region_t<key_range_t>(
-        min_hash_value, max_hash_value + 1,
-        key_range_t(key_range_t::closed, min_key, key_range_t::closed, max_key));
-}
-
 struct rdb_w_get_region_visitor : public boost::static_visitor<region_t> {
     region_t operator()(const batched_replace_t &br) const {
         return region_from_keys(br.keys);
@@ -1143,6 +1325,13 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
         rdb_get(get.key, btree, txn, superblock, res);
     }
 
+    void operator()(const batched_point_read_t &get) {
+        response->response = batched_point_read_response_t();
+        batched_point_read_response_t *res =
+            boost::get<batched_point_read_response_t>(&response->response);
+        rdb_batched_get(get.keys, btree, txn, superblock, res);
+    }
+
     void operator()(const rget_read_t &rget) {
         if (rget.transform.size() != 0 || rget.terminal) {
             rassert(rget.optargs.size() != 0);
@@ -1269,6 +1458,8 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
                NULL,
                &interruptor,
                ctx->machine_id,
+               ctx->io_backender,
+               ctx->spill_path,
                std::map<std::string, ql::wire_func_t>())
     { }
 
@@ -1482,6 +1673,8 @@ struct rdb_write_visitor_t : public boost::static_visitor<void> {
                NULL,
                &interruptor,
                ctx->machine_id,
+               ctx->io_backender,
+               ctx->spill_path,
                std::map<std::string, ql::wire_func_t>()),
         sindex_block_id((*superblock)->get_sindex_block_id())
     { }
@@ -1540,8 +1733,8 @@ struct rdb_backfill_chunk_get_btree_repli_timestamp_visitor_t : public boost::st
         return repli_timestamp_t::invalid;
     }
 
-    repli_timestamp_t operator()(const backfill_chunk_t::key_value_pair_t &kv) {
-        return kv.backfill_atom.recency;
+    repli_timestamp_t operator()(const backfill_chunk_t::key_value_pairs_t &kvs) {
+        return kvs.max_recency;
     }
 
     repli_timestamp_t operator()(const backfill_chunk_t::sindexes_t &) {
@@ -1554,30 +1747,129 @@ repli_timestamp_t backfill_chunk_t::get_btree_repli_timestamp() const THROWS_NOT
     return boost::apply_visitor(v, val);
 }
 
+struct rdb_backfill_chunk_get_data_size_visitor_t : public boost::static_visitor<int64_t> {
+    int64_t operator()(const backfill_chunk_t::delete_key_t &del) {
+        return del.key.size();
+    }
+
+    int64_t operator()(const backfill_chunk_t::delete_range_t &) {
+        return 0;
+    }
+
+    int64_t operator()(const backfill_chunk_t::key_value_pairs_t &kvs) {
+        return kvs.data.size();
+    }
+
+    int64_t operator()(const backfill_chunk_t::sindexes_t &) {
+        return 0;
+    }
+};
+
+int64_t backfill_chunk_t::get_data_size() const THROWS_NOTHING {
+    rdb_backfill_chunk_get_data_size_visitor_t v;
+    return boost::apply_visitor(v, val);
+}
+
+backfill_chunk_t::key_value_pairs_t::key_value_pairs_t(
+        int32_t _num_pairs, repli_timestamp_t _max_recency,
+        const write_message_t &atoms, int compression_level)
+    : num_pairs(_num_pairs), max_recency(_max_recency), compressed(false) {
+    vector_stream_t stream;
+    int write_res = send_write_message(&stream, &atoms);
+    guarantee(write_res == 0);
+    uncompressed_size = stream.vector().size();
+
+    if (compression_level != 0 && uncompressed_size > 0) {
+        uLongf compressed_size = compressBound(uncompressed_size);
+        data.resize(compressed_size);
+        int res = compress2(reinterpret_cast<Bytef *>(&data[0]), &compressed_size,
+                            reinterpret_cast<const Bytef *>(&stream.vector()[0]),
+                            uncompressed_size, compression_level);
+        guarantee(res == Z_OK, "zlib failed to compress a backfill chunk (error %d).", res);
+        if (static_cast<int64_t>(compressed_size) < uncompressed_size) {
+            data.resize(compressed_size);
+            compressed = true;
+            return;
+        }
+    }
+    data = stream.vector();
+}
+
+void backfill_chunk_t::key_value_pairs_t::get_atoms(std::vector<rdb_backfill_atom_t> *atoms_out) const {
+    std::vector<char> uncompressed;
+    const std::vector<char> *serialized = &data;
+    if (compressed) {
+        uncompressed.resize(uncompressed_size);
+        uLongf size = uncompressed_size;
+        int res = uncompress(reinterpret_cast<Bytef *>(&uncompressed[0]), &size,
+                             reinterpret_cast<const Bytef *>(&data[0]), data.size());
+        guarantee(res == Z_OK, "zlib failed to decompress a backfill chunk (error %d).", res);
+        guarantee(static_cast<int64_t>(size) == uncompressed_size);
+        serialized = &uncompressed;
+    }
+
+    vector_read_stream_t stream(serialized);
+    atoms_out->resize(num_pairs);
+    for (int32_t i = 0; i < num_pairs; ++i) {
+        archive_result_t res = deserialize(&stream, &(*atoms_out)[i]);
+        guarantee(res == ARCHIVE_SUCCESS, "Corrupted backfill chunk.");
+    }
+}
+
+/* Key/value pairs are batched into `key_value_pairs_t` chunks. Anything else
+flushes the batch first, so the backfillee sees every change in the order the
+traversal found it. The traversal may call us from several coroutines at once,
+so the batch is swapped out before `send_chunk()` gets a chance to block. */
 struct rdb_backfill_callback_impl_t : public rdb_backfill_callback_t {
 public:
     typedef backfill_chunk_t chunk_t;
 
     explicit rdb_backfill_callback_impl_t(chunk_fun_callback_t<rdb_protocol_t> *_chunk_fun_cb)
-        : chunk_fun_cb(_chunk_fun_cb) { }
+        : chunk_fun_cb(_chunk_fun_cb),
+          pending_pairs(new write_message_t),
+          num_pending_pairs(0),
+          pending_max_recency(repli_timestamp_t::distant_past) { }
     ~rdb_backfill_callback_impl_t() { }
 
     void on_delete_range(const key_range_t &range, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        send_pending_pairs(interruptor);
         chunk_fun_cb->send_chunk(chunk_t::delete_range(region_t(range)), interruptor);
     }
 
     void on_deletion(const btree_key_t *key, repli_timestamp_t recency, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        send_pending_pairs(interruptor);
         chunk_fun_cb->send_chunk(chunk_t::delete_key(to_store_key(key), recency), interruptor);
     }
 
     void on_keyvalue(const rdb_backfill_atom_t &atom, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
-        chunk_fun_cb->send_chunk(chunk_t::set_key(atom), interruptor);
+        *pending_pairs << atom;
+        ++num_pending_pairs;
+        pending_max_recency = std::max(pending_max_recency, atom.recency);
+        if (pending_pairs->size() >= BACKFILL_CHUNK_MAX_SIZE) {
+            send_pending_pairs(interruptor);
+        }
     }
 
     void on_sindexes(const std::map<std::string, secondary_index_t> &sindexes, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        send_pending_pairs(interruptor);
         chunk_fun_cb->send_chunk(chunk_t::sindexes(sindexes), interruptor);
     }
 
+    /* Sends whatever key/value pairs are still waiting for a full batch. Call
+    this once the traversal is done. */
+    void send_pending_pairs(signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        if (num_pending_pairs == 0) {
+            return;
+        }
+        chunk_t chunk = chunk_t::set_keys(
+            chunk_t::key_value_pairs_t(num_pending_pairs, pending_max_recency,
+                                       *pending_pairs, BACKFILL_CHUNK_COMPRESSION_LEVEL));
+        pending_pairs.init(new write_message_t);
+        num_pending_pairs = 0;
+        pending_max_recency = repli_timestamp_t::distant_past;
+        chunk_fun_cb->send_chunk(chunk, interruptor);
+    }
+
 protected:
     store_key_t to_store_key(const btree_key_t *key) {
         return store_key_t(key->size, key->contents);
@@ -1586,6 +1878,10 @@ protected:
 private:
     chunk_fun_callback_t<rdb_protocol_t> *chunk_fun_cb;
 
+    scoped_ptr_t<write_message_t> pending_pairs;
+    int32_t num_pending_pairs;
+    repli_timestamp_t pending_max_recency;
+
     DISABLE_COPYING(rdb_backfill_callback_impl_t);
 };
 
@@ -1624,6 +1920,8 @@ void store_t::protocol_send_backfill(const region_map_t<rdb_protocol_t, state_ti
     if (interruptor->is_pulsed()) {
         throw interrupted_exc_t();
     }
+
+    callback.send_pending_pairs(interruptor);
 }
 
 struct rdb_receive_backfill_visitor_t : public boost::static_visitor<void> {
@@ -1639,11 +1937,12 @@ struct rdb_receive_backfill_visitor_t : public boost::static_visitor<void> {
 
     void operator()(const backfill_chunk_t::delete_key_t& delete_key) const {
         point_delete_response_t response;
-        rdb_modification_report_t mod_report(delete_key.key);
+        std::vector<rdb_modification_report_t> mod_reports(
+            1, rdb_modification_report_t(delete_key.key));
         rdb_delete(delete_key.key, btree, delete_key.recency,
-                   txn, superblock, &response, &mod_report.info);
+                   txn, superblock, &response, &mod_reports[0].info);
 
-        update_sindexes(&mod_report);
+        update_sindexes(mod_reports);
     }
 
     void operator()(const backfill_chunk_t::delete_range_t& delete_range) const {
@@ -1652,16 +1951,39 @@ struct rdb_receive_backfill_visitor_t : public boost::static_visitor<void> {
                 store, token_pair, interruptor);
     }
 
-    void operator()(const backfill_chunk_t::key_value_pair_t& kv) const {
-        const rdb_backfill_atom_t& bf_atom = kv.backfill_atom;
-        point_write_response_t response;
-        rdb_modification_report_t mod_report(bf_atom.key);
-        rdb_set(bf_atom.key, bf_atom.value, true,
-                btree, bf_atom.recency,
-                txn, superblock, &response,
-                &mod_report.info);
+    void operator()(const backfill_chunk_t::key_value_pairs_t& kvs) const {
+        std::vector<rdb_backfill_atom_t> atoms;
+        kvs.get_atoms(&atoms);
+        // The traversal finds them in roughly key order; applying them in
+        // exactly key order walks the tree from left to right.
+        std::sort(atoms.begin(), atoms.end(), &backfill_atom_key_less);
+
+        // `rdb_set` hands the superblock back to us for every atom but the last,
+        // which releases it.  The secondary indexes are updated for the whole
+        // chunk at once, since the sindex block can only be acquired once per
+        // write token.
+        std::vector<rdb_modification_report_t> mod_reports;
+        mod_reports.reserve(atoms.size());
+        superblock_t *current_superblock = superblock;
+        for (size_t i = 0; i < atoms.size(); ++i) {
+            const rdb_backfill_atom_t& bf_atom = atoms[i];
+            const bool is_last = i + 1 == atoms.size();
+            point_write_response_t response;
+            mod_reports.push_back(rdb_modification_report_t(bf_atom.key));
+            promise_t<superblock_t *> return_superblock_local;
+            rdb_set(bf_atom.key, bf_atom.value, true,
+                    btree, bf_atom.recency,
+                    txn, current_superblock, &response,
+                    &mod_reports.back().info,
+                    is_last ? NULL : &return_superblock_local);
+            if (!is_last) {
+                current_superblock = return_superblock_local.wait();
+            }
+        }
 
-        update_sindexes(&mod_report);
+        if (!mod_reports.empty()) {
+            update_sindexes(mod_reports);
+        }
     }
 
     void operator()(const backfill_chunk_t::sindexes_t &s) const {
@@ -1685,7 +2007,12 @@ struct rdb_receive_backfill_visitor_t : public boost::static_visitor<void> {
     }
 
 private:
-    void update_sindexes(rdb_modification_report_t *mod_report) const {
+    static bool backfill_atom_key_less(const rdb_backfill_atom_t &x,
+                                       const rdb_backfill_atom_t &y) {
+        return x.key < y.key;
+    }
+
+    void update_sindexes(const std::vector<rdb_modification_report_t> &mod_reports) const {
         scoped_ptr_t<buf_lock_t> sindex_block;
         // Don't allow interruption here, or we may end up with inconsistent data
         cond_t dummy_interruptor;
@@ -1696,14 +2023,18 @@ private:
         mutex_t::acq_t acq;
         store->lock_sindex_queue(sindex_block.get(), &acq);
 
-        write_message_t wm;
-        wm << rdb_sindex_change_t(*mod_report);
-        store->sindex_queue_push(wm, &acq);
+        for (auto it = mod_reports.begin(); it != mod_reports.end(); ++it) {
+            write_message_t wm;
+            wm << rdb_sindex_change_t(*it);
+            store->sindex_queue_push(wm, &acq);
+        }
 
         sindex_access_vector_t sindexes;
         store->aquire_post_constructed_sindex_superblocks_for_write(
                 sindex_block.get(), txn, &sindexes);
-        rdb_update_sindexes(sindexes, mod_report, txn);
+        for (auto it = mod_reports.begin(); it != mod_reports.end(); ++it) {
+            rdb_update_sindexes(sindexes, &*it, txn);
+        }
     }
 
     btree_store_t<rdb_protocol_t> *store;
@@ -1765,6 +2096,7 @@ bool sindex_range_t::contains(counted_t<const ql::datum_t> value) const {
 RDB_IMPL_ME_SERIALIZABLE_3(rdb_protocol_details::rget_item_t, key, sindex_key, data);
 
 RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::point_read_response_t, data);
+RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::batched_point_read_response_t, rows);
 RDB_IMPL_ME_SERIALIZABLE_4(rdb_protocol_t::rget_read_response_t,
                            result, key_range, truncated, last_considered_key);
 RDB_IMPL_ME_SERIALIZABLE_2(rdb_protocol_t::distribution_read_response_t,
@@ -1773,6 +2105,7 @@ RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::sindex_list_response_t, sindexes);
 RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::read_response_t, response);
 
 RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::point_read_t, key);
+RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::batched_point_read_t, keys);
 
 RDB_IMPL_ME_SERIALIZABLE_4(sindex_range_t,
                            empty_ok(start), empty_ok(end), start_open, end_open);
@@ -1810,7 +2143,8 @@ RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::backfill_chunk_t::delete_key_t, key);
 
 RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::backfill_chunk_t::delete_range_t, range);
 
-RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::backfill_chunk_t::key_value_pair_t, backfill_atom);
+RDB_IMPL_ME_SERIALIZABLE_5(rdb_protocol_t::backfill_chunk_t::key_value_pairs_t,
+                           num_pairs, max_recency, compressed, uncompressed_size, data);
 
 RDB_IMPL_ME_SERIALIZABLE_1(rdb_protocol_t::backfill_chunk_t::sindexes_t, sindexes);
 
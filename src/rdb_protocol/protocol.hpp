@@ -132,7 +132,8 @@ typedef std::list<transform_variant_t> transform_t;
 
 typedef boost::variant<ql::gmr_wire_func_t,
                        ql::count_wire_func_t,
-                       ql::reduce_wire_func_t> terminal_variant_t;
+                       ql::reduce_wire_func_t,
+                       ql::top_k_wire_func_t> terminal_variant_t;
 typedef terminal_variant_t terminal_t;
 
 void bring_sindexes_up_to_date(
@@ -191,7 +192,9 @@ struct rdb_protocol_t {
                       auth_semilattice_metadata_t> > _auth_metadata,
                   directory_read_manager_t<
                       cluster_directory_metadata_t> *_directory_read_manager,
-                  uuid_u _machine_id);
+                  uuid_u _machine_id,
+                  io_backender_t *_io_backender,
+                  const base_path_t *_spill_path);
         ~context_t();
 
         extproc_pool_t *extproc_pool;
@@ -214,6 +217,9 @@ struct rdb_protocol_t {
         cond_t interruptor;
         scoped_array_t<scoped_ptr_t<cross_thread_signal_t> > signals;
         uuid_u machine_id;
+        // Passed on to the `ql::env_t`s of queries, for sorts to spill to disk.
+        io_backender_t *io_backender;
+        const base_path_t *spill_path;
     };
 
     struct point_read_response_t {
@@ -224,6 +230,12 @@ struct rdb_protocol_t {
         RDB_DECLARE_ME_SERIALIZABLE;
     };
 
+    struct batched_point_read_response_t {
+        // Only the keys that have a row are present.
+        std::map<store_key_t, counted_t<const ql::datum_t> > rows;
+        RDB_DECLARE_ME_SERIALIZABLE;
+    };
+
     struct rget_read_response_t {
          // Present if there was no terminal
         typedef std::vector<rdb_protocol_details::rget_item_t> stream_t;
@@ -240,6 +252,7 @@ struct rdb_protocol_t {
             counted_t<const ql::datum_t>,
             empty_t, // for `reduce`, sometimes
             ql::wire_datum_map_t, // for `gmr`, always
+            vec_t, // for `top_k`, as a heap
 
             // Streaming Result.
             stream_t
@@ -283,6 +296,7 @@ struct rdb_protocol_t {
 
     struct read_response_t {
         boost::variant<point_read_response_t,
+                       batched_point_read_response_t,
                        rget_read_response_t,
                        distribution_read_response_t,
                        sindex_list_response_t> response;
@@ -307,6 +321,22 @@ struct rdb_protocol_t {
         RDB_DECLARE_ME_SERIALIZABLE;
     };
 
+    // Looks up many primary keys at once.  Each shard gets the keys that belong
+    // to it and reads them all in one transaction, rather than each key being a
+    // round trip of its own.
+    class batched_point_read_t {
+    public:
+        batched_point_read_t() { }
+        explicit batched_point_read_t(std::vector<store_key_t> &&_keys)
+            : keys(std::move(_keys)) {
+            r_sanity_check(keys.size() != 0);
+        }
+
+        std::vector<store_key_t> keys;
+
+        RDB_DECLARE_ME_SERIALIZABLE;
+    };
+
     class rget_read_t {
     public:
         rget_read_t() { }
@@ -424,6 +454,7 @@ struct rdb_protocol_t {
 
     struct read_t {
         boost::variant<point_read_t,
+                       batched_point_read_t,
                        rget_read_t,
                        distribution_read_t,
                        sindex_list_t> read;
@@ -441,6 +472,7 @@ struct rdb_protocol_t {
 
         read_t() { }
         explicit read_t(const boost::variant<point_read_t,
+                                             batched_point_read_t,
                                              rget_read_t,
                                              distribution_read_t,
                                              sindex_list_t> &r)
@@ -701,11 +733,26 @@ struct rdb_protocol_t {
 
             RDB_DECLARE_ME_SERIALIZABLE;
         };
-        struct key_value_pair_t {
-            rdb_protocol_details::backfill_atom_t backfill_atom;
-
-            key_value_pair_t() { }
-            explicit key_value_pair_t(const rdb_protocol_details::backfill_atom_t& _backfill_atom) : backfill_atom(_backfill_atom) { }
+        /* A batch of key/value pairs that the backfiller found in one stretch
+        of the traversal. `data` holds the `num_pairs` serialized
+        `backfill_atom_t`s, compressed with zlib if `compressed` is set. */
+        struct key_value_pairs_t {
+            int32_t num_pairs;
+            repli_timestamp_t max_recency;
+            bool compressed;
+            int64_t uncompressed_size;
+            std::vector<char> data;
+
+            key_value_pairs_t()
+                : num_pairs(0), max_recency(repli_timestamp_t::distant_past),
+                  compressed(false), uncompressed_size(0) { }
+
+            /* Takes the serialized atoms, compressing them at `compression_level`
+            unless that's 0 or doesn't make them any smaller. */
+            key_value_pairs_t(int32_t _num_pairs, repli_timestamp_t _max_recency,
+                              const write_message_t &atoms, int compression_level);
+
+            void get_atoms(std::vector<rdb_protocol_details::backfill_atom_t> *atoms_out) const;
 
             RDB_DECLARE_ME_SERIALIZABLE;
         };
@@ -719,7 +766,7 @@ struct rdb_protocol_t {
             RDB_DECLARE_ME_SERIALIZABLE;
         };
 
-        typedef boost::variant<delete_range_t, delete_key_t, key_value_pair_t, sindexes_t> value_t;
+        typedef boost::variant<delete_range_t, delete_key_t, key_value_pairs_t, sindexes_t> value_t;
 
         backfill_chunk_t() { }
         explicit backfill_chunk_t(const value_t &_val) : val(_val) { }
@@ -731,8 +778,8 @@ struct rdb_protocol_t {
         static backfill_chunk_t delete_key(const store_key_t& key, const repli_timestamp_t& recency) {
             return backfill_chunk_t(delete_key_t(key, recency));
         }
-        static backfill_chunk_t set_key(const rdb_protocol_details::backfill_atom_t& key) {
-            return backfill_chunk_t(key_value_pair_t(key));
+        static backfill_chunk_t set_keys(const key_value_pairs_t &pairs) {
+            return backfill_chunk_t(pairs);
         }
 
         static backfill_chunk_t sindexes(const std::map<std::string, secondary_index_t> &sindexes) {
@@ -742,6 +789,10 @@ struct rdb_protocol_t {
         /* This is for `btree_store_t`; it's not part of the ICL protocol API. */
         repli_timestamp_t get_btree_repli_timestamp() const THROWS_NOTHING;
 
+        /* How many bytes of data this chunk carries over the wire; the backfiller
+        uses it to report throughput. */
+        int64_t get_data_size() const THROWS_NOTHING;
+
         RDB_DECLARE_ME_SERIALIZABLE;
     };
 
@@ -0,0 +1,77 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "rdb_protocol/regex_cache.hpp"
+
+#include <re2/re2.h>
+
+#include <list>
+#include <map>
+#include <utility>
+
+#include "config/args.hpp"
+#include "perfmon/perfmon.hpp"
+#include "thread_local.hpp"
+
+namespace ql {
+
+static perfmon_counter_t pm_regex_cache_hits, pm_regex_cache_misses;
+static perfmon_duration_sampler_t pm_regex_compile(secs_to_ticks(1), true);
+static perfmon_multi_membership_t pm_regex_membership(&get_global_perfmon_collection(),
+    &pm_regex_cache_hits, "regex_cache_hits",
+    &pm_regex_cache_misses, "regex_cache_misses",
+    &pm_regex_compile, "regex_compile",
+    NULLPTR);
+
+/* A least recently used cache of compiled patterns.  `lru` has the most recently
+used one first, and `index` finds a pattern's entry in it. */
+class regex_cache_t {
+public:
+    regex_cache_t() : size(0) { }
+
+    boost::shared_ptr<const RE2> get(const std::string &pattern) {
+        index_t::iterator it = index.find(pattern);
+        if (it != index.end()) {
+            ++pm_regex_cache_hits;
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+
+        ++pm_regex_cache_misses;
+        boost::shared_ptr<const RE2> regexp;
+        {
+            block_pm_duration timer(&pm_regex_compile);
+            regexp.reset(new RE2(pattern));
+        }
+        // Patterns that don't compile get cached too; the error is part of `RE2`.
+        lru.push_front(std::make_pair(pattern, regexp));
+        index[pattern] = lru.begin();
+        if (++size > REGEX_CACHE_SIZE) {
+            index.erase(lru.back().first);
+            lru.pop_back();
+            --size;
+        }
+        return regexp;
+    }
+
+private:
+    typedef std::list<std::pair<std::string, boost::shared_ptr<const RE2> > > lru_t;
+    typedef std::map<std::string, lru_t::iterator> index_t;
+
+    lru_t lru;
+    index_t index;
+    size_t size;
+
+    DISABLE_COPYING(regex_cache_t);
+};
+
+TLS_with_init(regex_cache_t *, regex_cache, NULL)
+
+boost::shared_ptr<const RE2> compile_regex(const std::string &pattern) {
+    regex_cache_t *cache = TLS_get_regex_cache();
+    if (cache == NULL) {
+        cache = new regex_cache_t;
+        TLS_set_regex_cache(cache);
+    }
+    return cache->get(pattern);
+}
+
+}  // namespace ql
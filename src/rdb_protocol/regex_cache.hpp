@@ -0,0 +1,21 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_REGEX_CACHE_HPP_
+#define RDB_PROTOCOL_REGEX_CACHE_HPP_
+
+#include <string>
+
+#include "errors.hpp"
+#include <boost/shared_ptr.hpp>
+
+namespace re2 { class RE2; }
+
+namespace ql {
+
+/* Returns `pattern` compiled, which might have failed (check `ok()`).  Each thread
+caches the REGEX_CACHE_SIZE patterns it has compiled most recently and hands out the
+same `RE2` for them, which is safe because matching doesn't modify it. */
+boost::shared_ptr<const re2::RE2> compile_regex(const std::string &pattern);
+
+}  // namespace ql
+
+#endif  // RDB_PROTOCOL_REGEX_CACHE_HPP_
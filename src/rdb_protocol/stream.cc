@@ -2,6 +2,8 @@
 #include "rdb_protocol/stream.hpp"
 
 #include "btree/keys.hpp"
+#include "concurrency/wait_any.hpp"
+#include "rdb_protocol/btree.hpp"
 #include "rdb_protocol/ql2.hpp"
 #include "rdb_protocol/transform_visitors.hpp"
 #include "rdb_protocol/datum_stream.hpp"
@@ -27,8 +29,12 @@ batched_rget_stream_t::batched_rget_stream_t(
             right_bound.has()
               ? store_key_t(right_bound->print_primary())
               : store_key_t::max()),
+      consumed_range(range),
       sorting(_sorting),
-      parent(_parent)
+      parent(_parent),
+      batches_size(0),
+      read_in_flight(false),
+      batch_waiter(NULL)
 { }
 
 batched_rget_stream_t::batched_rget_stream_t(
@@ -53,16 +59,17 @@ batched_rget_stream_t::batched_rget_stream_t(
                 _sindex_end_value.has()
                   ? _sindex_end_value->truncated_secondary()
                   : store_key_t::max())),
+      consumed_range(range),
       sorting(_sorting),
-      parent(_parent)
+      parent(_parent),
+      batches_size(0),
+      read_in_flight(false),
+      batch_waiter(NULL)
 { }
 
 boost::optional<rget_item_t> batched_rget_stream_t::head(ql::env_t *env) {
     started = true;
     if (data.empty()) {
-        if (finished) {
-            return boost::optional<rget_item_t>();
-        }
         read_more(env);
         if (data.empty()) {
             finished = true;
@@ -218,7 +225,8 @@ boost::shared_ptr<json_stream_t> batched_rget_stream_t::add_transformation(
 
 rdb_protocol_t::rget_read_response_t::result_t batched_rget_stream_t::apply_terminal(
     const rdb_protocol_details::terminal_variant_t &t, ql::env_t *env) {
-    rdb_protocol_t::rget_read_t rget_read = get_rget();
+    // Whatever has been read ahead gets read again, along with the rest.
+    rdb_protocol_t::rget_read_t rget_read = get_rget(consumed_range);
     rget_read.terminal = t;
     rdb_protocol_t::read_t read(rget_read);
     try {
@@ -246,14 +254,15 @@ rdb_protocol_t::rget_read_response_t::result_t batched_rget_stream_t::apply_term
     }
 }
 
-rdb_protocol_t::rget_read_t batched_rget_stream_t::get_rget() {
+rdb_protocol_t::rget_read_t batched_rget_stream_t::get_rget(
+    const key_range_t &rget_range) {
     if (!sindex_id) {
-        return rdb_protocol_t::rget_read_t(rdb_protocol_t::region_t(range),
+        return rdb_protocol_t::rget_read_t(rdb_protocol_t::region_t(rget_range),
                                            transform,
                                            optargs,
                                            sorting);
     } else {
-        return rdb_protocol_t::rget_read_t(rdb_protocol_t::region_t(range),
+        return rdb_protocol_t::rget_read_t(rdb_protocol_t::region_t(rget_range),
                                            *sindex_id,
                                            sindex_range,
                                            transform,
@@ -262,57 +271,158 @@ rdb_protocol_t::rget_read_t batched_rget_stream_t::get_rget() {
     }
 }
 
+// Pulses `target` when the signal it's subscribed to gets pulsed.
+class pulse_on_signal_t : public signal_t::subscription_t {
+public:
+    pulse_on_signal_t(signal_t *signal, cond_t *_target) : target(_target) {
+        reset(signal);
+    }
+    void run() {
+        if (!target->is_pulsed()) {
+            target->pulse();
+        }
+    }
+private:
+    cond_t *target;
+};
+
 void batched_rget_stream_t::read_more(ql::env_t *env) {
-    rdb_protocol_t::read_t read(get_rget());
+    if (batches.empty() && !read_in_flight) {
+        if (finished) {
+            return;
+        }
+        start_read();
+    }
+    while (batches.empty()) {
+        guarantee(read_in_flight);
+        // The read in flight was started for this query, or for an earlier call
+        // on the same stream; either way, the query's interruptor should stop it.
+        pulse_on_signal_t interrupt_read(env->interruptor, &interrupted);
+        cond_t batch_ready;
+        assignment_sentry_t<cond_t *> waiter_sentry(&batch_waiter, &batch_ready);
+        wait_interruptible(&batch_ready, env->interruptor);
+    }
+
+    rget_batch_t batch = std::move(batches.front());
+    batches.pop_front();
+    batches_size -= batch.size;
+    consumed_range = batch.range_after;
+    // Make room for the next batch while the caller works on this one.
+    maybe_prefetch();
+
+    if (batch.interrupted) {
+        throw interrupted_exc_t();
+    }
+    if (batch.error) {
+        rfail_datum(ql::base_exc_t::GENERIC,
+                    "cannot perform read: %s", batch.error->c_str());
+    }
+
+    /* Re throw an exception if we got one. */
+    if (auto e = boost::get<ql::exc_t>(&batch.response.result)) {
+        throw *e;
+    } else if (auto e2 = boost::get<ql::datum_exc_t>(&batch.response.result)) {
+        throw *e2;
+    }
+
+    typedef rdb_protocol_t::rget_read_response_t::stream_t stream_t;
+    stream_t *stream = boost::get<stream_t>(&batch.response.result);
+    guarantee(stream);
+
+    for (stream_t::iterator i = stream->begin(); i != stream->end(); ++i) {
+        guarantee(i->data);
+        data.push_back(*i);
+    }
+}
+
+void batched_rget_stream_t::maybe_prefetch() {
+    if (!read_in_flight && !finished
+        && batches.size() < RGET_PREFETCH_MAX_BATCHES
+        && batches_size < RGET_PREFETCH_MAX_SIZE) {
+        start_read();
+    }
+}
+
+void batched_rget_stream_t::start_read() {
+    guarantee(!read_in_flight && !finished);
+    guarantee(ns_access.get_namespace_if());
+    read_in_flight = true;
+    coro_t::spawn_sometime(std::bind(&batched_rget_stream_t::do_read, this,
+                                     rdb_protocol_t::read_t(get_rget(range)),
+                                     auto_drainer_t::lock_t(&drainer)));
+}
+
+void batched_rget_stream_t::do_read(const rdb_protocol_t::read_t &read,
+                                    auto_drainer_t::lock_t keepalive) {
+    rget_batch_t batch;
+    wait_any_t interruptor(keepalive.get_drain_signal(), &interrupted);
     try {
-        guarantee(ns_access.get_namespace_if());
         rdb_protocol_t::read_response_t res;
         if (use_outdated) {
-            ns_access.get_namespace_if()->read_outdated(read, &res, env->interruptor);
+            ns_access.get_namespace_if()->read_outdated(read, &res, &interruptor);
         } else {
             ns_access.get_namespace_if()->read(
-                read, &res, order_token_t::ignore, env->interruptor);
+                read, &res, order_token_t::ignore, &interruptor);
         }
         rdb_protocol_t::rget_read_response_t *p_res
             = boost::get<rdb_protocol_t::rget_read_response_t>(&res.response);
         guarantee(p_res);
+        batch.response = *p_res;
 
-        /* Re throw an exception if we got one. */
-        if (auto e = boost::get<ql::exc_t>(&p_res->result)) {
-            throw *e;
-        } else if (auto e2 = boost::get<ql::datum_exc_t>(&p_res->result)) {
-            throw *e2;
-        }
-
-        // todo: just do a straight copy?
         typedef rdb_protocol_t::rget_read_response_t::stream_t stream_t;
-        stream_t *stream = boost::get<stream_t>(&p_res->result);
-        guarantee(stream);
-
-        for (stream_t::iterator i = stream->begin(); i != stream->end(); ++i) {
-            guarantee(i->data);
-            data.push_back(*i);
-        }
-
-        if (forward(sorting)) {
-            range.left = p_res->last_considered_key;
+        if (stream_t *stream = boost::get<stream_t>(&batch.response.result)) {
+            if (stream->empty()) {
+                finished = true;
+            } else {
+                for (stream_t::iterator i = stream->begin(); i != stream->end(); ++i) {
+                    batch.size += estimate_rget_response_size(i->data);
+                }
+                advance_range(p_res->last_considered_key);
+            }
         } else {
-            range.right = key_range_t::right_bound_t(p_res->last_considered_key);
+            // The read failed, the consumer will throw when it gets to it.
+            finished = true;
         }
+    } catch (const cannot_perform_query_exc_t &e) {
+        batch.error = e.what();
+        finished = true;
+    } catch (const interrupted_exc_t &) {
+        if (keepalive.get_drain_signal()->is_pulsed()) {
+            // We're being destroyed.
+            return;
+        }
+        // The query was interrupted; whoever reads the stream next gets told so.
+        batch.interrupted = true;
+        finished = true;
+    }
 
-        if (forward(sorting) &&
-            (!range.left.increment() ||
-            (!range.right.unbounded && (range.right.key < range.left)))) {
+    batch.range_after = range;
+    read_in_flight = false;
+    batches_size += batch.size;
+    batches.push_back(std::move(batch));
+    if (batch_waiter != NULL) {
+        batch_waiter->pulse();
+    }
+    maybe_prefetch();
+}
+
+void batched_rget_stream_t::advance_range(const store_key_t &last_considered_key) {
+    if (forward(sorting)) {
+        range.left = last_considered_key;
+    } else {
+        range.right = key_range_t::right_bound_t(last_considered_key);
+    }
+
+    if (forward(sorting) &&
+        (!range.left.increment() ||
+        (!range.right.unbounded && (range.right.key < range.left)))) {
+        finished = true;
+    } else if (backward(sorting)) {
+        guarantee(!range.right.unbounded);
+        if (!range.right.key.decrement() ||
+            range.right.key < range.left) {
             finished = true;
-        } else if (backward(sorting)) {
-            guarantee(!range.right.unbounded);
-            if (!range.right.key.decrement() ||
-                range.right.key < range.left) {
-                finished = true;
-            }
         }
-    } catch (const cannot_perform_query_exc_t &e) {
-        rfail_datum(ql::base_exc_t::GENERIC, "cannot perform read: %s", e.what());
     }
 }
 
@@ -19,6 +19,8 @@
 #include <boost/variant/get.hpp>
 
 #include "clustering/administration/namespace_interface_repository.hpp"
+#include "concurrency/auto_drainer.hpp"
+#include "concurrency/cond_var.hpp"
 #include "rdb_protocol/protocol.hpp"
 
 enum batch_info_t { MID_BATCH, LAST_OF_BATCH, END_OF_STREAM };
@@ -90,10 +92,33 @@ public:
                    ql::env_t *env);
 
 private:
+    /* The response to one rget read, waiting to be consumed. */
+    struct rget_batch_t {
+        rget_batch_t() : interrupted(false), size(0) { }
+        rdb_protocol_t::rget_read_response_t response;
+        // Set if the read couldn't be performed at all.
+        boost::optional<std::string> error;
+        // Set if the read was interrupted by `interrupted`.
+        bool interrupted;
+        // What's left of the range once this batch has been consumed.
+        key_range_t range_after;
+        // The estimated size of the rows in `response`.
+        size_t size;
+    };
+
     boost::optional<rget_item_t> head(ql::env_t *env);
     void pop();
-    rdb_protocol_t::rget_read_t get_rget();
+    rdb_protocol_t::rget_read_t get_rget(const key_range_t &rget_range);
     void read_more(ql::env_t *env);
+
+    /* Reads are chained: each one starts at the `last_considered_key` of the one
+    before it, so there's at most one in flight. As soon as a read comes back we
+    start the next one, until `RGET_PREFETCH_MAX_BATCHES` unconsumed batches or
+    `RGET_PREFETCH_MAX_SIZE` bytes of them have piled up. */
+    void maybe_prefetch();
+    void start_read();
+    void do_read(const rdb_protocol_t::read_t &read, auto_drainer_t::lock_t keepalive);
+    void advance_range(const store_key_t &last_considered_key);
     bool check_and_set_key_in_sorting_buffer(const std::string &key);
 
     /* Returns true if the passed value is new. */
@@ -120,11 +145,29 @@ private:
     bool use_outdated;
 
     sindex_range_t sindex_range;
+    // What's left to read, past the batches that have been read ahead...
     key_range_t range;
+    // ... and past the batches that have been consumed, which is what a terminal
+    // has to cover.
+    key_range_t consumed_range;
 
     sorting_t sorting;
 
     ql::rcheckable_t *parent;
+
+    // `finished` is set once we know not to issue any more reads; batches that were
+    // already read may still be waiting in `batches`.
+    std::deque<rget_batch_t> batches;
+    size_t batches_size;
+    bool read_in_flight;
+    // Pulsed when the read in flight comes back, if someone is waiting for it.
+    cond_t *batch_waiter;
+    // Pulsed when the query's interruptor is pulsed while it waits for a batch;
+    // this interrupts the read in flight.
+    cond_t interrupted;
+
+    // Interrupts the read in flight when we're destroyed.
+    auto_drainer_t drainer;
 };
 
 } // namespace query_language
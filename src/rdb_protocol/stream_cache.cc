@@ -1,6 +1,8 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "rdb_protocol/stream_cache.hpp"
 
+#include "arch/runtime/coroutines.hpp"
+#include "concurrency/cross_thread_signal.hpp"
 #include "rdb_protocol/env.hpp"
 
 namespace ql {
@@ -29,10 +31,14 @@ bool stream_cache2_t::serve(int64_t key, Response *res, signal_t *interruptor) {
     entry_t *entry = it->second;
     entry->last_activity = time(0);
     try {
+        // The stream may belong to another thread; see `entry_t::thread`.
+        cross_thread_signal_t ct_interruptor(interruptor, entry->thread);
+        on_thread_t th(entry->thread);
+
         // Reset the env_t's interruptor to a good one before we use it.  This may be a
         // hack.  (I'd rather not have env_t be mutable this way -- could we construct
         // a new env_t instead?  Why do we keep env_t's around anymore?)
-        entry->env->interruptor = interruptor;
+        entry->env->interruptor = &ct_interruptor;
 
         int chunk_size = 0;
         if (entry->next_datum.has()) {
@@ -65,16 +71,27 @@ bool stream_cache2_t::serve(int64_t key, Response *res, signal_t *interruptor) {
     return true;
 }
 
+void stream_cache2_t::take_streams(stream_cache2_t *other) {
+    streams.transfer(other->streams);
+    guarantee(other->streams.empty());
+}
+
 void stream_cache2_t::maybe_evict() {
     // We never evict right now.
 }
 
 stream_cache2_t::entry_t::entry_t(time_t _last_activity, scoped_ptr_t<env_t> &&env_ptr,
                                   counted_t<datum_stream_t> _stream)
-    : last_activity(_last_activity), env(std::move(env_ptr)), stream(_stream),
+    : last_activity(_last_activity), thread(get_thread_id()),
+      env(std::move(env_ptr)), stream(_stream),
       max_chunk_size(DEFAULT_MAX_CHUNK_SIZE), max_age(DEFAULT_MAX_AGE) { }
 
-stream_cache2_t::entry_t::~entry_t() { }
+stream_cache2_t::entry_t::~entry_t() {
+    on_thread_t th(thread);
+    next_datum.reset();
+    stream.reset();
+    env.reset();
+}
 
 
 } // namespace ql
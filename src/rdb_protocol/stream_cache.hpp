@@ -28,11 +28,13 @@ public:
                 scoped_ptr_t<env_t> &&val_env, counted_t<datum_stream_t> val_stream);
     void erase(int64_t key);
     MUST_USE bool serve(int64_t key, Response *res, signal_t *interruptor);
+    // Moves all of `other`'s streams into this cache.
+    void take_streams(stream_cache2_t *other);
 private:
     void maybe_evict();
 
     struct entry_t {
-        ~entry_t(); // `env_t` is incomplete
+        ~entry_t(); // Destroys `env` and `stream` on `thread`
 #ifndef NDEBUG
         static const int DEFAULT_MAX_CHUNK_SIZE = 5;
 #else
@@ -42,6 +44,9 @@ private:
         entry_t(time_t _last_activity, scoped_ptr_t<env_t> &&env_ptr,
                 counted_t<datum_stream_t> _stream);
         time_t last_activity;
+        // The thread that evaluated the stream's query. The `env_t` and the
+        // stream belong to it, even if the cache is used from another thread.
+        const threadnum_t thread;
         scoped_ptr_t<env_t> env;
         counted_t<datum_stream_t> stream;
         int max_chunk_size; // Size of 0 = unlimited
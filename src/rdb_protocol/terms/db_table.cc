@@ -6,6 +6,7 @@
 
 #include "clustering/administration/main/ports.hpp"
 #include "clustering/administration/suggester.hpp"
+#include "rdb_protocol/func.hpp"
 #include "rdb_protocol/meta_utils.hpp"
 #include "rdb_protocol/op.hpp"
 #include "rpc/directory/read_manager.hpp"
@@ -155,7 +156,7 @@ public:
     table_create_term_t(compile_env_t *env, const protob_t<const Term> &term) :
         meta_write_op_t(env, term, argspec_t(1, 2),
                         optargspec_t({"datacenter", "primary_key",
-                                    "cache_size", "durability"})) { }
+                                    "cache_size", "compress_blocks", "durability"})) { }
 private:
     virtual std::string write_eval_impl(scope_env_t *env, UNUSED eval_flags_t flags) {
         uuid_u dc_id = nil_uuid();
@@ -183,6 +184,11 @@ private:
             cache_size = v->as_int<int64_t>();
         }
 
+        bool compress_blocks = false;
+        if (counted_t<val_t> v = optarg(env, "compress_blocks")) {
+            compress_blocks = v->as_bool();
+        }
+
         uuid_u db_id;
         name_string_t tbl_name;
         if (num_args() == 1) {
@@ -212,7 +218,7 @@ private:
             namespace_semilattice_metadata_t<rdb_protocol_t> ns =
                 new_namespace<rdb_protocol_t>(env->env->cluster_access.this_machine, db_id, dc_id, tbl_name,
                                               primary_key, port_defaults::reql_port,
-                                              cache_size);
+                                              cache_size, compress_blocks);
 
             // Set Durability
             std::map<datacenter_id_t, ack_expectation_t> *ack_map =
@@ -479,12 +485,17 @@ private:
                 = make_counted<union_datum_stream_t>(streams, backtrace());
             return new_val(stream, table);
         } else {
-            datum_ptr_t arr(datum_t::R_ARRAY);
+            std::vector<counted_t<const datum_t> > keys;
+            keys.reserve(num_args() - 1);
             for (size_t i = 1; i < num_args(); ++i) {
-                counted_t<const datum_t> key = arg(env, i)->as_datum();
-                counted_t<const datum_t> row = table->get_row(env->env, key);
-                if (row->get_type() != datum_t::R_NULL) {
-                    arr.add(row);
+                keys.push_back(arg(env, i)->as_datum());
+            }
+            std::vector<counted_t<const datum_t> > rows
+                = table->get_rows(env->env, keys);
+            datum_ptr_t arr(datum_t::R_ARRAY);
+            for (auto it = rows.begin(); it != rows.end(); ++it) {
+                if ((*it)->get_type() != datum_t::R_NULL) {
+                    arr.add(*it);
                 }
             }
             counted_t<datum_stream_t> stream
@@ -495,6 +506,23 @@ private:
     virtual const char *name() const { return "get_all"; }
 };
 
+class eq_join_term_t : public op_term_t {
+public:
+    eq_join_term_t(compile_env_t *env, const protob_t<const Term> &term)
+        : op_term_t(env, term, argspec_t(3), optargspec_t({ "index" })) { }
+private:
+    virtual counted_t<val_t> eval_impl(scope_env_t *env, UNUSED eval_flags_t flags) {
+        counted_t<datum_stream_t> left = arg(env, 0)->as_seq(env->env);
+        counted_t<func_t> left_attr = arg(env, 1)->as_func(GET_FIELD_SHORTCUT);
+        counted_t<table_t> right = arg(env, 2)->as_table();
+        counted_t<val_t> index = optarg(env, "index");
+        counted_t<datum_stream_t> stream = make_counted<eq_join_datum_stream_t>(
+            left_attr, right, index ? index->as_str() : right->get_pkey(), left);
+        return new_val(env->env, stream);
+    }
+    virtual const char *name() const { return "inner_join"; }
+};
+
 counted_t<term_t> make_db_term(compile_env_t *env, const protob_t<const Term> &term) {
     return make_counted<db_term_t>(env, term);
 }
@@ -511,6 +539,10 @@ counted_t<term_t> make_get_all_term(compile_env_t *env, const protob_t<const Ter
     return make_counted<get_all_term_t>(env, term);
 }
 
+counted_t<term_t> make_eq_join_term(compile_env_t *env, const protob_t<const Term> &term) {
+    return make_counted<eq_join_term_t>(env, term);
+}
+
 counted_t<term_t> make_db_create_term(compile_env_t *env, const protob_t<const Term> &term) {
     return make_counted<db_create_term_t>(env, term);
 }
@@ -5,17 +5,29 @@
 
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/op.hpp"
+#include "rdb_protocol/regex_cache.hpp"
 
 namespace ql {
 
 class match_term_t : public op_term_t {
 public:
     match_term_t(compile_env_t *env, const protob_t<const Term> &term)
-        : op_term_t(env, term, argspec_t(2)) { }
+        : op_term_t(env, term, argspec_t(2)) {
+        // A pattern that's a string literal gets compiled once, here, rather than
+        // looked up for every row.  Errors still get reported when we evaluate.
+        const Term &pattern = term->args(1);
+        if (pattern.type() == Term::DATUM && pattern.datum().type() == Datum::R_STR) {
+            constant_regexp = compile_regex(pattern.datum().r_str());
+        }
+    }
 private:
     virtual counted_t<val_t> eval_impl(scope_env_t *env, UNUSED eval_flags_t flags) {
         std::string str = arg(env, 0)->as_str();
-        RE2 regexp(arg(env, 1)->as_str());
+        boost::shared_ptr<const RE2> regexp_ptr = constant_regexp;
+        if (!regexp_ptr) {
+            regexp_ptr = compile_regex(arg(env, 1)->as_str());
+        }
+        const RE2 &regexp = *regexp_ptr;
         if (!regexp.ok()) {
             rfail(base_exc_t::GENERIC,
                   "Error in regexp `%s` (portion `%s`): %s",
@@ -64,6 +76,8 @@ private:
         }
     }
     virtual const char *name() const { return "match"; }
+
+    boost::shared_ptr<const RE2> constant_regexp;
 };
 
 counted_t<term_t> make_match_term(compile_env_t *env, const protob_t<const Term> &term) {
@@ -181,120 +181,6 @@ private:
     virtual const char *name() const { return "groupby"; }
 };
 
-class inner_join_term_t : public rewrite_term_t {
-public:
-    inner_join_term_t(compile_env_t *env, const protob_t<const Term> &term)
-        : rewrite_term_t(env, term, argspec_t(3), rewrite) { }
-
-    static protob_t<Term> rewrite(protob_t<const Term> in,
-                                  const protob_t<Term> out,
-                                  UNUSED const pb_rcheckable_t *bt_src) {
-        const Term *const left = &in->args(0);
-        const Term *const right = &in->args(1);
-        const Term *const func = &in->args(2);
-        sym_t n;
-        sym_t m;
-
-        Term *arg = out.get();
-        // `left`.concatmap { |n|
-        N2(CONCATMAP, *arg = *left, arg = pb::set_func(arg, pb::dummy_var_t::INNERJOIN_N, &n);
-           // `right`.concatmap { |m|
-           N2(CONCATMAP, *arg = *right, arg = pb::set_func(arg, pb::dummy_var_t::INNERJOIN_M, &m);
-              // r.branch(
-              N3(BRANCH,
-                 // r.funcall(`func`, n, m),
-                 N3(FUNCALL, *arg = *func, NVAR(n), NVAR(m)),
-                 // [{:left => n, :right => m}],
-                 N1(MAKE_ARRAY, OPT2(MAKE_OBJ, "left", NVAR(n), "right", NVAR(m))),
-                 // [])}}
-                 N0(MAKE_ARRAY))));
-        return out;
-    }
-
-    virtual const char *name() const { return "inner_join"; }
-};
-
-class outer_join_term_t : public rewrite_term_t {
-public:
-    outer_join_term_t(compile_env_t *env, const protob_t<const Term> &term) :
-        rewrite_term_t(env, term, argspec_t(3), rewrite) { }
-
-    static protob_t<Term> rewrite(protob_t<const Term> in,
-                                  const protob_t<Term> out,
-                                  UNUSED const pb_rcheckable_t *bt_src) {
-        const Term *const left = &in->args(0);
-        const Term *const right = &in->args(1);
-        const Term *const func = &in->args(2);
-        sym_t n;
-        sym_t m;
-        sym_t lst;
-
-        Term *arg = out.get();
-
-        // `left`.concatmap { |n|
-        N2(CONCATMAP, *arg = *left, arg = pb::set_func(arg, pb::dummy_var_t::OUTERJOIN_N, &n);
-           // r.funcall(lambda { |lst
-           N2(FUNCALL, arg = pb::set_func(arg, pb::dummy_var_t::OUTERJOIN_M, &lst);
-              // r.branch(
-              N3(BRANCH,
-                 // r.gt(r.count(lst), 0),
-                 N2(GT, N1(COUNT, NVAR(lst)), NDATUM(0.0)),
-                 // lst,
-                 NVAR(lst),
-                 // [{:left => n}])},
-                 N1(MAKE_ARRAY, OPT1(MAKE_OBJ, "left", NVAR(n)))),
-              // r.coerce_to(
-              N2(COERCE_TO,
-                 // `right`.concatmap { |m|
-                 N2(CONCATMAP, *arg = *right, arg = pb::set_func(arg, pb::dummy_var_t::OUTERJOIN_LST, &m);
-                    // r.branch(
-                    N3(BRANCH,
-                       // r.funcall(`func`, n, m),
-                       N3(FUNCALL, *arg = *func, NVAR(n), NVAR(m)),
-                       // [{:left => n, :right => m}],
-                       N1(MAKE_ARRAY, OPT2(MAKE_OBJ, "left", NVAR(n), "right", NVAR(m))),
-                       // [])},
-                       N0(MAKE_ARRAY))),
-                 // "ARRAY"))}
-                 NDATUM("ARRAY"))));
-        return out;
-    }
-
-    virtual const char *name() const { return "outer_join"; }
-};
-
-class eq_join_term_t : public rewrite_term_t {
-public:
-    eq_join_term_t(compile_env_t *env, const protob_t<const Term> &term) :
-        rewrite_term_t(env, term, argspec_t(3), rewrite) { }
-private:
-
-    static protob_t<Term> rewrite(protob_t<const Term> in,
-                                  const protob_t<Term> out,
-                                  UNUSED const pb_rcheckable_t *bt_src) {
-        const Term *const left = &in->args(0);
-        const Term *const left_attr = &in->args(1);
-        const Term *const right = &in->args(2);
-
-        sym_t row;
-        sym_t v;
-
-        Term *arg = out.get();
-        Term *optarg_inheritor = NULL;
-        N2(CONCATMAP, *arg = *left, arg = pb::set_func(arg, pb::dummy_var_t::EQJOIN_ROW, &row);
-           N2(MAP,
-              optarg_inheritor = arg;
-              N2(GET_ALL, *arg = *right, N2(FUNCALL, *arg = *left_attr, NVAR(row));
-                  OPT1(FUNCALL, "_SHORTCUT_", NDATUM(static_cast<double>(GET_FIELD_SHORTCUT)))),
-
-              arg = pb::set_func(arg, pb::dummy_var_t::EQJOIN_V, &v);
-              OPT2(MAKE_OBJ, "left", NVAR(row), "right", NVAR(v))));
-        r_sanity_check(optarg_inheritor != NULL);
-        return out.make_child(optarg_inheritor);
-    }
-    virtual const char *name() const { return "inner_join"; }
-};
-
 class delete_term_t : public rewrite_term_t {
 public:
     delete_term_t(compile_env_t *env, const protob_t<const Term> &term)
@@ -411,15 +297,6 @@ counted_t<term_t> make_skip_term(compile_env_t *env, const protob_t<const Term>
 counted_t<term_t> make_groupby_term(compile_env_t *env, const protob_t<const Term> &term) {
     return make_counted<groupby_term_t>(env, term);
 }
-counted_t<term_t> make_inner_join_term(compile_env_t *env, const protob_t<const Term> &term) {
-    return make_counted<inner_join_term_t>(env, term);
-}
-counted_t<term_t> make_outer_join_term(compile_env_t *env, const protob_t<const Term> &term) {
-    return make_counted<outer_join_term_t>(env, term);
-}
-counted_t<term_t> make_eq_join_term(compile_env_t *env, const protob_t<const Term> &term) {
-    return make_counted<eq_join_term_t>(env, term);
-}
 counted_t<term_t> make_update_term(compile_env_t *env, const protob_t<const Term> &term) {
     return make_counted<update_term_t>(env, term);
 }
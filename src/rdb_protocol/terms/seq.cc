@@ -161,6 +161,23 @@ private:
     virtual const char *name() const { return "zip"; }
 };
 
+class join_term_t : public op_term_t {
+public:
+    join_term_t(compile_env_t *env, const protob_t<const Term> &term, bool _outer)
+        : op_term_t(env, term, argspec_t(3)), outer(_outer) { }
+private:
+    virtual counted_t<val_t> eval_impl(scope_env_t *env, UNUSED eval_flags_t flags) {
+        counted_t<datum_stream_t> left = arg(env, 0)->as_seq(env->env);
+        counted_t<datum_stream_t> right = arg(env, 1)->as_seq(env->env);
+        counted_t<func_t> predicate = arg(env, 2)->as_func();
+        return new_val(env->env, make_counted<join_datum_stream_t>(
+                           predicate, outer, left, right));
+    }
+    virtual const char *name() const { return outer ? "outer_join" : "inner_join"; }
+
+    const bool outer;
+};
+
 counted_t<term_t> make_between_term(compile_env_t *env, const protob_t<const Term> &term) {
     return make_counted<between_term_t>(env, term);
 }
@@ -185,5 +202,11 @@ counted_t<term_t> make_union_term(compile_env_t *env, const protob_t<const Term>
 counted_t<term_t> make_zip_term(compile_env_t *env, const protob_t<const Term> &term) {
     return make_counted<zip_term_t>(env, term);
 }
+counted_t<term_t> make_inner_join_term(compile_env_t *env, const protob_t<const Term> &term) {
+    return make_counted<join_term_t>(env, term, false);
+}
+counted_t<term_t> make_outer_join_term(compile_env_t *env, const protob_t<const Term> &term) {
+    return make_counted<join_term_t>(env, term, true);
+}
 
 } // namespace ql
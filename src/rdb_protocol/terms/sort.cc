@@ -50,68 +50,12 @@ public:
         : op_term_t(env, term, argspec_t(1, -1),
           optargspec_t({"index"})), src_term(term) { }
 private:
-    enum order_direction_t { ASC, DESC };
-    class lt_cmp_t {
-    public:
-        explicit lt_cmp_t(std::vector<std::pair<order_direction_t, counted_t<func_t> > > _comparisons)
-            : comparisons(std::move(_comparisons)) { }
-
-        bool operator()(env_t *env, counted_t<const datum_t> l, counted_t<const datum_t> r) const {
-            for (auto it = comparisons.begin(); it != comparisons.end(); ++it) {
-                counted_t<const datum_t> lval;
-                counted_t<const datum_t> rval;
-                try {
-                    lval = it->second->call(env, l)->as_datum();
-                } catch (const base_exc_t &e) {
-                    if (e.get_type() != base_exc_t::NON_EXISTENCE) {
-                        throw;
-                    }
-                }
-
-                try {
-                    rval = it->second->call(env, r)->as_datum();
-                } catch (const base_exc_t &e) {
-                    if (e.get_type() != base_exc_t::NON_EXISTENCE) {
-                        throw;
-                    }
-                }
-
-                if (!lval.has() && !rval.has()) {
-                    continue;
-                }
-                if (!lval.has()) {
-                    return true != (it->first == DESC);
-                }
-                if (!rval.has()) {
-                    return false != (it->first == DESC);
-                }
-                // TODO: use datum_t::cmp instead to be faster
-                if (*lval == *rval) {
-                    continue;
-                }
-                return (*lval < *rval) != (it->first == DESC);
-            }
-
-            return false;
-        }
-
-    private:
-        const std::vector<std::pair<order_direction_t, counted_t<func_t> > > comparisons;
-    };
-
     virtual counted_t<val_t> eval_impl(scope_env_t *env, UNUSED eval_flags_t flags) {
-        std::vector<std::pair<order_direction_t, counted_t<func_t> > > comparisons;
-        scoped_ptr_t<datum_t> arr(new datum_t(datum_t::R_ARRAY));
+        order_wire_funcs_t lt_cmp;
         for (size_t i = 1; i < num_args(); ++i) {
-            if (get_src()->args(i).type() == Term::DESC) {
-                comparisons.push_back(
-                        std::make_pair(DESC, arg(env, i)->as_func(GET_FIELD_SHORTCUT)));
-            } else {
-                comparisons.push_back(
-                        std::make_pair(ASC, arg(env, i)->as_func(GET_FIELD_SHORTCUT)));
-            }
+            lt_cmp.add(arg(env, i)->as_func(GET_FIELD_SHORTCUT),
+                       get_src()->args(i).type() == Term::DESC);
         }
-        lt_cmp_t lt_cmp(comparisons);
         // We can't have datum_stream_t::sort because templates suck.
 
         counted_t<table_t> tbl;
@@ -154,8 +98,9 @@ private:
             seq = tbl->as_datum_stream(env->env, backtrace());
         }
 
-        if (!comparisons.empty()) {
-            seq = make_counted<sort_datum_stream_t<lt_cmp_t> >(env->env, lt_cmp, seq, backtrace());
+        if (num_args() > 1) {
+            seq = make_counted<sort_datum_stream_t<order_wire_funcs_t> >(
+                lt_cmp, seq, backtrace());
         }
 
         return tbl.has() ? new_val(seq, tbl) : new_val(env->env, seq);
@@ -178,7 +123,7 @@ private:
             new sort_datum_stream_t<
                 bool (*)(env_t *,
                          counted_t<const datum_t>,
-                         counted_t<const datum_t>) >(env->env, lt_cmp, arg(env, 0)->as_seq(env->env), backtrace()));
+                         counted_t<const datum_t>) >(lt_cmp, arg(env, 0)->as_seq(env->env), backtrace()));
         datum_ptr_t arr(datum_t::R_ARRAY);
         counted_t<const datum_t> last;
         while (counted_t<const datum_t> d = s->next(env->env)) {
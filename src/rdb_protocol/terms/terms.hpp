@@ -53,6 +53,7 @@ counted_t<term_t> make_db_term(compile_env_t *env, const protob_t<const Term> &t
 counted_t<term_t> make_table_term(compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_get_term(compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_get_all_term(compile_env_t *env, const protob_t<const Term> &term);
+counted_t<term_t> make_eq_join_term(compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_db_create_term(compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_db_drop_term(compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_db_list_term(compile_env_t *env, const protob_t<const Term> &term);
@@ -95,9 +96,6 @@ counted_t<term_t> make_not_term(compile_env_t *env, const protob_t<const Term> &
 // rewrites.cc
 counted_t<term_t> make_skip_term(compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_groupby_term(compile_env_t *env, const protob_t<const Term> &term);
-counted_t<term_t> make_inner_join_term(compile_env_t *env, const protob_t<const Term> &term);
-counted_t<term_t> make_outer_join_term(compile_env_t *env, const protob_t<const Term> &term);
-counted_t<term_t> make_eq_join_term(compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_update_term(compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_delete_term(compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_difference_term(compile_env_t *env, const protob_t<const Term> &term);
@@ -112,6 +110,8 @@ counted_t<term_t> make_concatmap_term(compile_env_t *env, const protob_t<const T
 counted_t<term_t> make_count_term(compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_union_term(compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_zip_term(compile_env_t *env, const protob_t<const Term> &term);
+counted_t<term_t> make_inner_join_term(compile_env_t *env, const protob_t<const Term> &term);
+counted_t<term_t> make_outer_join_term(compile_env_t *env, const protob_t<const Term> &term);
 
 // sindex.cc
 counted_t<term_t> make_sindex_create_term(compile_env_t *env, const protob_t<const Term> &term);
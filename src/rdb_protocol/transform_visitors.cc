@@ -27,6 +27,10 @@ public:
         *res_out = exc_t(exc, func.get_bt().get(), 1);
     }
 
+    void operator()(const top_k_wire_func_t &func) const {
+        *res_out = exc_t(exc, func.get_bt().get(), 1);
+    }
+
 private:
     const datum_exc_t exc;
     rget_read_response_t::result_t *res_out;
@@ -133,6 +137,67 @@ void transform_apply(ql::env_t *ql_env,
     boost::apply_visitor(transform_visitor_t(json, out, ql_env), *t);
 }
 
+class transform_field_access_visitor_t : public boost::static_visitor<bool> {
+public:
+    explicit transform_field_access_visitor_t(ql::field_access_t *_access_out)
+        : access_out(_access_out) { }
+
+    bool operator()(const ql::map_wire_func_t &func) const {
+        return func.compile_wire_func()->is_field_access(access_out)
+            && access_out->kind == ql::field_access_t::PLUCK;
+    }
+
+    bool operator()(const ql::concatmap_wire_func_t &func) const {
+        return func.compile_wire_func()->is_field_access(access_out)
+            && access_out->kind == ql::field_access_t::GET_FIELD;
+    }
+
+    bool operator()(const filter_transform_t &transf) const {
+        return transf.filter_func.compile_wire_func()->is_field_access(access_out)
+            && access_out->kind == ql::field_access_t::HAS_FIELDS;
+    }
+
+private:
+    ql::field_access_t *access_out;
+};
+
+bool transform_field_access(const rdb_protocol_details::transform_variant_t &t,
+                            ql::field_access_t *access_out) {
+    return boost::apply_visitor(transform_field_access_visitor_t(access_out), t);
+}
+
+void field_access_apply(const ql::field_access_t &access, const lazy_json_t &json,
+                        std::vector<counted_t<const ql::datum_t> > *out) {
+    switch (access.kind) {
+    case ql::field_access_t::GET_FIELD: {
+        guarantee(access.fields.size() == 1);
+        if (counted_t<const ql::datum_t> val = json.get_field(access.fields[0])) {
+            out->push_back(val);
+        }
+    } break;
+    case ql::field_access_t::PLUCK: {
+        ql::datum_ptr_t res(ql::datum_t::R_OBJECT);
+        for (auto it = access.fields.begin(); it != access.fields.end(); ++it) {
+            if (counted_t<const ql::datum_t> val = json.get_field(*it)) {
+                // Plucking a field twice is fine, so we ignore clobbering.
+                UNUSED bool b = res.add(*it, val, ql::CLOBBER);
+            }
+        }
+        out->push_back(res.to_counted());
+    } break;
+    case ql::field_access_t::HAS_FIELDS: {
+        for (auto it = access.fields.begin(); it != access.fields.end(); ++it) {
+            counted_t<const ql::datum_t> val = json.get_field(*it);
+            if (!val.has() || val->get_type() == ql::datum_t::R_NULL) {
+                return;
+            }
+        }
+        out->push_back(json.get());
+    } break;
+    default: unreachable();
+    }
+}
+
 /* A visitor for applying a terminal to a bit of json. */
 class terminal_visitor_t : public boost::static_visitor<void> {
 public:
@@ -143,6 +208,7 @@ public:
     void operator()(const ql::count_wire_func_t &) const;
     void operator()(const ql::gmr_wire_func_t &) const;
     void operator()(const ql::reduce_wire_func_t &) const;
+    void operator()(const ql::top_k_wire_func_t &) const;
 private:
     lazy_json_t json;
     ql::env_t *ql_env;
@@ -193,6 +259,12 @@ void terminal_visitor_t::operator()(const ql::reduce_wire_func_t &func) const {
     }
 }
 
+void terminal_visitor_t::operator()(const ql::top_k_wire_func_t &func) const {
+    rget_read_response_t::vec_t *top = boost::get<rget_read_response_t::vec_t>(out);
+    guarantee(top);
+    func.add(ql_env, json.get(), top);
+}
+
 void terminal_apply(ql::env_t *ql_env,
                     lazy_json_t json,
                     const rdb_protocol_details::terminal_variant_t *t,
@@ -225,6 +297,10 @@ public:
         *out = rget_read_response_t::empty_t();
     }
 
+    void operator()(const ql::top_k_wire_func_t &) const {
+        *out = rget_read_response_t::vec_t();
+    }
+
 private:
     rget_read_response_t::result_t *out;
 };
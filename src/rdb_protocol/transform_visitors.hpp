@@ -11,6 +11,8 @@
 
 namespace ql {
 
+struct field_access_t;
+
 void terminal_exception(const datum_exc_t &exc,
                         const rdb_protocol_details::terminal_variant_t &t,
                         rdb_protocol_t::rget_read_response_t::result_t *out);
@@ -27,6 +29,17 @@ void transform_apply(ql::env_t *ql_env, counted_t<const ql::datum_t> json,
                      const rdb_protocol_details::transform_variant_t *t,
                      std::vector<counted_t<const ql::datum_t> > *out);
 
+// Returns true if `t` is a `get_field`, `pluck` or `has_fields` on each row (see
+// `ql::func_t::is_field_access`), and fills in `*access_out`.
+bool transform_field_access(const rdb_protocol_details::transform_variant_t &t,
+                            ql::field_access_t *access_out);
+
+// Applies the transform described by `access` to `json` like `transform_apply`
+// would, but only reads the fields it needs if `json` hasn't been loaded yet.
+// `has_fields` still loads the rows it lets through.
+void field_access_apply(const ql::field_access_t &access, const lazy_json_t &json,
+                        std::vector<counted_t<const ql::datum_t> > *out);
+
 // Sets the result type based on a terminal.
 void terminal_initialize(const rdb_protocol_details::terminal_variant_t *t,
                          rdb_protocol_t::rget_read_response_t::result_t *out);
@@ -1,6 +1,9 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "rdb_protocol/val.hpp"
 
+#include <algorithm>
+
+#include "config/args.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/func.hpp"
 #include "rdb_protocol/meta_utils.hpp"
@@ -271,6 +274,40 @@ counted_t<const datum_t> table_t::get_row(env_t *env, counted_t<const datum_t> p
     return p_res->data;
 }
 
+std::vector<counted_t<const datum_t> > table_t::get_rows(
+        env_t *env, const std::vector<counted_t<const datum_t> > &pvals) {
+    const counted_t<const datum_t> null_row(new datum_t(datum_t::R_NULL));
+    std::vector<counted_t<const datum_t> > rows;
+    rows.reserve(pvals.size());
+    for (size_t start = 0; start < pvals.size(); start += POINT_READ_BATCH_SIZE) {
+        const size_t end = std::min<size_t>(pvals.size(), start + POINT_READ_BATCH_SIZE);
+        std::vector<store_key_t> keys;
+        keys.reserve(end - start);
+        for (size_t i = start; i < end; ++i) {
+            keys.push_back(store_key_t(pvals[i]->print_primary()));
+        }
+
+        rdb_protocol_t::read_t read((
+            rdb_protocol_t::batched_point_read_t(std::vector<store_key_t>(keys))));
+        rdb_protocol_t::read_response_t res;
+        if (use_outdated) {
+            access->get_namespace_if()->read_outdated(read, &res, env->interruptor);
+        } else {
+            access->get_namespace_if()->read(
+                read, &res, order_token_t::ignore, env->interruptor);
+        }
+        rdb_protocol_t::batched_point_read_response_t *bp_res =
+            boost::get<rdb_protocol_t::batched_point_read_response_t>(&res.response);
+        r_sanity_check(bp_res);
+
+        for (auto it = keys.begin(); it != keys.end(); ++it) {
+            auto row = bp_res->rows.find(*it);
+            rows.push_back(row != bp_res->rows.end() ? row->second : null_row);
+        }
+    }
+    return rows;
+}
+
 counted_t<datum_stream_t> table_t::get_all(
         env_t *env,
         counted_t<const datum_t> value,
@@ -36,6 +36,10 @@ public:
                                               const protob_t<const Backtrace> &bt);
     const std::string &get_pkey();
     counted_t<const datum_t> get_row(env_t *env, counted_t<const datum_t> pval);
+    // Like `get_row` for each of `pvals`, but with one read per
+    // POINT_READ_BATCH_SIZE keys.  Rows that don't exist come back as null.
+    std::vector<counted_t<const datum_t> > get_rows(
+            env_t *env, const std::vector<counted_t<const datum_t> > &pvals);
     counted_t<datum_stream_t> get_all(
             env_t *env,
             counted_t<const datum_t> value,
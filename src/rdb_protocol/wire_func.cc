@@ -1,6 +1,8 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "rdb_protocol/wire_func.hpp"
 
+#include <algorithm>
+
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/func.hpp"
 #include "rdb_protocol/protocol.hpp"
@@ -153,5 +155,74 @@ counted_t<func_t> gmr_wire_func_t::compile_reduce() const {
     return reduce.compile_wire_func();
 }
 
+void order_wire_funcs_t::add(counted_t<func_t> f, bool descending) {
+    orderings.push_back(std::make_pair(map_wire_func_t(f), descending));
+}
+
+bool order_wire_funcs_t::operator()(env_t *env,
+                                    const counted_t<const datum_t> &l,
+                                    const counted_t<const datum_t> &r) const {
+    for (auto it = orderings.begin(); it != orderings.end(); ++it) {
+        counted_t<func_t> f = it->first.compile_wire_func();
+        const bool descending = it->second;
+        counted_t<const datum_t> lval;
+        counted_t<const datum_t> rval;
+        try {
+            lval = f->call(env, l)->as_datum();
+        } catch (const base_exc_t &e) {
+            if (e.get_type() != base_exc_t::NON_EXISTENCE) {
+                throw;
+            }
+        }
+
+        try {
+            rval = f->call(env, r)->as_datum();
+        } catch (const base_exc_t &e) {
+            if (e.get_type() != base_exc_t::NON_EXISTENCE) {
+                throw;
+            }
+        }
+
+        if (!lval.has() && !rval.has()) {
+            continue;
+        }
+        if (!lval.has()) {
+            return true != descending;
+        }
+        if (!rval.has()) {
+            return false != descending;
+        }
+        // TODO: use datum_t::cmp instead to be faster
+        if (*lval == *rval) {
+            continue;
+        }
+        return (*lval < *rval) != descending;
+    }
+
+    return false;
+}
+
+protob_t<const Backtrace> order_wire_funcs_t::get_bt() const {
+    r_sanity_check(!orderings.empty());
+    return orderings.front().first.get_bt();
+}
+
+void top_k_wire_func_t::add(env_t *env, counted_t<const datum_t> row,
+                            std::vector<counted_t<const datum_t> > *top) const {
+    if (k == 0) {
+        return;
+    }
+    auto lt = std::bind(std::cref(order), env,
+                        std::placeholders::_1, std::placeholders::_2);
+    if (top->size() < k) {
+        top->push_back(row);
+        std::push_heap(top->begin(), top->end(), lt);
+    } else if (lt(row, top->front())) {
+        std::pop_heap(top->begin(), top->end(), lt);
+        top->back() = row;
+        std::push_heap(top->begin(), top->end(), lt);
+    }
+}
+
 
 }  // namespace ql
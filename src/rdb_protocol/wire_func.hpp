@@ -5,8 +5,10 @@
 #include <functional>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "containers/archive/stl_types.hpp"
 #include "containers/uuid.hpp"
 #include "rdb_protocol/counted_term.hpp"
 #include "rdb_protocol/pb_utils.hpp"
@@ -19,6 +21,7 @@ class Datum;
 class Term;
 
 namespace ql {
+class datum_t;
 class func_t;
 class env_t;
 
@@ -101,6 +104,48 @@ private:
     reduce_wire_func_t reduce;
 };
 
+// The ordering of `orderBy`: rows are compared by the value of each function in
+// turn, ascending or descending.  Rows that a function has no value for sort
+// before the rest (after them, when descending).
+class order_wire_funcs_t {
+public:
+    void add(counted_t<func_t> f, bool descending);
+
+    // Whether `l` sorts before `r`.
+    bool operator()(env_t *env,
+                    const counted_t<const datum_t> &l,
+                    const counted_t<const datum_t> &r) const;
+
+    protob_t<const Backtrace> get_bt() const;
+
+    RDB_MAKE_ME_SERIALIZABLE_1(orderings);
+
+private:
+    std::vector<std::pair<map_wire_func_t, bool> > orderings;
+};
+
+// Top K: the first `k` rows in the order of `order`.  Shards each return their
+// first `k`, which get merged down to the overall first `k`.
+class top_k_wire_func_t {
+public:
+    top_k_wire_func_t() : k(0) { }
+    top_k_wire_func_t(const order_wire_funcs_t &_order, uint64_t _k)
+        : order(_order), k(_k) { }
+
+    // Adds `row` to `top`, a heap of the first (at most `k`) rows so far with the
+    // last of them at the front.
+    void add(env_t *env, counted_t<const datum_t> row,
+             std::vector<counted_t<const datum_t> > *top) const;
+
+    protob_t<const Backtrace> get_bt() const { return order.get_bt(); }
+
+    RDB_MAKE_ME_SERIALIZABLE_2(order, k);
+
+private:
+    order_wire_funcs_t order;
+    uint64_t k;
+};
+
 }  // namespace ql
 
 #endif  // RDB_PROTOCOL_WIRE_FUNC_HPP_
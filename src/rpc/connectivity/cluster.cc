@@ -10,7 +10,9 @@
 #include "concurrency/cross_thread_signal.hpp"
 #include "concurrency/pmap.hpp"
 #include "concurrency/semaphore.hpp"
+#include "concurrency/wait_any.hpp"
 #include "containers/archive/string_stream.hpp"
+#include "containers/archive/varint.hpp"
 #include "containers/object_buffer.hpp"
 #include "containers/uuid.hpp"
 #include "logger.hpp"
@@ -70,7 +72,8 @@ connectivity_cluster_t::run_t::run_t(connectivity_cluster_t *p,
                                      int port,
                                      message_handler_t *mh,
                                      int client_port,
-                                     heartbeat_manager_t *_heartbeat_manager) THROWS_ONLY(address_in_use_exc_t) :
+                                     heartbeat_manager_t *_heartbeat_manager,
+                                     int _streams_per_peer) THROWS_ONLY(address_in_use_exc_t) :
     parent(p),
     message_handler(mh),
     heartbeat_manager(_heartbeat_manager),
@@ -82,6 +85,8 @@ connectivity_cluster_t::run_t::run_t(connectivity_cluster_t *p,
     /* The local port to use when connecting to the cluster port of peers */
     cluster_client_port(client_port),
 
+    streams_per_peer(std::min(_streams_per_peer, NUM_MESSAGE_CLASSES)),
+
     /* This sets `parent->current_run` to `this`. It's necessary to do it in the
     constructor of a subfield rather than in the body of the `run_t` constructor
     because `parent->current_run` needs to be set before `connection_to_ourself`
@@ -111,6 +116,7 @@ connectivity_cluster_t::run_t::run_t(connectivity_cluster_t *p,
                                             this, _1, auto_drainer_t::lock_t(&drainer))))
 {
     parent->assert_thread();
+    guarantee(streams_per_peer >= 1);
 }
 
 connectivity_cluster_t::run_t::~run_t() { }
@@ -135,6 +141,44 @@ void connectivity_cluster_t::run_t::join(const peer_address_t &address) THROWS_N
         auto_drainer_t::lock_t(&drainer)));
 }
 
+static const char *message_class_name(message_class_t message_class) {
+    switch (message_class) {
+    case message_class_t::control: return "control";
+    case message_class_t::replication: return "replication";
+    case message_class_t::backfill: return "backfill";
+    default: unreachable();
+    }
+}
+
+/* The `SO_PRIORITY` for the connection that carries each class of messages.
+These are the kernel's `TC_PRIO_INTERACTIVE`, `TC_PRIO_BESTEFFORT`, and
+`TC_PRIO_BULK`, which the default queueing discipline maps to its high, middle,
+and low priority bands. */
+static int message_class_socket_priority(message_class_t message_class) {
+    switch (message_class) {
+    case message_class_t::control: return 6;
+    case message_class_t::replication: return 0;
+    case message_class_t::backfill: return 2;
+    default: unreachable();
+    }
+}
+
+connectivity_cluster_t::run_t::connection_entry_t::stream_t::stream_t(tcp_conn_stream_t *c,
+                                                                      perfmon_collection_t *parent,
+                                                                      message_class_t message_class) :
+    conn(c), num_waiting_senders(0),
+    pm_collection(),
+    pm_bytes_sent(secs_to_ticks(1), true),
+    pm_send_queue_length(secs_to_ticks(1), false),
+    pm_collection_membership(parent, &pm_collection, message_class_name(message_class)),
+    pm_bytes_sent_membership(&pm_collection, &pm_bytes_sent, "bytes_sent"),
+    pm_send_queue_length_membership(&pm_collection, &pm_send_queue_length, "send_queue_length") {
+    /* The priority only matters when the network is congested, so it's not a
+    problem if the kernel won't let us set it. */
+    UNUSED int res = conn->get_underlying_conn()->set_priority(
+        message_class_socket_priority(message_class));
+}
+
 connectivity_cluster_t::run_t::connection_entry_t::connection_entry_t(run_t *p,
                                                                       peer_id_t id,
                                                                       tcp_conn_stream_t *c,
@@ -144,14 +188,29 @@ connectivity_cluster_t::run_t::connection_entry_t::connection_entry_t(run_t *p,
     pm_bytes_sent(secs_to_ticks(1), true),
     pm_collection_membership(&p->parent->connectivity_collection, &pm_collection, uuid_to_str(id.get_uuid())),
     pm_bytes_sent_membership(&pm_collection, &pm_bytes_sent, "bytes_sent"),
-    parent(p), peer(id),
-    entries(new one_per_thread_t<entry_installation_t>(this)) {
+    stream_drainer(new auto_drainer_t),
+    parent(p), peer(id) {
+    if (conn != NULL) {
+        main_stream.create(conn, &pm_collection, message_class_t::control);
+    }
+    for (int i = 0; i < NUM_MESSAGE_CLASSES; ++i) {
+        streams[i] = main_stream.has() ? main_stream.get() : NULL;
+    }
+
+    /* `streams` has to be set up before we register ourselves, because
+    `send_message()` may use it as soon as we have. */
+    entries.init(new one_per_thread_t<entry_installation_t>(this));
+
     if (peer != parent->parent->me && parent->heartbeat_manager != NULL) {
         parent->heartbeat_manager->begin_peer_heartbeat(peer);
     }
 }
 
 connectivity_cluster_t::run_t::connection_entry_t::~connection_entry_t() THROWS_NOTHING {
+    /* Close the extra connections and wait for `handle_stream()` to detach
+    them, so all our messages go through `main_stream` from here on. */
+    stream_drainer.reset();
+
     if (peer != parent->parent->me && parent->heartbeat_manager != NULL) {
         parent->heartbeat_manager->end_peer_heartbeat(peer);
     }
@@ -161,7 +220,13 @@ connectivity_cluster_t::run_t::connection_entry_t::~connection_entry_t() THROWS_
 
     /* `~entry_installation_t` destroys the `auto_drainer_t`'s in entries,
     so nothing can be holding the `send_mutex`. */
-    guarantee(!send_mutex.is_locked());
+    guarantee(!main_stream.has() || !main_stream->send_mutex.is_locked());
+}
+
+connectivity_cluster_t::run_t::connection_entry_t::stream_t *
+connectivity_cluster_t::run_t::connection_entry_t::get_stream(message_class_t message_class) {
+    assert_thread();
+    return streams[static_cast<int>(message_class)];
 }
 
 static void ping_connection_watcher(peer_id_t peer, peers_list_callback_t *connect_disconnect_cb) THROWS_NOTHING {
@@ -246,7 +311,8 @@ void connectivity_cluster_t::run_t::connect_to_peer(const peer_address_t *addres
             keepalive_tcp_conn_stream_t conn(selected_addr->ip(), selected_addr->port().value(),
                                              drainer_lock.get_drain_signal(), cluster_client_port);
             if (!*successful_join) {
-                handle(&conn, expected_id, boost::optional<peer_address_t>(*address), drainer_lock, successful_join);
+                handle(&conn, expected_id, boost::optional<peer_address_t>(*address),
+                       drainer_lock, successful_join, &*selected_addr);
             }
         } catch (const tcp_conn_t::connect_failed_exc_t &) {
             /* Ignore */
@@ -497,34 +563,15 @@ bool connectivity_cluster_t::run_t::get_routing_table_to_send_and_add_peer(
     return true;
 }
 
-// We log error conditions as follows:
-// - silent: network error; conflict between parallel connections
-// - warning: invalid header
-// - error: id or address don't match expected id or address; deserialization range error; unknown error
-// In all cases we close the connection and quit.
-void connectivity_cluster_t::run_t::handle(
-        /* `conn` should remain valid until `handle()` returns.
-         * `handle()` does not take ownership of `conn`. */
+bool connectivity_cluster_t::run_t::exchange_handshake(
         keepalive_tcp_conn_stream_t *conn,
-        boost::optional<peer_id_t> expected_id,
-        boost::optional<peer_address_t> expected_address,
-        auto_drainer_t::lock_t drainer_lock,
-        bool *successful_join) THROWS_NOTHING
-{
+        const char *peername,
+        message_class_t stream_class,
+        peer_id_t *other_id_out,
+        std::set<host_and_port_t> *other_hosts_out,
+        message_class_t *other_stream_class_out) THROWS_NOTHING {
     parent->assert_thread();
 
-    // Get the name of our peer, for error reporting.
-    ip_address_t peer_addr;
-    std::string peerstr = "(unknown)";
-    if (!conn->get_underlying_conn()->getpeername(&peer_addr))
-        peerstr = peer_addr.to_string();
-    const char *peername = peerstr.c_str();
-
-    // Make sure that if we're ordered to shut down, any pending read
-    // or write gets interrupted.
-    cluster_conn_closing_subscription_t conn_closer_1(conn);
-    conn_closer_1.reset(drainer_lock.get_drain_signal());
-
     // Each side sends a header followed by its own ID and address, then receives and checks the
     // other side's.
     {
@@ -538,8 +585,9 @@ void connectivity_cluster_t::run_t::handle(
         msg.append(cluster_build_mode.data(), cluster_build_mode.length());
         msg << parent->me;
         msg << routing_table[parent->me].hosts();
+        msg << stream_class;
         if (send_write_message(conn, &msg))
-            return; // network error.
+            return false; // network error.
     }
 
     // Receive & check header.
@@ -550,12 +598,12 @@ void connectivity_cluster_t::run_t::handle(
         for (uint64_t i = 0; i < cluster_proto_header.length(); i += r) {
             r = conn->read(buffer, std::min(buffer_size, int64_t(cluster_proto_header.length() - i)));
             if (-1 == r)
-                return; // network error.
+                return false; // network error.
             rassert(r >= 0);
             // If EOF or remote_header does not match header, terminate connection.
             if (0 == r || memcmp(cluster_proto_header.c_str() + i, buffer, r) != 0) {
                 logWRN("Received invalid clustering header from %s, closing connection -- something might be connecting to the wrong port.", peername);
-                return;
+                return false;
             }
         }
     }
@@ -565,14 +613,14 @@ void connectivity_cluster_t::run_t::handle(
         std::string remote_version;
 
         if (!deserialize_compatible_string(conn, &remote_version, peername)) {
-            return;
+            return false;
         }
 
         if (remote_version != cluster_version) {
             logWRN("Connection attempt with a RethinkDB node of the wrong version, "
                    "peer: %s, local version: %s, remote version: %s, connection dropped\n",
                    peername, cluster_version.c_str(), remote_version.c_str());
-            return;
+            return false;
         }
     }
 
@@ -581,14 +629,14 @@ void connectivity_cluster_t::run_t::handle(
         std::string remote_arch_bitsize;
 
         if (!deserialize_compatible_string(conn, &remote_arch_bitsize, peername)) {
-            return;
+            return false;
         }
 
         if (remote_arch_bitsize != cluster_arch_bitsize) {
             logWRN("Connection attempt with a RethinkDB node of the wrong architecture, "
                    "peer: %s, local: %s, remote: %s, connection dropped\n",
                    peername, cluster_arch_bitsize.c_str(), remote_arch_bitsize.c_str());
-            return;
+            return false;
         }
 
     }
@@ -598,26 +646,65 @@ void connectivity_cluster_t::run_t::handle(
         std::string remote_build_mode;
 
         if (!deserialize_compatible_string(conn, &remote_build_mode, peername)) {
-            return;
+            return false;
         }
 
         if (remote_build_mode != cluster_build_mode) {
             logWRN("Connection attempt with a RethinkDB node of the wrong build mode, "
                    "peer: %s, local: %s, remote: %s, connection dropped\n",
                    peername, cluster_build_mode.c_str(), remote_build_mode.c_str());
-            return;
+            return false;
         }
     }
 
-    // Receive id, host/ports.
+    // Receive id, host/ports, and what the connection is for.
+    if (deserialize_and_check(conn, other_id_out, peername) ||
+        deserialize_and_check(conn, other_hosts_out, peername) ||
+        deserialize_and_check(conn, other_stream_class_out, peername))
+        return false;
+
+    return true;
+}
+
+// We log error conditions as follows:
+// - silent: network error; conflict between parallel connections
+// - warning: invalid header
+// - error: id or address don't match expected id or address; deserialization range error; unknown error
+// In all cases we close the connection and quit.
+void connectivity_cluster_t::run_t::handle(
+        /* `conn` should remain valid until `handle()` returns.
+         * `handle()` does not take ownership of `conn`. */
+        keepalive_tcp_conn_stream_t *conn,
+        boost::optional<peer_id_t> expected_id,
+        boost::optional<peer_address_t> expected_address,
+        auto_drainer_t::lock_t drainer_lock,
+        bool *successful_join,
+        /* The address we connected to, if we opened the connection */
+        const ip_and_port_t *connected_to) THROWS_NOTHING
+{
+    parent->assert_thread();
+
+    // Get the name of our peer, for error reporting.
+    ip_address_t peer_addr;
+    std::string peerstr = "(unknown)";
+    if (!conn->get_underlying_conn()->getpeername(&peer_addr))
+        peerstr = peer_addr.to_string();
+    const char *peername = peerstr.c_str();
+
+    // Make sure that if we're ordered to shut down, any pending read
+    // or write gets interrupted.
+    cluster_conn_closing_subscription_t conn_closer_1(conn);
+    conn_closer_1.reset(drainer_lock.get_drain_signal());
+
+    // Each side sends a header followed by its own ID and address, then receives and checks the
+    // other side's.
     peer_id_t other_id;
     std::set<host_and_port_t> other_peer_addr_hosts;
-    if (deserialize_and_check(conn, &other_id, peername) ||
-        deserialize_and_check(conn, &other_peer_addr_hosts, peername))
+    message_class_t other_stream_class;
+    if (!exchange_handshake(conn, peername, message_class_t::control,
+                            &other_id, &other_peer_addr_hosts, &other_stream_class)) {
         return;
-
-    // Look up the ip addresses for the other host
-    peer_address_t other_peer_addr(other_peer_addr_hosts);
+    }
 
     /* Sanity checks */
     if (other_id == parent->me) {
@@ -635,6 +722,18 @@ void connectivity_cluster_t::run_t::handle(
         }
         return;
     }
+
+    if (other_stream_class != message_class_t::control) {
+        /* This isn't a new peer; it's one we're already connected to opening an
+        extra connection for one class of messages. */
+        conn_closer_1.reset();
+        handle_stream(conn, other_id, other_stream_class, false, peername, drainer_lock);
+        return;
+    }
+
+    // Look up the ip addresses for the other host
+    peer_address_t other_peer_addr(other_peer_addr_hosts);
+
     if (expected_address && !is_similar_peer_address(other_peer_addr,
                                                      *expected_address)) {
         printf_buffer_t buf;
@@ -750,6 +849,20 @@ void connectivity_cluster_t::run_t::handle(
         }
     }
 
+    /* If we opened the connection, we also open the extra connections for the
+    other classes of messages. We don't if we were told to connect from a
+    particular port, because all our connections to the peer would have the same
+    addresses. */
+    if (connected_to != NULL && cluster_client_port == 0
+        && !drainer_lock.get_drain_signal()->is_pulsed()) {
+        for (int i = 1; i < streams_per_peer; ++i) {
+            coro_t::spawn_sometime(boost::bind(
+                &connectivity_cluster_t::run_t::connect_stream, this,
+                *connected_to, other_id, static_cast<message_class_t>(i),
+                drainer_lock));
+        }
+    }
+
     /* Now that we're about to switch threads, it's not safe to try to close
     the connection from this thread anymore. This is safe because we won't do
     anything that permanently blocks before setting up `conn_closer_2`. */
@@ -784,32 +897,170 @@ void connectivity_cluster_t::run_t::handle(
         /* Main message-handling loop: read messages off the connection until
         it's closed, which may be due to network events, or the other end
         shutting down, or us shutting down. */
-        try {
-            while (true) {
-                /* For now, we use `std::string` for messages on the wire: it's
-                just a length and a byte vector. This is obviously slow and we
-                should change it when we care about performance. */
-                std::string message;
-                if (deserialize_and_check(conn, &message, peername))
-                    break;
-
-                string_read_stream_t stream(std::move(message), 0);
-                message_handler->on_message(other_id, &stream); // might raise fake_archive_exc_t
+        read_messages(conn, other_id, peername);
+
+        /* The `conn_structure` destructor removes us from the connection map
+        and notifies any disconnect listeners. */
+    }
+}
+
+void connectivity_cluster_t::run_t::connect_stream(ip_and_port_t address,
+                                                   peer_id_t other_id,
+                                                   message_class_t stream_class,
+                                                   auto_drainer_t::lock_t drainer_lock) THROWS_NOTHING {
+    parent->assert_thread();
+    try {
+        for (int attempt = 0; attempt < CLUSTER_STREAM_CONNECT_ATTEMPTS; ++attempt) {
+            /* Give the peer a moment to finish setting up the main connection
+            before each attempt. */
+            nap(CLUSTER_STREAM_CONNECT_RETRY_MS, drainer_lock.get_drain_signal());
+
+            try {
+                keepalive_tcp_conn_stream_t conn(address.ip(), address.port().value(),
+                                                 drainer_lock.get_drain_signal());
+                const std::string peerstr = address.ip().to_string();
+                const char *peername = peerstr.c_str();
+
+                cluster_conn_closing_subscription_t conn_closer(&conn);
+                conn_closer.reset(drainer_lock.get_drain_signal());
+
+                peer_id_t id;
+                std::set<host_and_port_t> hosts;
+                message_class_t other_stream_class;
+                if (!exchange_handshake(&conn, peername, stream_class,
+                                        &id, &hosts, &other_stream_class)
+                    || id != other_id) {
+                    return;
+                }
+
+                conn_closer.reset();
+                if (handle_stream(&conn, other_id, stream_class, true, peername, drainer_lock)) {
+                    return;
+                }
+            } catch (const tcp_conn_t::connect_failed_exc_t &) {
+                /* Try again */
             }
-        } catch (const fake_archive_exc_t &) {
-            /* The exception broke us out of the loop, and that's what we
-            wanted. This could either be because we lost contact with the peer
-            or because the cluster is shutting down and `close_conn()` got
-            called. */
         }
+    } catch (const interrupted_exc_t &) {
+        /* We're shutting down */
+    }
+}
+
+bool connectivity_cluster_t::run_t::handle_stream(keepalive_tcp_conn_stream_t *conn,
+                                                  peer_id_t other_id,
+                                                  message_class_t stream_class,
+                                                  bool we_connected,
+                                                  const char *peername,
+                                                  auto_drainer_t::lock_t drainer_lock) THROWS_NOTHING {
+    parent->assert_thread();
+    const int stream_index = static_cast<int>(stream_class);
+
+    /* The extra connection lives on the same thread as the main one. */
+    threadnum_t conn_thread = INVALID_THREAD;
+    {
+        std::map<peer_id_t, std::pair<run_t::connection_entry_t *, auto_drainer_t::lock_t> >::const_iterator it =
+            parent->thread_info.get()->connection_map.find(other_id);
+        if (it == parent->thread_info.get()->connection_map.end()) {
+            return false;
+        }
+        conn_thread = it->second.first->conn->home_thread();
+    }
 
-        guarantee(!conn->is_read_open(), "the connection is still open for "
-            "read, which means we had a problem other than the TCP "
-            "connection closing or dying");
+    cross_thread_signal_t connection_thread_drain_signal(drainer_lock.get_drain_signal(), conn_thread);
 
-        /* The `conn_structure` destructor removes us from the connection map
-        and notifies any disconnect listeners. */
+    rethread_tcp_conn_stream_t unregister_conn(conn, INVALID_THREAD);
+    on_thread_t conn_threader(conn_thread);
+    rethread_tcp_conn_stream_t reregister_conn(conn, get_thread_id());
+
+    /* The main connection may have gone away, or been replaced by one on
+    another thread, while we were switching threads. */
+    connection_entry_t *conn_structure;
+    auto_drainer_t::lock_t stream_lock;
+    {
+        std::map<peer_id_t, std::pair<run_t::connection_entry_t *, auto_drainer_t::lock_t> >::const_iterator it =
+            parent->thread_info.get()->connection_map.find(other_id);
+        if (it == parent->thread_info.get()->connection_map.end()) {
+            return false;
+        }
+        conn_structure = it->second.first;
+        if (conn_structure->conn->home_thread().threadnum != get_thread_id().threadnum
+            || !conn_structure->stream_drainer.has()
+            || conn_structure->streams[stream_index] != conn_structure->main_stream.get()) {
+            return false;
+        }
+        stream_lock = auto_drainer_t::lock_t(conn_structure->stream_drainer.get());
     }
+
+    wait_any_t interruptor(stream_lock.get_drain_signal(), &connection_thread_drain_signal);
+    cluster_conn_closing_subscription_t conn_closer(conn);
+    conn_closer.reset(&interruptor);
+
+    /* The side that didn't open the connection tells the other side that it's
+    attaching it; until then, the opening side can still give up and retry
+    without disturbing the main connection. */
+    if (we_connected) {
+        int8_t ack;
+        if (deserialize_and_check(conn, &ack, peername)
+            || conn_structure->streams[stream_index] != conn_structure->main_stream.get()) {
+            return false;
+        }
+    } else {
+        write_message_t msg;
+        msg << static_cast<int8_t>(1);
+        if (send_write_message(conn, &msg)) {
+            return false;
+        }
+    }
+
+    {
+        connection_entry_t::stream_t stream(conn, &conn_structure->pm_collection, stream_class);
+        conn_structure->streams[stream_index] = &stream;
+
+        read_messages(conn, other_id, peername);
+
+        conn_structure->streams[stream_index] = conn_structure->main_stream.get();
+        if (conn->is_write_open()) {
+            conn->shutdown_write();
+        }
+
+        /* Messages that were queued on this connection are lost, so we can't
+        keep using the main connection as if nothing happened. Closing it makes
+        both sides drop the peer and reconnect. */
+        if (conn_structure->conn->is_read_open()) {
+            conn_structure->conn->shutdown_read();
+        }
+
+        /* `~stream_t` waits for any senders that are still using the stream. */
+    }
+
+    return true;
+}
+
+void connectivity_cluster_t::run_t::read_messages(tcp_conn_stream_t *conn,
+                                                  peer_id_t other_id,
+                                                  const char *peername) THROWS_NOTHING {
+    try {
+        while (true) {
+            /* For now, we use `std::string` for messages on the wire: it's
+            just a length and a byte vector. This is obviously slow and we
+            should change it when we care about performance. */
+            std::string message;
+            if (deserialize_and_check(conn, &message, peername))
+                break;
+
+            string_read_stream_t stream(std::move(message), 0);
+            message_handler->on_message(other_id, &stream); // might raise fake_archive_exc_t
+        }
+    } catch (const fake_archive_exc_t &) {
+        /* The exception broke us out of the loop, and that's what we
+        wanted. This could either be because we lost contact with the peer
+        or because the cluster is shutting down and `close_conn()` got
+        called. */
+    }
+
+    guarantee(!conn->is_read_open(), "the connection is still open for "
+        "read, which means we had a problem other than the TCP "
+        "connection closing or dying");
 }
 
 connectivity_cluster_t::connectivity_cluster_t() THROWS_NOTHING :
@@ -857,20 +1108,61 @@ connectivity_service_t *connectivity_cluster_t::get_connectivity_service() THROW
     return this;
 }
 
+/* Writes `header` followed by `message` to `conn`. Big messages are handed to the
+socket in place; small ones are copied into the connection's write buffer, which
+is only flushed if `flush` is true. Returns 0 upon success, -1 upon failure. */
+static int send_message_chunks(tcp_conn_stream_t *conn, write_message_t *header,
+                               write_message_t *message, int64_t message_size,
+                               bool flush) {
+    intrusive_list_t<write_buffer_t> *header_chunks = header->unsafe_expose_buffers();
+    intrusive_list_t<write_buffer_t> *message_chunks = message->unsafe_expose_buffers();
+
+    if (message_size < CLUSTER_MESSAGE_ZERO_COPY_SIZE) {
+        for (write_buffer_t *p = header_chunks->head(); p; p = header_chunks->next(p)) {
+            if (conn->write_buffered(p->data, p->size) == -1) {
+                return -1;
+            }
+        }
+        for (write_buffer_t *p = message_chunks->head(); p; p = message_chunks->next(p)) {
+            if (conn->write_buffered(p->data, p->size) == -1) {
+                return -1;
+            }
+        }
+        return flush ? conn->flush_buffer() : 0;
+    }
+
+    std::vector<iovec> iovecs;
+    iovecs.reserve(message_size / write_buffer_t::DATA_SIZE + 2);
+    for (write_buffer_t *p = header_chunks->head(); p; p = header_chunks->next(p)) {
+        iovec iov = { p->data, static_cast<size_t>(p->size) };
+        iovecs.push_back(iov);
+    }
+    for (write_buffer_t *p = message_chunks->head(); p; p = message_chunks->next(p)) {
+        iovec iov = { p->data, static_cast<size_t>(p->size) };
+        iovecs.push_back(iov);
+    }
+    return conn->writev(iovecs.data(), iovecs.size()) == -1 ? -1 : 0;
+}
+
 void connectivity_cluster_t::send_message(peer_id_t dest, send_message_write_callback_t *callback) THROWS_NOTHING {
     // We could be on _any_ thread.
 
     guarantee(!dest.is_nil());
 
-    /* We currently write the message to a vector_stream_t, then
-       serialize that as a string. It's horribly inefficient, of course. */
+    const message_class_t message_class = callback->get_message_class();
+
+    /* We serialize the message into the buffers of a `write_message_t` here,
+    and send those buffers to the socket as they are, so that the message
+    doesn't get copied again. */
     // TODO: If we don't do it this way, we (or the caller) will need
     // to worry about having the writer run on the connection thread.
-    string_stream_t buffer;
+    write_message_t buffer;
     {
         ASSERT_FINITE_CORO_WAITING;
-        callback->write(&buffer);
+        write_message_stream_t stream(&buffer);
+        callback->write(&stream);
     }
+    const int64_t message_size = buffer.size();
 
 #ifdef CLUSTER_MESSAGE_DEBUGGING
     {
@@ -881,7 +1173,12 @@ void connectivity_cluster_t::send_message(peer_id_t dest, send_message_write_cal
         debug_print(&buf, dest);
         buf.appendf("\n");
         fprintf(stderr, "%s", buf.c_str());
-        print_hd(buffer.str()->data(), 0, buffer.str()->size());
+        intrusive_list_t<write_buffer_t> *chunks = buffer.unsafe_expose_buffers();
+        size_t offset = 0;
+        for (write_buffer_t *p = chunks->head(); p; p = chunks->next(p)) {
+            print_hd(p->data, offset, p->size);
+            offset += p->size;
+        }
     }
 #endif
 
@@ -911,38 +1208,52 @@ void connectivity_cluster_t::send_message(peer_id_t dest, send_message_write_cal
         conn_structure_lock = it->second.second;
     }
 
-    size_t bytes_sent = buffer.str().size();
-
     if (conn_structure->conn == NULL) {
         // We're sending a message to ourself
         guarantee(dest == me);
         // We could be on any thread here! Oh no!
-        string_read_stream_t read_stream(std::move(buffer.str()), 0);
+        std::string message;
+        message.reserve(message_size);
+        intrusive_list_t<write_buffer_t> *chunks = buffer.unsafe_expose_buffers();
+        for (write_buffer_t *p = chunks->head(); p; p = chunks->next(p)) {
+            message.append(p->data, p->size);
+        }
+        string_read_stream_t read_stream(std::move(message), 0);
         current_run->message_handler->on_message(me, &read_stream);
     } else {
         guarantee(dest != me);
         on_thread_t threader(conn_structure->conn->home_thread());
 
+        run_t::connection_entry_t::stream_t *stream = conn_structure->get_stream(message_class);
+        auto_drainer_t::lock_t stream_lock(&stream->drainer);
+
+        /* On the wire, a message is its length followed by its contents, which
+        is how `std::string` gets serialized. */
+        write_message_t header;
+        serialize_varint_uint64(&header, message_size);
+
         /* Acquire the send-mutex so we don't collide with other things trying
         to send on the same connection. */
-        mutex_t::acq_t acq(&conn_structure->send_mutex);
-
-        {
-            write_message_t msg;
-            msg << buffer.str();
-            int res = send_write_message(conn_structure->conn, &msg);
-            if (res) {
-                /* Close the other half of the connection to make sure that
-                   `connectivity_cluster_t::run_t::handle()` notices that something is
-                   up */
-                if (conn_structure->conn->is_read_open()) {
-                    conn_structure->conn->shutdown_read();
-                }
+        stream->pm_send_queue_length.record(stream->num_waiting_senders);
+        ++stream->num_waiting_senders;
+        mutex_t::acq_t acq(&stream->send_mutex);
+        --stream->num_waiting_senders;
+
+        if (send_message_chunks(stream->conn, &header, &buffer,
+                                message_size,
+                                stream->num_waiting_senders == 0)) {
+            /* Close the other half of the connection to make sure that
+               `connectivity_cluster_t::run_t::handle()` (or `handle_stream()`)
+               notices that something is up */
+            if (stream->conn->is_read_open()) {
+                stream->conn->shutdown_read();
             }
         }
+
+        stream->pm_bytes_sent.record(message_size);
     }
 
-    conn_structure->pm_bytes_sent.record(bytes_sent);
+    conn_structure->pm_bytes_sent.record(message_size);
 }
 
 void connectivity_cluster_t::kill_connection(peer_id_t peer) THROWS_NOTHING {
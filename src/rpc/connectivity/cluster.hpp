@@ -10,10 +10,13 @@
 
 #include "arch/types.hpp"
 #include "concurrency/auto_drainer.hpp"
+#include "concurrency/mutex.hpp"
 #include "concurrency/one_per_thread.hpp"
 #include "concurrency/semaphore.hpp"
+#include "config/args.hpp"
 #include "containers/archive/tcp_conn_stream.hpp"
 #include "containers/map_sentries.hpp"
+#include "containers/object_buffer.hpp"
 #include "perfmon/perfmon.hpp"
 #include "rpc/connectivity/connectivity.hpp"
 #include "rpc/connectivity/messages.hpp"
@@ -74,7 +77,8 @@ public:
               int port,
               message_handler_t *message_handler,
               int client_port,
-              heartbeat_manager_t *_heartbeat_manager) THROWS_ONLY(address_in_use_exc_t);
+              heartbeat_manager_t *_heartbeat_manager,
+              int streams_per_peer = CLUSTER_STREAMS_PER_PEER) THROWS_ONLY(address_in_use_exc_t);
 
         ~run_t();
 
@@ -91,12 +95,48 @@ public:
 
         class connection_entry_t : public home_thread_mixin_debug_only_t {
         public:
+            /* A TCP connection to the peer that messages can be sent on. Every
+            `connection_entry_t` (except our connection to ourself) has one for
+            its main connection; the extra connections that carry a single
+            class of messages get one each. */
+            class stream_t {
+            public:
+                stream_t(tcp_conn_stream_t *conn, perfmon_collection_t *parent,
+                         message_class_t message_class);
+
+                tcp_conn_stream_t *conn;
+
+                mutex_t send_mutex;
+
+                /* The number of `send_message()` calls that are waiting for
+                `send_mutex`. A sender leaves small messages in the connection's
+                write buffer when somebody is queued up behind it, so messages
+                that are sent at the same time share syscalls; the last one
+                flushes. */
+                int num_waiting_senders;
+
+                perfmon_collection_t pm_collection;
+                perfmon_sampler_t pm_bytes_sent, pm_send_queue_length;
+                perfmon_membership_t pm_collection_membership, pm_bytes_sent_membership,
+                    pm_send_queue_length_membership;
+
+                /* Senders hold a lock on this while they use the stream. */
+                auto_drainer_t drainer;
+
+            private:
+                DISABLE_COPYING(stream_t);
+            };
+
             /* The constructor registers us in every thread's `connection_map`;
             the destructor deregisters us. Both also notify all subscribers. */
             connection_entry_t(run_t *, peer_id_t, tcp_conn_stream_t *,
                                const peer_address_t &peer) THROWS_NOTHING;
             ~connection_entry_t() THROWS_NOTHING;
 
+            /* Returns the stream that messages of the given class should be
+            sent on. Must be called on the connection's thread. */
+            stream_t *get_stream(message_class_t message_class);
+
             /* NULL for our "connection" to ourself */
             tcp_conn_stream_t *conn;
 
@@ -105,15 +145,25 @@ public:
             cross-thread to access the routing table. */
             peer_address_t address;
 
-            /* Unused for our connection to ourself */
-            mutex_t send_mutex;
-
             uuid_u session_id;
 
             perfmon_collection_t pm_collection;
             perfmon_sampler_t pm_bytes_sent;
             perfmon_membership_t pm_collection_membership, pm_bytes_sent_membership;
 
+            /* The stream for `conn`; empty for our connection to ourself. */
+            object_buffer_t<stream_t> main_stream;
+
+            /* `streams[c]` is the stream that messages of class `c` go on. It
+            points to `main_stream` until `handle_stream()` attaches an extra
+            connection for that class. */
+            stream_t *streams[NUM_MESSAGE_CLASSES];
+
+            /* `handle_stream()` holds a lock on this while an extra connection
+            is attached to us. It's reset at the beginning of the destructor,
+            which closes those connections. */
+            scoped_ptr_t<auto_drainer_t> stream_drainer;
+
         private:
             /* We only hold this information so we can deregister ourself */
             run_t *parent;
@@ -192,7 +242,46 @@ public:
             boost::optional<peer_id_t> expected_id,
             boost::optional<peer_address_t> expected_address,
             auto_drainer_t::lock_t,
-            bool *successful_join) THROWS_NOTHING;
+            bool *successful_join,
+            const ip_and_port_t *connected_to = NULL) THROWS_NOTHING;
+
+        /* Exchanges the header, the node IDs and addresses, and which class of
+        messages the connection is for with the peer on the other end of `c`.
+        Returns false if the connection should be closed. */
+        bool exchange_handshake(keepalive_tcp_conn_stream_t *c,
+                                const char *peername,
+                                message_class_t stream_class,
+                                peer_id_t *other_id_out,
+                                std::set<host_and_port_t> *other_hosts_out,
+                                message_class_t *other_stream_class_out) THROWS_NOTHING;
+
+        /* When `handle()` has set up a connection that we opened, it spawns a
+        `connect_stream()` for each extra class of messages that we send on a
+        connection of its own. `connect_stream()` opens that connection and
+        retries a few times in case the peer hasn't finished setting up its end
+        of the main connection yet. */
+        void connect_stream(ip_and_port_t address,
+                            peer_id_t other_id,
+                            message_class_t stream_class,
+                            auto_drainer_t::lock_t drainer_lock) THROWS_NOTHING;
+
+        /* `handle_stream()` attaches an extra connection for `stream_class` to
+        the `connection_entry_t` for `other_id` and reads messages off it until
+        either of them goes away. Returns false if it couldn't attach the
+        connection. The side that opened the connection waits for the other
+        side to attach it first. Losing an extra connection closes the main
+        one, so the peers reconnect rather than silently dropping messages. */
+        bool handle_stream(keepalive_tcp_conn_stream_t *c,
+                           peer_id_t other_id,
+                           message_class_t stream_class,
+                           bool we_connected,
+                           const char *peername,
+                           auto_drainer_t::lock_t drainer_lock) THROWS_NOTHING;
+
+        /* Reads messages off `c` and passes them to `message_handler` until the
+        connection is closed. */
+        void read_messages(tcp_conn_stream_t *c, peer_id_t other_id,
+                           const char *peername) THROWS_NOTHING;
 
         connectivity_cluster_t *parent;
 
@@ -223,6 +312,9 @@ public:
         int cluster_listener_port;
         int cluster_client_port;
 
+        /* How many TCP connections we open to each peer we connect to. */
+        int streams_per_peer;
+
         variable_setter_t register_us_with_parent;
 
         map_insertion_sentry_t<peer_id_t, peer_address_t> routing_table_entry_for_ourself;
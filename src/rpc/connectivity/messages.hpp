@@ -46,10 +46,33 @@ no further messages are delivered. This gives a natural way to make sure that no
 messages are still being delivered at the time that the `application_t`
 destructor is called. */
 
+/* Messages are sorted into classes so that a `message_service_t` can keep them
+from getting in each other's way. `connectivity_cluster_t` gives each class its
+own TCP connection to each peer (if it's been configured to open that many), so
+a backfill that's saturating the network doesn't hold up heartbeats or the
+writes that are being replicated alongside it. Only `message_class_t::control`
+messages are guaranteed to arrive in the order they were sent; the others may be
+reordered with respect to messages of other classes, and with respect to each
+other while a connection is being set up, so their receivers must be able to
+put them back in order (e.g. with a `fifo_enforcer_sink_t`). */
+enum class message_class_t {
+    control = 0,        // Heartbeats, metadata, acks; anything that isn't below.
+    replication = 1,    // Reads and writes from the broadcaster to its listeners.
+    backfill = 2        // Backfill chunks.
+};
+
+ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(message_class_t, int8_t,
+                                      message_class_t::control, message_class_t::backfill);
+
+const int NUM_MESSAGE_CLASSES = 3;
+
 class send_message_write_callback_t {
 public:
     virtual ~send_message_write_callback_t() { }
     virtual void write(write_stream_t *stream) = 0;
+    virtual message_class_t get_message_class() {
+        return message_class_t::control;
+    }
 };
 
 class message_service_t  {
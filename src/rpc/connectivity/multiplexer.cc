@@ -80,6 +80,10 @@ public:
         subwriter->write(os);
     }
 
+    message_class_t get_message_class() {
+        return subwriter->get_message_class();
+    }
+
 private:
     message_multiplexer_t::tag_t tag;
     send_message_write_callback_t *subwriter;
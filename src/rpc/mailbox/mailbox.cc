@@ -16,10 +16,12 @@
 const int raw_mailbox_t::address_t::ANY_THREAD = -1;
 
 raw_mailbox_t::address_t::address_t() :
-    peer(peer_id_t()), thread(ANY_THREAD), mailbox_id(0) { }
+    peer(peer_id_t()), thread(ANY_THREAD), mailbox_id(0),
+    message_class(message_class_t::control) { }
 
 raw_mailbox_t::address_t::address_t(const address_t &a) :
-    peer(a.peer), thread(a.thread), mailbox_id(a.mailbox_id) { }
+    peer(a.peer), thread(a.thread), mailbox_id(a.mailbox_id),
+    message_class(a.message_class) { }
 
 bool raw_mailbox_t::address_t::is_nil() const {
     return peer.is_nil();
@@ -34,10 +36,12 @@ std::string raw_mailbox_t::address_t::human_readable() const {
     return strprintf("%s:%d:%" PRIu64, uuid_to_str(peer.get_uuid()).c_str(), thread, mailbox_id);
 }
 
-raw_mailbox_t::raw_mailbox_t(mailbox_manager_t *m, mailbox_read_callback_t *_callback) :
+raw_mailbox_t::raw_mailbox_t(mailbox_manager_t *m, mailbox_read_callback_t *_callback,
+                             message_class_t _message_class) :
     manager(m),
     mailbox_id(manager->register_mailbox(this)),
-    callback(_callback) {
+    callback(_callback),
+    message_class(_message_class) {
     // Do nothing
 }
 
@@ -51,13 +55,16 @@ raw_mailbox_t::address_t raw_mailbox_t::get_address() const {
     a.peer = manager->get_connectivity_service()->get_me();
     a.thread = home_thread().threadnum;
     a.mailbox_id = mailbox_id;
+    a.message_class = message_class;
     return a;
 }
 
 class raw_mailbox_writer_t : public send_message_write_callback_t {
 public:
-    raw_mailbox_writer_t(int32_t _dest_thread, raw_mailbox_t::id_t _dest_mailbox_id, mailbox_write_callback_t *_subwriter) :
-        dest_thread(_dest_thread), dest_mailbox_id(_dest_mailbox_id), subwriter(_subwriter) { }
+    raw_mailbox_writer_t(int32_t _dest_thread, raw_mailbox_t::id_t _dest_mailbox_id,
+                         message_class_t _message_class, mailbox_write_callback_t *_subwriter) :
+        dest_thread(_dest_thread), dest_mailbox_id(_dest_mailbox_id),
+        message_class(_message_class), subwriter(_subwriter) { }
     virtual ~raw_mailbox_writer_t() { }
 
     void write(write_stream_t *stream) {
@@ -71,16 +78,21 @@ public:
 
         subwriter->write(stream);
     }
+
+    message_class_t get_message_class() {
+        return message_class;
+    }
 private:
     int32_t dest_thread;
     raw_mailbox_t::id_t dest_mailbox_id;
+    message_class_t message_class;
     mailbox_write_callback_t *subwriter;
 };
 
 void send(mailbox_manager_t *src, raw_mailbox_t::address_t dest, mailbox_write_callback_t *callback) {
     guarantee(src);
     guarantee(!dest.is_nil());
-    raw_mailbox_writer_t writer(dest.thread, dest.mailbox_id, callback);
+    raw_mailbox_writer_t writer(dest.thread, dest.mailbox_id, dest.message_class, callback);
     src->message_service->send_message(dest.peer, &writer);
 }
 
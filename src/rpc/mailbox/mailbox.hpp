@@ -43,6 +43,8 @@ private:
 
     mailbox_read_callback_t *callback;
 
+    const message_class_t message_class;
+
     auto_drainer_t drainer;
 
     DISABLE_COPYING(raw_mailbox_t);
@@ -70,7 +72,7 @@ public:
         friend struct raw_mailbox_t;
         friend class mailbox_manager_t;
 
-        RDB_MAKE_ME_SERIALIZABLE_3(peer, thread, mailbox_id);
+        RDB_MAKE_ME_SERIALIZABLE_4(peer, thread, mailbox_id, message_class);
 
         /* The peer on which the mailbox is located */
         peer_id_t peer;
@@ -81,9 +83,16 @@ public:
 
         /* The ID of the mailbox */
         id_t mailbox_id;
+
+        /* Which of the connection's streams messages to the mailbox go on */
+        message_class_t message_class;
     };
 
-    raw_mailbox_t(mailbox_manager_t *, mailbox_read_callback_t *callback);
+    /* Messages sent to the mailbox are sent as `message_class`. Mailboxes that
+    use something other than `message_class_t::control` must be prepared for
+    their messages to arrive out of order relative to other mailboxes'. */
+    raw_mailbox_t(mailbox_manager_t *, mailbox_read_callback_t *callback,
+                  message_class_t message_class = message_class_t::control);
     ~raw_mailbox_t();
 
     address_t get_address() const;
@@ -101,8 +101,9 @@ public:
     typedef mailbox_addr_t< void() > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void()> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void()> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -162,8 +163,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -230,8 +232,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -303,8 +306,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -381,8 +385,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t, arg3_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -464,8 +469,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -552,8 +558,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -645,8 +652,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -743,8 +751,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -846,8 +855,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -954,8 +964,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -1067,8 +1078,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -1185,8 +1197,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t, arg11_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t, arg11_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t, arg11_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -1308,8 +1321,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t, arg11_t, arg12_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t, arg11_t, arg12_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t, arg11_t, arg12_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
@@ -1436,8 +1450,9 @@ public:
     typedef mailbox_addr_t< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t, arg11_t, arg12_t, arg13_t) > address_t;
 
     mailbox_t(mailbox_manager_t *manager,
-              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t, arg11_t, arg12_t, arg13_t)> &f) :
-        reader(this), fun(f), mailbox(manager, &reader)
+              const boost::function< void(arg0_t, arg1_t, arg2_t, arg3_t, arg4_t, arg5_t, arg6_t, arg7_t, arg8_t, arg9_t, arg10_t, arg11_t, arg12_t, arg13_t)> &f,
+              message_class_t message_class = message_class_t::control) :
+        reader(this), fun(f), mailbox(manager, &reader, message_class)
         { }
 
     address_t get_address() const {
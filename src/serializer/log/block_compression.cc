@@ -0,0 +1,63 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "serializer/log/block_compression.hpp"
+
+#include <string.h>
+#include <zlib.h>
+
+#include "config/args.hpp"
+#include "utils.hpp"
+
+bool compress_block(const ser_buffer_t *buf, block_size_t block_size,
+                    scoped_malloc_t<ser_buffer_t> *compressed_out,
+                    block_size_t *compressed_size_out) {
+    // Compression only pays off if it saves at least one device block, so we don't
+    // give zlib any more room than that.
+    const uint32_t aligned_size = ceil_aligned(block_size.ser_value(), DEVICE_BLOCK_SIZE);
+    if (aligned_size <= DEVICE_BLOCK_SIZE + sizeof(ls_buf_data_t)) {
+        return false;
+    }
+    const uint32_t max_aligned_compressed_size = aligned_size - DEVICE_BLOCK_SIZE;
+
+    scoped_malloc_t<ser_buffer_t> compressed(
+        malloc_aligned(max_aligned_compressed_size, DEVICE_BLOCK_SIZE));
+    compressed->ser_header = buf->ser_header;
+
+    uLongf data_size = max_aligned_compressed_size - sizeof(ls_buf_data_t);
+    int res = compress2(reinterpret_cast<Bytef *>(compressed->cache_data), &data_size,
+                        reinterpret_cast<const Bytef *>(buf->cache_data),
+                        block_size.value(), Z_BEST_SPEED);
+    if (res == Z_BUF_ERROR) {
+        // It doesn't fit into fewer device blocks.
+        return false;
+    }
+    guarantee(res == Z_OK, "zlib failed to compress a block (error %d).", res);
+
+    const uint32_t compressed_size = sizeof(ls_buf_data_t) + data_size;
+    const uint32_t aligned_compressed_size = ceil_aligned(compressed_size, DEVICE_BLOCK_SIZE);
+    rassert(aligned_compressed_size <= max_aligned_compressed_size);
+
+    // Don't write uninitialized memory to disk.
+    memset(reinterpret_cast<char *>(compressed.get()) + compressed_size, 0,
+           aligned_compressed_size - compressed_size);
+
+    *compressed_out = std::move(compressed);
+    *compressed_size_out = block_size_t::unsafe_make(compressed_size);
+    return true;
+}
+
+void decompress_block(const ser_buffer_t *compressed, block_size_t compressed_size,
+                      block_size_t block_size, ser_buffer_t *buf_out) {
+    guarantee(compressed_size.ser_value() > sizeof(ls_buf_data_t));
+
+    buf_out->ser_header = compressed->ser_header;
+
+    uLongf data_size = block_size.value();
+    int res = uncompress(reinterpret_cast<Bytef *>(buf_out->cache_data), &data_size,
+                         reinterpret_cast<const Bytef *>(compressed->cache_data),
+                         compressed_size.ser_value() - sizeof(ls_buf_data_t));
+    guarantee(res == Z_OK, "Block %" PR_BLOCK_ID " is corrupted: "
+              "zlib failed to decompress it (error %d).",
+              compressed->ser_header.block_id, res);
+    guarantee(data_size == block_size.value(), "Block %" PR_BLOCK_ID " is corrupted: "
+              "it decompressed to the wrong size.", compressed->ser_header.block_id);
+}
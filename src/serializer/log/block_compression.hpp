@@ -0,0 +1,25 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef SERIALIZER_LOG_BLOCK_COMPRESSION_HPP_
+#define SERIALIZER_LOG_BLOCK_COMPRESSION_HPP_
+
+#include "containers/scoped.hpp"
+#include "serializer/types.hpp"
+
+/* A block stored compressed on disk starts with the same ls_buf_data_t header as an
+uncompressed one, so the GC and read-ahead can still tell which block it is, and is
+followed by the block's cache data compressed with zlib. The LBA records both the
+compressed and the uncompressed size of the block. */
+
+// Compresses `buf`, a block of size `block_size`, into a newly allocated buffer that
+// can be written to disk as it is. Returns false, and outputs nothing, if compressing
+// the block would not make it take up fewer device blocks on disk.
+bool compress_block(const ser_buffer_t *buf, block_size_t block_size,
+                    scoped_malloc_t<ser_buffer_t> *compressed_out,
+                    block_size_t *compressed_size_out);
+
+// Decompresses a block produced by compress_block() into `buf_out`, which must have
+// room for `block_size` bytes.
+void decompress_block(const ser_buffer_t *compressed, block_size_t compressed_size,
+                      block_size_t block_size, ser_buffer_t *buf_out);
+
+#endif  // SERIALIZER_LOG_BLOCK_COMPRESSION_HPP_
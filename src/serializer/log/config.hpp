@@ -15,7 +15,10 @@ struct log_serializer_dynamic_config_t {
         gc_low_ratio = DEFAULT_GC_LOW_RATIO;
         gc_high_ratio = DEFAULT_GC_HIGH_RATIO;
         read_ahead = true;
+        compress_blocks = false;
         io_batch_factor = DEFAULT_IO_BATCH_FACTOR;
+        lba_checkpoint_min_entries = DEFAULT_LBA_CHECKPOINT_MIN_ENTRIES;
+        lba_checkpoint_replay_ratio = DEFAULT_LBA_CHECKPOINT_REPLAY_RATIO;
     }
 
     /* When the proportion of garbage blocks hits gc_high_ratio, then the serializer will collect
@@ -30,7 +33,19 @@ struct log_serializer_dynamic_config_t {
     /* Enable reading more data than requested to let the cache warmup more quickly esp. on rotational drives */
     bool read_ahead;
 
-    RDB_MAKE_ME_SERIALIZABLE_4(gc_low_ratio, gc_high_ratio, io_batch_factor, read_ahead);
+    /* Compress blocks before writing them, if that makes them take up less space on
+    disk. Blocks that were written compressed can be read either way. */
+    bool compress_blocks;
+
+    /* The serializer writes a checkpoint of the LBA once startup would have to replay
+    at least lba_checkpoint_min_entries LBA entries, and at least
+    lba_checkpoint_replay_ratio times as many entries as there are blocks. */
+    int64_t lba_checkpoint_min_entries;
+    double lba_checkpoint_replay_ratio;
+
+    RDB_MAKE_ME_SERIALIZABLE_7(gc_low_ratio, gc_high_ratio, io_batch_factor, read_ahead,
+                               compress_blocks,
+                               lba_checkpoint_min_entries, lba_checkpoint_replay_ratio);
 };
 
 /* This is equivalent to log_serializer_static_config_t below, but is an on-disk
@@ -4,6 +4,7 @@
 #include "serializer/log/data_block_manager.hpp"
 
 #include <inttypes.h>
+#include <math.h>
 #include <sys/uio.h>
 
 #include "utils.hpp"
@@ -160,6 +161,14 @@ public:
 
     bool all_garbage() const { return num_live_blocks() == 0; }
 
+    // How much it's worth garbage collecting this extent, with its age measured at
+    // parent->gc_pq_time; this is what gc_pq is ordered by.
+    double gc_score() const {
+        const microtime_t now = parent->gc_pq_time;
+        return gc_cost_benefit(garbage_bytes(), parent->static_config->extent_size(),
+                               now > timestamp ? now - timestamp : 0);
+    }
+
     uint32_t garbage_bytes() const {
         uint32_t b = parent->static_config->extent_size();
         for (auto it = block_infos.begin(); it < block_infos.end(); ++it) {
@@ -296,7 +305,7 @@ public:
         // It has been, or is being, reconstructed from data on disk.
         state_reconstructing,
         // We are currently putting things on this extent. It is equal to
-        // last_data_extent.
+        // active_extent or gc_active_extent.
         state_active,
         // Not active, but not a GC candidate yet. It is in young_extent_queue.
         state_young,
@@ -334,6 +343,8 @@ private:
 data_block_manager_t::data_block_manager_t(const log_serializer_dynamic_config_t *_dynamic_config, extent_manager_t *em, log_serializer_t *_serializer, const log_serializer_on_disk_static_config_t *_static_config, log_serializer_stats_t *_stats)
     : stats(_stats), shutdown_callback(NULL), state(state_unstarted), dynamic_config(_dynamic_config),
       static_config(_static_config), extent_manager(em), serializer(_serializer),
+      garbage_ratio_trend(0.0), trend_sample_garbage_ratio(0.0), trend_sample_time(0),
+      active_extent(NULL), gc_active_extent(NULL), gc_pq_time(current_microtime()),
       gc_state(), gc_stats(stats)
 {
     rassert(dynamic_config != NULL);
@@ -348,6 +359,7 @@ data_block_manager_t::~data_block_manager_t() {
 
 void data_block_manager_t::prepare_initial_metablock(data_block_manager::metablock_mixin_t *mb) {
     mb->active_extent = NULL_OFFSET;
+    mb->gc_active_extent = NULL_OFFSET;
 }
 
 void data_block_manager_t::start_reconstruct() {
@@ -383,33 +395,19 @@ void data_block_manager_t::start_existing(file_t *file,
                                           data_block_manager::metablock_mixin_t *last_metablock) {
     guarantee(state == state_unstarted);
     dbfile = file;
-    gc_io_account_nice.init(new file_account_t(file, GC_IO_PRIORITY_NICE));
-    gc_io_account_high.init(new file_account_t(file, GC_IO_PRIORITY_HIGH));
-
-    /* Reconstruct the active data block extents from the metablock. */
-    const int64_t offset = last_metablock->active_extent;
-
-    if (offset != NULL_OFFSET) {
-        /* It is (perhaps) possible to have an active data block extent with no
-           actual data blocks in it. In this case we would not have created a
-           gc_entry_t for the extent yet. */
-        if (entries.get(offset / extent_manager->extent_size) == NULL) {
-            gc_entry_t *e = new gc_entry_t(this, offset);
-            reconstructed_extents.push_back(e);
-        }
-
-        active_extent = entries.get(offset / extent_manager->extent_size);
-        guarantee(active_extent != NULL);
 
-        /* Turn the extent from a reconstructing extent into an active extent */
-        guarantee(active_extent->state == gc_entry_t::state_reconstructing);
-        reconstructed_extents.remove(active_extent);
-
-        active_extent->make_active();
-    } else {
-        active_extent = NULL;
+    gc_io_accounts.init(GC_IO_PRIORITY_LEVELS);
+    for (int i = 0; i < GC_IO_PRIORITY_LEVELS; ++i) {
+        const double level = static_cast<double>(i) / (GC_IO_PRIORITY_LEVELS - 1);
+        const double priority = GC_IO_PRIORITY_NICE
+            * pow(static_cast<double>(GC_IO_PRIORITY_HIGH) / GC_IO_PRIORITY_NICE, level);
+        gc_io_accounts[i].init(new file_account_t(file, lround(priority)));
     }
 
+    /* Reconstruct the active data block extents from the metablock. */
+    active_extent = reconstruct_active_extent(last_metablock->active_extent);
+    gc_active_extent = reconstruct_active_extent(last_metablock->gc_active_extent);
+
     /* Convert any extents that we found live blocks in, but that are not active
     extents, into old extents */
     while (gc_entry_t *entry = reconstructed_extents.head()) {
@@ -424,9 +422,36 @@ void data_block_manager_t::start_existing(file_t *file,
         gc_stats.old_garbage_block_bytes += entry->garbage_bytes();
     }
 
+    trend_sample_time = current_microtime();
+    trend_sample_garbage_ratio = garbage_ratio();
+
     state = state_ready;
 }
 
+gc_entry_t *data_block_manager_t::reconstruct_active_extent(int64_t offset) {
+    if (offset == NULL_OFFSET) {
+        return NULL;
+    }
+
+    /* It is (perhaps) possible to have an active data block extent with no
+       actual data blocks in it. In this case we would not have created a
+       gc_entry_t for the extent yet. */
+    if (entries.get(offset / extent_manager->extent_size) == NULL) {
+        gc_entry_t *e = new gc_entry_t(this, offset);
+        reconstructed_extents.push_back(e);
+    }
+
+    gc_entry_t *entry = entries.get(offset / extent_manager->extent_size);
+    guarantee(entry != NULL);
+
+    /* Turn the extent from a reconstructing extent into an active extent */
+    guarantee(entry->state == gc_entry_t::state_reconstructing);
+    reconstructed_extents.remove(entry);
+
+    entry->make_active();
+    return entry;
+}
+
 // Computes an offset and end offset for the purposes of readahead.  Returns an interval
 // that contains the [block_offset, block_offset + ser_block_size_in) interval that
 // is also contained within a single extent.  boundaries is the extent's gc_entry_t's
@@ -591,13 +616,16 @@ public:
                     continue;
                 }
 
-                scoped_malloc_t<ser_buffer_t> data = parent->serializer->malloc();
-                memcpy(data.get(), current_buf, info.ser_block_size);
                 guarantee(info.ser_block_size <= *(lower_it + 1) - *lower_it);
+                scoped_malloc_t<ser_buffer_t> data = parent->serializer->malloc();
+                parent->serializer->unpack_block(
+                        reinterpret_cast<const ser_buffer_t *>(current_buf),
+                        info.disk_block_size(), info.block_size(), data.get());
 
                 counted_t<ls_block_token_pointee_t> ls_token
                     = parent->serializer->generate_block_token(current_offset,
-                                                               block_size_t::unsafe_make(info.ser_block_size));
+                                                               info.block_size(),
+                                                               info.disk_block_size());
 
                 counted_t<standard_block_token_t> token
                     = to_standard_block_token(block_id, ls_token);
@@ -653,7 +681,7 @@ void data_block_manager_t::read(int64_t off_in, uint32_t ser_block_size_in,
 
 std::vector<counted_t<ls_block_token_pointee_t> >
 data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
-                                  bool assign_new_block_sequence_id,
+                                  bool is_gc_write,
                                   file_account_t *io_account,
                                   iocallback_t *cb) {
     // Either we're ready to write, or we're shutting down and just finished reading
@@ -664,11 +692,11 @@ data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
     // These tokens are grouped by extent.  You can do a contiguous write in each
     // extent.
     std::vector<std::vector<counted_t<ls_block_token_pointee_t> > > token_groups
-        = gimme_some_new_offsets(writes);
+        = gimme_some_new_offsets(writes, is_gc_write);
 
     for (auto it = writes.begin(); it != writes.end(); ++it) {
         it->buf->ser_header.block_id = it->block_id;
-        if (assign_new_block_sequence_id) {
+        if (!is_gc_write) {
             ++serializer->latest_block_sequence_id;
             it->buf->ser_header.block_sequence_id = serializer->latest_block_sequence_id;
         }
@@ -699,7 +727,7 @@ data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
 
         const int64_t front_offset = token_groups[i].front()->offset();
         const int64_t back_offset = token_groups[i].back()->offset()
-            + gc_entry_t::aligned_value(token_groups[i].back()->block_size());
+            + gc_entry_t::aligned_value(token_groups[i].back()->disk_block_size());
 
         guarantee(divides(DEVICE_BLOCK_SIZE, front_offset));
 
@@ -711,7 +739,7 @@ data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
 
         for (size_t j = 0; j < token_groups[i].size(); ++j) {
             const int64_t j_offset = token_groups[i][j]->offset();
-            const block_size_t j_block_size = token_groups[i][j]->block_size();
+            const block_size_t j_block_size = token_groups[i][j]->disk_block_size();
             guarantee(j_offset == last_written_offset);
             const size_t j_aligned_size = gc_entry_t::aligned_value(j_block_size);
 
@@ -728,6 +756,7 @@ data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
 
         guarantee(last_written_offset == back_offset);
 
+        stats->pm_serializer_data_bytes_written += write_size;
         dbfile->writev_async(front_offset, write_size,
                              std::move(iovecs), io_account, intermediate_cb);
     }
@@ -789,20 +818,33 @@ void data_block_manager_t::check_and_handle_empty_extent(uint64_t extent_id) {
 }
 
 file_account_t *data_block_manager_t::choose_gc_io_account() {
-    // Start going into high priority as soon as the garbage ratio is more than
-    // 2% above the configured goal.
-    // The idea is that we use the nice i/o account whenever possible, except
-    // if it proves insufficient to maintain an acceptable garbage ratio, in
-    // which case we switch over to the high priority account until the situation
-    // has improved.
-
-    // This means that we can end up oscillating between both accounts, which
-    // is probably fine. TODO: Make sure it actually is in practice!
-    if (garbage_ratio() > dynamic_config->gc_high_ratio * 1.02) {
-        return gc_io_account_high.get();
-    } else {
-        return gc_io_account_nice.get();
+    // Rather than switching between a nice and a high priority account (and
+    // oscillating between them), we raise the GC's priority gradually as the
+    // garbage ratio gets closer to gc_high_ratio, or is heading there quickly.
+    update_garbage_ratio_trend();
+    const double pressure = gc_pressure(garbage_ratio(), garbage_ratio_trend,
+                                        dynamic_config->gc_low_ratio,
+                                        dynamic_config->gc_high_ratio);
+    const int level = lround(pressure * (GC_IO_PRIORITY_LEVELS - 1));
+    return gc_io_accounts[level].get();
+}
+
+void data_block_manager_t::update_garbage_ratio_trend() {
+    const microtime_t now = current_microtime();
+    if (now < trend_sample_time + GC_TREND_SAMPLE_INTERVAL_MICROS) {
+        return;
     }
+
+    const double ratio = garbage_ratio();
+    const double secs = static_cast<double>(now - trend_sample_time) / MILLION;
+    const double sample = (ratio - trend_sample_garbage_ratio) / secs;
+
+    // A moving average, so that a single big write or deletion doesn't get taken
+    // for a trend.
+    garbage_ratio_trend = 0.75 * garbage_ratio_trend + 0.25 * sample;
+
+    trend_sample_time = now;
+    trend_sample_garbage_ratio = ratio;
 }
 
 void data_block_manager_t::mark_garbage(int64_t offset, extent_transaction_t *txn) {
@@ -893,19 +935,24 @@ void data_block_manager_t::gc_writer_t::write_gcs(gc_write_t *writes, size_t num
             // Step 1: Write buffers to disk and assemble index operations
             ASSERT_NO_CORO_WAITING;
 
+            // The blocks are copied as they are on disk, so a compressed block stays
+            // compressed; the tokens here only use their disk sizes.
             std::vector<buf_write_info_t> the_writes;
             the_writes.reserve(num_writes);
             for (size_t i = 0; i < num_writes; ++i) {
                 old_block_tokens.push_back(parent->serializer->generate_block_token(writes[i].old_offset,
+                                                                                    writes[i].block_size,
                                                                                     writes[i].block_size));
 
                 the_writes.push_back(buf_write_info_t(writes[i].buf,
                                                       writes[i].block_size,
                                                       writes[i].buf->ser_header.block_id));
+                parent->stats->pm_serializer_gc_bytes_written
+                    += gc_entry_t::aligned_value(writes[i].block_size);
             }
 
             new_block_tokens
-                = parent->many_writes(the_writes, false, parent->choose_gc_io_account(),
+                = parent->many_writes(the_writes, true, parent->choose_gc_io_account(),
                                       &block_write_cond);
 
             guarantee(new_block_tokens.size() == num_writes);
@@ -933,11 +980,20 @@ void data_block_manager_t::gc_writer_t::write_gcs(gc_write_t *writes, size_t num
                 if (parent->gc_state.current_entry->block_referenced_by_index(block_index)) {
                     block_id_t block_id = writes[i].buf->ser_header.block_id;
 
+                    // The index knows the block's uncompressed size, which the new
+                    // token has to carry.
+                    const index_block_info_t info
+                        = parent->serializer->lba_index->get_block_info(block_id);
+                    guarantee(info.offset.has_value()
+                              && info.offset.get_value() == writes[i].old_offset);
+                    counted_t<ls_block_token_pointee_t> token
+                        = parent->serializer->generate_block_token(new_block_tokens[i]->offset(),
+                                                                   info.block_size(),
+                                                                   info.disk_block_size());
+
                     index_write_ops.push_back(
                             index_write_op_t(block_id,
-                                             to_standard_block_token(
-                                                     block_id,
-                                                     new_block_tokens[i])));
+                                             to_standard_block_token(block_id, token)));
                 }
 
                 // (If we don't have an i_array entry, the block is referenced
@@ -1004,12 +1060,23 @@ void data_block_manager_t::run_gc() {
 
                 ASSERT_NO_CORO_WAITING;
 
+                /* let the extents in gc_pq age */
+                const microtime_t now = current_microtime();
+                if (now > gc_pq_time + GC_SCORE_REFRESH_INTERVAL_MICROS) {
+                    gc_pq_time = now;
+                    gc_pq.rebuild();
+                }
+
                 ++stats->pm_serializer_data_extents_gced;
 
                 /* grab the entry */
                 gc_state.current_entry = gc_pq.pop();
                 gc_state.current_entry->our_pq_entry = NULL;
 
+                stats->pm_serializer_gc_extent_live_ratio.record(
+                    1.0 - static_cast<double>(gc_state.current_entry->garbage_bytes())
+                    / static_config->extent_size());
+
                 guarantee(gc_state.current_entry->state == gc_entry_t::state_old);
                 gc_state.current_entry->state = gc_entry_t::state_in_gc;
                 gc_stats.old_garbage_block_bytes -= gc_state.current_entry->garbage_bytes();
@@ -1189,6 +1256,12 @@ void data_block_manager_t::prepare_metablock(data_block_manager::metablock_mixin
     } else {
         metablock->active_extent = NULL_OFFSET;
     }
+
+    if (gc_active_extent != NULL) {
+        metablock->gc_active_extent = gc_active_extent->extent_ref.offset();
+    } else {
+        metablock->gc_active_extent = NULL_OFFSET;
+    }
 }
 
 bool data_block_manager_t::shutdown(data_block_manager::shutdown_callback_t *cb) {
@@ -1218,6 +1291,12 @@ void data_block_manager_t::actually_shutdown() {
         active_extent = NULL;
     }
 
+    if (gc_active_extent != NULL) {
+        UNUSED int64_t extent = gc_active_extent->extent_ref.release();
+        delete gc_active_extent;
+        gc_active_extent = NULL;
+    }
+
     while (gc_entry_t *entry = young_extent_queue.head()) {
         young_extent_queue.remove(entry);
         UNUSED int64_t extent = entry->extent_ref.release();
@@ -1236,17 +1315,20 @@ void data_block_manager_t::actually_shutdown() {
 }
 
 std::vector<std::vector<counted_t<ls_block_token_pointee_t> > >
-data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t> &writes) {
+data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t> &writes,
+                                             bool is_gc_write) {
     ASSERT_NO_CORO_WAITING;
 
+    gc_entry_t **const active = is_gc_write ? &gc_active_extent : &active_extent;
+
     // Start a new extent if necessary.
-    if (active_extent == NULL) {
-        active_extent = new gc_entry_t(this);
+    if (*active == NULL) {
+        *active = new gc_entry_t(this);
         ++stats->pm_serializer_data_extents_allocated;
     }
 
 
-    guarantee(active_extent->state == gc_entry_t::state_active);
+    guarantee((*active)->state == gc_entry_t::state_active);
 
     std::vector<std::vector<counted_t<ls_block_token_pointee_t> > > ret;
 
@@ -1254,19 +1336,19 @@ data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t>
     for (auto it = writes.begin(); it != writes.end(); ++it) {
         uint32_t relative_offset = valgrind_undefined<uint32_t>(UINT32_MAX);
         unsigned int block_index = valgrind_undefined<unsigned int>(UINT_MAX);
-        if (!active_extent->new_offset(it->block_size,
-                                       &relative_offset, &block_index)) {
-            // Move the active_extent gc_entry_t to the young extent queue, and make a
+        if (!(*active)->new_offset(it->block_size,
+                                   &relative_offset, &block_index)) {
+            // Move the active gc_entry_t to the young extent queue, and make a
             // new gc_entry_t.
-            active_extent->state = gc_entry_t::state_young;
-            young_extent_queue.push_back(active_extent);
+            (*active)->state = gc_entry_t::state_young;
+            young_extent_queue.push_back(*active);
             mark_unyoung_entries();
 
-            active_extent = new gc_entry_t(this);
+            *active = new gc_entry_t(this);
             ++stats->pm_serializer_data_extents_allocated;
-            const bool succeeded = active_extent->new_offset(it->block_size,
-                                                             &relative_offset,
-                                                             &block_index);
+            const bool succeeded = (*active)->new_offset(it->block_size,
+                                                         &relative_offset,
+                                                         &block_index);
             guarantee(succeeded);
 
             // Push the current group of tokens, if it's nonempty, onto the return vector.
@@ -1276,11 +1358,12 @@ data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t>
             }
         }
 
-        const int64_t offset = active_extent->extent_ref.offset() + relative_offset;
-        active_extent->was_written = true;
-        active_extent->mark_live_tokenwise(block_index);
+        const int64_t offset = (*active)->extent_ref.offset() + relative_offset;
+        (*active)->was_written = true;
+        (*active)->mark_live_tokenwise(block_index);
 
-        tokens.push_back(serializer->generate_block_token(offset, it->block_size));
+        tokens.push_back(serializer->generate_block_token(offset, it->block_size,
+                                                          it->block_size));
     }
 
     if (!tokens.empty()) {
@@ -1333,14 +1416,40 @@ bool data_block_manager_t::should_we_keep_gcing() const {
 }
 
 // Answers the following question: Do we want to bother gc'ing?
-// Returns true when our garbage_ratio is greater than
-// GC_THRESHOLD_RATIO_*.
+// Returns true when our garbage_ratio is greater than gc_low_ratio.  Rather
+// than waiting for gc_high_ratio and then collecting in a burst, we collect
+// continuously, at a priority that choose_gc_io_account() paces.
 bool data_block_manager_t::do_we_want_to_start_gcing() const {
-    return garbage_ratio() > dynamic_config->gc_high_ratio;
+    return garbage_ratio() > dynamic_config->gc_low_ratio;
 }
 
 bool gc_entry_less_t::operator()(const gc_entry_t *x, const gc_entry_t *y) {
-    return x->garbage_bytes() < y->garbage_bytes();
+    return x->gc_score() < y->gc_score();
+}
+
+double gc_cost_benefit(uint32_t garbage_bytes, uint32_t extent_size, microtime_t age) {
+    rassert(garbage_bytes <= extent_size);
+    // The benefit is the garbage freed up, times how long it's likely to stay free
+    // (estimated by the age of the extent); the cost is reading the whole extent
+    // and writing back its live part.  The + 1 keeps extents of age 0 ordered by
+    // their garbage.
+    const double live = 1.0 - static_cast<double>(garbage_bytes) / extent_size;
+    return (1.0 - live) * (static_cast<double>(age) + 1.0) / (1.0 + live);
+}
+
+double gc_pressure(double garbage_ratio, double garbage_ratio_trend,
+                   double gc_low_ratio, double gc_high_ratio) {
+    // Only a rising trend counts: the garbage ratio falls because the GC is
+    // working, which is no reason for it to slow down below what the current
+    // ratio calls for.
+    const double projected_ratio = garbage_ratio
+        + std::max(0.0, garbage_ratio_trend) * GC_TREND_HORIZON_SECS;
+
+    if (gc_high_ratio <= gc_low_ratio) {
+        return projected_ratio > gc_low_ratio ? 1.0 : 0.0;
+    }
+    const double pressure = (projected_ratio - gc_low_ratio) / (gc_high_ratio - gc_low_ratio);
+    return std::min(1.0, std::max(0.0, pressure));
 }
 
 /****************
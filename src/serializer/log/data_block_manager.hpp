@@ -20,6 +20,7 @@ class data_block_manager_t;
 
 class gc_entry_t;
 
+// Orders extents by how much it's worth garbage collecting them; see gc_cost_benefit().
 struct gc_entry_less_t {
     bool operator() (const gc_entry_t *x, const gc_entry_t *y);
 };
@@ -97,20 +98,28 @@ public:
     // ratio of garbage to blocks in the system
     double garbage_ratio() const;
 
+    // GC writes move existing blocks: they keep their block sequence ids, and they
+    // go to a different active extent than fresh writes, so that blocks that have
+    // survived a GC (and are probably cold) get grouped together.
     std::vector<counted_t<ls_block_token_pointee_t> >
     many_writes(const std::vector<buf_write_info_t> &writes,
-                bool assign_new_block_sequence_id,
+                bool is_gc_write,
                 file_account_t *io_account,
                 iocallback_t *cb);
 
     std::vector<std::vector<counted_t<ls_block_token_pointee_t> > >
-    gimme_some_new_offsets(const std::vector<buf_write_info_t> &writes);
+    gimme_some_new_offsets(const std::vector<buf_write_info_t> &writes, bool is_gc_write);
 
 
 private:
     void actually_shutdown();
 
+    // Turns the extent at `offset`, which the metablock says was active, back into
+    // an active extent at startup.
+    gc_entry_t *reconstruct_active_extent(int64_t offset);
+
     file_account_t *choose_gc_io_account();
+    void update_garbage_ratio_trend();
 
     /* Checks whether the extent is empty and if it is, notifies the extent manager
        and cleans up */
@@ -161,8 +170,15 @@ private:
     log_serializer_t *const serializer;
 
     file_t *dbfile;
-    scoped_ptr_t<file_account_t> gc_io_account_nice;
-    scoped_ptr_t<file_account_t> gc_io_account_high;
+    // I/O accounts of increasing priority, from GC_IO_PRIORITY_NICE to
+    // GC_IO_PRIORITY_HIGH; the GC picks one according to gc_pressure().
+    scoped_array_t<scoped_ptr_t<file_account_t> > gc_io_accounts;
+
+    // How fast the garbage ratio is changing, per second, and the last sample it
+    // was computed from.
+    double garbage_ratio_trend;
+    double trend_sample_garbage_ratio;
+    microtime_t trend_sample_time;
 
     /* Contains a pointer to every gc_entry_t, regardless of what its current state
        is */
@@ -171,8 +187,10 @@ private:
     /* Contains every extent in the gc_entry_t::state_reconstructing state */
     intrusive_list_t<gc_entry_t> reconstructed_extents;
 
-    /* Contains the extent in the gc_entry_t::state_active state. */
+    /* Contain the extents in the gc_entry_t::state_active state: the one that new
+    blocks are written to, and the one that the GC moves blocks to. */
     gc_entry_t *active_extent;
+    gc_entry_t *gc_active_extent;
 
     /* Contains every extent in the gc_entry_t::state_young state */
     intrusive_list_t<gc_entry_t> young_extent_queue;
@@ -180,6 +198,10 @@ private:
     /* Contains every extent in the gc_entry_t::state_old state */
     priority_queue_t<gc_entry_t *, gc_entry_less_t> gc_pq;
 
+    /* The time that the ages in gc_pq's ordering are measured at. It only moves
+    forward when gc_pq gets rebuilt, so that the ordering stays consistent. */
+    microtime_t gc_pq_time;
+
 
     /* Buffer used during GC. */
     std::vector<gc_write_t> gc_writes;
@@ -252,6 +274,20 @@ private:
     DISABLE_COPYING(data_block_manager_t);
 };
 
+// Exposed for unit tests.  How much it's worth garbage collecting an extent: the
+// garbage it frees up per byte of live data it has to copy, weighted by the age of
+// the extent, as in LFS's cost-benefit cleaning policy.  Old extents get collected
+// at a lower garbage ratio than young ones, whose live blocks are more likely to
+// become garbage soon anyway.
+double gc_cost_benefit(uint32_t garbage_bytes, uint32_t extent_size, microtime_t age);
+
+// Exposed for unit tests.  How hard the GC should work, from 0 (at the lowest I/O
+// priority) to 1 (at the highest), given the garbage ratio and how fast it is
+// changing per second.  The GC works harder the further the garbage ratio is
+// projected to rise above gc_low_ratio, reaching full speed at gc_high_ratio.
+double gc_pressure(double garbage_ratio, double garbage_ratio_trend,
+                   double gc_low_ratio, double gc_high_ratio);
+
 // Exposed for unit tests.  Returns a super-interval of [block_offset,
 // ser_block_size) that is almost appropriate for a read-ahead disk read -- it still
 // needs to be stretched to be aligned with disk block boundaries.
@@ -0,0 +1,303 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "serializer/log/lba/checkpoint.hpp"
+
+#include <algorithm>
+
+#include <boost/crc.hpp>
+
+#include "arch/arch.hpp"
+#include "concurrency/cond_var.hpp"
+#include "containers/scoped.hpp"
+
+static uint32_t compute_crc(const void *data, size_t size) {
+    boost::crc_32_type crc_computer;
+    crc_computer.process_bytes(data, size);
+    return crc_computer.checksum();
+}
+
+static void co_sync_extent(extent_t *extent) {
+    struct : public cond_t, public extent_t::sync_callback_t {
+        void on_extent_sync() { pulse(); }
+    } on_sync;
+    extent->sync(&on_sync);
+    on_sync.wait();
+}
+
+struct checkpoint_extent_read_t : public extent_t::read_callback_t {
+    explicit checkpoint_extent_read_t(size_t size)
+        : buffer(malloc_aligned(size, DEVICE_BLOCK_SIZE)) { }
+    void on_extent_read() { done.pulse(); }
+
+    scoped_malloc_t<char> buffer;
+    cond_t done;
+};
+
+lba_checkpoint_t::lba_checkpoint_t(extent_manager_t *_em, file_t *_file,
+                                   const lba_shard_position_t _positions[LBA_SHARD_FACTOR])
+    : em(_em), file(_file), directory_extent(NULL), directory_offset(NULL_OFFSET),
+      directory_ok(true) {
+    for (int i = 0; i < LBA_SHARD_FACTOR; ++i) {
+        positions[i] = _positions[i];
+    }
+}
+
+lba_checkpoint_t::lba_checkpoint_t(extent_manager_t *_em, file_t *_file)
+    : em(_em), file(_file), directory_extent(NULL), directory_offset(NULL_OFFSET),
+      directory_ok(true) {
+    for (int i = 0; i < LBA_SHARD_FACTOR; ++i) {
+        positions[i] = lba_shard_position_t::invalid();
+    }
+}
+
+lba_checkpoint_t::~lba_checkpoint_t() { }
+
+lba_checkpoint_t *lba_checkpoint_t::load(extent_manager_t *em, file_t *file,
+                                         const lba_checkpoint_metablock_t *metablock) {
+    rassert(metablock->directory_offset != NULL_OFFSET);
+    lba_checkpoint_t *checkpoint = new lba_checkpoint_t(em, file);
+
+    const int64_t directory_size
+        = lba_checkpoint_directory_t::extents_count_to_file_size(metablock->extents_count);
+    const int64_t directory_extent_offset
+        = metablock->directory_offset - (metablock->directory_offset % em->extent_size);
+    checkpoint->directory_offset = metablock->directory_offset;
+    checkpoint->directory_extent = new extent_t(em, file, directory_extent_offset,
+        metablock->directory_offset + directory_size - directory_extent_offset);
+
+    checkpoint_extent_read_t directory_read(directory_size);
+    checkpoint->directory_extent->read(metablock->directory_offset - directory_extent_offset,
+                                       directory_size, directory_read.buffer.get(),
+                                       &directory_read);
+    directory_read.done.wait();
+
+    const lba_checkpoint_directory_t *directory
+        = reinterpret_cast<const lba_checkpoint_directory_t *>(directory_read.buffer.get());
+    const size_t extents_size
+        = sizeof(lba_checkpoint_extent_entry_t) * metablock->extents_count;
+    for (int i = 0; i < LBA_SHARD_FACTOR; ++i) {
+        checkpoint->positions[i] = metablock->shards[i];
+    }
+
+    if (memcmp(directory->magic, lba_checkpoint_magic, LBA_CHECKPOINT_MAGIC_SIZE) != 0
+        || directory->extents_count != metablock->extents_count
+        || directory->extents_crc != compute_crc(directory->extents, extents_size)) {
+        // We don't know where the data extents are, so we can't reserve them.
+        // `read` fails, unless nobody needs the checkpoint anyway.
+        checkpoint->directory_ok = false;
+        return checkpoint;
+    }
+
+    for (int32_t i = 0; i < directory->extents_count; ++i) {
+        const lba_checkpoint_extent_entry_t &e = directory->extents[i];
+        data_extent_t data_extent;
+        data_extent.extent = new extent_t(em, file, e.offset,
+            ceil_aligned(offsetof(lba_extent_t, entries[0]) + sizeof(lba_entry_t) * e.entries_count,
+                         DEVICE_BLOCK_SIZE));
+        data_extent.entries_count = e.entries_count;
+        data_extent.entries_crc = e.entries_crc;
+        checkpoint->data_extents.push_back(data_extent);
+    }
+
+    return checkpoint;
+}
+
+void lba_checkpoint_t::prepare_initial_metablock(lba_checkpoint_metablock_t *mb_out) {
+    mb_out->directory_offset = NULL_OFFSET;
+    mb_out->extents_count = 0;
+    mb_out->padding = 0;
+    for (int i = 0; i < LBA_SHARD_FACTOR; ++i) {
+        mb_out->shards[i] = lba_shard_position_t::invalid();
+    }
+}
+
+void lba_checkpoint_t::prepare_metablock(lba_checkpoint_metablock_t *mb_out) {
+    rassert(is_complete());
+    mb_out->directory_offset = directory_offset;
+    mb_out->extents_count = data_extents.size();
+    mb_out->padding = 0;
+    for (int i = 0; i < LBA_SHARD_FACTOR; ++i) {
+        mb_out->shards[i] = positions[i];
+    }
+}
+
+int lba_checkpoint_t::entries_per_extent() const {
+    return (em->extent_size - offsetof(lba_extent_t, entries[0])) / sizeof(lba_entry_t);
+}
+
+void lba_checkpoint_t::write_extent(in_memory_index_t *index, block_id_t *next_block_id,
+                                    block_id_t end_block_id, file_account_t *io_account) {
+    rassert(!is_complete());
+    scoped_malloc_t<char> buffer(malloc_aligned(em->extent_size, DEVICE_BLOCK_SIZE));
+    lba_extent_t *extent_buffer = reinterpret_cast<lba_extent_t *>(buffer.get());
+
+    bzero(&extent_buffer->header, sizeof(extent_buffer->header));
+    memcpy(extent_buffer->header.magic, lba_checkpoint_magic, LBA_CHECKPOINT_MAGIC_SIZE);
+    CT_ASSERT(LBA_CHECKPOINT_MAGIC_SIZE == LBA_MAGIC_SIZE);
+
+    // Copy the entries out of the index all at once, so that we don't see a
+    // half-finished index write.
+    const int max_entries = entries_per_extent();
+    int32_t entries_count = 0;
+    block_id_t id = *next_block_id;
+    for (; id < end_block_id && entries_count < max_entries; ++id) {
+        index_block_info_t info = index->get_block_info(id);
+        if (info.offset.has_value()) {
+            extent_buffer->entries[entries_count++]
+                = lba_entry_t::make(id, info.recency, info.offset, info.ser_block_size,
+                                    info.uncompressed_ser_block_size);
+        }
+    }
+    *next_block_id = id;
+
+    if (entries_count == 0) {
+        return;
+    }
+
+    const size_t entries_size = sizeof(lba_entry_t) * entries_count;
+    const size_t used_size = offsetof(lba_extent_t, entries[0]) + entries_size;
+    const size_t write_size = ceil_aligned(used_size, DEVICE_BLOCK_SIZE);
+    bzero(buffer.get() + used_size, write_size - used_size);
+
+    data_extent_t data_extent;
+    data_extent.extent = new extent_t(em, file);
+    data_extent.entries_count = entries_count;
+    data_extent.entries_crc = compute_crc(extent_buffer->entries, entries_size);
+    data_extent.extent->append(buffer.get(), write_size, io_account);
+    data_extents.push_back(data_extent);
+
+    co_sync_extent(data_extent.extent);
+}
+
+void lba_checkpoint_t::write_directory(file_account_t *io_account) {
+    rassert(!is_complete());
+    const int64_t directory_size
+        = lba_checkpoint_directory_t::extents_count_to_file_size(data_extents.size());
+    guarantee(directory_size <= static_cast<int64_t>(em->extent_size),
+              "Too many extents in the LBA checkpoint.");
+
+    scoped_malloc_t<char> buffer(malloc_aligned(directory_size, DEVICE_BLOCK_SIZE));
+    bzero(buffer.get(), directory_size);
+    lba_checkpoint_directory_t *directory
+        = reinterpret_cast<lba_checkpoint_directory_t *>(buffer.get());
+    memcpy(directory->magic, lba_checkpoint_magic, LBA_CHECKPOINT_MAGIC_SIZE);
+    directory->extents_count = data_extents.size();
+    for (size_t i = 0; i < data_extents.size(); ++i) {
+        directory->extents[i].offset = data_extents[i].extent->extent_ref.offset();
+        directory->extents[i].entries_count = data_extents[i].entries_count;
+        directory->extents[i].entries_crc = data_extents[i].entries_crc;
+    }
+    directory->extents_crc = compute_crc(directory->extents,
+        sizeof(lba_checkpoint_extent_entry_t) * data_extents.size());
+
+    extent_t *extent = new extent_t(em, file);
+    extent->append(buffer.get(), directory_size, io_account);
+    co_sync_extent(extent);
+
+    directory_extent = extent;
+    directory_offset = extent->extent_ref.offset();
+}
+
+bool lba_checkpoint_t::is_complete() const {
+    return directory_extent != NULL;
+}
+
+bool lba_checkpoint_t::read(in_memory_index_t *index) {
+    rassert(is_complete());
+    if (!has_valid_positions()) {
+        return true;
+    }
+    if (!directory_ok) {
+        return false;
+    }
+
+    // Keep several extent reads in flight, staying under LBA_READ_BUFFER_SIZE.
+    const size_t read_size = em->extent_size;
+    const size_t max_reads_in_flight = std::max<size_t>(LBA_READ_BUFFER_SIZE / read_size, 1);
+    std::vector<scoped_ptr_t<checkpoint_extent_read_t> > reads(data_extents.size());
+    size_t next_read = 0;
+    bool ok = true;
+
+    for (size_t i = 0; i < data_extents.size(); ++i) {
+        while (next_read < data_extents.size() && next_read < i + max_reads_in_flight) {
+            const data_extent_t &e = data_extents[next_read];
+            reads[next_read].init(new checkpoint_extent_read_t(read_size));
+            e.extent->read(0, e.extent->amount_filled, reads[next_read]->buffer.get(),
+                           reads[next_read].get());
+            ++next_read;
+        }
+
+        reads[i]->done.wait();
+
+        // Once something is wrong we keep going only to wait for the reads that
+        // are still in flight.
+        const lba_extent_t *extent_buffer
+            = reinterpret_cast<const lba_extent_t *>(reads[i]->buffer.get());
+        const size_t entries_size = sizeof(lba_entry_t) * data_extents[i].entries_count;
+        if (ok && (memcmp(extent_buffer->header.magic, lba_checkpoint_magic,
+                          LBA_CHECKPOINT_MAGIC_SIZE) != 0
+                   || compute_crc(extent_buffer->entries, entries_size)
+                      != data_extents[i].entries_crc)) {
+            ok = false;
+        }
+
+        if (ok) {
+            for (int32_t j = 0; j < data_extents[i].entries_count; ++j) {
+                const lba_entry_t *e = &extent_buffer->entries[j];
+                if (positions[e->block_id % LBA_SHARD_FACTOR].is_valid()) {
+                    index->set_block_info(e->block_id, e->recency, e->offset,
+                                          e->ser_block_size,
+                                          e->uncompressed_ser_block_size);
+                }
+            }
+        }
+
+        reads[i].reset();
+    }
+
+    return ok;
+}
+
+lba_shard_position_t lba_checkpoint_t::get_position(int shard) const {
+    rassert(shard >= 0 && shard < LBA_SHARD_FACTOR);
+    return positions[shard];
+}
+
+void lba_checkpoint_t::invalidate_position(int shard) {
+    rassert(shard >= 0 && shard < LBA_SHARD_FACTOR);
+    positions[shard] = lba_shard_position_t::invalid();
+}
+
+void lba_checkpoint_t::on_leading_extents_dropped(int shard, int count) {
+    rassert(shard >= 0 && shard < LBA_SHARD_FACTOR);
+    rassert(positions[shard].is_valid() && positions[shard].extent_index >= count);
+    positions[shard].extent_index -= count;
+}
+
+bool lba_checkpoint_t::has_valid_positions() const {
+    for (int i = 0; i < LBA_SHARD_FACTOR; ++i) {
+        if (positions[i].is_valid()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void lba_checkpoint_t::destroy(extent_transaction_t *txn) {
+    for (size_t i = 0; i < data_extents.size(); ++i) {
+        data_extents[i].extent->destroy(txn);
+    }
+    if (directory_extent) {
+        directory_extent->destroy(txn);
+    }
+    delete this;
+}
+
+void lba_checkpoint_t::shutdown() {
+    for (size_t i = 0; i < data_extents.size(); ++i) {
+        data_extents[i].extent->shutdown();
+    }
+    if (directory_extent) {
+        directory_extent->shutdown();
+    }
+    delete this;
+}
@@ -0,0 +1,96 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#ifndef SERIALIZER_LOG_LBA_CHECKPOINT_HPP_
+#define SERIALIZER_LOG_LBA_CHECKPOINT_HPP_
+
+#include <vector>
+
+#include "arch/types.hpp"
+#include "serializer/log/extent_manager.hpp"
+#include "serializer/log/lba/disk_format.hpp"
+#include "serializer/log/lba/extent.hpp"
+#include "serializer/log/lba/in_memory_index.hpp"
+
+/* An LBA checkpoint is a compact copy of the in-memory index, written every so often
+so that startup doesn't have to replay the whole LBA. It remembers how far into each
+shard's LBA it was started; at startup it is loaded first, and then only the LBA
+entries written after those positions are replayed on top of it.
+
+A checkpoint is written a few extents at a time while the serializer keeps running,
+so it isn't a snapshot of any single moment. That's fine: a block that changes after
+the checkpoint was started has an LBA entry after the checkpoint's positions, and
+that entry will be replayed over whatever the checkpoint recorded for it.
+
+The metablock refers to the newest complete checkpoint and to the one before it.
+When a checkpoint completes, the LBA extents before the positions of the one before
+it are dropped, so the previous checkpoint is the only copy of the entries it
+covers; but the newest one isn't, and if it turns out to be corrupted startup falls
+back to the previous one and replays more of the LBA. If a shard's LBA is garbage
+collected, the checkpoints' positions in it become invalid and that shard is read
+in full instead. */
+
+class lba_checkpoint_t {
+public:
+    // Starts a new checkpoint, taken at `positions`
+    lba_checkpoint_t(extent_manager_t *em, file_t *file,
+                     const lba_shard_position_t positions[LBA_SHARD_FACTOR]);
+
+    // Reads the directory of the checkpoint that `metablock` refers to and reserves
+    // its extents. Blocks. If the directory is corrupted, `read` will fail.
+    static lba_checkpoint_t *load(extent_manager_t *em, file_t *file,
+                                  const lba_checkpoint_metablock_t *metablock);
+
+    static void prepare_initial_metablock(lba_checkpoint_metablock_t *mb_out);
+    void prepare_metablock(lba_checkpoint_metablock_t *mb_out);
+
+    // Writes the live entries of `index` for blocks from `*next_block_id` onwards into
+    // a new extent, until the extent is full or `end_block_id` is reached, and
+    // advances `*next_block_id`. Blocks until the extent is on disk.
+    void write_extent(in_memory_index_t *index, block_id_t *next_block_id,
+                      block_id_t end_block_id, file_account_t *io_account);
+    // Writes the directory, after which the checkpoint is complete. Blocks.
+    void write_directory(file_account_t *io_account);
+    bool is_complete() const;
+
+    // Loads the checkpoint's entries into `index`, except for the shards whose
+    // positions are invalid. Blocks. Returns false if the directory or an extent
+    // fails its checksum; `index` may have been partly updated by then.
+    MUST_USE bool read(in_memory_index_t *index);
+
+    lba_shard_position_t get_position(int shard) const;
+    // Called when the shard's LBA gets garbage collected
+    void invalidate_position(int shard);
+    // Called when the first `count` extents of the shard's LBA are dropped
+    void on_leading_extents_dropped(int shard, int count);
+    bool has_valid_positions() const;
+
+    void destroy(extent_transaction_t *txn);   // Delete both in memory and on disk
+    void shutdown();   // Delete just in memory
+
+private:
+    lba_checkpoint_t(extent_manager_t *em, file_t *file);
+    ~lba_checkpoint_t();   // Use destroy() or shutdown() instead
+
+    int entries_per_extent() const;
+
+    struct data_extent_t {
+        extent_t *extent;
+        int32_t entries_count;
+        uint32_t entries_crc;
+    };
+
+    extent_manager_t *const em;
+    file_t *const file;
+
+    lba_shard_position_t positions[LBA_SHARD_FACTOR];
+    std::vector<data_extent_t> data_extents;
+
+    // NULL until the directory has been written
+    extent_t *directory_extent;
+    int64_t directory_offset;
+    // False if `load` found the directory to be corrupted
+    bool directory_ok;
+
+    DISABLE_COPYING(lba_checkpoint_t);
+};
+
+#endif  // SERIALIZER_LOG_LBA_CHECKPOINT_HPP_
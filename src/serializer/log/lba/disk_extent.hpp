@@ -35,7 +35,8 @@ public:
     /* To read from an LBA on disk, first call read_step_1(), passing it the address of a
     new read_info_t structure. When it calls the callback you provide, then call
     read_step_2() with the same read_info_t as before and with a pointer to the
-    in_memory_index_t to be filled with data. */
+    in_memory_index_t to be filled with data. read_step_2() skips the first
+    `entries_to_skip` entries of the extent. */
 
     struct read_info_t {
         void *buffer;
@@ -43,7 +44,7 @@ public:
     };
 
     void read_step_1(read_info_t *info_out, extent_t::read_callback_t *cb);
-    void read_step_2(read_info_t *info, in_memory_index_t *index);
+    void read_step_2(read_info_t *info, in_memory_index_t *index, int entries_to_skip = 0);
 
     /* destroy() deletes the structure in memory and also tells the extent manager that the extent
     can be safely reused */
@@ -62,26 +62,26 @@ static const block_id_t PADDING_BLOCK_ID = NULL_BLOCK_ID;
 struct lba_entry_t {
     block_id_t block_id;
 
+    // The number of bytes the block takes up on disk.
     uint32_t ser_block_size;
 
-    // TODO: Remove the need for these fields (or this zero field).  Remove the
-    // requirement that lba_entry_t be a divisor of DEVICE_BLOCK_SIZE.  When doing
-    // so, be sure to make lba entries backwards compatiblizable for now.  (We could
-    // in the future use this value being non-zero to mean the lba entry is a
-    // new-style entry.)
-    uint32_t zero2;
+    // If the block is stored compressed, the size it decompresses to; otherwise
+    // zero.  (This used to be an always-zero padding field, so older entries read
+    // as uncompressed blocks.)
+    uint32_t uncompressed_ser_block_size;
 
     repli_timestamp_t recency;
     // An offset into the file, with is_delete set appropriately.
     flagged_off64_t offset;
 
     static lba_entry_t make(block_id_t block_id, repli_timestamp_t recency,
-                            flagged_off64_t offset, uint32_t ser_block_size) {
+                            flagged_off64_t offset, uint32_t ser_block_size,
+                            uint32_t uncompressed_ser_block_size) {
         guarantee(ser_block_size != 0 || !offset.has_value());
         lba_entry_t entry;
         entry.block_id = block_id;
         entry.ser_block_size = ser_block_size;
-        entry.zero2 = 0;
+        entry.uncompressed_ser_block_size = uncompressed_ser_block_size;
         entry.recency = recency;
         entry.offset = offset;
         return entry;
@@ -92,7 +92,7 @@ struct lba_entry_t {
     }
 
     static lba_entry_t make_padding_entry() {
-        return make(PADDING_BLOCK_ID, repli_timestamp_t::invalid, flagged_off64_t::padding(), 0);
+        return make(PADDING_BLOCK_ID, repli_timestamp_t::invalid, flagged_off64_t::padding(), 0, 0);
     }
 } __attribute__((__packed__));
 
@@ -112,8 +112,52 @@ struct lba_shard_metablock_t {
     int32_t padding2;
 };
 
+/* A position in a shard's LBA: the index of an extent, counting the superblock's
+ * extents first and then the last extent, and a number of entries in that extent.
+ * An extent_index of -1 means that the position is no longer meaningful because
+ * the shard's LBA has been garbage collected. */
+struct lba_shard_position_t {
+    int32_t extent_index;
+    int32_t entries_count;
+
+    bool is_valid() const {
+        return extent_index >= 0;
+    }
+
+    static lba_shard_position_t beginning() {
+        lba_shard_position_t ret;
+        ret.extent_index = 0;
+        ret.entries_count = 0;
+        return ret;
+    }
+
+    static lba_shard_position_t invalid() {
+        lba_shard_position_t ret;
+        ret.extent_index = -1;
+        ret.entries_count = 0;
+        return ret;
+    }
+};
+
+struct lba_checkpoint_metablock_t {
+    /* Reference to the checkpoint's directory and the number of extents it
+     * lists. The directory offset is NULL_OFFSET if there is no checkpoint. */
+    int64_t directory_offset;
+    int32_t extents_count;
+    int32_t padding;
+
+    /* How far into each shard's LBA the checkpoint was taken. At startup only
+     * the entries after these positions are replayed on top of the checkpoint. */
+    lba_shard_position_t shards[LBA_SHARD_FACTOR];
+};
+
 struct lba_metablock_mixin_t {
     lba_shard_metablock_t shards[LBA_SHARD_FACTOR];
+    /* The newest complete checkpoint, and the one before it. Only the LBA extents
+     * that the previous checkpoint covers get dropped, so if the newest checkpoint
+     * turns out to be corrupted we can start from the previous one instead. */
+    lba_checkpoint_metablock_t checkpoint;
+    lba_checkpoint_metablock_t previous_checkpoint;
     
     /* Note that inline_lba_entries is not sharded into LBA_SHARD_FACTOR shards.
      * Instead it contains entries from all shards. Sharding is not necessary
@@ -184,5 +228,35 @@ struct lba_superblock_t {
 
 
 
+#define LBA_CHECKPOINT_MAGIC_SIZE 8
+static const char lba_checkpoint_magic[LBA_CHECKPOINT_MAGIC_SIZE] = {'l', 'b', 'a', 'c', 'h', 'k', 'p', 't'};
+
+/* A checkpoint's entries are stored in extents laid out like `lba_extent_t`, with
+ * `lba_checkpoint_magic` in the header and no padding or deletion entries. */
+
+struct lba_checkpoint_extent_entry_t {
+    int64_t offset;
+    int32_t entries_count;
+    // CRC of the extent's entries
+    uint32_t entries_crc;
+};
+
+struct lba_checkpoint_directory_t {
+    char magic[LBA_CHECKPOINT_MAGIC_SIZE];
+    int32_t extents_count;
+    // CRC of `extents`
+    uint32_t extents_crc;
+
+    lba_checkpoint_extent_entry_t extents[0];
+
+    static int64_t extents_count_to_file_size(int64_t nextents) {
+        return ceil_aligned(offsetof(lba_checkpoint_directory_t, extents[0])
+                            + sizeof(lba_checkpoint_extent_entry_t) * nextents,
+                            DEVICE_BLOCK_SIZE);
+    }
+};
+
+
+
 #endif  // SERIALIZER_LOG_LBA_DISK_FORMAT_HPP_
 
@@ -64,6 +64,7 @@ void lba_disk_structure_t::on_extent_read() {
 
 void lba_disk_structure_t::add_entry(block_id_t block_id, repli_timestamp_t recency,
                                      flagged_off64_t offset, uint32_t ser_block_size,
+                                     uint32_t uncompressed_ser_block_size,
                                      file_account_t *io_account, extent_transaction_t *txn) {
     if (last_extent && last_extent->full()) {
         /* We have filled up an extent. Transfer it to the superblock. */
@@ -71,48 +72,77 @@ void lba_disk_structure_t::add_entry(block_id_t block_id, repli_timestamp_t rece
         extents_in_superblock.push_back(last_extent);
         last_extent = NULL;
 
-        /* Since there is a new extent on the superblock, we need to rewrite the superblock. Make
-        sure that the superblock extent has enough room for a new superblock. */
+        /* Since there is a new extent on the superblock, we need to rewrite the superblock. */
+        write_superblock(io_account, txn);
+    }
 
-        size_t superblock_size = sizeof(lba_superblock_t) + sizeof(lba_superblock_entry_t) * extents_in_superblock.size();
-        rassert(superblock_size <= em->extent_size);
+    if (!last_extent) {
+        last_extent = new lba_disk_extent_t(em, file, io_account);
+    }
 
-        if (superblock_extent && superblock_extent->amount_filled + superblock_size > em->extent_size) {
-            superblock_extent->destroy(txn);
-            superblock_extent = NULL;
-        }
+    rassert(!last_extent->full());
 
-        if (!superblock_extent) {
-            superblock_extent = new extent_t(em, file);
-        }
+    last_extent->add_entry(lba_entry_t::make(block_id, recency, offset, ser_block_size,
+                                             uncompressed_ser_block_size),
+                           io_account);
+}
 
-        /* Prepare the new superblock. */
+void lba_disk_structure_t::write_superblock(file_account_t *io_account, extent_transaction_t *txn) {
+    /* Make sure that the superblock extent has enough room for a new superblock. */
 
-        scoped_malloc_t<char> buffer(ceil_aligned(superblock_size, DEVICE_BLOCK_SIZE));
-        bzero(buffer.get(), ceil_aligned(superblock_size, DEVICE_BLOCK_SIZE));
+    size_t superblock_size = sizeof(lba_superblock_t) + sizeof(lba_superblock_entry_t) * extents_in_superblock.size();
+    rassert(superblock_size <= em->extent_size);
 
-        lba_superblock_t *new_superblock = reinterpret_cast<lba_superblock_t *>(buffer.get());
-        memcpy(new_superblock->magic, lba_super_magic, LBA_SUPER_MAGIC_SIZE);
-        int i = 0;
-        for (lba_disk_extent_t *e = extents_in_superblock.head(); e; e = extents_in_superblock.next(e)) {
-            new_superblock->entries[i].offset = e->data->extent_ref.offset();
-            new_superblock->entries[i].lba_entries_count = e->count;
-            i++;
-        }
+    if (superblock_extent && superblock_extent->amount_filled + superblock_size > em->extent_size) {
+        superblock_extent->destroy(txn);
+        superblock_extent = NULL;
+    }
+
+    if (!superblock_extent) {
+        superblock_extent = new extent_t(em, file);
+    }
 
-        /* Write the new superblock */
+    /* Prepare the new superblock. */
 
-        superblock_offset = superblock_extent->extent_ref.offset() + superblock_extent->amount_filled;
-        superblock_extent->append(buffer.get(), ceil_aligned(superblock_size, DEVICE_BLOCK_SIZE), io_account);
+    scoped_malloc_t<char> buffer(ceil_aligned(superblock_size, DEVICE_BLOCK_SIZE));
+    bzero(buffer.get(), ceil_aligned(superblock_size, DEVICE_BLOCK_SIZE));
+
+    lba_superblock_t *new_superblock = reinterpret_cast<lba_superblock_t *>(buffer.get());
+    memcpy(new_superblock->magic, lba_super_magic, LBA_SUPER_MAGIC_SIZE);
+    int i = 0;
+    for (lba_disk_extent_t *e = extents_in_superblock.head(); e; e = extents_in_superblock.next(e)) {
+        new_superblock->entries[i].offset = e->data->extent_ref.offset();
+        new_superblock->entries[i].lba_entries_count = e->count;
+        i++;
     }
 
-    if (!last_extent) {
-        last_extent = new lba_disk_extent_t(em, file, io_account);
+    /* Write the new superblock */
+
+    superblock_offset = superblock_extent->extent_ref.offset() + superblock_extent->amount_filled;
+    superblock_extent->append(buffer.get(), ceil_aligned(superblock_size, DEVICE_BLOCK_SIZE), io_account);
+}
+
+void lba_disk_structure_t::drop_leading_extents(int count, file_account_t *io_account,
+                                                extent_transaction_t *txn) {
+    rassert(count >= 0 && count <= static_cast<int>(extents_in_superblock.size()));
+    if (count == 0) {
+        return;
     }
 
-    rassert(!last_extent->full());
+    for (int i = 0; i < count; ++i) {
+        lba_disk_extent_t *e = extents_in_superblock.head();
+        extents_in_superblock.remove(e);
+        e->destroy(txn);
+    }
 
-    last_extent->add_entry(lba_entry_t::make(block_id, recency, offset, ser_block_size), io_account);
+    if (extents_in_superblock.size() == 0) {
+        if (superblock_extent) {
+            superblock_extent->destroy(txn);
+            superblock_extent = NULL;
+        }
+    } else {
+        write_superblock(io_account, txn);
+    }
 }
 
 class lba_writer_t :
@@ -170,6 +200,7 @@ struct reader_t
         reader_t *parent;   // Our reader_t that we were created by
         int index;   // parent->readers[index] = this
         lba_disk_extent_t *extent;   // The extent we are supposed to read
+        int entries_to_skip;   // How many of its entries were already read before
         lba_disk_extent_t::read_info_t read_info;   // Opaque data used by extent_t::read()
         bool have_read;   // true if our extent has been loaded from disk
 
@@ -179,8 +210,8 @@ struct reader_t
         and the LBA would be corrupted. */
         bool prev_done;
 
-        extent_reader_t(reader_t *p, lba_disk_extent_t *e)
-            : parent(p), extent(e), have_read(false)
+        extent_reader_t(reader_t *p, lba_disk_extent_t *e, int skip)
+            : parent(p), extent(e), entries_to_skip(skip), have_read(false)
         {
             index = parent->readers.size();
             parent->readers.push_back(this);
@@ -207,7 +238,7 @@ struct reader_t
             if (have_read) done();
         }
         void done() {
-            extent->read_step_2(&read_info, parent->index);
+            extent->read_step_2(&read_info, parent->index, entries_to_skip);
             parent->active_readers--;
             parent->start_more_readers();
             if (index == static_cast<int>(parent->readers.size()) - 1) {
@@ -226,13 +257,16 @@ struct reader_t
     // reading process so that we stay under LBA_READ_BUFFER_SIZE.
     int active_readers;
 
-    reader_t(lba_disk_structure_t *_ds, in_memory_index_t *_index, lba_disk_structure_t::read_callback_t *cb)
+    reader_t(lba_disk_structure_t *_ds, in_memory_index_t *_index, lba_disk_structure_t::read_callback_t *cb,
+             lba_shard_position_t start)
         : ds(_ds), index(_index), rcb(cb)
     {
+        rassert(start.is_valid());
+        int extent_index = 0;
         for (lba_disk_extent_t *e = ds->extents_in_superblock.head(); e; e = ds->extents_in_superblock.next(e)) {
-            new extent_reader_t(this, e);
+            consider_extent(e, extent_index++, start);
         }
-        if (ds->last_extent) new extent_reader_t(this, ds->last_extent);
+        if (ds->last_extent) consider_extent(ds->last_extent, extent_index, start);
 
         /* The constructor for extent_reader_t pushed them onto our 'readers' vector. So now we
         have a vector with an extent_reader_t object for each extent we need to read, but none
@@ -247,6 +281,14 @@ struct reader_t
         }
     }
 
+    void consider_extent(lba_disk_extent_t *e, int extent_index, lba_shard_position_t start) {
+        if (extent_index > start.extent_index) {
+            new extent_reader_t(this, e, 0);
+        } else if (extent_index == start.extent_index && e->count > start.entries_count) {
+            new extent_reader_t(this, e, start.entries_count);
+        }
+    }
+
     void start_more_readers() {
         int limit = std::max<int>(LBA_READ_BUFFER_SIZE / ds->em->extent_size / LBA_SHARD_FACTOR, 1);
         while (next_reader != static_cast<int>(readers.size()) && active_readers < limit) {
@@ -260,8 +302,35 @@ struct reader_t
     }
 };
 
-void lba_disk_structure_t::read(in_memory_index_t *index, read_callback_t *cb) {
-    new reader_t(this, index, cb);
+void lba_disk_structure_t::read(in_memory_index_t *index, read_callback_t *cb,
+                                lba_shard_position_t start) {
+    new reader_t(this, index, cb, start);
+}
+
+lba_shard_position_t lba_disk_structure_t::current_position() {
+    lba_shard_position_t pos;
+    pos.extent_index = extents_in_superblock.size();
+    pos.entries_count = last_extent ? last_extent->count : 0;
+    return pos;
+}
+
+int64_t lba_disk_structure_t::count_entries_since(lba_shard_position_t start) {
+    rassert(start.is_valid());
+    int64_t count = 0;
+    int extent_index = 0;
+    for (lba_disk_extent_t *e = extents_in_superblock.head(); e; e = extents_in_superblock.next(e)) {
+        if (extent_index >= start.extent_index) {
+            count += e->count;
+        }
+        ++extent_index;
+    }
+    if (last_extent && extent_index >= start.extent_index) {
+        count += last_extent->count;
+    }
+    if (start.extent_index < extent_index + (last_extent ? 1 : 0)) {
+        count -= start.entries_count;
+    }
+    return count;
 }
 
 void lba_disk_structure_t::prepare_metablock(lba_shard_metablock_t *mb_out) {
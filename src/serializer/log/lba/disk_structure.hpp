@@ -31,6 +31,7 @@ public:
     // Put entries in an LBA and then call sync() to write to disk
     void add_entry(block_id_t block_id, repli_timestamp_t recency,
                    flagged_off64_t offset, uint32_t ser_block_size,
+                   uint32_t uncompressed_ser_block_size,
                    file_account_t *io_account,
                    extent_transaction_t *txn);
     struct sync_callback_t {
@@ -40,12 +41,22 @@ public:
     void sync(file_account_t *io_account, sync_callback_t *cb);
 
     // If you call read(), then the in_memory_index_t will be populated and then the read_callback_t
-    // will be called when it is done.
+    // will be called when it is done. If `start` is given, only the entries written after that
+    // position are read.
     struct read_callback_t {
         virtual void on_lba_extents_read() = 0;
         virtual ~read_callback_t() {}
     };
-    void read(in_memory_index_t *index, read_callback_t *cb);
+    void read(in_memory_index_t *index, read_callback_t *cb,
+              lba_shard_position_t start = lba_shard_position_t::beginning());
+
+    // The position just after the last entry added so far
+    lba_shard_position_t current_position();
+    // The number of entries that read() would read if started at `start`
+    int64_t count_entries_since(lba_shard_position_t start);
+
+    // Destroys the first `count` extents, whose entries are covered by a checkpoint now.
+    void drop_leading_extents(int count, file_account_t *io_account, extent_transaction_t *txn);
 
     void prepare_metablock(lba_shard_metablock_t *mb_out);
 
@@ -63,6 +74,8 @@ public:
     lba_disk_extent_t *last_extent;
 
 private:
+    void write_superblock(file_account_t *io_account, extent_transaction_t *txn);
+
     /* Used during the startup process */
     void on_extent_read();
     load_callback_t *start_callback;
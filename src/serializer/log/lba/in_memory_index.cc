@@ -20,12 +20,13 @@ index_block_info_t in_memory_index_t::get_block_info(block_id_t id) {
 }
 
 void in_memory_index_t::set_block_info(block_id_t id, repli_timestamp_t recency,
-                                       flagged_off64_t offset, uint32_t ser_block_size) {
+                                       flagged_off64_t offset, uint32_t ser_block_size,
+                                       uint32_t uncompressed_ser_block_size) {
     if (id >= end_block_id_) {
         end_block_id_ = id + 1;
     }
 
-    index_block_info_t info(offset, recency, ser_block_size);
+    index_block_info_t info(offset, recency, ser_block_size, uncompressed_ser_block_size);
     infos_.set(id, info);
 }
 
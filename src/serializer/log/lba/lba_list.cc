@@ -1,18 +1,27 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "serializer/log/lba/lba_list.hpp"
 
+#include <algorithm>
+
 #include "utils.hpp"
+#include <boost/bind.hpp>
+
 #include "serializer/log/lba/disk_format.hpp"
 #include "arch/arch.hpp"
+#include "arch/runtime/coroutines.hpp"
+#include "logger.hpp"
 #include "perfmon/perfmon.hpp"
 #include "serializer/log/stats.hpp"
 
 // TODO: Some of the code in this file is bullshit disgusting shit.
 
-lba_list_t::lba_list_t(extent_manager_t *em)
-    : shutdown_callback(NULL), gc_count(0), extent_manager(em),
+lba_list_t::lba_list_t(extent_manager_t *em, const log_serializer_dynamic_config_t *_dynamic_config)
+    : shutdown_callback(NULL), gc_count(0), checkpoint_writer_running(false),
+      extent_manager(em), dynamic_config(_dynamic_config),
       state(state_unstarted),
-      inline_lba_entries_count(0)
+      inline_lba_entries_count(0),
+      checkpoint(NULL), previous_checkpoint(NULL), pending_checkpoint(NULL),
+      corrupted_checkpoint(NULL)
 {
     for (int i = 0; i < LBA_SHARD_FACTOR; i++) disk_structures[i] = NULL;
 }
@@ -25,6 +34,8 @@ void lba_list_t::prepare_initial_metablock(metablock_mixin_t *mb_out) {
         mb_out->shards[i].last_lba_extent_offset = NULL_OFFSET;
         mb_out->shards[i].last_lba_extent_entries_count = 0;
     }
+    lba_checkpoint_t::prepare_initial_metablock(&mb_out->checkpoint);
+    lba_checkpoint_t::prepare_initial_metablock(&mb_out->previous_checkpoint);
     mb_out->inline_lba_entries_count = 0;
     memset(mb_out->inline_lba_entries,
            0,
@@ -35,6 +46,16 @@ void lba_list_t::prepare_metablock(metablock_mixin_t *mb_out) {
     for (int i = 0; i < LBA_SHARD_FACTOR; i++) {
         disk_structures[i]->prepare_metablock(&mb_out->shards[i]);
     }
+    if (checkpoint) {
+        checkpoint->prepare_metablock(&mb_out->checkpoint);
+    } else {
+        lba_checkpoint_t::prepare_initial_metablock(&mb_out->checkpoint);
+    }
+    if (previous_checkpoint) {
+        previous_checkpoint->prepare_metablock(&mb_out->previous_checkpoint);
+    } else {
+        lba_checkpoint_t::prepare_initial_metablock(&mb_out->previous_checkpoint);
+    }
     rassert(inline_lba_entries_count <= LBA_NUM_INLINE_ENTRIES);
     mb_out->inline_lba_entries_count = inline_lba_entries_count;
     memcpy(mb_out->inline_lba_entries,
@@ -55,8 +76,12 @@ public:
     lba_list_t *owner;
     lba_list_t::ready_callback_t *callback;
 
+    lba_checkpoint_metablock_t checkpoint_metablock;
+    lba_checkpoint_metablock_t previous_checkpoint_metablock;
+
     lba_start_fsm_t(lba_list_t *l, lba_list_t::metablock_mixin_t *last_metablock)
-        : owner(l), callback(NULL)
+        : owner(l), callback(NULL), checkpoint_metablock(last_metablock->checkpoint),
+          previous_checkpoint_metablock(last_metablock->previous_checkpoint)
     {
         rassert(owner->state == lba_list_t::state_unstarted);
         owner->state = lba_list_t::state_starting_up;
@@ -81,8 +106,66 @@ public:
         rassert(cbs_out > 0);
         cbs_out--;
         if (cbs_out == 0) {
-            cbs_out = LBA_SHARD_FACTOR;
-            for (int i = 0; i < LBA_SHARD_FACTOR; i++) {
+            if (checkpoint_metablock.directory_offset != NULL_OFFSET
+                || previous_checkpoint_metablock.directory_offset != NULL_OFFSET) {
+                coro_t::spawn_sometime(boost::bind(&lba_start_fsm_t::load_checkpoints, this));
+            } else {
+                read_extents();
+            }
+        }
+    }
+
+    void load_checkpoints() {
+        if (checkpoint_metablock.directory_offset != NULL_OFFSET) {
+            owner->checkpoint = lba_checkpoint_t::load(
+                owner->extent_manager, owner->dbfile, &checkpoint_metablock);
+        }
+        if (previous_checkpoint_metablock.directory_offset != NULL_OFFSET) {
+            owner->previous_checkpoint = lba_checkpoint_t::load(
+                owner->extent_manager, owner->dbfile, &previous_checkpoint_metablock);
+        }
+
+        if (owner->checkpoint && !owner->checkpoint->read(&owner->in_memory_index)) {
+            /* The LBA extents that the newest checkpoint covers are still there, so
+            we can replay them on top of the previous checkpoint instead. That also
+            overwrites whatever the corrupted checkpoint put into the index before we
+            noticed, because every block it has an entry for either hasn't changed
+            since the previous checkpoint was started or has a newer entry in the LBA.
+            If there is no previous checkpoint, no LBA extents have been dropped, and
+            we replay the whole LBA. */
+            logWRN("The newest LBA checkpoint is corrupted. Starting from the one "
+                   "before it instead.");
+            owner->corrupted_checkpoint = owner->checkpoint;
+            owner->checkpoint = NULL;
+            if (owner->previous_checkpoint
+                && !owner->previous_checkpoint->read(&owner->in_memory_index)) {
+                fail_due_to_user_error("Both LBA checkpoints of the data file are "
+                                       "corrupted, so its block index can't be "
+                                       "restored. Restore the data from a replica or "
+                                       "a backup.");
+            }
+        } else if (!owner->checkpoint && owner->previous_checkpoint) {
+            // The newest checkpoint was found to be corrupted in an earlier run.
+            if (!owner->previous_checkpoint->read(&owner->in_memory_index)) {
+                fail_due_to_user_error("The LBA checkpoint of the data file is "
+                                       "corrupted, so its block index can't be "
+                                       "restored. Restore the data from a replica or "
+                                       "a backup.");
+            }
+        }
+        read_extents();
+    }
+
+    void read_extents() {
+        // If there is a checkpoint, we only need the LBA entries that were written
+        // after it was started.
+        lba_checkpoint_t *loaded = owner->startup_checkpoint();
+        cbs_out = LBA_SHARD_FACTOR;
+        for (int i = 0; i < LBA_SHARD_FACTOR; i++) {
+            if (loaded && loaded->get_position(i).is_valid()) {
+                owner->disk_structures[i]->read(&owner->in_memory_index, this,
+                                                loaded->get_position(i));
+            } else {
                 owner->disk_structures[i]->read(&owner->in_memory_index, this);
             }
         }
@@ -101,7 +184,8 @@ public:
                         e->block_id,
                         e->recency,
                         e->offset,
-                        e->ser_block_size);
+                        e->ser_block_size,
+                        e->uncompressed_ser_block_size);
             }
             
             owner->state = lba_list_t::state_ready;
@@ -115,6 +199,7 @@ bool lba_list_t::start_existing(file_t *file, metablock_mixin_t *last_metablock,
     rassert(state == state_unstarted);
 
     dbfile = file;
+    checkpoint_io_account.init(new file_account_t(dbfile, LBA_CHECKPOINT_IO_PRIORITY));
 
     lba_start_fsm_t *starter = new lba_start_fsm_t(this, last_metablock);
     if (state == state_ready) {
@@ -140,24 +225,18 @@ flagged_off64_t lba_list_t::get_block_offset(block_id_t block) {
     return get_block_info(block).offset;
 }
 
-uint32_t lba_list_t::get_ser_block_size(block_id_t block) {
-    return get_block_info(block).ser_block_size;
-}
-
-block_size_t lba_list_t::get_block_size(block_id_t block) {
-    return block_size_t::unsafe_make(get_block_info(block).ser_block_size);
-}
-
 repli_timestamp_t lba_list_t::get_block_recency(block_id_t block) {
     return get_block_info(block).recency;
 }
 
 void lba_list_t::set_block_info(block_id_t block, repli_timestamp_t recency,
                                 flagged_off64_t offset, uint32_t ser_block_size,
+                                uint32_t uncompressed_ser_block_size,
                                 file_account_t *io_account, extent_transaction_t *txn) {
     rassert(state == state_ready);
 
-    in_memory_index.set_block_info(block, recency, offset, ser_block_size);
+    in_memory_index.set_block_info(block, recency, offset, ser_block_size,
+                                   uncompressed_ser_block_size);
 
     // If the inline LBA is full, free it up first by moving its entries to
     // the LBA extents
@@ -166,7 +245,7 @@ void lba_list_t::set_block_info(block_id_t block, repli_timestamp_t recency,
         rassert(!check_inline_lba_full());
     }
     // Then store the entry inline
-    add_inline_entry(block, recency, offset, ser_block_size);
+    add_inline_entry(block, recency, offset, ser_block_size, uncompressed_ser_block_size);
 }
 
 bool lba_list_t::check_inline_lba_full() const {
@@ -204,6 +283,7 @@ void lba_list_t::move_inline_entries_to_extents(file_account_t *io_account, exte
                 e.recency,
                 e.offset,
                 e.ser_block_size,
+                e.uncompressed_ser_block_size,
                 io_account,
                 txn);
     }
@@ -212,11 +292,13 @@ void lba_list_t::move_inline_entries_to_extents(file_account_t *io_account, exte
 }
 
 void lba_list_t::add_inline_entry(block_id_t block, repli_timestamp_t recency,
-                                flagged_off64_t offset, uint32_t ser_block_size) {
+                                flagged_off64_t offset, uint32_t ser_block_size,
+                                uint32_t uncompressed_ser_block_size) {
     
     rassert(!check_inline_lba_full());
     inline_lba_entries[inline_lba_entries_count++] =
-            lba_entry_t::make(block, recency, offset, ser_block_size);
+            lba_entry_t::make(block, recency, offset, ser_block_size,
+                              uncompressed_ser_block_size);
 }
 
 class lba_syncer_t :
@@ -294,12 +376,12 @@ public:
              id < end_id;
              id += LBA_SHARD_FACTOR) {
             block_id_t block_id = id;
-            flagged_off64_t off = owner->get_block_offset(block_id);
-            if (off.has_value()) {
-                uint32_t ser_block_size = owner->get_ser_block_size(block_id);
+            index_block_info_t info = owner->get_block_info(block_id);
+            if (info.offset.has_value()) {
                 owner->disk_structures[i]->add_entry(block_id,
-                                                     owner->get_block_recency(block_id),
-                                                     off, ser_block_size,
+                                                     info.recency,
+                                                     info.offset, info.ser_block_size,
+                                                     info.uncompressed_ser_block_size,
                                                      io_account, txn);
             }
         }
@@ -313,8 +395,7 @@ public:
         rassert(owner->gc_count > 0);
         owner->gc_count--;
 
-        if (owner->state == lba_list_t::state_shutting_down && owner->gc_count == 0)
-            owner->shutdown_now();
+        owner->maybe_finish_shutdown();
 
         delete this;
     }
@@ -323,6 +404,14 @@ public:
 // Decides, based on the number of unused entries.
 bool lba_list_t::we_want_to_gc(int i) {
 
+    // If a checkpoint covers the shard, then the LBA is kept small by dropping the extents that
+    // the checkpoint covers instead. GCing would only make the checkpoint useless for this shard.
+    if ((checkpoint && checkpoint->get_position(i).is_valid())
+        || (previous_checkpoint && previous_checkpoint->get_position(i).is_valid())
+        || (pending_checkpoint && pending_checkpoint->get_position(i).is_valid())) {
+        return false;
+    }
+
     // Don't count the extent we're currently writing to. If there is no superblock, then that
     // extent is the only one, so we don't want to GC obviously.
     if (disk_structures[i]->superblock_extent == NULL) {
@@ -349,15 +438,106 @@ bool lba_list_t::we_want_to_gc(int i) {
 }
 
 void lba_list_t::gc(int i, file_account_t *io_account, extent_transaction_t *txn) {
+    // The checkpoints' positions in the shard's old LBA mean nothing in the new one.
+    if (checkpoint) checkpoint->invalidate_position(i);
+    if (previous_checkpoint) previous_checkpoint->invalidate_position(i);
+    if (pending_checkpoint) pending_checkpoint->invalidate_position(i);
+
     new gc_fsm_t(this, i, io_account, txn);
 }
 
+void lba_list_t::consider_checkpoint(file_account_t *io_account, extent_transaction_t *txn) {
+    rassert(state == state_ready);
+
+    if (corrupted_checkpoint) {
+        // The metablock that this transaction writes doesn't refer to it anymore.
+        corrupted_checkpoint->destroy(txn);
+        corrupted_checkpoint = NULL;
+    }
+
+    if (pending_checkpoint && pending_checkpoint->is_complete()) {
+        /* Switch over to the new checkpoint. The metablock that this transaction writes will
+        refer to it and to the checkpoint before it, so the checkpoint before that and the
+        LBA extents that the (new) previous checkpoint covers can go away once that
+        metablock is on disk. If there is no `checkpoint` because it was corrupted, we keep
+        `previous_checkpoint`: the LBA extents that it covers are gone already. */
+        if (checkpoint) {
+            if (previous_checkpoint) previous_checkpoint->destroy(txn);
+            previous_checkpoint = checkpoint;
+        }
+        checkpoint = pending_checkpoint;
+        pending_checkpoint = NULL;
+        ++extent_manager->stats->pm_serializer_lba_checkpoints;
+
+        for (int i = 0; previous_checkpoint && i < LBA_SHARD_FACTOR; i++) {
+            lba_shard_position_t position = previous_checkpoint->get_position(i);
+            if (position.is_valid()) {
+                int count = std::min<int>(position.extent_index,
+                                          disk_structures[i]->extents_in_superblock.size());
+                disk_structures[i]->drop_leading_extents(count, io_account, txn);
+                previous_checkpoint->on_leading_extents_dropped(i, count);
+                checkpoint->on_leading_extents_dropped(i, count);
+            }
+        }
+    }
+
+    if (!pending_checkpoint && we_want_to_checkpoint()) {
+        lba_shard_position_t positions[LBA_SHARD_FACTOR];
+        for (int i = 0; i < LBA_SHARD_FACTOR; i++) {
+            positions[i] = disk_structures[i]->current_position();
+        }
+        pending_checkpoint = new lba_checkpoint_t(extent_manager, dbfile, positions);
+        checkpoint_writer_running = true;
+        coro_t::spawn_sometime(boost::bind(&lba_list_t::write_checkpoint, this,
+                                           pending_checkpoint, end_block_id()));
+    }
+}
+
+lba_checkpoint_t *lba_list_t::startup_checkpoint() {
+    return checkpoint ? checkpoint : previous_checkpoint;
+}
+
+int64_t lba_list_t::count_entries_to_replay() {
+    lba_checkpoint_t *loaded = startup_checkpoint();
+    int64_t count = 0;
+    for (int i = 0; i < LBA_SHARD_FACTOR; i++) {
+        if (loaded && loaded->get_position(i).is_valid()) {
+            count += disk_structures[i]->count_entries_since(loaded->get_position(i));
+        } else {
+            count += disk_structures[i]->count_entries_since(lba_shard_position_t::beginning());
+        }
+    }
+    return count;
+}
+
+bool lba_list_t::we_want_to_checkpoint() {
+    int64_t entries_to_replay = count_entries_to_replay();
+    return entries_to_replay >= dynamic_config->lba_checkpoint_min_entries
+        && entries_to_replay >= end_block_id() * dynamic_config->lba_checkpoint_replay_ratio;
+}
+
+void lba_list_t::write_checkpoint(lba_checkpoint_t *cp, block_id_t end_id) {
+    rassert(checkpoint_writer_running);
+
+    // We stop early if we're shutting down; the unfinished checkpoint is just dropped.
+    block_id_t next_id = 0;
+    while (next_id < end_id && state == state_ready) {
+        cp->write_extent(&in_memory_index, &next_id, end_id, checkpoint_io_account.get());
+    }
+    if (state == state_ready) {
+        cp->write_directory(checkpoint_io_account.get());
+    }
+
+    checkpoint_writer_running = false;
+    maybe_finish_shutdown();
+}
+
 bool lba_list_t::shutdown(shutdown_callback_t *cb) {
     rassert(state == state_ready);
     rassert(cb);
 
-    if (gc_count > 0) {
-        // We're gc'ing, can't shut down just yet...
+    if (gc_count > 0 || checkpoint_writer_running) {
+        // We're gc'ing or writing a checkpoint, can't shut down just yet...
         state = state_shutting_down;
         shutdown_callback = cb;
         return false;
@@ -367,12 +547,36 @@ bool lba_list_t::shutdown(shutdown_callback_t *cb) {
     }
 }
 
+void lba_list_t::maybe_finish_shutdown() {
+    if (state == state_shutting_down && gc_count == 0 && !checkpoint_writer_running) {
+        shutdown_now();
+    }
+}
+
 bool lba_list_t::shutdown_now() {
     for (int i = 0; i < LBA_SHARD_FACTOR; i++) {
         disk_structures[i]->shutdown();   // Also deletes it
         disk_structures[i] = NULL;
     }
 
+    if (checkpoint) {
+        checkpoint->shutdown();
+        checkpoint = NULL;
+    }
+    if (previous_checkpoint) {
+        previous_checkpoint->shutdown();
+        previous_checkpoint = NULL;
+    }
+    if (corrupted_checkpoint) {
+        corrupted_checkpoint->shutdown();
+        corrupted_checkpoint = NULL;
+    }
+    if (pending_checkpoint) {
+        pending_checkpoint->shutdown();
+        pending_checkpoint = NULL;
+    }
+    checkpoint_io_account.reset();
+
     state = state_shut_down;
 
     if (shutdown_callback)
@@ -384,4 +588,6 @@ bool lba_list_t::shutdown_now() {
 lba_list_t::~lba_list_t() {
     rassert(state == state_unstarted || state == state_shut_down);
     for (int i = 0; i < LBA_SHARD_FACTOR; i++) rassert(disk_structures[i] == NULL);
+    rassert(checkpoint == NULL && previous_checkpoint == NULL);
+    rassert(pending_checkpoint == NULL && corrupted_checkpoint == NULL);
 }
@@ -4,6 +4,7 @@
 
 #include "serializer/serializer.hpp"
 #include "serializer/log/extent_manager.hpp"
+#include "serializer/log/lba/checkpoint.hpp"
 #include "serializer/log/lba/disk_format.hpp"
 #include "serializer/log/lba/in_memory_index.hpp"
 #include "serializer/log/lba/disk_structure.hpp"
@@ -21,7 +22,7 @@ class lba_list_t
 public:
     typedef lba_metablock_mixin_t metablock_mixin_t;
 
-    explicit lba_list_t(extent_manager_t *em);
+    lba_list_t(extent_manager_t *em, const log_serializer_dynamic_config_t *dynamic_config);
     ~lba_list_t();
 
     static void prepare_initial_metablock(metablock_mixin_t *mb_out);
@@ -37,8 +38,6 @@ public:
 
     // These return individual fields of get_block_info.
     flagged_off64_t get_block_offset(block_id_t block);
-    uint32_t get_ser_block_size(block_id_t block);
-    block_size_t get_block_size(block_id_t block);
     repli_timestamp_t get_block_recency(block_id_t block);
 
     /* Returns a block ID such that all blocks that exist are guaranteed to have IDs less than
@@ -53,6 +52,7 @@ public:
 
     void set_block_info(block_id_t block, repli_timestamp_t recency,
                         flagged_off64_t offset, uint32_t ser_block_size,
+                        uint32_t uncompressed_ser_block_size,
                         file_account_t *io_account,
                         extent_transaction_t *txn);
 
@@ -64,6 +64,10 @@ public:
 
     void consider_gc(file_account_t *io_account, extent_transaction_t *txn);
 
+    // Switches the metablock over to a newly finished checkpoint, and starts writing
+    // a new one if enough has been written to the LBA since the last.
+    void consider_checkpoint(file_account_t *io_account, extent_transaction_t *txn);
+
     struct shutdown_callback_t {
         virtual void on_lba_shutdown() = 0;
         virtual ~shutdown_callback_t() {}
@@ -73,9 +77,12 @@ public:
 private:
     shutdown_callback_t *shutdown_callback;
     int gc_count;   // Number of active GC fsms
+    bool checkpoint_writer_running;
     bool shutdown_now();
+    void maybe_finish_shutdown();
 
     extent_manager_t *const extent_manager;
+    const log_serializer_dynamic_config_t *const dynamic_config;
 
     enum state_t {
         state_unstarted,
@@ -98,7 +105,8 @@ private:
     bool check_inline_lba_full() const;
     void move_inline_entries_to_extents(file_account_t *io_account, extent_transaction_t *txn);
     void add_inline_entry(block_id_t block, repli_timestamp_t recency,
-                                flagged_off64_t offset, uint32_t ser_block_size);
+                                flagged_off64_t offset, uint32_t ser_block_size,
+                                uint32_t uncompressed_ser_block_size);
     
     lba_disk_structure_t *disk_structures[LBA_SHARD_FACTOR];
 
@@ -109,6 +117,24 @@ private:
     // gc. The integer is which shard to GC.
     bool we_want_to_gc(int i);
 
+    // The newest checkpoint that the metablock refers to, the one before it, and
+    // the one being written. Any of them can be NULL. If `checkpoint` was corrupted
+    // at startup, it is moved to `corrupted_checkpoint` until the next extent
+    // transaction frees it.
+    lba_checkpoint_t *checkpoint;
+    lba_checkpoint_t *previous_checkpoint;
+    lba_checkpoint_t *pending_checkpoint;
+    lba_checkpoint_t *corrupted_checkpoint;
+    scoped_ptr_t<file_account_t> checkpoint_io_account;
+
+    // The checkpoint that startup would load: `checkpoint`, or if there is none
+    // (because it was corrupted), `previous_checkpoint`. Can be NULL.
+    lba_checkpoint_t *startup_checkpoint();
+    // The number of entries that startup would have to replay from the LBA
+    int64_t count_entries_to_replay();
+    bool we_want_to_checkpoint();
+    void write_checkpoint(lba_checkpoint_t *cp, block_id_t end_id);
+
     DISABLE_COPYING(lba_list_t);
 };
 
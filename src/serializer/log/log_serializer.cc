@@ -12,6 +12,7 @@
 #include "buffer_cache/types.hpp"
 #include "logger.hpp"
 #include "perfmon/perfmon.hpp"
+#include "serializer/log/block_compression.hpp"
 #include "serializer/log/data_block_manager.hpp"
 
 filepath_file_opener_t::filepath_file_opener_t(const serializer_filepath_t &filepath,
@@ -116,6 +117,10 @@ log_serializer_stats_t::log_serializer_stats_t(perfmon_collection_t *parent)
       pm_serializer_block_writes(),
       pm_serializer_index_writes(secs_to_ticks(1)),
       pm_serializer_index_writes_size(secs_to_ticks(1), false),
+      pm_serializer_block_compressions(secs_to_ticks(1)),
+      pm_serializer_block_decompressions(secs_to_ticks(1)),
+      pm_serializer_bytes_before_compression(),
+      pm_serializer_bytes_after_compression(),
       pm_extents_in_use(),
       pm_bytes_in_use(),
       pm_serializer_lba_extents(),
@@ -124,9 +129,13 @@ log_serializer_stats_t::log_serializer_stats_t(perfmon_collection_t *parent)
       pm_serializer_data_extents_reclaimed(),
       pm_serializer_data_extents_gced(),
       pm_serializer_data_blocks_written(),
+      pm_serializer_data_bytes_written(),
+      pm_serializer_gc_bytes_written(),
+      pm_serializer_gc_extent_live_ratio(secs_to_ticks(60), false),
       pm_serializer_old_garbage_block_bytes(),
       pm_serializer_old_total_block_bytes(),
       pm_serializer_lba_gcs(),
+      pm_serializer_lba_checkpoints(),
       parent_collection_membership(parent, &serializer_collection, "serializer"),
       stats_membership(&serializer_collection,
           &pm_serializer_block_reads, "serializer_block_reads",
@@ -134,6 +143,10 @@ log_serializer_stats_t::log_serializer_stats_t(perfmon_collection_t *parent)
           &pm_serializer_block_writes, "serializer_block_writes",
           &pm_serializer_index_writes, "serializer_index_writes",
           &pm_serializer_index_writes_size, "serializer_index_writes_size",
+          &pm_serializer_block_compressions, "serializer_block_compressions",
+          &pm_serializer_block_decompressions, "serializer_block_decompressions",
+          &pm_serializer_bytes_before_compression, "serializer_bytes_before_compression",
+          &pm_serializer_bytes_after_compression, "serializer_bytes_after_compression",
           &pm_extents_in_use, "serializer_extents_in_use",
           &pm_bytes_in_use, "serializer_bytes_in_use",
           &pm_serializer_lba_extents, "serializer_lba_extents",
@@ -142,9 +155,13 @@ log_serializer_stats_t::log_serializer_stats_t(perfmon_collection_t *parent)
           &pm_serializer_data_extents_reclaimed, "serializer_data_extents_reclaimed",
           &pm_serializer_data_extents_gced, "serializer_data_extents_gced",
           &pm_serializer_data_blocks_written, "serializer_data_blocks_written",
+          &pm_serializer_data_bytes_written, "serializer_data_bytes_written",
+          &pm_serializer_gc_bytes_written, "serializer_gc_bytes_written",
+          &pm_serializer_gc_extent_live_ratio, "serializer_gc_extent_live_ratio",
           &pm_serializer_old_garbage_block_bytes, "serializer_old_garbage_block_bytes",
           &pm_serializer_old_total_block_bytes, "serializer_old_total_block_bytes",
           &pm_serializer_lba_gcs, "serializer_lba_gcs",
+          &pm_serializer_lba_checkpoints, "serializer_lba_checkpoints",
           NULLPTR)
 { }
 
@@ -239,7 +256,7 @@ struct ls_start_existing_fsm_t :
             }
 
             ser->metablock_manager = new mb_manager_t(ser->extent_manager);
-            ser->lba_index = new lba_list_t(ser->extent_manager);
+            ser->lba_index = new lba_list_t(ser->extent_manager, &ser->dynamic_config);
             ser->data_block_manager = new data_block_manager_t(&ser->dynamic_config, ser->extent_manager, ser, &ser->static_config, ser->stats.get());
 
             // STATE E
@@ -274,9 +291,9 @@ struct ls_start_existing_fsm_t :
         if (start_existing_state == state_reconstruct) {
             ser->data_block_manager->start_reconstruct();
             for (block_id_t id = 0; id < ser->lba_index->end_block_id(); id++) {
-                flagged_off64_t offset = ser->lba_index->get_block_offset(id);
-                if (offset.has_value()) {
-                    ser->data_block_manager->mark_live(offset.get_value(), ser->lba_index->get_block_size(id));
+                index_block_info_t info = ser->lba_index->get_block_info(id);
+                if (info.offset.has_value()) {
+                    ser->data_block_manager->mark_live(info.offset.get_value(), info.disk_block_size());
                 }
             }
             ser->data_block_manager->end_reconstruct();
@@ -413,12 +430,33 @@ void log_serializer_t::block_read(const counted_t<ls_block_token_pointee_t>& tok
     ticks_t pm_time;
     stats->pm_serializer_block_reads.begin(&pm_time);
 
-    data_block_manager->read(token->offset_, token->block_size().ser_value(),
-                             buf, io_account);
+    if (!token->is_compressed()) {
+        data_block_manager->read(token->offset_, token->block_size().ser_value(),
+                                 buf, io_account);
+    } else {
+        scoped_malloc_t<ser_buffer_t> disk_buf(
+            malloc_aligned(ceil_aligned(token->disk_block_size().ser_value(),
+                                        DEVICE_BLOCK_SIZE),
+                           DEVICE_BLOCK_SIZE));
+        data_block_manager->read(token->offset_, token->disk_block_size().ser_value(),
+                                 disk_buf.get(), io_account);
+        unpack_block(disk_buf.get(), token->disk_block_size(), token->block_size(), buf);
+    }
 
     stats->pm_serializer_block_reads.end(&pm_time);
 }
 
+void log_serializer_t::unpack_block(const ser_buffer_t *disk_buf, block_size_t disk_block_size,
+                                    block_size_t block_size, ser_buffer_t *buf_out) {
+    assert_thread();
+    if (disk_block_size == block_size) {
+        memcpy(buf_out, disk_buf, block_size.ser_value());
+    } else {
+        block_pm_duration timer(&stats->pm_serializer_block_decompressions);
+        decompress_block(disk_buf, disk_block_size, block_size, buf_out);
+    }
+}
+
 // God this is such a hack.
 #ifndef SEMANTIC_SERIALIZER_CHECK
 counted_t<ls_block_token_pointee_t>
@@ -456,8 +494,10 @@ void log_serializer_t::index_write(const std::vector<index_write_op_t>& write_op
              write_op_it != write_ops.end();
              ++write_op_it) {
             const index_write_op_t& op = *write_op_it;
-            flagged_off64_t offset = lba_index->get_block_offset(op.block_id);
-            uint32_t ser_block_size = lba_index->get_ser_block_size(op.block_id);
+            index_block_info_t info = lba_index->get_block_info(op.block_id);
+            flagged_off64_t offset = info.offset;
+            uint32_t ser_block_size = info.ser_block_size;
+            uint32_t uncompressed_ser_block_size = info.uncompressed_ser_block_size;
 
             if (op.token) {
                 // Update the offset pointed to, and mark garbage/liveness as necessary.
@@ -472,21 +512,23 @@ void log_serializer_t::index_write(const std::vector<index_write_op_t>& write_op
                 // Write new token to index, or remove from index as appropriate.
                 if (token.has()) {
                     offset = flagged_off64_t::make(token->offset_);
-                    ser_block_size = token->block_size().ser_value();
+                    ser_block_size = token->disk_block_size().ser_value();
+                    uncompressed_ser_block_size = token->is_compressed()
+                        ? token->block_size().ser_value() : 0;
 
                     /* mark the life */
-                    data_block_manager->mark_live(offset.get_value(), token->block_size());
+                    data_block_manager->mark_live(offset.get_value(), token->disk_block_size());
                 } else {
                     offset = flagged_off64_t::unused();
                     ser_block_size = 0;
+                    uncompressed_ser_block_size = 0;
                 }
             }
 
-            repli_timestamp_t recency = op.recency ? op.recency.get()
-                : lba_index->get_block_recency(op.block_id);
+            repli_timestamp_t recency = op.recency ? op.recency.get() : info.recency;
 
             lba_index->set_block_info(op.block_id, recency,
-                                      offset, ser_block_size,
+                                      offset, ser_block_size, uncompressed_ser_block_size,
                                       io_account, &context.extent_txn);
         }
     }
@@ -505,6 +547,7 @@ void log_serializer_t::index_write_prepare(index_write_context_t *context, file_
 
     /* Just to make sure that the LBA GC gets exercised */
     lba_index->consider_gc(io_account, &context->extent_txn);
+    lba_index->consider_checkpoint(io_account, &context->extent_txn);
 }
 
 void log_serializer_t::index_write_finish(index_write_context_t *context, file_account_t *io_account) {
@@ -576,9 +619,11 @@ void log_serializer_t::index_write_finish(index_write_context_t *context, file_a
 }
 
 counted_t<ls_block_token_pointee_t>
-log_serializer_t::generate_block_token(int64_t offset, block_size_t block_size) {
+log_serializer_t::generate_block_token(int64_t offset, block_size_t block_size,
+                                       block_size_t disk_block_size) {
     assert_thread();
-    counted_t<ls_block_token_pointee_t> ret(new ls_block_token_pointee_t(this, offset, block_size));
+    counted_t<ls_block_token_pointee_t> ret(new ls_block_token_pointee_t(this, offset, block_size,
+                                                                         disk_block_size));
     return ret;
 }
 
@@ -588,9 +633,65 @@ log_serializer_t::block_writes(const std::vector<buf_write_info_t> &write_infos,
     assert_thread();
     stats->pm_serializer_block_writes += write_infos.size();
 
+    if (!dynamic_config.compress_blocks) {
+        std::vector<counted_t<ls_block_token_pointee_t> > result
+            = data_block_manager->many_writes(write_infos, false, io_account, cb);
+        guarantee(result.size() == write_infos.size());
+        return result;
+    }
+
+    // Holds on to the compressed copies of the blocks until they have been written.
+    struct compressed_writes_cb_t : public iocallback_t {
+        void on_io_complete() {
+            iocallback_t *local_cb = cb;
+            delete this;
+            local_cb->on_io_complete();
+        }
+        std::vector<scoped_malloc_t<ser_buffer_t> > compressed_bufs;
+        iocallback_t *cb;
+    };
+    compressed_writes_cb_t *compressed_writes_cb = new compressed_writes_cb_t;
+    compressed_writes_cb->cb = cb;
+    compressed_writes_cb->compressed_bufs.resize(write_infos.size());
+
+    std::vector<buf_write_info_t> disk_write_infos;
+    disk_write_infos.reserve(write_infos.size());
+    for (size_t i = 0; i < write_infos.size(); ++i) {
+        const buf_write_info_t &info = write_infos[i];
+        block_size_t compressed_size = block_size_t::undefined();
+        bool compressed;
+        {
+            block_pm_duration timer(&stats->pm_serializer_block_compressions);
+            compressed = compress_block(info.buf, info.block_size,
+                                        &compressed_writes_cb->compressed_bufs[i],
+                                        &compressed_size);
+        }
+        stats->pm_serializer_bytes_before_compression += info.block_size.ser_value();
+        if (compressed) {
+            stats->pm_serializer_bytes_after_compression += compressed_size.ser_value();
+            disk_write_infos.push_back(
+                buf_write_info_t(compressed_writes_cb->compressed_bufs[i].get(),
+                                 compressed_size, info.block_id));
+        } else {
+            stats->pm_serializer_bytes_after_compression += info.block_size.ser_value();
+            disk_write_infos.push_back(info);
+        }
+    }
+
     std::vector<counted_t<ls_block_token_pointee_t> > result
-        = data_block_manager->many_writes(write_infos, true, io_account, cb);
+        = data_block_manager->many_writes(disk_write_infos, false, io_account,
+                                          compressed_writes_cb);
     guarantee(result.size() == write_infos.size());
+
+    for (size_t i = 0; i < write_infos.size(); ++i) {
+        if (compressed_writes_cb->compressed_bufs[i].has()) {
+            // many_writes() assigned the block sequence id in the compressed copy.
+            write_infos[i].buf->ser_header
+                = compressed_writes_cb->compressed_bufs[i]->ser_header;
+            result[i]->block_size_ = write_infos[i].block_size;
+        }
+    }
+
     return result;
 }
 
@@ -712,7 +813,8 @@ counted_t<ls_block_token_pointee_t> log_serializer_t::index_read(block_id_t bloc
 
     index_block_info_t info = lba_index->get_block_info(block_id);
     if (info.offset.has_value()) {
-        return generate_block_token(info.offset.get_value(), block_size_t::unsafe_make(info.ser_block_size));
+        return generate_block_token(info.offset.get_value(), info.block_size(),
+                                    info.disk_block_size());
     } else {
         return counted_t<ls_block_token_pointee_t>();
     }
@@ -893,9 +995,11 @@ bool log_serializer_t::should_perform_read_ahead() {
 
 ls_block_token_pointee_t::ls_block_token_pointee_t(log_serializer_t *serializer,
                                                    int64_t initial_offset,
-                                                   block_size_t initial_block_size)
+                                                   block_size_t initial_block_size,
+                                                   block_size_t initial_disk_block_size)
     : serializer_(serializer), ref_count_(0),
-      block_size_(initial_block_size), offset_(initial_offset) {
+      block_size_(initial_block_size), disk_block_size_(initial_disk_block_size),
+      offset_(initial_offset) {
     serializer_->assert_thread();
     serializer_->register_block_token(this, initial_offset);
 }
@@ -31,6 +31,7 @@ struct shutdown_callback_t {
 
 struct metablock_mixin_t {
     int64_t active_extent;
+    int64_t gc_active_extent;
 } __attribute__((__packed__));
 
 }  // namespace data_block_manager
@@ -165,7 +166,12 @@ private:
     void unregister_block_token(ls_block_token_pointee_t *token);
     void remap_block_to_new_offset(int64_t current_offset, int64_t new_offset);
     counted_t<ls_block_token_pointee_t> generate_block_token(int64_t offset,
-                                                             block_size_t block_size);
+                                                             block_size_t block_size,
+                                                             block_size_t disk_block_size);
+
+    // Copies a block, as read from disk, into `buf_out`, decompressing it if necessary.
+    void unpack_block(const ser_buffer_t *disk_buf, block_size_t disk_block_size,
+                      block_size_t block_size, ser_buffer_t *buf_out);
 
     void offer_buf_to_read_ahead_callbacks(
             block_id_t block_id,
@@ -14,6 +14,13 @@ struct log_serializer_stats_t {
     perfmon_duration_sampler_t pm_serializer_index_writes;
     perfmon_sampler_t pm_serializer_index_writes_size;
 
+    /* Block compression. The compression ratio is
+    bytes_after_compression / bytes_before_compression. */
+    perfmon_duration_sampler_t pm_serializer_block_compressions;
+    perfmon_duration_sampler_t pm_serializer_block_decompressions;
+    perfmon_counter_t pm_serializer_bytes_before_compression;
+    perfmon_counter_t pm_serializer_bytes_after_compression;
+
     /* used in serializer/log/extent_manager.cc */
     perfmon_counter_t pm_extents_in_use;
     perfmon_counter_t pm_bytes_in_use;
@@ -27,11 +34,17 @@ struct log_serializer_stats_t {
     perfmon_counter_t pm_serializer_data_extents_reclaimed;
     perfmon_counter_t pm_serializer_data_extents_gced;
     perfmon_counter_t pm_serializer_data_blocks_written;
+    // All bytes written to data extents, and the part of them written by the GC
+    perfmon_counter_t pm_serializer_data_bytes_written;
+    perfmon_counter_t pm_serializer_gc_bytes_written;
+    // The fraction of each extent chosen for GC that was still live
+    perfmon_sampler_t pm_serializer_gc_extent_live_ratio;
     perfmon_counter_t pm_serializer_old_garbage_block_bytes;
     perfmon_counter_t pm_serializer_old_total_block_bytes;
 
     /* used in serializer/log/lba/lba_list.cc */
     perfmon_counter_t pm_serializer_lba_gcs;
+    perfmon_counter_t pm_serializer_lba_checkpoints;
 
     perfmon_membership_t parent_collection_membership;
     perfmon_multi_membership_t stats_membership;
@@ -35,5 +35,34 @@ TEST(WriteMessageTest, Variant) {
 }
 
 
+TEST(WriteMessageTest, MessageStream) {
+    write_message_t msg;
+    write_message_stream_t stream(&msg);
+
+    // Enough data to span several buffers.
+    std::string data;
+    for (int i = 0; i < 3 * write_buffer_t::DATA_SIZE + 17; ++i) {
+        data.push_back(static_cast<char>(i));
+    }
+    ASSERT_EQ(10, stream.write(data.data(), 10));
+    ASSERT_EQ(static_cast<int64_t>(data.size() - 10),
+              stream.write(data.data() + 10, data.size() - 10));
+    ASSERT_EQ(static_cast<int64_t>(data.size()), msg.size());
+
+    std::string s;
+    dump_to_string(&msg, &s);
+    ASSERT_EQ(data, s);
+}
+
+TEST(WriteMessageTest, BufferReuse) {
+    // Buffers that go back to the free list come out again empty.
+    write_buffer_t *buffer = write_buffer_t::allocate();
+    buffer->size = write_buffer_t::DATA_SIZE;
+    write_buffer_t::release(buffer);
+    write_buffer_t *reused = write_buffer_t::allocate();
+    ASSERT_EQ(buffer, reused);
+    ASSERT_EQ(0, reused->size);
+    write_buffer_t::release(reused);
+}
 
 }  // namespace unittest
@@ -1,6 +1,8 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "arch/runtime/context_switching.hpp"
 
+#include <unistd.h>
+
 #include <stdexcept>
 
 #include "containers/scoped.hpp"
@@ -89,6 +91,63 @@ TEST(ContextSwitchingTest, SwitchBetweenContexts) {
     original_context = NULL;
 }
 
+static __thread artificial_stack_t *measured_stack = NULL;
+static __thread size_t touched_before_release, touched_after_release;
+
+__attribute__((noinline)) static void touch_stack_deeply() {
+    volatile char buf[64 * 1024];
+    for (size_t i = 0; i < sizeof(buf); i += 512) {
+        buf[i] = 1;
+    }
+}
+
+static void measure_stack_usage(void) {
+    touch_stack_deeply();
+    touched_before_release = measured_stack->touched_size();
+    measured_stack->release_unused_pages();
+    touched_after_release = measured_stack->touched_size();
+    context_switch(artificial_stack_1_context, original_context);
+}
+
+TEST(ContextSwitchingTest, ReleaseUnusedPages) {
+    scoped_ptr_t<context_ref_t> orig_context_local(new context_ref_t);
+    original_context = orig_context_local.get();
+    {
+        artificial_stack_t a(&measure_stack_usage, 1024*1024);
+        measured_stack = &a;
+        artificial_stack_1_context = &a.context;
+        // Only the page with the initial context has been touched so far.
+        EXPECT_LE(a.touched_size(), static_cast<size_t>(getpagesize()));
+
+        context_switch(original_context, artificial_stack_1_context);
+    }
+    EXPECT_GE(touched_before_release, 64u * 1024);
+    EXPECT_LT(touched_after_release, 16u * 1024);
+    measured_stack = NULL;
+    original_context = NULL;
+}
+
+static void touch_stack_and_switch_out(void) {
+    touch_stack_deeply();
+    context_switch(artificial_stack_1_context, original_context);
+}
+
+TEST(ContextSwitchingTest, ReleaseUnusedPagesBelowContext) {
+    scoped_ptr_t<context_ref_t> orig_context_local(new context_ref_t);
+    original_context = orig_context_local.get();
+    {
+        artificial_stack_t a(&touch_stack_and_switch_out, 1024*1024);
+        artificial_stack_1_context = &a.context;
+
+        context_switch(original_context, artificial_stack_1_context);
+        // The stack isn't running any more, but its context is still on it.
+        EXPECT_GE(a.touched_size(), 64u * 1024);
+        a.release_unused_pages_below_context();
+        EXPECT_LT(a.touched_size(), 16u * 1024);
+    }
+    original_context = NULL;
+}
+
 __attribute__((noreturn)) static void throw_an_exception() {
     throw std::runtime_error("This is a test exception");
 }
@@ -1,6 +1,9 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
+#include <malloc.h>
 
+#include "containers/archive/buffer_group_stream.hpp"
 #include "containers/archive/string_stream.hpp"
+#include "containers/buffer_group.hpp"
 #include "rdb_protocol/datum.hpp"
 #include "unittest/gtest.hpp"
 
@@ -62,6 +65,353 @@ TEST(DatumTest, NumericSerialization) {
     test_datum_serialization(make_counted<ql::datum_t>(std::move(vec)));
 }
 
+std::string serialize_indexed_to_string(const counted_t<const ql::datum_t> &datum) {
+    string_stream_t write_stream;
+    write_message_t wm;
+    ql::serialize_indexed(&wm, datum);
+    int write_res = send_write_message(&write_stream, &wm);
+    guarantee(write_res == 0);
+    EXPECT_EQ(ql::indexed_serialized_size(datum), write_stream.str().size());
+    return write_stream.str();
+}
+
+// An object with `num_fields` fields, some of which are nested objects and arrays.
+counted_t<const ql::datum_t> make_wide_object(size_t num_fields) {
+    std::map<std::string, counted_t<const ql::datum_t> > fields;
+    for (size_t i = 0; i < num_fields; ++i) {
+        std::string key = strprintf("field%zu", i);
+        switch (i % 3) {
+        case 0: {
+            fields[key] = make_counted<const ql::datum_t>(static_cast<double>(i));
+        } break;
+        case 1: {
+            std::map<std::string, counted_t<const ql::datum_t> > inner;
+            inner["a"] = make_counted<const ql::datum_t>(std::string(i, 'x'));
+            inner["b"] = make_counted<const ql::datum_t>(ql::datum_t::R_NULL);
+            fields[key] = make_counted<const ql::datum_t>(std::move(inner));
+        } break;
+        case 2: {
+            std::vector<counted_t<const ql::datum_t> > inner;
+            inner.push_back(make_counted<const ql::datum_t>(ql::datum_t::R_BOOL, true));
+            inner.push_back(make_counted<const ql::datum_t>(-0.5));
+            fields[key] = make_counted<const ql::datum_t>(std::move(inner));
+        } break;
+        default: unreachable();
+        }
+    }
+    return make_counted<const ql::datum_t>(std::move(fields));
+}
+
+TEST(DatumTest, IndexedSerialization) {
+    counted_t<const ql::datum_t> datum = make_wide_object(100);
+    std::string serialized = serialize_indexed_to_string(datum);
+
+    string_read_stream_t read_stream(std::string(serialized), 0);
+    counted_t<const ql::datum_t> deserialized_datum;
+    archive_result_t res = deserialize(&read_stream, &deserialized_datum);
+    ASSERT_EQ(ARCHIVE_SUCCESS, res);
+    ASSERT_EQ(*datum, *deserialized_datum);
+
+    // Split the value into small buffers, like a blob spread over several blocks.
+    const_buffer_group_t group;
+    const size_t chunk_size = 37;
+    for (size_t i = 0; i < serialized.size(); i += chunk_size) {
+        group.add_buffer(std::min(chunk_size, serialized.size() - i),
+                         serialized.data() + i);
+    }
+
+    const std::map<std::string, counted_t<const ql::datum_t> > &fields =
+        datum->as_object();
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+        buffer_group_read_stream_t stream(&group);
+        bool indexed;
+        counted_t<const ql::datum_t> field;
+        res = ql::deserialize_indexed_field(&stream, it->first, &indexed, &field);
+        ASSERT_EQ(ARCHIVE_SUCCESS, res);
+        ASSERT_TRUE(indexed);
+        ASSERT_TRUE(field.has());
+        ASSERT_EQ(*it->second, *field);
+    }
+
+    {
+        buffer_group_read_stream_t stream(&group);
+        bool indexed;
+        counted_t<const ql::datum_t> field;
+        res = ql::deserialize_indexed_field(&stream, "no_such_field", &indexed, &field);
+        ASSERT_EQ(ARCHIVE_SUCCESS, res);
+        ASSERT_TRUE(indexed);
+        ASSERT_FALSE(field.has());
+    }
+}
+
+// Compares reading one field of a wide document by deserializing the whole
+// document against reading it straight out of the indexed layout. It only runs
+// with `--gtest_also_run_disabled_tests`.
+TEST(DatumTest, DISABLED_IndexedFieldBenchmark) {
+    const size_t num_fields = 1000;
+    const int iterations = 200;
+    counted_t<const ql::datum_t> datum = make_wide_object(num_fields);
+    const std::string key = strprintf("field%zu", num_fields / 2);
+    std::string serialized = serialize_indexed_to_string(datum);
+    const_buffer_group_t group;
+    group.add_buffer(serialized.size(), serialized.data());
+
+    ticks_t start = get_ticks();
+    for (int i = 0; i < iterations; ++i) {
+        buffer_group_read_stream_t stream(&group);
+        counted_t<const ql::datum_t> whole;
+        ASSERT_EQ(ARCHIVE_SUCCESS, deserialize(&stream, &whole));
+        ASSERT_TRUE(whole->get(key, ql::NOTHROW).has());
+    }
+    const double full_secs = ticks_to_secs(get_ticks() - start);
+
+    start = get_ticks();
+    for (int i = 0; i < iterations; ++i) {
+        buffer_group_read_stream_t stream(&group);
+        bool indexed;
+        counted_t<const ql::datum_t> field;
+        ASSERT_EQ(ARCHIVE_SUCCESS,
+                  ql::deserialize_indexed_field(&stream, key, &indexed, &field));
+        ASSERT_TRUE(field.has());
+    }
+    const double field_secs = ticks_to_secs(get_ticks() - start);
+
+    printf("Field extraction from a %zu field document: %.0f/s deserializing the "
+           "whole document, %.0f/s with the offset table\n", num_fields,
+           iterations / full_secs, iterations / field_secs);
+    EXPECT_LT(field_secs, full_secs);
+}
+
+TEST(DatumTest, IndexedFieldOfOldLayout) {
+    counted_t<const ql::datum_t> datum = make_wide_object(10);
+    string_stream_t write_stream;
+    write_message_t wm;
+    wm << datum;
+    int write_res = send_write_message(&write_stream, &wm);
+    ASSERT_EQ(0, write_res);
+
+    const_buffer_group_t group;
+    group.add_buffer(write_stream.str().size(), write_stream.str().data());
+    buffer_group_read_stream_t stream(&group);
+    bool indexed;
+    counted_t<const ql::datum_t> field;
+    archive_result_t res = ql::deserialize_indexed_field(&stream, "field0",
+                                                         &indexed, &field);
+    ASSERT_EQ(ARCHIVE_SUCCESS, res);
+    ASSERT_FALSE(indexed);
+}
+
+counted_t<const ql::datum_t> sum_datums(const counted_t<const ql::datum_t> &lhs,
+                                        const counted_t<const ql::datum_t> &rhs) {
+    return make_counted<const ql::datum_t>(lhs->as_num() + rhs->as_num());
+}
+
+TEST(DatumTest, WireDatumMapMerge) {
+    ql::wire_datum_map_t left;
+    ql::wire_datum_map_t right;
+    for (int i = 0; i < 10; ++i) {
+        left.set(make_counted<const ql::datum_t>(static_cast<double>(i)),
+                 make_counted<const ql::datum_t>(1.0));
+    }
+    for (int i = 5; i < 20; ++i) {
+        right.set(make_counted<const ql::datum_t>(static_cast<double>(i)),
+                  make_counted<const ql::datum_t>(10.0));
+    }
+
+    // Merging into an empty map takes the other map's groups as they are.
+    ql::wire_datum_map_t merged;
+    merged.merge(&left, &sum_datums);
+    ASSERT_EQ(0u, left.size());
+    ASSERT_EQ(10u, merged.size());
+
+    merged.merge(&right, &sum_datums);
+    ASSERT_EQ(0u, right.size());
+    ASSERT_EQ(20u, merged.size());
+    for (int i = 0; i < 20; ++i) {
+        const double expected = (i < 5 ? 1 : 0) + (5 <= i && i < 10 ? 11 : 0) + (i >= 10 ? 10 : 0);
+        ASSERT_EQ(expected,
+                  merged.get(make_counted<const ql::datum_t>(static_cast<double>(i)))->as_num());
+    }
 
+    // The size is the same once the map is ready to be sent.
+    merged.finalize();
+    ASSERT_EQ(20u, merged.size());
+}
+
+// A document with `num_fields` fields: mostly numbers, plus some bools, strings
+// and nested objects, with both short and long keys.
+counted_t<const ql::datum_t> make_row(size_t num_fields) {
+    std::map<std::string, counted_t<const ql::datum_t> > fields;
+    for (size_t i = 0; i < num_fields; ++i) {
+        std::string key = (i % 2 == 0)
+            ? strprintf("f%zu", i)
+            : strprintf("a_rather_long_field_name_%zu", i);
+        switch (i % 10) {
+        case 0: {
+            fields[key] = make_counted<const ql::datum_t>(strprintf("value %zu", i));
+        } break;
+        case 1: {
+            fields[key] = make_counted<const ql::datum_t>(ql::datum_t::R_BOOL, i % 4 == 1);
+        } break;
+        case 2: {
+            fields[key] = make_counted<const ql::datum_t>(ql::datum_t::R_NULL);
+        } break;
+        case 3: {
+            std::map<std::string, counted_t<const ql::datum_t> > inner;
+            inner["x"] = make_counted<const ql::datum_t>(1.5);
+            fields[key] = make_counted<const ql::datum_t>(std::move(inner));
+        } break;
+        default: {
+            fields[key] = make_counted<const ql::datum_t>(i * 1.25);
+        } break;
+        }
+    }
+    return make_counted<const ql::datum_t>(std::move(fields));
+}
+
+counted_t<const ql::datum_t> deserialize_from_string(const std::string &serialized) {
+    string_read_stream_t read_stream(std::string(serialized), 0);
+    counted_t<const ql::datum_t> datum;
+    archive_result_t res = deserialize(&read_stream, &datum);
+    guarantee(res == ARCHIVE_SUCCESS);
+    return datum;
+}
+
+std::string serialize_to_string(const counted_t<const ql::datum_t> &datum) {
+    string_stream_t write_stream;
+    write_message_t wm;
+    wm << datum;
+    int write_res = send_write_message(&write_stream, &wm);
+    guarantee(write_res == 0);
+    EXPECT_EQ(serialized_size(datum), write_stream.str().size());
+    return write_stream.str();
+}
+
+void check_flat_object(const counted_t<const ql::datum_t> &original,
+                       const counted_t<const ql::datum_t> &flat) {
+    ASSERT_TRUE(original->as_flat_object() == NULL);
+    ASSERT_TRUE(flat->as_flat_object() != NULL);
+
+    const std::map<std::string, counted_t<const ql::datum_t> > &fields =
+        original->as_object();
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+        counted_t<const ql::datum_t> field = flat->get(it->first, ql::NOTHROW);
+        ASSERT_TRUE(field.has());
+        ASSERT_EQ(*it->second, *field);
+    }
+    ASSERT_FALSE(flat->get("no_such_field", ql::NOTHROW).has());
+    ASSERT_FALSE(flat->get("", ql::NOTHROW).has());
+
+    ASSERT_EQ(original->print(), flat->print());
+    ASSERT_EQ(0, original->cmp(*flat));
+    ASSERT_EQ(0, flat->cmp(*original));
+}
+
+TEST(DatumTest, FlatObject) {
+    counted_t<const ql::datum_t> original = make_row(40);
+
+    counted_t<const ql::datum_t> flat = deserialize_from_string(serialize_to_string(original));
+    check_flat_object(original, flat);
+
+    counted_t<const ql::datum_t> flat_indexed =
+        deserialize_from_string(serialize_indexed_to_string(original));
+    check_flat_object(original, flat_indexed);
+
+    // Serializing a flat object writes the same bytes as the map did.
+    ASSERT_EQ(serialize_to_string(original), serialize_to_string(flat));
+    ASSERT_EQ(serialize_indexed_to_string(original), serialize_indexed_to_string(flat));
+    ASSERT_EQ(0, flat->cmp(*flat_indexed));
+
+    // Comparisons between flat objects.
+    counted_t<const ql::datum_t> smaller =
+        deserialize_from_string(serialize_to_string(make_row(39)));
+    ASSERT_TRUE(smaller->as_flat_object() != NULL);
+    ASSERT_EQ(original->cmp(*smaller), flat->cmp(*smaller));
+    ASSERT_EQ(smaller->cmp(*original), smaller->cmp(*flat));
+
+    // `as_object` still works, and builds the same map.
+    const std::map<std::string, counted_t<const ql::datum_t> > &fields = flat->as_object();
+    ASSERT_EQ(original->as_object().size(), fields.size());
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+        ASSERT_EQ(*original->get(it->first), *it->second);
+    }
+
+    // Objects with unsorted keys can't be flat, but still deserialize.
+    {
+        write_message_t wm;
+        wm << static_cast<int8_t>(5);  // R_OBJECT
+        serialize_varint_uint64(&wm, 2);
+        wm << std::string("b") << make_counted<const ql::datum_t>(1.0);
+        wm << std::string("a") << make_counted<const ql::datum_t>(2.0);
+        string_stream_t write_stream;
+        ASSERT_EQ(0, send_write_message(&write_stream, &wm));
+        counted_t<const ql::datum_t> unsorted = deserialize_from_string(write_stream.str());
+        ASSERT_TRUE(unsorted->as_flat_object() == NULL);
+        ASSERT_EQ(2.0, unsorted->get("a")->as_num());
+        ASSERT_EQ(1.0, unsorted->get("b")->as_num());
+    }
+}
+
+// Compares objects deserialized into a `flat_object_t` with the same objects built
+// as maps: how much heap they use, and how fast field lookups and comparisons are.
+TEST(DatumTest, FlatObjectBenchmark) {
+    const size_t num_rows = 1000;
+    const size_t num_fields = 20;
+    counted_t<const ql::datum_t> prototype = make_row(num_fields);
+    const std::string serialized = serialize_to_string(prototype);
+    const std::string json = prototype->print();
+
+    std::vector<counted_t<const ql::datum_t> > map_rows;
+    map_rows.reserve(num_rows);
+    std::vector<counted_t<const ql::datum_t> > flat_rows;
+    flat_rows.reserve(num_rows);
+
+    size_t before = mallinfo().uordblks;
+    for (size_t i = 0; i < num_rows; ++i) {
+        scoped_cJSON_t parsed(cJSON_Parse(json.c_str()));
+        map_rows.push_back(make_counted<const ql::datum_t>(parsed));
+    }
+    const double map_bytes = (mallinfo().uordblks - before) / static_cast<double>(num_rows);
+
+    before = mallinfo().uordblks;
+    for (size_t i = 0; i < num_rows; ++i) {
+        flat_rows.push_back(deserialize_from_string(serialized));
+    }
+    const double flat_bytes = (mallinfo().uordblks - before) / static_cast<double>(num_rows);
+
+    printf("Heap usage of a %zu field row: %.0f bytes as a map, %.0f bytes flat\n",
+           num_fields, map_bytes, flat_bytes);
+    EXPECT_LT(flat_bytes, map_bytes);
+
+    std::vector<std::string> keys;
+    const std::map<std::string, counted_t<const ql::datum_t> > &fields =
+        prototype->as_object();
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+        keys.push_back(it->first);
+    }
+
+    const std::vector<counted_t<const ql::datum_t> > *const row_sets[] = { &map_rows, &flat_rows };
+    const char *const names[] = { "map", "flat" };
+    for (size_t r = 0; r < 2; ++r) {
+        const std::vector<counted_t<const ql::datum_t> > &rows = *row_sets[r];
+
+        ticks_t start = get_ticks();
+        for (size_t i = 0; i < num_rows; ++i) {
+            for (size_t k = 0; k < keys.size(); ++k) {
+                ASSERT_TRUE(rows[i]->get(keys[k], ql::NOTHROW).has());
+            }
+        }
+        const double get_secs = ticks_to_secs(get_ticks() - start);
+
+        start = get_ticks();
+        for (size_t i = 1; i < num_rows; ++i) {
+            ASSERT_EQ(0, rows[i]->cmp(*rows[i - 1]));
+        }
+        const double cmp_secs = ticks_to_secs(get_ticks() - start);
+
+        printf("%s rows: %.0f field lookups/s, %.0f comparisons/s\n", names[r],
+               num_rows * keys.size() / get_secs, (num_rows - 1) / cmp_secs);
+    }
+}
 
 }  // namespace unittest
@@ -1,5 +1,10 @@
+#include "arch/timing.hpp"
+#include "perfmon/collect.hpp"
 #include "serializer/log/data_block_manager.hpp"
+#include "serializer/log/log_serializer.hpp"
 #include "unittest/gtest.hpp"
+#include "unittest/mock_file.hpp"
+#include "unittest/unittest_utils.hpp"
 
 namespace unittest {
 
@@ -48,6 +53,80 @@ TEST(DBMTest, ReadAheadInterval) {
     ASSERT_EQ(100, end_offset);
 }
 
+TEST(DBMTest, GcCostBenefit) {
+    const uint32_t extent_size = 1000;
 
+    // At the same age, more garbage is better.
+    ASSERT_LT(gc_cost_benefit(200, extent_size, 1000), gc_cost_benefit(500, extent_size, 1000));
+    ASSERT_LT(gc_cost_benefit(500, extent_size, 0), gc_cost_benefit(900, extent_size, 0));
+
+    // With the same garbage, older is better.
+    ASSERT_LT(gc_cost_benefit(500, extent_size, 1000), gc_cost_benefit(500, extent_size, 5000));
+
+    // An old extent with less garbage can beat a young one with more.
+    ASSERT_LT(gc_cost_benefit(600, extent_size, 1000), gc_cost_benefit(300, extent_size, 100000));
+
+    // An extent with no garbage is never worth collecting.
+    ASSERT_EQ(0.0, gc_cost_benefit(0, extent_size, 100000));
+}
+
+TEST(DBMTest, GcPressure) {
+    // Below the low ratio, the GC idles along at the lowest priority.
+    ASSERT_EQ(0.0, gc_pressure(0.10, 0.0, 0.15, 0.35));
+
+    // In between, the pressure grows linearly...
+    ASSERT_DOUBLE_EQ(0.5, gc_pressure(0.25, 0.0, 0.15, 0.35));
+
+    // ... and it saturates at the high ratio.
+    ASSERT_EQ(1.0, gc_pressure(0.35, 0.0, 0.15, 0.35));
+    ASSERT_EQ(1.0, gc_pressure(0.80, 0.0, 0.15, 0.35));
+
+    // A rising garbage ratio raises the pressure ahead of time.
+    ASSERT_LT(gc_pressure(0.20, 0.0, 0.15, 0.35), gc_pressure(0.20, 0.005, 0.15, 0.35));
+    ASSERT_EQ(1.0, gc_pressure(0.10, 0.1, 0.15, 0.35));
+
+    // A falling one doesn't lower it.
+    ASSERT_DOUBLE_EQ(gc_pressure(0.25, 0.0, 0.15, 0.35), gc_pressure(0.25, -0.01, 0.15, 0.35));
+}
+
+// Writes every `step`th block of blocks 0 to num_blocks - 1.
+void write_every_nth_block(serializer_t *ser, file_account_t *account,
+                           block_id_t num_blocks, block_id_t step) {
+    std::vector<index_write_op_t> ops;
+    for (block_id_t id = 0; id < num_blocks; id += step) {
+        scoped_malloc_t<ser_buffer_t> buf = ser->malloc();
+        memset(buf->cache_data, 0, ser->get_block_size().value());
+        counted_t<standard_block_token_t> token
+            = serializer_block_write(ser, buf.get(), ser->get_block_size(), id, account);
+        ops.push_back(index_write_op_t(id, token, repli_timestamp_t::distant_past));
+    }
+    ser->index_write(ops, account);
+}
+
+void run_ShutdownDuringGc() {
+    mock_file_opener_t file_opener;
+    standard_serializer_t::static_config_t static_config;
+    static_config.extent_size_ = 64 * static_config.block_size_;
+    standard_serializer_t::create(&file_opener, static_config);
+
+    const block_id_t num_blocks = 256;
+    standard_serializer_t ser(standard_serializer_t::dynamic_config_t(),
+                              &file_opener, &get_global_perfmon_collection());
+    scoped_ptr_t<file_account_t> account(ser.make_io_account(CACHE_WRITES_IO_PRIORITY,
+                                                             UNLIMITED_OUTSTANDING_REQUESTS));
+    write_every_nth_block(&ser, account.get(), num_blocks, 1);
+
+    // Once the first extents are no longer young, overwriting half of their blocks
+    // makes them GC candidates, and the index write starts a GC...
+    nap(2 * GC_YOUNG_EXTENT_TIMELIMIT_MICROS / 1000);
+    write_every_nth_block(&ser, account.get(), num_blocks, 2);
+
+    // ... whose reads are still in flight when the serializer shuts down.  It then
+    // has to write the blocks it read before the shutdown can finish.
+}
+
+TEST(DBMTest, ShutdownDuringGc) {
+    run_in_thread_pool(run_ShutdownDuringGc);
+}
 
 }  // namespace unittest
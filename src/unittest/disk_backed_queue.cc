@@ -3,10 +3,13 @@
 
 #include "arch/io/disk.hpp"
 #include "arch/timing.hpp"
+#include "buffer_cache/blob.hpp"
+#include "buffer_cache/buffer_cache.hpp"
 #include "concurrency/coro_pool.hpp"
 #include "concurrency/queue/disk_backed_queue_wrapper.hpp"
 #include "containers/archive/stl_types.hpp"
 #include "containers/disk_backed_queue.hpp"
+#include "serializer/config.hpp"
 #include "unittest/unittest_utils.hpp"
 #include "unittest/gtest.hpp"
 
@@ -74,6 +77,204 @@ TEST(DiskBackedQueue, BigVals) {
     unittest::run_in_thread_pool(&run_big_values_test, 2);
 }
 
+/* `Segments` pushes and pops values of varying sizes so that the queue goes
+through several segment files, and then drains it completely and refills it. */
+
+std::string make_test_value(int i) {
+    std::string val(randint(20000), 'a' + i % 26);
+    val += strprintf("%d", i);
+    return val;
+}
+
+void run_segments_test() {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    disk_backed_queue_t<std::string> queue(&io_backender, dbq_serializer_path(), &get_global_perfmon_collection());
+    std::queue<std::string> ref_queue;
+
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 6000; ++i) {
+            std::string val = make_test_value(i);
+            queue.push(val);
+            ref_queue.push(val);
+            if (i % 2 == 1) {
+                std::string x;
+                queue.pop(&x);
+                ASSERT_EQ(ref_queue.front(), x);
+                ref_queue.pop();
+            }
+        }
+        ASSERT_EQ(static_cast<int64_t>(ref_queue.size()), queue.size());
+
+        while (!ref_queue.empty()) {
+            ASSERT_FALSE(queue.empty());
+            std::string x;
+            queue.pop(&x);
+            ASSERT_EQ(ref_queue.front(), x);
+            ref_queue.pop();
+        }
+        EXPECT_TRUE(queue.empty());
+    }
+}
+
+TEST(DiskBackedQueue, Segments) {
+    unittest::run_in_thread_pool(&run_segments_test, 2);
+}
+
+/* `DISABLED_Benchmark` compares the segmented queue with the queue it replaced,
+which kept its entries in blobs in a cache on top of a serializer. It only runs
+with `--gtest_also_run_disabled_tests`. */
+
+struct queue_block_t {
+    block_id_t next;
+    int data_size, live_data_offset;
+    char data[0];
+};
+
+#define MAX_REF_SIZE 251
+
+class serializer_backed_queue_t {
+public:
+    serializer_backed_queue_t(io_backender_t *io_backender, const serializer_filepath_t &filename)
+        : head_block_id(NULL_BLOCK_ID), tail_block_id(NULL_BLOCK_ID) {
+        filepath_file_opener_t file_opener(filename, io_backender);
+        standard_serializer_t::create(&file_opener, standard_serializer_t::static_config_t());
+        serializer.init(new standard_serializer_t(standard_serializer_t::dynamic_config_t(),
+                                                  &file_opener,
+                                                  &get_global_perfmon_collection()));
+        file_opener.unlink_serializer_file();
+
+        cache_t::create(serializer.get());
+        mirrored_cache_config_t cache_dynamic_config;
+        cache_dynamic_config.max_size = MEGABYTE;
+        cache_dynamic_config.max_dirty_size = MEGABYTE / 2;
+        cache.init(new cache_t(serializer.get(), cache_dynamic_config, &get_global_perfmon_collection()));
+    }
+
+    void push(const std::string &value) {
+        transaction_t txn(cache.get(), rwi_write, 2, repli_timestamp_t::distant_past,
+                          order_source.check_in("push"), WRITE_DURABILITY_SOFT);
+        if (head_block_id == NULL_BLOCK_ID) {
+            add_block_to_head(&txn);
+        }
+
+        scoped_ptr_t<buf_lock_t> head_lock(new buf_lock_t(&txn, head_block_id, rwi_write));
+        queue_block_t *head = reinterpret_cast<queue_block_t *>(head_lock->get_data_write());
+
+        char buffer[MAX_REF_SIZE];
+        bzero(buffer, MAX_REF_SIZE);
+        blob_t blob(cache->get_block_size(), buffer, MAX_REF_SIZE);
+        blob.append_region(&txn, value.size());
+        blob.write_from_string(value, &txn, 0);
+
+        const int refsize = blob.refsize(cache->get_block_size());
+        if (static_cast<size_t>(head->data + head->data_size + refsize - reinterpret_cast<char *>(head))
+            > cache->get_block_size().value()) {
+            head_lock.reset();
+            add_block_to_head(&txn);
+            head_lock.init(new buf_lock_t(&txn, head_block_id, rwi_write));
+            head = reinterpret_cast<queue_block_t *>(head_lock->get_data_write());
+        }
+
+        memcpy(head->data + head->data_size, buffer, refsize);
+        head->data_size += refsize;
+    }
+
+    void pop(std::string *value_out) {
+        transaction_t txn(cache.get(), rwi_write, 2, repli_timestamp_t::distant_past,
+                          order_source.check_in("pop"), WRITE_DURABILITY_SOFT);
+        scoped_ptr_t<buf_lock_t> tail_lock(new buf_lock_t(&txn, tail_block_id, rwi_write));
+        queue_block_t *tail = reinterpret_cast<queue_block_t *>(tail_lock->get_data_write());
+
+        char buffer[MAX_REF_SIZE];
+        char *ref = tail->data + tail->live_data_offset;
+        memcpy(buffer, ref, blob::ref_size(cache->get_block_size(), ref, MAX_REF_SIZE));
+        blob_t blob(cache->get_block_size(), buffer, MAX_REF_SIZE);
+        {
+            blob_acq_t acq_group;
+            buffer_group_t blob_group;
+            blob.expose_all(&txn, rwi_read, &blob_group, &acq_group);
+            value_out->resize(blob_group.get_size());
+            buffer_group_t value_group;
+            value_group.add_buffer(value_out->size(), &(*value_out)[0]);
+            buffer_group_copy_data(&value_group, const_view(&blob_group));
+        }
+        tail->live_data_offset += blob.refsize(cache->get_block_size());
+        blob.clear(&txn);
+
+        if (tail->live_data_offset == tail->data_size) {
+            tail_lock.reset();
+            buf_lock_t old_tail_lock(&txn, tail_block_id, rwi_write);
+            queue_block_t *old_tail = reinterpret_cast<queue_block_t *>(old_tail_lock.get_data_write());
+            if (old_tail->next == NULL_BLOCK_ID) {
+                tail_block_id = head_block_id = NULL_BLOCK_ID;
+            } else {
+                tail_block_id = old_tail->next;
+            }
+            old_tail_lock.mark_deleted();
+        }
+    }
+
+private:
+    void add_block_to_head(transaction_t *txn) {
+        buf_lock_t new_head_lock(txn);
+        queue_block_t *new_head = reinterpret_cast<queue_block_t *>(new_head_lock.get_data_write());
+        if (head_block_id == NULL_BLOCK_ID) {
+            head_block_id = tail_block_id = new_head_lock.get_block_id();
+        } else {
+            buf_lock_t old_head_lock(txn, head_block_id, rwi_write);
+            queue_block_t *old_head = reinterpret_cast<queue_block_t *>(old_head_lock.get_data_write());
+            old_head->next = new_head_lock.get_block_id();
+            head_block_id = new_head_lock.get_block_id();
+        }
+        new_head->next = NULL_BLOCK_ID;
+        new_head->data_size = 0;
+        new_head->live_data_offset = 0;
+    }
+
+    order_source_t order_source;
+    block_id_t head_block_id, tail_block_id;
+    scoped_ptr_t<standard_serializer_t> serializer;
+    scoped_ptr_t<cache_t> cache;
+};
+
+template <class queue_t>
+double time_queue(queue_t *queue, int num_values, const std::string &value) {
+    ticks_t start = get_ticks();
+    for (int i = 0; i < num_values; ++i) {
+        queue->push(value);
+    }
+    std::string x;
+    for (int i = 0; i < num_values; ++i) {
+        queue->pop(&x);
+        EXPECT_EQ(value, x);
+    }
+    return ticks_to_secs(get_ticks() - start);
+}
+
+void run_benchmark() {
+    const int num_values = 20000;
+    const std::string value(4 * KILOBYTE, 'a');
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+
+    double segmented_secs;
+    {
+        disk_backed_queue_t<std::string> queue(&io_backender, dbq_serializer_path(), &get_global_perfmon_collection());
+        segmented_secs = time_queue(&queue, num_values, value);
+    }
+    double serializer_secs;
+    {
+        serializer_backed_queue_t queue(&io_backender, dbq_serializer_path());
+        serializer_secs = time_queue(&queue, num_values, value);
+    }
+    printf("Pushing and then popping %d values of %zu bytes: %.3f s with segment files, "
+           "%.3f s with a serializer\n",
+           num_values, value.size(), segmented_secs, serializer_secs);
+}
+
+TEST(DiskBackedQueue, DISABLED_Benchmark) {
+    unittest::run_in_thread_pool(&run_benchmark, 2);
+}
+
 static void randomly_delay(int, signal_t *) {
     nap(randint(100));
 }
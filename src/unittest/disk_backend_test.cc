@@ -0,0 +1,84 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include <limits.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "arch/arch.hpp"
+#include "arch/io/disk.hpp"
+#include "arch/runtime/coroutines.hpp"
+#include "containers/scoped.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+struct coro_iocallback_t : public iocallback_t {
+    coro_t *cont;
+    coro_iocallback_t() : cont(coro_t::self()) { }
+    void on_io_complete() {
+        cont->notify_later_ordered();
+    }
+};
+
+void fill_block(char *block, int i) {
+    memset(block, 'a' + (i % 26), DEVICE_BLOCK_SIZE);
+}
+
+void run_read_write_test(io_backend_t io_backend) {
+    temp_file_t temp_file;
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired,
+                                DEFAULT_MAX_CONCURRENT_IO_REQUESTS,
+                                io_backend);
+
+    scoped_ptr_t<file_t> file;
+    file_open_result_t res = open_file(temp_file.name().permanent_path().c_str(),
+                                       linux_file_t::mode_read | linux_file_t::mode_write,
+                                       &io_backender, &file);
+    ASSERT_NE(file_open_result_t::ERROR, res.outcome);
+
+    // Enough blocks that the writev below has to be split at IOV_MAX.
+    const int num_blocks = IOV_MAX + 3;
+    file->set_size_at_least(num_blocks * DEVICE_BLOCK_SIZE);
+
+    scoped_malloc_t<char> data(malloc_aligned(num_blocks * DEVICE_BLOCK_SIZE,
+                                              DEVICE_BLOCK_SIZE));
+    for (int i = 0; i < num_blocks; ++i) {
+        fill_block(data.get() + i * DEVICE_BLOCK_SIZE, i);
+    }
+
+    // A single write, and one wrapped in datasyncs.
+    co_write(file.get(), 0, DEVICE_BLOCK_SIZE, data.get(), DEFAULT_DISK_ACCOUNT,
+             file_t::NO_DATASYNCS);
+    co_write(file.get(), DEVICE_BLOCK_SIZE, DEVICE_BLOCK_SIZE,
+             data.get() + DEVICE_BLOCK_SIZE, DEFAULT_DISK_ACCOUNT,
+             file_t::WRAP_IN_DATASYNCS);
+
+    // A vectored write of everything else.
+    {
+        scoped_array_t<iovec> iovecs(num_blocks - 2);
+        for (int i = 2; i < num_blocks; ++i) {
+            iovecs[i - 2].iov_base = data.get() + i * DEVICE_BLOCK_SIZE;
+            iovecs[i - 2].iov_len = DEVICE_BLOCK_SIZE;
+        }
+        coro_iocallback_t cb;
+        file->writev_async(2 * DEVICE_BLOCK_SIZE, (num_blocks - 2) * DEVICE_BLOCK_SIZE,
+                           std::move(iovecs), DEFAULT_DISK_ACCOUNT, &cb);
+        coro_t::wait();
+    }
+
+    scoped_malloc_t<char> readback(malloc_aligned(num_blocks * DEVICE_BLOCK_SIZE,
+                                                  DEVICE_BLOCK_SIZE));
+    co_read(file.get(), 0, num_blocks * DEVICE_BLOCK_SIZE, readback.get(),
+            DEFAULT_DISK_ACCOUNT);
+    EXPECT_EQ(0, memcmp(data.get(), readback.get(), num_blocks * DEVICE_BLOCK_SIZE));
+}
+
+TEST(DiskBackendTest, PoolReadWrite) {
+    run_in_thread_pool(std::bind(&run_read_write_test, io_backend_t::pool));
+}
+
+TEST(DiskBackendTest, NativeAioReadWrite) {
+    run_in_thread_pool(std::bind(&run_read_write_test, io_backend_t::native_aio));
+}
+
+}  // namespace unittest
@@ -50,11 +50,31 @@ TEST(DiskFormatTest, LbaMetablockMixinT) {
     EXPECT_EQ(4096, METABLOCK_SIZE);
     EXPECT_EQ(METABLOCK_SIZE - 512, LBA_INLINE_SIZE);
     EXPECT_EQ(32u, sizeof(lba_entry_t));
-    EXPECT_EQ(32ul * LBA_SHARD_FACTOR + 8ul + LBA_INLINE_SIZE, sizeof(lba_metablock_mixin_t));
+    EXPECT_EQ(32ul * LBA_SHARD_FACTOR + 2 * sizeof(lba_checkpoint_metablock_t) + 8ul
+              + LBA_INLINE_SIZE,
+              sizeof(lba_metablock_mixin_t));
+}
+
+TEST(DiskFormatTest, LbaCheckpointMetablockT) {
+    EXPECT_EQ(8u, sizeof(lba_shard_position_t));
+    EXPECT_EQ(0u, offsetof(lba_checkpoint_metablock_t, directory_offset));
+    EXPECT_EQ(8u, offsetof(lba_checkpoint_metablock_t, extents_count));
+    EXPECT_EQ(16u, offsetof(lba_checkpoint_metablock_t, shards));
+    EXPECT_EQ(16u + 8u * LBA_SHARD_FACTOR, sizeof(lba_checkpoint_metablock_t));
+}
+
+TEST(DiskFormatTest, LbaCheckpointDirectoryT) {
+    EXPECT_EQ(16u, sizeof(lba_checkpoint_extent_entry_t));
+    EXPECT_EQ(16u, offsetof(lba_checkpoint_directory_t, extents[0]));
+    EXPECT_EQ(DEVICE_BLOCK_SIZE, lba_checkpoint_directory_t::extents_count_to_file_size(0));
+    EXPECT_EQ(DEVICE_BLOCK_SIZE, lba_checkpoint_directory_t::extents_count_to_file_size(31));
+    EXPECT_EQ(2 * DEVICE_BLOCK_SIZE, lba_checkpoint_directory_t::extents_count_to_file_size(32));
 }
 
 TEST(DiskFormatTest, LbaEntryT) {
     EXPECT_EQ(0u, offsetof(lba_entry_t, block_id));
+    EXPECT_EQ(8u, offsetof(lba_entry_t, ser_block_size));
+    EXPECT_EQ(12u, offsetof(lba_entry_t, uncompressed_ser_block_size));
     EXPECT_EQ(16u, offsetof(lba_entry_t, recency));
     EXPECT_EQ(24u, offsetof(lba_entry_t, offset));
     EXPECT_EQ(32u, sizeof(lba_entry_t));
@@ -65,11 +85,11 @@ TEST(DiskFormatTest, LbaEntryT) {
     ASSERT_TRUE(lba_entry_t::is_padding(&ent));
     flagged_off64_t real = flagged_off64_t::unused();
     real = flagged_off64_t::make(1);
-    ent = lba_entry_t::make(1, repli_timestamp_t::invalid, real, 1234);
+    ent = lba_entry_t::make(1, repli_timestamp_t::invalid, real, 1234, 0);
     ASSERT_FALSE(lba_entry_t::is_padding(&ent));
     flagged_off64_t deleteblock = flagged_off64_t::unused();
     deleteblock = flagged_off64_t::make(1);
-    ent = lba_entry_t::make(1, repli_timestamp_t::invalid, deleteblock, 1234);
+    ent = lba_entry_t::make(1, repli_timestamp_t::invalid, deleteblock, 1234, 4096);
     ASSERT_FALSE(lba_entry_t::is_padding(&ent));
 }
 
@@ -96,7 +116,8 @@ TEST(DiskFormatTest, LbaSuperblockT) {
 
 TEST(DiskFormatTest, DataBlockManagerMetablockMixinT) {
     EXPECT_EQ(0u, offsetof(data_block_manager::metablock_mixin_t, active_extent));
-    EXPECT_EQ(8u, sizeof(data_block_manager::metablock_mixin_t));
+    EXPECT_EQ(8u, offsetof(data_block_manager::metablock_mixin_t, gc_active_extent));
+    EXPECT_EQ(16u, sizeof(data_block_manager::metablock_mixin_t));
 }
 
 TEST(DiskFormatTest, ExtentManagerMetablockMixinT) {
@@ -130,5 +130,61 @@ TEST(MirroredTest, Durability) {
     unittest::run_in_thread_pool(boost::bind(&durability_tester_t::check_snapshotted_file_contents, &tester));
 }
 
+class scan_resistance_tester_t : public server_test_helper_t {
+protected:
+    void run_serializer_tests() {
+        cache_t::create(this->serializer);
+
+        const int num_hot_blocks = 16;
+        const int num_cold_blocks = 256;
+        std::vector<block_id_t> block_ids;
+
+        {
+            mirrored_cache_config_t cache_cfg;
+            cache_cfg.max_size = GIGABYTE;
+            cache_t cache(this->serializer, cache_cfg, &get_global_perfmon_collection());
+            transaction_t txn(&cache, rwi_write, 0, repli_timestamp_t::distant_past,
+                              order_token_t::ignore, WRITE_DURABILITY_HARD);
+            for (int i = 0; i < num_hot_blocks + num_cold_blocks; ++i) {
+                buf_lock_t buf(&txn);
+                block_ids.push_back(buf.get_block_id());
+                change_value(&buf, i);
+            }
+        }
+
+        // A cache with room for four times as many blocks as the hot set.
+        mirrored_cache_config_t cache_cfg;
+        cache_cfg.max_size = 4 * num_hot_blocks * this->serializer->get_block_size().ser_value();
+        cache_cfg.page_repl_policy = page_repl_policy_t::two_queue;
+        cache_t cache(this->serializer, cache_cfg, &get_global_perfmon_collection());
+
+        // Touch the hot blocks twice, so they get promoted.
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int i = 0; i < num_hot_blocks; ++i) {
+                transaction_t txn(&cache, rwi_read, order_token_t::ignore);
+                buf_lock_t buf(&txn, block_ids[i], rwi_read);
+                EXPECT_EQ(static_cast<uint32_t>(i), get_value(&buf));
+            }
+        }
+
+        // Then scan over all the other blocks once.
+        for (int i = num_hot_blocks; i < num_hot_blocks + num_cold_blocks; ++i) {
+            transaction_t txn(&cache, rwi_read, order_token_t::ignore);
+            buf_lock_t buf(&txn, block_ids[i], rwi_read);
+            EXPECT_EQ(static_cast<uint32_t>(i), get_value(&buf));
+        }
+
+        for (int i = 0; i < num_hot_blocks; ++i) {
+            EXPECT_TRUE(cache.contains_block(block_ids[i]));
+        }
+    }
+
+    void run_tests(UNUSED cache_t *cache) { }
+};
+
+TEST(MirroredTest, TwoQueueScanResistance) {
+    scan_resistance_tester_t().run();
+}
+
 }  // namespace unittest
 
@@ -79,6 +79,9 @@ public:
     void open_semantic_checking_file(scoped_ptr_t<semantic_checking_file_t> *file_out);
 #endif
 
+    // The contents of the file, for tests that look at or damage what's on disk.
+    std::vector<char> *file_data() { return &file_; }
+
 private:
     enum existence_state_t { no_file, temporary_file, permanent_file, unlinked_file };
     existence_state_t file_existence_state_;
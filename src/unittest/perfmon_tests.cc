@@ -4,6 +4,7 @@
 #include <math.h>
 
 #include <cmath>  // for std::isnan -- read the comment below.
+#include <limits>
 
 #include "perfmon/perfmon.hpp"
 #include "unittest/gtest.hpp"
@@ -57,4 +58,55 @@ TEST(PerfmonTest, StddevComputation) {
     }
 }
 
+TEST(PerfmonTest, HistogramBuckets) {
+    typedef perfmon_histogram::buckets_t t;
+
+    // Bucket indices are monotonic and every value maps to a bucket whose
+    // highest value is at least the value and within the relative error.
+    const double max_relative_error = 1.0 / (1 << (t::sub_bucket_bits - 1));
+    size_t last_index = 0;
+    for (uint64_t value = 0; value < 1000000; value += 1 + value / 50) {
+        size_t index = t::bucket_index(value);
+        ASSERT_LT(index, t::num_buckets);
+        EXPECT_LE(last_index, index);
+        last_index = index;
+
+        uint64_t highest = t::bucket_highest_value(index);
+        EXPECT_LE(value, highest);
+        EXPECT_LE(highest - value, value * max_relative_error);
+    }
+    EXPECT_EQ(t::num_buckets - 1, t::bucket_index(std::numeric_limits<uint64_t>::max()));
+    EXPECT_EQ(std::numeric_limits<uint64_t>::max(),
+              t::bucket_highest_value(t::num_buckets - 1));
+}
+
+TEST(PerfmonTest, HistogramPercentiles) {
+    typedef perfmon_histogram::buckets_t t;
+
+    {
+        t buckets;
+        EXPECT_EQ(0u, buckets.count());
+        EXPECT_EQ(0u, buckets.percentile(99));
+    }
+
+    // 1..10000 split over two buckets_t, as if recorded on two threads.
+    t first, second;
+    for (uint64_t i = 1; i <= 10000; ++i) {
+        (i % 2 == 0 ? &first : &second)->record(i);
+    }
+    first.aggregate(second);
+    EXPECT_EQ(10000u, first.count());
+    EXPECT_EQ(10000u, first.max());
+
+    const double max_relative_error = 1.0 / (1 << (t::sub_bucket_bits - 1));
+    const double percentiles[] = { 50, 90, 99, 99.9 };
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i) {
+        double expected = percentiles[i] * 100;
+        uint64_t actual = first.percentile(percentiles[i]);
+        EXPECT_LE(expected, actual);
+        EXPECT_NEAR(expected, actual, expected * max_relative_error);
+    }
+    EXPECT_EQ(10000u, first.percentile(100));
+}
+
 }  // namespace unittest
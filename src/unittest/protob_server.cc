@@ -0,0 +1,185 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include <algorithm>
+#include <set>
+#include <string>
+
+#include "errors.hpp"
+#include <boost/bind.hpp>
+
+#include "arch/timing.hpp"
+#include "clustering/administration/metadata.hpp"
+#include "containers/archive/tcp_conn_stream.hpp"
+#include "protob/protob.hpp"
+#include "rdb_protocol/counted_term.hpp"
+#include "rdb_protocol/pb_server.hpp"
+#include "unittest/dummy_metadata_controller.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+struct test_protob_context_t {
+    test_protob_context_t() : interruptor(NULL) { }
+    static const int32_t no_auth_magic_number = VersionDummy::V0_1;
+    static const int32_t auth_magic_number = VersionDummy::V0_2;
+    signal_t *interruptor;
+};
+
+Response test_on_unparsable_query(ql::protob_t<Query> q, std::string) {
+    Response res;
+    res.set_token((q.has() && q->has_token()) ? q->token() : -1);
+    res.set_type(Response::CLIENT_ERROR);
+    return res;
+}
+
+/* Takes as many milliseconds to answer a query as its token says, and keeps
+track of how many queries it was answering at once. */
+class napping_query_handler_t {
+public:
+    napping_query_handler_t() : num_running(0), max_num_running(0) { }
+
+    bool handle(ql::protob_t<Query> q, Response *res, test_protob_context_t *ctx) {
+        ++num_running;
+        max_num_running = std::max(max_num_running, num_running);
+        res->set_token(q->token());
+        try {
+            nap(q->token(), ctx->interruptor);
+            res->set_type(Response::SUCCESS_ATOM);
+        } catch (const interrupted_exc_t &) {
+            res->set_type(Response::RUNTIME_ERROR);
+        }
+        --num_running;
+        return true;
+    }
+
+    int num_running;
+    int max_num_running;
+};
+
+class test_protob_client_t {
+public:
+    explicit test_protob_client_t(int port)
+        : conn(*get_unittest_addresses().begin(), port, &non_interruptor) {
+        int32_t magic_number = VersionDummy::V0_1;
+        EXPECT_EQ(static_cast<int64_t>(sizeof(magic_number)),
+                  conn.write(&magic_number, sizeof(magic_number)));
+    }
+
+    void send_query(int64_t token) {
+        Query q;
+        q.set_type(Query::CONTINUE);
+        q.set_token(token);
+        std::string data;
+        q.SerializeToString(&data);
+        int32_t size = data.size();
+        EXPECT_EQ(static_cast<int64_t>(sizeof(size)), conn.write(&size, sizeof(size)));
+        EXPECT_EQ(static_cast<int64_t>(size), conn.write(data.data(), size));
+    }
+
+    Response receive_response() {
+        int32_t size;
+        EXPECT_EQ(static_cast<int64_t>(sizeof(size)), force_read(&conn, &size, sizeof(size)));
+        scoped_array_t<char> data(size);
+        EXPECT_EQ(static_cast<int64_t>(size), force_read(&conn, data.data(), size));
+        Response res;
+        EXPECT_TRUE(res.ParseFromArray(data.data(), size));
+        return res;
+    }
+
+    int64_t receive_token() {
+        Response res = receive_response();
+        EXPECT_EQ(Response::SUCCESS_ATOM, res.type());
+        return res.token();
+    }
+
+    void shutdown_write() {
+        conn.shutdown_write();
+    }
+
+private:
+    cond_t non_interruptor;
+    tcp_conn_stream_t conn;
+};
+
+/* `OutOfOrder` checks that a slow query doesn't hold up the response to a fast
+query that was sent after it on the same connection. */
+
+void run_out_of_order_test() {
+    dummy_semilattice_controller_t<auth_semilattice_metadata_t> auth((auth_semilattice_metadata_t()));
+    napping_query_handler_t handler;
+    protob_server_t<ql::protob_t<Query>, Response, test_protob_context_t> server(
+        get_unittest_addresses(), ANY_PORT,
+        boost::bind(&napping_query_handler_t::handle, &handler, _1, _2, _3),
+        &test_on_unparsable_query, auth.get_view(), CORO_UNORDERED);
+
+    test_protob_client_t client(server.get_port());
+    client.send_query(500);
+    client.send_query(1);
+    EXPECT_EQ(1, client.receive_token());
+    EXPECT_EQ(500, client.receive_token());
+    EXPECT_EQ(2, handler.max_num_running);
+}
+
+TEST(ProtobServerTest, OutOfOrder) {
+    unittest::run_in_thread_pool(&run_out_of_order_test, 2);
+}
+
+/* `ConcurrencyLimit` checks that no more than the configured number of queries
+from one connection run at once, and that the rest still get answered. */
+
+void run_concurrency_limit_test() {
+    dummy_semilattice_controller_t<auth_semilattice_metadata_t> auth((auth_semilattice_metadata_t()));
+    napping_query_handler_t handler;
+    const int max_concurrent_queries = 3;
+    protob_server_t<ql::protob_t<Query>, Response, test_protob_context_t> server(
+        get_unittest_addresses(), ANY_PORT,
+        boost::bind(&napping_query_handler_t::handle, &handler, _1, _2, _3),
+        &test_on_unparsable_query, auth.get_view(), CORO_UNORDERED,
+        max_concurrent_queries);
+
+    test_protob_client_t client(server.get_port());
+    const int num_queries = 10;
+    for (int i = 0; i < num_queries; ++i) {
+        client.send_query(50 + i);
+    }
+    std::set<int64_t> tokens;
+    for (int i = 0; i < num_queries; ++i) {
+        tokens.insert(client.receive_token());
+    }
+    EXPECT_EQ(static_cast<size_t>(num_queries), tokens.size());
+    EXPECT_EQ(max_concurrent_queries, handler.max_num_running);
+}
+
+TEST(ProtobServerTest, ConcurrencyLimit) {
+    unittest::run_in_thread_pool(&run_concurrency_limit_test, 2);
+}
+
+/* `ResponsesAfterClose` checks that the queries a client sent before it closed
+its half of the connection still get their responses. */
+
+void run_responses_after_close_test() {
+    dummy_semilattice_controller_t<auth_semilattice_metadata_t> auth((auth_semilattice_metadata_t()));
+    napping_query_handler_t handler;
+    protob_server_t<ql::protob_t<Query>, Response, test_protob_context_t> server(
+        get_unittest_addresses(), ANY_PORT,
+        boost::bind(&napping_query_handler_t::handle, &handler, _1, _2, _3),
+        &test_on_unparsable_query, auth.get_view(), CORO_UNORDERED);
+
+    test_protob_client_t client(server.get_port());
+    const int num_queries = 5;
+    for (int i = 0; i < num_queries; ++i) {
+        client.send_query(100 + i);
+    }
+    client.shutdown_write();
+    std::set<int64_t> tokens;
+    for (int i = 0; i < num_queries; ++i) {
+        tokens.insert(client.receive_response().token());
+    }
+    EXPECT_EQ(static_cast<size_t>(num_queries), tokens.size());
+}
+
+TEST(ProtobServerTest, ResponsesAfterClose) {
+    unittest::run_in_thread_pool(&run_responses_after_close_test, 2);
+}
+
+}  // namespace unittest
@@ -1,12 +1,14 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "unittest/gtest.hpp"
 
+#include "btree/operations.hpp"
 #include "clustering/administration/metadata.hpp"
 #include "clustering/immediate_consistency/branch/broadcaster.hpp"
 #include "clustering/immediate_consistency/branch/listener.hpp"
 #include "clustering/immediate_consistency/branch/replier.hpp"
 #include "extproc/extproc_pool.hpp"
 #include "extproc/extproc_spawner.hpp"
+#include "rdb_protocol/btree.hpp"
 #include "rdb_protocol/minidriver.hpp"
 #include "rdb_protocol/pb_utils.hpp"
 #include "rdb_protocol/env.hpp"
@@ -14,6 +16,7 @@
 #include "rdb_protocol/sym.hpp"
 #include "rpc/directory/read_manager.hpp"
 #include "rpc/semilattice/semilattice_manager.hpp"
+#include "serializer/config.hpp"
 #include "unittest/branch_history_manager.hpp"
 #include "unittest/clustering_utils.hpp"
 #include "unittest/dummy_metadata_controller.hpp"
@@ -60,7 +63,8 @@ void run_with_broadcaster(
 
     boost::shared_ptr<semilattice_readwrite_view_t<auth_semilattice_metadata_t> > dummy_auth;
     rdb_protocol_t::context_t ctx(&extproc_pool, NULL, slm.get_root_view(),
-                                  dummy_auth, &read_manager, generate_uuid());
+                                  dummy_auth, &read_manager, generate_uuid(),
+                                  NULL, NULL);
 
     /* Set up a broadcaster and initial listener */
     test_store_t<rdb_protocol_t> initial_store(&io_backender, &order_source, &ctx);
@@ -233,6 +237,98 @@ TEST(RDBProtocolBackfill, BackfillLargeValues) {
      run_in_thread_pool_with_broadcaster(boost::bind(&run_backfill_test, 300, _1, _2, _3, _4, _5, _6, _7, _8));
 }
 
+void check_key_value_pairs_round_trip(int compression_level) {
+    const int num_pairs = 100;
+    write_message_t wm;
+    repli_timestamp_t max_recency = repli_timestamp_t::distant_past;
+    for (int i = 0; i < num_pairs; ++i) {
+        repli_timestamp_t recency;
+        recency.longtime = i;
+        max_recency = recency;
+        wm << rdb_protocol_details::backfill_atom_t(store_key_t(strprintf("%d", i)),
+                                                    generate_document(300, strprintf("%d", i)),
+                                                    recency);
+    }
+
+    rdb_protocol_t::backfill_chunk_t::key_value_pairs_t pairs(num_pairs, max_recency,
+                                                              wm, compression_level);
+    EXPECT_EQ(compression_level != 0, pairs.compressed);
+    if (pairs.compressed) {
+        // The padding compresses very well.
+        EXPECT_LT(static_cast<int64_t>(pairs.data.size()), pairs.uncompressed_size / 2);
+    }
+    EXPECT_EQ(max_recency, rdb_protocol_t::backfill_chunk_t::set_keys(pairs).get_btree_repli_timestamp());
+
+    std::vector<rdb_protocol_details::backfill_atom_t> atoms;
+    pairs.get_atoms(&atoms);
+    ASSERT_EQ(static_cast<size_t>(num_pairs), atoms.size());
+    for (int i = 0; i < num_pairs; ++i) {
+        EXPECT_EQ(store_key_t(strprintf("%d", i)), atoms[i].key);
+        EXPECT_EQ(*generate_document(300, strprintf("%d", i)), *atoms[i].value);
+        EXPECT_EQ(static_cast<uint64_t>(i), atoms[i].recency.longtime);
+    }
+}
+
+void run_key_value_pairs_chunk_test() {
+    check_key_value_pairs_round_trip(BACKFILL_CHUNK_COMPRESSION_LEVEL);
+    check_key_value_pairs_round_trip(0);
+}
+
+TEST(RDBProtocolBackfill, KeyValuePairsChunk) {
+    unittest::run_in_thread_pool(&run_key_value_pairs_chunk_test);
+}
+
+void run_receive_key_value_pairs_test() {
+    temp_file_t temp_file;
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(&file_opener, standard_serializer_t::static_config_t());
+    standard_serializer_t serializer(standard_serializer_t::dynamic_config_t(),
+                                     &file_opener,
+                                     &get_global_perfmon_collection());
+    rdb_protocol_t::store_t store(&serializer, "unit_test_store", GIGABYTE, true,
+                                  &get_global_perfmon_collection(), NULL,
+                                  &io_backender, base_path_t("."));
+    cond_t non_interruptor;
+
+    // Far more rows than fit in a leaf node, so applying the chunk splits the root
+    // and the later atoms have to go through internal nodes.
+    const int num_pairs = 2000;
+    write_message_t wm;
+    repli_timestamp_t recency;
+    recency.longtime = 1;
+    for (int i = 0; i < num_pairs; ++i) {
+        wm << rdb_protocol_details::backfill_atom_t(store_key_t(strprintf("%d", i)),
+                                                    generate_document(300, strprintf("%d", i)),
+                                                    recency);
+    }
+    rdb_protocol_t::backfill_chunk_t::key_value_pairs_t pairs(num_pairs, recency, wm, 0);
+    {
+        write_token_pair_t token_pair;
+        store.new_write_token_pair(&token_pair);
+        store.receive_backfill(rdb_protocol_t::backfill_chunk_t::set_keys(pairs),
+                               &token_pair, &non_interruptor);
+    }
+
+    for (int i = 0; i < num_pairs; ++i) {
+        read_token_pair_t token_pair;
+        store.new_read_token_pair(&token_pair);
+        scoped_ptr_t<transaction_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        store.acquire_superblock_for_read(rwi_read, &token_pair.main_read_token,
+                                          &txn, &superblock, &non_interruptor, false);
+        point_read_response_t response;
+        rdb_get(store_key_t(strprintf("%d", i)), store.btree.get(), txn.get(),
+                superblock.get(), &response);
+        ASSERT_TRUE(response.data.has());
+        EXPECT_EQ(*generate_document(300, strprintf("%d", i)), *response.data);
+    }
+}
+
+TEST(RDBProtocolBackfill, ReceiveKeyValuePairs) {
+    unittest::run_in_thread_pool(&run_receive_key_value_pairs_test);
+}
+
 void run_sindex_backfill_test(std::pair<io_backender_t *, simple_mailbox_cluster_t *> io_backender_and_cluster,
                               branch_history_manager_t<rdb_protocol_t> *branch_history_manager,
                               clone_ptr_t<watchable_t<boost::optional<boost::optional<broadcaster_business_card_t<rdb_protocol_t> > > > > broadcaster_metadata_view,
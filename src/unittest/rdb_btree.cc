@@ -348,6 +348,170 @@ TEST(RDBBtree, SindexPostConstruct) {
     run_in_thread_pool(&run_sindex_post_construction);
 }
 
+/* Post-constructs the sindex directly, without registering a modification queue,
+so there mustn't be any concurrent writes. */
+void post_construct_sindex_in_mode(btree_store_t<rdb_protocol_t> *store,
+                                   const std::string &sindex_id,
+                                   sindex_build_mode_t mode,
+                                   const sindex_bulk_build_limits_t &bulk_limits) {
+    cond_t dummy_interruptor;
+    std::set<uuid_u> sindexes_to_post_construct;
+    {
+        write_token_pair_t token_pair;
+        store->new_write_token_pair(&token_pair);
+
+        scoped_ptr_t<transaction_t> txn;
+        scoped_ptr_t<real_superblock_t> super_block;
+        store->acquire_superblock_for_write(rwi_write, repli_timestamp_t::invalid,
+                                            1, WRITE_DURABILITY_SOFT,
+                                            &token_pair, &txn, &super_block, &dummy_interruptor);
+
+        scoped_ptr_t<buf_lock_t> sindex_block;
+        store->acquire_sindex_block_for_write(
+                &token_pair, txn.get(), &sindex_block,
+                super_block->get_sindex_block_id(),
+                &dummy_interruptor);
+
+        std::map<std::string, secondary_index_t> sindexes;
+        store->get_sindexes(sindex_block.get(), txn.get(), &sindexes);
+        guarantee(std_contains(sindexes, sindex_id));
+        sindexes_to_post_construct.insert(sindexes[sindex_id].id);
+    }
+
+    post_construct_secondary_indexes(store, sindexes_to_post_construct,
+                                     &dummy_interruptor, mode, bulk_limits);
+
+    {
+        write_token_pair_t token_pair;
+        store->new_write_token_pair(&token_pair);
+
+        scoped_ptr_t<transaction_t> txn;
+        scoped_ptr_t<real_superblock_t> super_block;
+        store->acquire_superblock_for_write(rwi_write, repli_timestamp_t::invalid,
+                                            1, WRITE_DURABILITY_SOFT,
+                                            &token_pair, &txn, &super_block, &dummy_interruptor);
+
+        scoped_ptr_t<buf_lock_t> sindex_block;
+        store->acquire_sindex_block_for_write(
+                &token_pair, txn.get(), &sindex_block,
+                super_block->get_sindex_block_id(),
+                &dummy_interruptor);
+
+        UNUSED bool b = store->mark_index_up_to_date(sindex_id, txn.get(),
+                                                     sindex_block.get());
+    }
+}
+
+void run_sindex_bulk_post_construction() {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    rdb_protocol_t::store_t store(
+            &serializer,
+            "unit_test_store",
+            GIGABYTE,
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."));
+
+    insert_rows(0, TOTAL_KEYS_TO_INSERT, &store);
+
+    std::string incremental_id = create_sindex(&store);
+    post_construct_sindex_in_mode(&store, incremental_id,
+                                  sindex_build_mode_t::incremental,
+                                  sindex_bulk_build_limits_t());
+    _check_keys_are_present(&store, incremental_id);
+
+    // With the default limits all of the rows fit into one in-memory run.
+    std::string in_memory_id = create_sindex(&store);
+    post_construct_sindex_in_mode(&store, in_memory_id, sindex_build_mode_t::bulk,
+                                  sindex_bulk_build_limits_t());
+    _check_keys_are_present(&store, in_memory_id);
+
+    // Small limits make the builder spill a few dozen runs, each of them split
+    // over several queue elements, and merge them with partial write batches.
+    sindex_bulk_build_limits_t spill_limits;
+    spill_limits.run_size = 4 * KILOBYTE;
+    spill_limits.spill_chunk = 7;
+    spill_limits.write_batch = 10;
+    std::string spilled_id = create_sindex(&store);
+    post_construct_sindex_in_mode(&store, spilled_id, sindex_build_mode_t::bulk,
+                                  spill_limits);
+    _check_keys_are_present(&store, spilled_id);
+}
+
+TEST(RDBBtree, SindexBulkPostConstruct) {
+    run_in_thread_pool(&run_sindex_bulk_post_construction);
+}
+
+/* `DISABLED_SindexBulkPostConstructBenchmark` times the bulk build against the
+incremental one that `SindexPostConstruct` uses. It only runs with
+`--gtest_also_run_disabled_tests`. */
+
+double time_post_construct_sindex(btree_store_t<rdb_protocol_t> *store,
+                                  sindex_build_mode_t mode) {
+    std::string sindex_id = create_sindex(store);
+    ticks_t start = get_ticks();
+    post_construct_sindex_in_mode(store, sindex_id, mode, sindex_bulk_build_limits_t());
+    const double secs = ticks_to_secs(get_ticks() - start);
+    _check_keys_are_present(store, sindex_id);
+    return secs;
+}
+
+void run_sindex_bulk_post_construction_benchmark() {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    rdb_protocol_t::store_t store(
+            &serializer,
+            "unit_test_store",
+            GIGABYTE,
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."));
+
+    insert_rows(0, TOTAL_KEYS_TO_INSERT, &store);
+
+    const double incremental_secs
+        = time_post_construct_sindex(&store, sindex_build_mode_t::incremental);
+    const double bulk_secs
+        = time_post_construct_sindex(&store, sindex_build_mode_t::bulk);
+    printf("Sindex post construction of %d rows: %.3fs incremental, %.3fs bulk\n",
+           TOTAL_KEYS_TO_INSERT, incremental_secs, bulk_secs);
+}
+
+TEST(RDBBtree, DISABLED_SindexBulkPostConstructBenchmark) {
+    run_in_thread_pool(&run_sindex_bulk_post_construction_benchmark);
+}
+
 void run_erase_range_test() {
     recreate_temporary_directory(base_path_t("."));
     temp_file_t temp_file;
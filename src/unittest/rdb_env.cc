@@ -1,7 +1,11 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "unittest/rdb_env.hpp"
 
+#include <limits>
+
+#include "concurrency/wait_any.hpp"
 #include "rdb_protocol/func.hpp"
+#include "rdb_protocol/term_walker.hpp"
 
 namespace unittest {
 
@@ -43,7 +47,10 @@ mock_namespace_repo_t::namespace_cache_entry_t *mock_namespace_repo_t::get_cache
 
 
 mock_namespace_interface_t::mock_namespace_interface_t(mock_namespace_repo_t *_parent) :
-    parent(_parent) {
+    parent(_parent),
+    rget_batch_rows(std::numeric_limits<size_t>::max()),
+    read_gate(NULL),
+    reads_waiting(0) {
     ready_cond.pulse();
 }
 
@@ -67,7 +74,18 @@ void mock_namespace_interface_t::read_outdated(const rdb_protocol_t::read_t &que
     if (interruptor->is_pulsed()) {
         throw interrupted_exc_t();
     }
-    read_visitor_t v(&data, response);
+    if (read_gate != NULL && !read_gate->is_pulsed()) {
+        signal_t *gate = read_gate;
+        ++reads_waiting;
+        try {
+            wait_interruptible(gate, interruptor);
+        } catch (const interrupted_exc_t &) {
+            --reads_waiting;
+            throw;
+        }
+        --reads_waiting;
+    }
+    read_visitor_t v(&data, rget_batch_rows, response);
     boost::apply_visitor(v, query.read);
 }
 
@@ -86,6 +104,19 @@ std::map<store_key_t, scoped_cJSON_t*>* mock_namespace_interface_t::get_data() {
     return &data;
 }
 
+void mock_namespace_interface_t::set_rget_batch_rows(size_t rows) {
+    guarantee(rows > 0);
+    rget_batch_rows = rows;
+}
+
+void mock_namespace_interface_t::set_read_gate(signal_t *gate) {
+    read_gate = gate;
+}
+
+int mock_namespace_interface_t::reads_waiting_on_gate() const {
+    return reads_waiting;
+}
+
 void mock_namespace_interface_t::read_visitor_t::operator()(const rdb_protocol_t::point_read_t &get) {
     response->response = rdb_protocol_t::point_read_response_t();
     rdb_protocol_t::point_read_response_t &res = boost::get<rdb_protocol_t::point_read_response_t>(response->response);
@@ -97,8 +128,55 @@ void mock_namespace_interface_t::read_visitor_t::operator()(const rdb_protocol_t
     }
 }
 
-void NORETURN mock_namespace_interface_t::read_visitor_t::operator()(UNUSED const rdb_protocol_t::rget_read_t &rget) {
-    throw cannot_perform_query_exc_t("unimplemented");
+void mock_namespace_interface_t::read_visitor_t::operator()(const rdb_protocol_t::batched_point_read_t &get) {
+    response->response = rdb_protocol_t::batched_point_read_response_t();
+    rdb_protocol_t::batched_point_read_response_t &res = boost::get<rdb_protocol_t::batched_point_read_response_t>(response->response);
+
+    for (auto it = get.keys.begin(); it != get.keys.end(); ++it) {
+        if (data->find(*it) != data->end()) {
+            res.rows[*it] = make_counted<ql::datum_t>(scoped_cJSON_t(data->at(*it)->DeepCopy()));
+        }
+    }
+}
+
+void mock_namespace_interface_t::read_visitor_t::operator()(const rdb_protocol_t::rget_read_t &rget) {
+    if (rget.sindex || rget.terminal || !rget.transform.empty()) {
+        throw cannot_perform_query_exc_t("unimplemented");
+    }
+    typedef rdb_protocol_t::rget_read_response_t::stream_t stream_t;
+    response->response = rdb_protocol_t::rget_read_response_t();
+    rdb_protocol_t::rget_read_response_t &res = boost::get<rdb_protocol_t::rget_read_response_t>(response->response);
+    res.result = stream_t();
+    stream_t *stream = boost::get<stream_t>(&res.result);
+
+    const key_range_t &range = rget.region.inner;
+    std::vector<std::map<store_key_t, scoped_cJSON_t *>::iterator> rows;
+    if (!backward(rget.sorting)) {
+        res.last_considered_key = range.left;
+        for (auto it = data->lower_bound(range.left);
+             it != data->end() && range.contains_key(it->first)
+                 && rows.size() < rget_batch_rows;
+             ++it) {
+            rows.push_back(it);
+        }
+    } else {
+        res.last_considered_key = range.right.unbounded ? store_key_t::max() : range.right.key;
+        auto it = range.right.unbounded ? data->end() : data->lower_bound(range.right.key);
+        while (it != data->begin() && rows.size() < rget_batch_rows) {
+            --it;
+            if (!range.contains_key(it->first)) {
+                break;
+            }
+            rows.push_back(it);
+        }
+    }
+
+    for (auto it = rows.begin(); it != rows.end(); ++it) {
+        stream->push_back(rdb_protocol_details::rget_item_t(
+            (*it)->first,
+            make_counted<ql::datum_t>(scoped_cJSON_t((*it)->second->DeepCopy()))));
+        res.last_considered_key = (*it)->first;
+    }
 }
 
 void NORETURN mock_namespace_interface_t::read_visitor_t::operator()(UNUSED const rdb_protocol_t::distribution_read_t &dg) {
@@ -110,8 +188,9 @@ void NORETURN mock_namespace_interface_t::read_visitor_t::operator()(UNUSED cons
 }
 
 mock_namespace_interface_t::read_visitor_t::read_visitor_t(std::map<store_key_t, scoped_cJSON_t *> *_data,
+                                                           size_t _rget_batch_rows,
                                                            rdb_protocol_t::read_response_t *_response) :
-    data(_data), response(_response) {
+    data(_data), rget_batch_rows(_rget_batch_rows), response(_response) {
     // Do nothing
 }
 
@@ -263,7 +342,8 @@ namespace_id_t test_rdb_env_t::add_table(const std::string &table_name,
                                       table_name_string,
                                       primary_key,
                                       port_defaults::reql_port,
-                                      GIGABYTE);
+                                      GIGABYTE,
+                                      false);
 
     // Set up initial data
     std::map<store_key_t, scoped_cJSON_t*> *data = new std::map<store_key_t, scoped_cJSON_t*>();
@@ -316,6 +396,8 @@ test_rdb_env_t::instance_t::instance_t(test_rdb_env_t *test_env) :
                            NULL,
                            &interruptor,
                            test_env->machine_id,
+                           NULL,
+                           NULL,
                            std::map<std::string, ql::wire_func_t>()));
     rdb_ns_repo.set_env(env.get());
 
@@ -333,14 +415,26 @@ ql::env_t *test_rdb_env_t::instance_t::get() {
 }
 
 std::map<store_key_t, scoped_cJSON_t*>* test_rdb_env_t::instance_t::get_data(const namespace_id_t &ns_id) {
+    return get_ns_if(ns_id)->get_data();
+}
+
+mock_namespace_interface_t *test_rdb_env_t::instance_t::get_ns_if(const namespace_id_t &ns_id) {
     mock_namespace_interface_t *ns_if = rdb_ns_repo.get_ns_if(ns_id);
     guarantee(ns_if != NULL);
-    return ns_if->get_data();
+    return ns_if;
 }
 
 void test_rdb_env_t::instance_t::interrupt() {
     interruptor.pulse();
 }
 
+counted_t<ql::func_t> compile_func(ql::r::reql_t &&fun) {
+    ql::protob_t<Term> twrap = fun.release_counted();
+    ql::propagate_backtrace(twrap.get(), ql::make_counted_backtrace().get());
+    ql::compile_env_t empty_compile_env((ql::var_visibility_t()));
+    counted_t<ql::func_term_t> func_term
+        = make_counted<ql::func_term_t>(&empty_compile_env, twrap);
+    return func_term->eval_to_func(ql::var_scope_t());
 }
 
+}
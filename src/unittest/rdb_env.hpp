@@ -18,6 +18,7 @@
 #include "extproc/extproc_pool.hpp"
 #include "extproc/extproc_spawner.hpp"
 #include "rdb_protocol/env.hpp"
+#include "rdb_protocol/minidriver.hpp"
 #include "rpc/connectivity/multiplexer.hpp"
 #include "rpc/directory/read_manager.hpp"
 #include "rpc/directory/write_manager.hpp"
@@ -61,18 +62,32 @@ public:
 
     std::map<store_key_t, scoped_cJSON_t*>* get_data();
 
+    // Primary key range reads return at most this many rows at a time.
+    void set_rget_batch_rows(size_t rows);
+
+    // While `gate` is set and not pulsed, reads wait for it before they run.
+    void set_read_gate(signal_t *gate);
+    int reads_waiting_on_gate() const;
+
 private:
     cond_t ready_cond;
+    size_t rget_batch_rows;
+    signal_t *read_gate;
+    int reads_waiting;
 
     struct read_visitor_t : public boost::static_visitor<void> {
         void operator()(const rdb_protocol_t::point_read_t &get);
-        void NORETURN operator()(UNUSED const rdb_protocol_t::rget_read_t &rget);
+        void operator()(const rdb_protocol_t::batched_point_read_t &get);
+        void operator()(const rdb_protocol_t::rget_read_t &rget);
         void NORETURN operator()(UNUSED const rdb_protocol_t::distribution_read_t &dg);
         void NORETURN operator()(UNUSED const rdb_protocol_t::sindex_list_t &sl);
 
-        read_visitor_t(std::map<store_key_t, scoped_cJSON_t*> *_data, rdb_protocol_t::read_response_t *_response);
+        read_visitor_t(std::map<store_key_t, scoped_cJSON_t*> *_data,
+                       size_t _rget_batch_rows,
+                       rdb_protocol_t::read_response_t *_response);
 
         std::map<store_key_t, scoped_cJSON_t*> *data;
+        size_t rget_batch_rows;
         rdb_protocol_t::read_response_t *response;
     };
 
@@ -163,6 +178,7 @@ public:
         void interrupt();
 
         std::map<store_key_t, scoped_cJSON_t*>* get_data(const namespace_id_t &ns_id);
+        mock_namespace_interface_t *get_ns_if(const namespace_id_t &ns_id);
 
     private:
         dummy_semilattice_controller_t<cluster_semilattice_metadata_t> dummy_semilattice_controller;
@@ -189,6 +205,9 @@ private:
     std::map<namespace_id_t, std::map<store_key_t, scoped_cJSON_t*>*> initial_datas;
 };
 
+// Compiles a function built with the minidriver, like `r::fun(x, r::var(x)["a"])`.
+counted_t<ql::func_t> compile_func(ql::r::reql_t &&fun);
+
 }
 
 #endif // UNITTEST_RDB_ENV_HPP_
@@ -0,0 +1,125 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include "concurrency/cond_var.hpp"
+#include "rdb_protocol/env.hpp"
+#include "rdb_protocol/func.hpp"
+#include "rdb_protocol/minidriver.hpp"
+#include "rdb_protocol/transform_visitors.hpp"
+#include "unittest/rdb_env.hpp"
+
+namespace unittest {
+
+const ql::pb::dummy_var_t x = ql::pb::dummy_var_t::OBJORSEQ_VARNUM;
+
+// The functions `obj_or_seq_op_term_t` builds for `get_field`, `pluck` and
+// `has_fields` on a sequence.
+ql::r::reql_t no_recurse(Term::TermType type, const std::string &field) {
+    return ql::r::reql_t(type, ql::r::var(x), field,
+                         ql::r::optarg("_NO_RECURSE_", ql::r::boolean(true)));
+}
+
+ql::r::reql_t no_recurse(Term::TermType type, const std::string &field1,
+                         const std::string &field2) {
+    return ql::r::reql_t(type, ql::r::var(x), field1, field2,
+                         ql::r::optarg("_NO_RECURSE_", ql::r::boolean(true)));
+}
+
+// Rows `{id: i, a: i}`, with `b` set on even rows and `c` set to null on every
+// third row.
+std::vector<counted_t<const ql::datum_t> > make_field_rows() {
+    std::vector<counted_t<const ql::datum_t> > rows;
+    for (int i = 0; i < 12; ++i) {
+        std::map<std::string, counted_t<const ql::datum_t> > fields;
+        fields["id"] = make_counted<ql::datum_t>(static_cast<double>(i));
+        fields["a"] = make_counted<ql::datum_t>(static_cast<double>(i));
+        if (i % 2 == 0) {
+            fields["b"] = make_counted<ql::datum_t>("even");
+        }
+        if (i % 3 == 0) {
+            fields["c"] = make_counted<ql::datum_t>(ql::datum_t::R_NULL);
+        }
+        rows.push_back(make_counted<ql::datum_t>(std::move(fields)));
+    }
+    return rows;
+}
+
+// Checks that reading just the fields gives the same results as evaluating the
+// transform on the whole row.
+void check_field_access(ql::env_t *env,
+                        const rdb_protocol_details::transform_variant_t &transform,
+                        ql::field_access_t::kind_t expected_kind) {
+    ql::field_access_t access;
+    ASSERT_TRUE(query_language::transform_field_access(transform, &access));
+    EXPECT_EQ(expected_kind, access.kind);
+
+    std::vector<counted_t<const ql::datum_t> > rows = make_field_rows();
+    for (auto it = rows.begin(); it != rows.end(); ++it) {
+        std::vector<counted_t<const ql::datum_t> > expected;
+        query_language::transform_apply(env, *it, &transform, &expected);
+        std::vector<counted_t<const ql::datum_t> > actual;
+        query_language::field_access_apply(access, lazy_json_t(*it), &actual);
+        ASSERT_EQ(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_EQ(*expected[i], *actual[i]);
+        }
+    }
+}
+
+void run_field_access_test() {
+    cond_t non_interruptor;
+    ql::env_t env(&non_interruptor);
+
+    for (int f = 0; f < 3; ++f) {
+        const std::string field = f == 0 ? "a" : (f == 1 ? "b" : "c");
+        check_field_access(
+            &env,
+            rdb_protocol_details::transform_variant_t(ql::concatmap_wire_func_t(
+                compile_func(ql::r::fun(x, ql::r::reql_t(
+                    Term::DEFAULT,
+                    ql::r::array(no_recurse(Term::GET_FIELD, field)),
+                    ql::r::array()))))),
+            ql::field_access_t::GET_FIELD);
+        check_field_access(
+            &env,
+            rdb_protocol_details::transform_variant_t(ql::map_wire_func_t(
+                compile_func(ql::r::fun(x, no_recurse(Term::PLUCK, field, "id"))))),
+            ql::field_access_t::PLUCK);
+        check_field_access(
+            &env,
+            rdb_protocol_details::transform_variant_t(filter_transform_t(
+                ql::wire_func_t(compile_func(
+                    ql::r::fun(x, no_recurse(Term::HAS_FIELDS, "id", field)))),
+                boost::optional<ql::wire_func_t>())),
+            ql::field_access_t::HAS_FIELDS);
+    }
+}
+
+TEST(RDBFieldAccess, MatchesTransforms) {
+    run_in_thread_pool(&run_field_access_test);
+}
+
+void run_reject_field_access_test() {
+    ql::field_access_t access;
+    // Field names that aren't literals.
+    EXPECT_FALSE(compile_func(ql::r::fun(x, ql::r::reql_t(
+        Term::PLUCK, ql::r::var(x), ql::r::var(x)["a"])))->is_field_access(&access));
+    // Not a pluck of the function's argument.
+    EXPECT_FALSE(compile_func(ql::r::fun(x, ql::r::var(x)["a"].pluck("b")))
+                 ->is_field_access(&access));
+    // `get_field` without the `default` that skips rows missing the field.
+    EXPECT_FALSE(compile_func(ql::r::fun(x, ql::r::var(x)["a"]))
+                 ->is_field_access(&access));
+
+    // The right function, but the wrong kind of transform for it.
+    EXPECT_FALSE(query_language::transform_field_access(
+        rdb_protocol_details::transform_variant_t(ql::map_wire_func_t(
+            compile_func(ql::r::fun(x, no_recurse(Term::HAS_FIELDS, "a"))))),
+        &access));
+}
+
+TEST(RDBFieldAccess, RejectsOtherFunctions) {
+    run_in_thread_pool(&run_reject_field_access_test);
+}
+
+}  // namespace unittest
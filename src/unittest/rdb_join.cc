@@ -0,0 +1,166 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include <algorithm>
+
+#include "arch/io/disk.hpp"
+#include "concurrency/cond_var.hpp"
+#include "config/args.hpp"
+#include "rdb_protocol/counted_term.hpp"
+#include "rdb_protocol/datum_stream.hpp"
+#include "rdb_protocol/env.hpp"
+#include "rdb_protocol/func.hpp"
+#include "rdb_protocol/minidriver.hpp"
+#include "unittest/rdb_env.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+// Documents `{id: i, k: (i * multiplier) % modulus}` for i in [0, count).
+counted_t<ql::datum_stream_t> make_rows(size_t count, size_t multiplier, size_t modulus) {
+    std::vector<counted_t<const ql::datum_t> > rows;
+    for (size_t i = 0; i < count; ++i) {
+        std::map<std::string, counted_t<const ql::datum_t> > fields;
+        fields["id"] = make_counted<ql::datum_t>(static_cast<double>(i));
+        fields["k"] = make_counted<ql::datum_t>(
+            static_cast<double>((i * multiplier) % modulus));
+        rows.push_back(make_counted<ql::datum_t>(std::move(fields)));
+    }
+    return make_counted<ql::array_datum_stream_t>(
+        make_counted<ql::datum_t>(std::move(rows)), ql::make_counted_backtrace());
+}
+
+std::vector<counted_t<const ql::datum_t> > join(ql::env_t *env,
+                                                counted_t<ql::func_t> predicate,
+                                                bool outer) {
+    // Left keys are 0 to 9, right keys are the even numbers from 0 to 12.  There
+    // are enough right rows per key to fill a few spilled chunks.
+    counted_t<ql::datum_stream_t> joined = make_counted<ql::join_datum_stream_t>(
+        predicate, outer, make_rows(30, 1, 10), make_rows(8000, 2, 14));
+    std::vector<counted_t<const ql::datum_t> > results;
+    while (counted_t<const ql::datum_t> d = joined->next(env)) {
+        results.push_back(d);
+    }
+    return results;
+}
+
+bool datum_ptr_lt(const counted_t<const ql::datum_t> &left,
+                  const counted_t<const ql::datum_t> &right) {
+    return *left < *right;
+}
+
+void expect_same_results(std::vector<counted_t<const ql::datum_t> > expected,
+                         std::vector<counted_t<const ql::datum_t> > actual,
+                         bool same_order) {
+    ASSERT_EQ(expected.size(), actual.size());
+    if (!same_order) {
+        std::sort(expected.begin(), expected.end(), &datum_ptr_lt);
+        std::sort(actual.begin(), actual.end(), &datum_ptr_lt);
+    }
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(*expected[i], *actual[i]);
+    }
+}
+
+void run_hash_join_test() {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    const base_path_t spill_path(".");
+    cond_t non_interruptor;
+    ql::env_t env(&non_interruptor);
+
+    const ql::pb::dummy_var_t l = ql::pb::dummy_var_t::INNERJOIN_N;
+    const ql::pb::dummy_var_t r = ql::pb::dummy_var_t::INNERJOIN_M;
+    counted_t<ql::func_t> eq = compile_func(
+        ql::r::fun(l, r, ql::r::var(l)["k"] == ql::r::var(r)["k"]));
+    counted_t<ql::func_t> swapped_eq = compile_func(
+        ql::r::fun(l, r, ql::r::var(r)["k"] == ql::r::var(l)["k"]));
+    // The same predicate, but one that can't be hashed.
+    counted_t<ql::func_t> opaque_eq = compile_func(
+        ql::r::fun(l, r, (ql::r::var(l)["k"] + 0.0) == ql::r::var(r)["k"]));
+
+    std::string left_field;
+    std::string right_field;
+    EXPECT_TRUE(eq->is_field_equality(&left_field, &right_field));
+    EXPECT_TRUE(swapped_eq->is_field_equality(&left_field, &right_field));
+    EXPECT_EQ("k", left_field);
+    EXPECT_EQ("k", right_field);
+    EXPECT_FALSE(opaque_eq->is_field_equality(&left_field, &right_field));
+
+    for (int outer = 0; outer < 2; ++outer) {
+        std::vector<counted_t<const ql::datum_t> > nested_loop
+            = join(&env, opaque_eq, outer);
+        // Each even left key matches about 8000 / 7 right rows; odd ones match none.
+        EXPECT_LT(0u, nested_loop.size());
+
+        // Hashing in memory gives the same results in the same order.
+        expect_same_results(nested_loop, join(&env, eq, outer), true);
+        expect_same_results(nested_loop, join(&env, swapped_eq, outer), true);
+
+        // Spilling partitions gives the same results in some other order.
+        env.io_backender = &io_backender;
+        env.spill_path = &spill_path;
+        env.join_memory_budget = KILOBYTE;
+        expect_same_results(nested_loop, join(&env, eq, outer), false);
+        env.io_backender = NULL;
+        env.spill_path = NULL;
+        env.join_memory_budget = JOIN_MEMORY_BUDGET;
+    }
+}
+
+TEST(RDBJoin, HashJoin) {
+    unittest::run_in_thread_pool(&run_hash_join_test);
+}
+
+// Two documents `{id: i, k: [z, {z: z}]}`, where `z` is 0 or -0, and one with
+// `k: [z, {z: 1}]`.
+counted_t<ql::datum_stream_t> make_zero_rows(double zero) {
+    std::vector<counted_t<const ql::datum_t> > rows;
+    for (size_t i = 0; i < 3; ++i) {
+        std::map<std::string, counted_t<const ql::datum_t> > nested;
+        nested["z"] = make_counted<ql::datum_t>(i == 2 ? 1.0 : zero);
+        std::vector<counted_t<const ql::datum_t> > key;
+        key.push_back(make_counted<ql::datum_t>(zero));
+        key.push_back(make_counted<ql::datum_t>(std::move(nested)));
+        std::map<std::string, counted_t<const ql::datum_t> > fields;
+        fields["id"] = make_counted<ql::datum_t>(static_cast<double>(i));
+        fields["k"] = make_counted<ql::datum_t>(std::move(key));
+        rows.push_back(make_counted<ql::datum_t>(std::move(fields)));
+    }
+    return make_counted<ql::array_datum_stream_t>(
+        make_counted<ql::datum_t>(std::move(rows)), ql::make_counted_backtrace());
+}
+
+void run_nested_zero_join_test() {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    const base_path_t spill_path(".");
+    cond_t non_interruptor;
+    ql::env_t env(&non_interruptor);
+
+    const ql::pb::dummy_var_t l = ql::pb::dummy_var_t::INNERJOIN_N;
+    const ql::pb::dummy_var_t r = ql::pb::dummy_var_t::INNERJOIN_M;
+    counted_t<ql::func_t> eq = compile_func(
+        ql::r::fun(l, r, ql::r::var(l)["k"] == ql::r::var(r)["k"]));
+
+    for (int spill = 0; spill < 2; ++spill) {
+        if (spill) {
+            env.io_backender = &io_backender;
+            env.spill_path = &spill_path;
+            env.join_memory_budget = 1;
+        }
+        // `[-0, {z: -0}]` equals `[0, {z: 0}]`, so each of the first two left rows
+        // matches the first two right rows, and the last rows match each other.
+        counted_t<ql::datum_stream_t> joined = make_counted<ql::join_datum_stream_t>(
+            eq, false, make_zero_rows(-0.0), make_zero_rows(0.0));
+        size_t count = 0;
+        while (joined->next(&env).has()) {
+            ++count;
+        }
+        EXPECT_EQ(5u, count);
+    }
+}
+
+TEST(RDBJoin, NestedZeroKeys) {
+    unittest::run_in_thread_pool(&run_nested_zero_join_test);
+}
+
+}  // namespace unittest
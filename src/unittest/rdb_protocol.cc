@@ -78,7 +78,8 @@ void run_with_namespace_interface(boost::function<void(namespace_interface_t<rdb
 
     boost::shared_ptr<semilattice_readwrite_view_t<auth_semilattice_metadata_t> > dummy_auth;
     rdb_protocol_t::context_t ctx(&extproc_pool, NULL, slm.get_root_view(),
-                                  dummy_auth, &read_manager, generate_uuid());
+                                  dummy_auth, &read_manager, generate_uuid(),
+                                  NULL, NULL);
 
     for (size_t i = 0; i < store_shards.size(); ++i) {
         underlying_stores.push_back(
@@ -477,5 +478,104 @@ TEST(RDBProtocol, OvershardedMissingAttr) {
     run_in_thread_pool_with_namespace_interface(&run_sindex_missing_attr_test, true);
 }
 
+void run_sorted_rget_test(namespace_interface_t<rdb_protocol_t> *nsi, order_source_t *osource) {
+    // Keys on both sides of the shard boundary at "n", written out of order.
+    std::vector<std::string> keys;
+    for (char c = 'z'; c >= 'a'; --c) {
+        for (int i = 0; i < 10; ++i) {
+            keys.push_back(strprintf("%c%d", c, i));
+        }
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        rdb_protocol_t::write_t write(
+            rdb_protocol_t::point_write_t(store_key_t(keys[i]),
+                                          make_counted<ql::datum_t>(static_cast<double>(i))),
+            DURABILITY_REQUIREMENT_DEFAULT);
+        rdb_protocol_t::write_response_t response;
+
+        cond_t interruptor;
+        nsi->write(write, &response, osource->check_in("unittest::run_sorted_rget_test(rdb_protocol.cc-A)"), &interruptor);
+        ASSERT_TRUE(boost::get<rdb_protocol_t::point_write_response_t>(&response.response) != NULL);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    const sorting_t sortings[] = { ASCENDING, DESCENDING };
+    for (size_t s = 0; s < 2; ++s) {
+        rdb_protocol_t::read_t read(
+            rdb_protocol_t::rget_read_t(rdb_protocol_t::region_t::universe(), sortings[s]));
+        rdb_protocol_t::read_response_t response;
+
+        cond_t interruptor;
+        nsi->read(read, &response, osource->check_in("unittest::run_sorted_rget_test(rdb_protocol.cc-B)"), &interruptor);
+
+        rdb_protocol_t::rget_read_response_t *rget_resp = boost::get<rdb_protocol_t::rget_read_response_t>(&response.response);
+        ASSERT_TRUE(rget_resp != NULL);
+        rdb_protocol_t::rget_read_response_t::stream_t *stream = boost::get<rdb_protocol_t::rget_read_response_t::stream_t>(&rget_resp->result);
+        ASSERT_TRUE(stream != NULL);
+        ASSERT_EQ(keys.size(), stream->size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            const std::string &expected = forward(sortings[s]) ? keys[i] : keys[keys.size() - 1 - i];
+            ASSERT_EQ(store_key_t(expected), (*stream)[i].key);
+        }
+    }
+}
+
+TEST(RDBProtocol, SortedRangeGet) {
+    run_in_thread_pool_with_namespace_interface(&run_sorted_rget_test, false);
+}
+
+TEST(RDBProtocol, OvershardedSortedRangeGet) {
+    run_in_thread_pool_with_namespace_interface(&run_sorted_rget_test, true);
+}
+
+void run_batched_get_test(namespace_interface_t<rdb_protocol_t> *nsi, order_source_t *osource) {
+    // Rows on both sides of the shard boundary at "n".
+    std::vector<store_key_t> keys;
+    for (char c = 'a'; c <= 'z'; ++c) {
+        const store_key_t key(strprintf("%c", c));
+        keys.push_back(key);
+        if (c % 2 == 0) {
+            continue;
+        }
+        rdb_protocol_t::write_t write(
+            rdb_protocol_t::point_write_t(key, make_counted<ql::datum_t>(static_cast<double>(c))),
+            DURABILITY_REQUIREMENT_DEFAULT);
+        rdb_protocol_t::write_response_t response;
+
+        cond_t interruptor;
+        nsi->write(write, &response, osource->check_in("unittest::run_batched_get_test(rdb_protocol.cc-A)"), &interruptor);
+        ASSERT_TRUE(boost::get<rdb_protocol_t::point_write_response_t>(&response.response) != NULL);
+    }
+
+    rdb_protocol_t::read_t read((rdb_protocol_t::batched_point_read_t(std::vector<store_key_t>(keys))));
+    rdb_protocol_t::read_response_t response;
+
+    cond_t interruptor;
+    nsi->read(read, &response, osource->check_in("unittest::run_batched_get_test(rdb_protocol.cc-B)"), &interruptor);
+
+    rdb_protocol_t::batched_point_read_response_t *bp_resp = boost::get<rdb_protocol_t::batched_point_read_response_t>(&response.response);
+    ASSERT_TRUE(bp_resp != NULL);
+    // Only the odd letters were written.
+    ASSERT_EQ(13u, bp_resp->rows.size());
+    for (auto it = keys.begin(); it != keys.end(); ++it) {
+        const char c = it->contents()[0];
+        auto row = bp_resp->rows.find(*it);
+        if (c % 2 == 0) {
+            EXPECT_TRUE(row == bp_resp->rows.end());
+        } else {
+            ASSERT_TRUE(row != bp_resp->rows.end());
+            EXPECT_EQ(ql::datum_t(static_cast<double>(c)), *row->second);
+        }
+    }
+}
+
+TEST(RDBProtocol, BatchedGet) {
+    run_in_thread_pool_with_namespace_interface(&run_batched_get_test, false);
+}
+
+TEST(RDBProtocol, OvershardedBatchedGet) {
+    run_in_thread_pool_with_namespace_interface(&run_batched_get_test, true);
+}
+
 }   /* namespace unittest */
 
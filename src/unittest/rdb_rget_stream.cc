@@ -0,0 +1,177 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "errors.hpp"
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include "arch/runtime/coroutines.hpp"
+#include "arch/timing.hpp"
+#include "rdb_protocol/env.hpp"
+#include "rdb_protocol/func.hpp"
+#include "rdb_protocol/stream.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/rdb_env.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+// Enough rows for several batches, with a partial batch at the end.
+const size_t rget_num_rows = 50;
+const size_t rget_batch_rows = 8;
+
+std::string rget_row_id(size_t i) {
+    return strprintf("k%02zu", i);
+}
+
+namespace_id_t add_rget_table(test_rdb_env_t *test_env) {
+    std::set<std::map<std::string, std::string> > rows;
+    for (size_t i = 0; i < rget_num_rows; ++i) {
+        std::map<std::string, std::string> row;
+        row["id"] = rget_row_id(i);
+        rows.insert(row);
+    }
+    return test_env->add_table("table", test_env->add_database("db"), "id", rows);
+}
+
+boost::shared_ptr<query_language::batched_rget_stream_t> make_rget_stream(
+        ql::env_t *env, const namespace_id_t &ns_id, sorting_t sorting) {
+    std::map<std::string, ql::wire_func_t> optargs;
+    optargs["db"] = ql::wire_func_t(compile_func(ql::r::fun(ql::r::expr("db"))));
+    namespace_repo_t<rdb_protocol_t>::access_t ns_access(
+        env->cluster_access.ns_repo, ns_id, env->interruptor);
+    return boost::make_shared<query_language::batched_rget_stream_t>(
+        ns_access,
+        counted_t<const ql::datum_t>(), false,
+        counted_t<const ql::datum_t>(), false,
+        optargs, false, sorting, static_cast<ql::rcheckable_t *>(NULL));
+}
+
+void expect_next_row(ql::env_t *env, query_language::batched_rget_stream_t *stream,
+                     size_t i) {
+    counted_t<const ql::datum_t> row = stream->next(env);
+    ASSERT_TRUE(row.has());
+    EXPECT_EQ(rget_row_id(i), row->get("id")->as_str());
+}
+
+void wait_for_gated_read(mock_namespace_interface_t *ns_if) {
+    while (ns_if->reads_waiting_on_gate() == 0) {
+        nap(1);
+    }
+}
+
+// Lets the first read through `first_gate` once it's waiting there, and makes the
+// reads after it wait on `second_gate`.
+void let_first_read_through(mock_namespace_interface_t *ns_if,
+                            cond_t *first_gate, cond_t *second_gate) {
+    wait_for_gated_read(ns_if);
+    ns_if->set_read_gate(second_gate);
+    first_gate->pulse();
+}
+
+// Reads the first batch while the read after it is held back, so the stream has a
+// prefetch in flight that it can't get past.  Returns after taking the first row.
+boost::shared_ptr<query_language::batched_rget_stream_t> start_with_prefetch_held(
+        ql::env_t *env, const namespace_id_t &ns_id,
+        mock_namespace_interface_t *ns_if, cond_t *prefetch_gate) {
+    cond_t first_gate;
+    ns_if->set_read_gate(&first_gate);
+    boost::shared_ptr<query_language::batched_rget_stream_t> stream
+        = make_rget_stream(env, ns_id, ASCENDING);
+    coro_t::spawn_sometime(boost::bind(&let_first_read_through,
+                                       ns_if, &first_gate, prefetch_gate));
+    expect_next_row(env, stream.get(), 0);
+    wait_for_gated_read(ns_if);
+    return stream;
+}
+
+void run_rget_stream_order_test(test_rdb_env_t *test_env, namespace_id_t ns_id) {
+    scoped_ptr_t<test_rdb_env_t::instance_t> env_instance;
+    test_env->make_env(&env_instance);
+    ql::env_t *env = env_instance->get();
+    env_instance->get_ns_if(ns_id)->set_rget_batch_rows(rget_batch_rows);
+
+    const sorting_t sortings[] = { ASCENDING, DESCENDING };
+    for (size_t s = 0; s < 2; ++s) {
+        boost::shared_ptr<query_language::batched_rget_stream_t> stream
+            = make_rget_stream(env, ns_id, sortings[s]);
+        for (size_t i = 0; i < rget_num_rows; ++i) {
+            expect_next_row(env, stream.get(),
+                            forward(sortings[s]) ? i : rget_num_rows - 1 - i);
+        }
+        EXPECT_FALSE(stream->next(env).has());
+    }
+}
+
+TEST(RDBRgetStream, OrderAcrossBatches) {
+    test_rdb_env_t test_env;
+    namespace_id_t ns_id = add_rget_table(&test_env);
+    run_in_thread_pool(boost::bind(&run_rget_stream_order_test, &test_env, ns_id));
+}
+
+void run_rget_stream_prefetch_test(test_rdb_env_t *test_env, namespace_id_t ns_id) {
+    scoped_ptr_t<test_rdb_env_t::instance_t> env_instance;
+    test_env->make_env(&env_instance);
+    ql::env_t *env = env_instance->get();
+    mock_namespace_interface_t *ns_if = env_instance->get_ns_if(ns_id);
+    ns_if->set_rget_batch_rows(rget_batch_rows);
+
+    cond_t prefetch_gate;
+    boost::shared_ptr<query_language::batched_rget_stream_t> stream
+        = start_with_prefetch_held(env, ns_id, ns_if, &prefetch_gate);
+
+    // The rest of the first batch comes out while the next read is in flight.
+    for (size_t i = 1; i < rget_batch_rows; ++i) {
+        expect_next_row(env, stream.get(), i);
+    }
+    EXPECT_EQ(1, ns_if->reads_waiting_on_gate());
+
+    ns_if->set_read_gate(NULL);
+    prefetch_gate.pulse();
+    for (size_t i = rget_batch_rows; i < rget_num_rows; ++i) {
+        expect_next_row(env, stream.get(), i);
+    }
+    EXPECT_FALSE(stream->next(env).has());
+}
+
+TEST(RDBRgetStream, PrefetchInFlight) {
+    test_rdb_env_t test_env;
+    namespace_id_t ns_id = add_rget_table(&test_env);
+    run_in_thread_pool(boost::bind(&run_rget_stream_prefetch_test, &test_env, ns_id));
+}
+
+void run_rget_stream_interrupt_test(test_rdb_env_t *test_env, namespace_id_t ns_id) {
+    scoped_ptr_t<test_rdb_env_t::instance_t> env_instance;
+    test_env->make_env(&env_instance);
+    ql::env_t *env = env_instance->get();
+    mock_namespace_interface_t *ns_if = env_instance->get_ns_if(ns_id);
+    ns_if->set_rget_batch_rows(rget_batch_rows);
+
+    cond_t prefetch_gate;
+    {
+        // Destroying the stream interrupts the prefetch.
+        boost::shared_ptr<query_language::batched_rget_stream_t> stream
+            = start_with_prefetch_held(env, ns_id, ns_if, &prefetch_gate);
+    }
+    EXPECT_EQ(0, ns_if->reads_waiting_on_gate());
+
+    {
+        // A consumer that's waiting for the prefetch can be interrupted.
+        boost::shared_ptr<query_language::batched_rget_stream_t> stream
+            = start_with_prefetch_held(env, ns_id, ns_if, &prefetch_gate);
+        for (size_t i = 1; i < rget_batch_rows; ++i) {
+            expect_next_row(env, stream.get(), i);
+        }
+        coro_t::spawn_sometime(boost::bind(&test_rdb_env_t::instance_t::interrupt,
+                                           env_instance.get()));
+        EXPECT_THROW(stream->next(env), interrupted_exc_t);
+        EXPECT_EQ(1, ns_if->reads_waiting_on_gate());
+    }
+    EXPECT_EQ(0, ns_if->reads_waiting_on_gate());
+}
+
+TEST(RDBRgetStream, InterruptedPrefetch) {
+    test_rdb_env_t test_env;
+    namespace_id_t ns_id = add_rget_table(&test_env);
+    run_in_thread_pool(boost::bind(&run_rget_stream_interrupt_test, &test_env, ns_id));
+}
+
+}  // namespace unittest
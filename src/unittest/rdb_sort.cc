@@ -0,0 +1,142 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include "arch/io/disk.hpp"
+#include "arch/timing.hpp"
+#include "concurrency/cond_var.hpp"
+#include "rdb_protocol/counted_term.hpp"
+#include "rdb_protocol/datum_stream.hpp"
+#include "rdb_protocol/env.hpp"
+#include "rdb_protocol/func.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+// Hands out its documents one at a time, like a table does, rather than as an
+// array that `sort_datum_stream_t` would sort in memory.
+class unsorted_datum_stream_t : public ql::eager_datum_stream_t {
+public:
+    explicit unsorted_datum_stream_t(size_t _count)
+        : ql::eager_datum_stream_t(ql::make_counted_backtrace()),
+          count(_count), index(0) { }
+
+    bool is_array() { return false; }
+    counted_t<const ql::datum_t> as_array(UNUSED ql::env_t *env) {
+        return counted_t<const ql::datum_t>();
+    }
+
+private:
+    counted_t<const ql::datum_t> next_impl(UNUSED ql::env_t *env) {
+        if (index == count) {
+            return counted_t<const ql::datum_t>();
+        }
+        std::map<std::string, counted_t<const ql::datum_t> > fields;
+        fields["id"] = make_counted<ql::datum_t>(static_cast<double>(index));
+        // A permutation of [0, count) as long as count isn't a multiple of 7919
+        fields["value"] = make_counted<ql::datum_t>(
+            static_cast<double>((index * 7919) % count));
+        ++index;
+        return make_counted<ql::datum_t>(std::move(fields));
+    }
+
+    size_t count;
+    size_t index;
+};
+
+bool value_lt(UNUSED ql::env_t *env,
+              const counted_t<const ql::datum_t> &left,
+              const counted_t<const ql::datum_t> &right) {
+    return left->get("value")->as_num() < right->get("value")->as_num();
+}
+
+typedef ql::sort_datum_stream_t<ql::external_sort_t::lt_cmp_t> value_sort_stream_t;
+
+// Sorts `count` documents, checks that they come out in order and returns how
+// long that took.
+double sort_and_check(ql::env_t *env, size_t count) {
+    const ticks_t start = get_ticks();
+    counted_t<ql::datum_stream_t> sorted = make_counted<value_sort_stream_t>(
+        &value_lt, make_counted<unsorted_datum_stream_t>(count),
+        ql::make_counted_backtrace());
+    size_t i = 0;
+    while (counted_t<const ql::datum_t> d = sorted->next(env)) {
+        EXPECT_EQ(static_cast<double>(i), d->get("value")->as_num());
+        ++i;
+    }
+    EXPECT_EQ(count, i);
+    return ticks_to_secs(get_ticks() - start);
+}
+
+void run_spill_test() {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    const base_path_t spill_path(".");
+    cond_t non_interruptor;
+    ql::env_t env(&non_interruptor);
+
+    // Without anywhere to spill to, sorting stays in memory.
+    sort_and_check(&env, 10000);
+
+    // With a tiny budget, the same sort has to merge a few dozen runs.
+    env.io_backender = &io_backender;
+    env.spill_path = &spill_path;
+    env.sort_memory_budget = 16 * KILOBYTE;
+    sort_and_check(&env, 10000);
+}
+
+TEST(RDBSort, SpillsAndMerges) {
+    unittest::run_in_thread_pool(&run_spill_test);
+}
+
+void run_top_k_test() {
+    cond_t non_interruptor;
+    ql::env_t env(&non_interruptor);
+    const size_t count = 10000;
+
+    // `orderBy("value").limit(10)`, `.skip(5).limit(10)` and the same descending.
+    for (int descending = 0; descending < 2; ++descending) {
+        ql::order_wire_funcs_t order;
+        order.add(ql::new_get_field_func(make_counted<const ql::datum_t>("value"),
+                                         ql::make_counted_backtrace()),
+                  descending);
+        for (size_t skip = 0; skip <= 5; skip += 5) {
+            counted_t<ql::datum_stream_t> sorted
+                = make_counted<ql::sort_datum_stream_t<ql::order_wire_funcs_t> >(
+                    order, make_counted<unsorted_datum_stream_t>(count),
+                    ql::make_counted_backtrace());
+            counted_t<ql::datum_stream_t> limited = sorted->slice(skip, skip + 10);
+            for (size_t i = skip; i < skip + 10; ++i) {
+                counted_t<const ql::datum_t> d = limited->next(&env);
+                ASSERT_TRUE(d.has());
+                EXPECT_EQ(static_cast<double>(descending ? count - 1 - i : i),
+                          d->get("value")->as_num());
+            }
+            EXPECT_FALSE(limited->next(&env).has());
+        }
+    }
+}
+
+TEST(RDBSort, TopK) {
+    unittest::run_in_thread_pool(&run_top_k_test);
+}
+
+void run_sort_benchmark() {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    const base_path_t spill_path(".");
+    cond_t non_interruptor;
+    ql::env_t env(&non_interruptor);
+    env.io_backender = &io_backender;
+    env.spill_path = &spill_path;
+
+    const size_t count = 10 * MILLION;
+    const double secs = sort_and_check(&env, count);
+    printf("Sorted %zu documents with a %zu byte memory budget in %.1f s "
+           "(%.0f documents/s)\n", count, env.sort_memory_budget, secs,
+           count / secs);
+}
+
+// This takes minutes; run it with --gtest_also_run_disabled_tests.
+TEST(RDBSort, DISABLED_SortBenchmark) {
+    unittest::run_in_thread_pool(&run_sort_benchmark);
+}
+
+}  // namespace unittest
@@ -0,0 +1,37 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include <re2/re2.h>
+
+#include "config/args.hpp"
+#include "rdb_protocol/regex_cache.hpp"
+#include "unittest/unittest_utils.hpp"
+#include "utils.hpp"
+
+namespace unittest {
+
+void run_regex_cache_test() {
+    // The same pattern comes back already compiled.
+    boost::shared_ptr<const RE2> first = ql::compile_regex("a(b*)c");
+    ASSERT_TRUE(first->ok());
+    EXPECT_EQ(first.get(), ql::compile_regex("a(b*)c").get());
+    EXPECT_TRUE(RE2::PartialMatch("xabbbcx", *first));
+
+    // Patterns that don't compile come back with their error.
+    EXPECT_FALSE(ql::compile_regex("a(b")->ok());
+
+    // Once enough other patterns have been compiled, the first one gets dropped.
+    // We still hold it, so its replacement can't end up at the same address.
+    for (size_t i = 0; i < REGEX_CACHE_SIZE; ++i) {
+        ql::compile_regex(strprintf("x{%zu}", i));
+    }
+    boost::shared_ptr<const RE2> recompiled = ql::compile_regex("a(b*)c");
+    EXPECT_NE(first.get(), recompiled.get());
+    EXPECT_EQ(first->pattern(), recompiled->pattern());
+}
+
+TEST(RegexCache, ReusesAndEvicts) {
+    unittest::run_in_thread_pool(&run_regex_cache_test);
+}
+
+}  // namespace unittest
@@ -23,10 +23,12 @@ public:
         service(s),
         sequence_number(0)
         { }
-    void send(int message, peer_id_t peer) {
+    void send(int message, peer_id_t peer,
+              message_class_t message_class = message_class_t::control) {
         class writer_t : public send_message_write_callback_t {
         public:
-            explicit writer_t(int _data) : data(_data) { }
+            writer_t(int _data, message_class_t _message_class) :
+                data(_data), message_class(_message_class) { }
             virtual ~writer_t() { }
             void write(write_stream_t *stream) {
                 write_message_t msg;
@@ -34,8 +36,12 @@ public:
                 int res = send_write_message(stream, &msg);
                 if (res) { throw fake_archive_exc_t(); }
             }
+            message_class_t get_message_class() {
+                return message_class;
+            }
             int32_t data;
-        } writer(message);
+            message_class_t message_class;
+        } writer(message, message_class);
         service->send_message(peer, &writer);
     }
     void expect(int message, peer_id_t peer) {
@@ -197,6 +203,58 @@ TEST(RPCConnectivityTest, OrderingMultiThread) {
     unittest::run_in_thread_pool(&run_ordering_test, 3);
 }
 
+/* `MessageClasses` sends messages of every class in both directions between
+two nodes, with each combination of the number of connections they open to
+their peers, and checks that each class's messages arrive in order. */
+
+void run_message_classes_test(int streams_1, int streams_2) {
+    connectivity_cluster_t c1, c2;
+    recording_test_application_t a1(&c1), a2(&c2);
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(), ANY_PORT, &a1, 0, NULL, streams_1);
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(), ANY_PORT, &a2, 0, NULL, streams_2);
+
+    cr1.join(c2.get_peer_address(c2.get_me()));
+
+    /* Give the extra connections time to be set up, so that none of the
+    messages below switch connections halfway through. */
+    for (int i = 0; i < 5; ++i) {
+        let_stuff_happen();
+    }
+
+    const int num_messages = 300;
+    for (int i = 0; i < num_messages; ++i) {
+        message_class_t message_class = static_cast<message_class_t>(i % NUM_MESSAGE_CLASSES);
+        a1.send(i, c2.get_me(), message_class);
+        a2.send(i, c1.get_me(), message_class);
+    }
+
+    let_stuff_happen();
+
+    for (int i = 0; i + NUM_MESSAGE_CLASSES < num_messages; ++i) {
+        a1.expect_order(i, i + NUM_MESSAGE_CLASSES);
+        a2.expect_order(i, i + NUM_MESSAGE_CLASSES);
+    }
+
+    /* The connection is still usable in both directions. */
+    a1.send(num_messages, c2.get_me());
+    a2.send(num_messages, c1.get_me());
+    let_stuff_happen();
+    a1.expect(num_messages, c2.get_me());
+    a2.expect(num_messages, c1.get_me());
+}
+void run_all_message_classes_tests() {
+    run_message_classes_test(1, 1);
+    run_message_classes_test(NUM_MESSAGE_CLASSES, NUM_MESSAGE_CLASSES);
+    run_message_classes_test(NUM_MESSAGE_CLASSES, 1);
+    run_message_classes_test(1, NUM_MESSAGE_CLASSES);
+}
+TEST(RPCConnectivityTest, MessageClasses) {
+    unittest::run_in_thread_pool(&run_all_message_classes_tests);
+}
+TEST(RPCConnectivityTest, MessageClassesMultiThread) {
+    unittest::run_in_thread_pool(&run_all_message_classes_tests, 3);
+}
+
 /* `GetPeersList` confirms that the behavior of `cluster_t::get_peers_list()` is
 correct. */
 
@@ -310,7 +368,8 @@ struct watcher_t : private peers_list_callback_t {
         /* Make sure messages sent from connection events are delivered
         properly. We must use `coro_t::spawn_now_dangerously()` because `send_message()`
         may block. */
-        coro_t::spawn_now_dangerously(boost::bind(&recording_test_application_t::send, application, 89765, p));
+        coro_t::spawn_now_dangerously(boost::bind(&recording_test_application_t::send, application, 89765, p,
+                                                  message_class_t::control));
     }
 
     void on_disconnect(peer_id_t p) {
@@ -546,6 +605,87 @@ TEST(RPCConnectivityTest, BinaryDataMultiThread) {
     unittest::run_in_thread_pool(&run_binary_data_test, 3);
 }
 
+/* `MixedSizes` sends small messages, which get coalesced in the connection's write
+buffer, interleaved with big ones, which go to the socket in place, and makes sure
+they all arrive intact and in order. */
+
+class sized_message_test_application_t : public home_thread_mixin_t, public message_handler_t {
+public:
+    explicit sized_message_test_application_t(message_service_t *s) :
+        service(s), num_received(0)
+        { }
+    void send(int32_t id, int64_t size, peer_id_t peer) {
+        class writer_t : public send_message_write_callback_t {
+        public:
+            writer_t(int32_t _id, int64_t _size) : id(_id), size(_size) { }
+            virtual ~writer_t() { }
+            void write(write_stream_t *stream) {
+                write_message_t msg;
+                msg << id;
+                msg << size;
+                int res = send_write_message(stream, &msg);
+                if (res) { throw fake_archive_exc_t(); }
+                std::string body(size, '\0');
+                for (int64_t i = 0; i < size; ++i) {
+                    body[i] = static_cast<char>(id + i);
+                }
+                if (stream->write(body.data(), size) != size) { throw fake_archive_exc_t(); }
+            }
+            int32_t id;
+            int64_t size;
+        } writer(id, size);
+        service->send_message(peer, &writer);
+    }
+    void on_message(peer_id_t, string_read_stream_t *stream) {
+        int32_t id;
+        int64_t size;
+        if (deserialize(stream, &id) || deserialize(stream, &size)) {
+            throw fake_archive_exc_t();
+        }
+        std::string body(size, '\0');
+        int64_t res = force_read(stream, &body[0], size);
+        if (res != size) { throw fake_archive_exc_t(); }
+        char blah;
+        EXPECT_EQ(0, force_read(stream, &blah, 1));
+        for (int64_t i = 0; i < size; ++i) {
+            EXPECT_EQ(static_cast<char>(id + i), body[i]);
+        }
+
+        on_thread_t th(home_thread());
+        EXPECT_EQ(num_received, id);
+        ++num_received;
+    }
+
+    message_service_t *service;
+    int num_received;
+};
+
+void run_mixed_sizes_test() {
+    connectivity_cluster_t c1, c2;
+    sized_message_test_application_t a1(&c1), a2(&c2);
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(), ANY_PORT, &a1, 0, NULL);
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(), ANY_PORT, &a2, 0, NULL);
+    cr1.join(c2.get_peer_address(c2.get_me()));
+
+    let_stuff_happen();
+
+    const int num_messages = 30;
+    for (int i = 0; i < num_messages; ++i) {
+        const int64_t size = (i % 3 == 0) ? CLUSTER_MESSAGE_ZERO_COPY_SIZE * (i + 1) : i;
+        a1.send(i, size, c2.get_me());
+    }
+
+    let_stuff_happen();
+
+    EXPECT_EQ(num_messages, a2.num_received);
+}
+TEST(RPCConnectivityTest, MixedSizes) {
+    unittest::run_in_thread_pool(&run_mixed_sizes_test);
+}
+TEST(RPCConnectivityTest, MixedSizesMultiThread) {
+    unittest::run_in_thread_pool(&run_mixed_sizes_test, 3);
+}
+
 /* `PeerIDSemantics` makes sure that `peer_id_t::is_nil()` works as expected. */
 
 void run_peer_id_semantics_test() {
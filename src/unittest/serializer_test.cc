@@ -1,5 +1,13 @@
+#include <stdlib.h>
+
+#include <vector>
+
 #include "arch/runtime/starter.hpp"
+#include "perfmon/collect.hpp"
 #include "serializer/config.hpp"
+#include "serializer/log/lba/disk_format.hpp"
+#include "serializer/log/log_serializer.hpp"
+#include "serializer/log/metablock_manager.hpp"
 #include "unittest/mock_file.hpp"
 #include "unittest/gtest.hpp"
 
@@ -20,5 +28,329 @@ TEST(SerializerTest, CreateConstructDestroy) {
     run_in_thread_pool(run_CreateConstructDestroy, 4);
 }
 
+repli_timestamp_t make_recency(uint64_t t) {
+    repli_timestamp_t ret;
+    ret.longtime = t;
+    return ret;
+}
+
+// Writes blocks 0 to num_blocks - 1, each holding its own block id.
+void write_numbered_blocks(serializer_t *ser, file_account_t *account, block_id_t num_blocks) {
+    const block_size_t block_size = ser->get_block_size();
+    std::vector<index_write_op_t> ops;
+    for (block_id_t id = 0; id < num_blocks; ++id) {
+        scoped_malloc_t<ser_buffer_t> buf = ser->malloc();
+        memset(buf->cache_data, 0, block_size.value());
+        memcpy(buf->cache_data, &id, sizeof(id));
+        counted_t<standard_block_token_t> token
+            = serializer_block_write(ser, buf.get(), block_size, id, account);
+        ops.push_back(index_write_op_t(id, token, make_recency(0)));
+    }
+    ser->index_write(ops, account);
+}
+
+// Rewrites the recency of every block, which adds an LBA entry for each of them.
+void touch_blocks(serializer_t *ser, file_account_t *account, block_id_t num_blocks,
+                  repli_timestamp_t recency) {
+    std::vector<index_write_op_t> ops;
+    for (block_id_t id = 0; id < num_blocks; ++id) {
+        ops.push_back(index_write_op_t(id, boost::none, recency));
+    }
+    ser->index_write(ops, account);
+}
+
+// Returns the value of one of the serializer's perfmon counters.
+int64_t get_serializer_counter(const char *name) {
+    scoped_ptr_t<perfmon_result_t> stats = perfmon_get_stats();
+    const perfmon_result_t *serializer_stats
+        = static_cast<const perfmon_result_t *>(stats.get())->get_map()->at("serializer");
+    const perfmon_result_t *count = serializer_stats->get_map()->at(name);
+    return strtoll(count->get_string()->c_str(), NULL, 10);
+}
+
+int64_t get_lba_checkpoint_count() {
+    return get_serializer_counter("serializer_lba_checkpoints");
+}
+
+/* `LbaCheckpoint` checks that the index comes back the same after a restart that
+loads it from an LBA checkpoint plus the LBA entries written after it. */
+
+void run_LbaCheckpoint() {
+    mock_file_opener_t file_opener;
+    standard_serializer_t::create(&file_opener, standard_serializer_t::static_config_t());
+
+    standard_serializer_t::dynamic_config_t config;
+    config.lba_checkpoint_min_entries = 1000;
+
+    const block_id_t num_blocks = 2000;
+    {
+        standard_serializer_t ser(config, &file_opener, &get_global_perfmon_collection());
+        scoped_ptr_t<file_account_t> account(ser.make_io_account(CACHE_WRITES_IO_PRIORITY, UNLIMITED_OUTSTANDING_REQUESTS));
+        write_numbered_blocks(&ser, account.get(), num_blocks);
+
+        // Keep going until a checkpoint has replaced another one, so that the LBA
+        // extents that the first one covered have been dropped.
+        uint64_t round = 1;
+        while (get_lba_checkpoint_count() < 2) {
+            ASSERT_LT(round, 1000u);
+            touch_blocks(&ser, account.get(), num_blocks, make_recency(round));
+            ++round;
+        }
+
+        // Some changes that only the LBA knows about
+        touch_blocks(&ser, account.get(), num_blocks / 2, make_recency(round));
+        std::vector<index_write_op_t> deletes;
+        for (block_id_t id = 0; id < num_blocks; id += 7) {
+            deletes.push_back(index_write_op_t(id, counted_t<standard_block_token_t>()));
+        }
+        ser.index_write(deletes, account.get());
+    }
+
+    standard_serializer_t ser(config, &file_opener, &get_global_perfmon_collection());
+    scoped_ptr_t<file_account_t> account(ser.make_io_account(CACHE_READS_IO_PRIORITY, UNLIMITED_OUTSTANDING_REQUESTS));
+    ASSERT_EQ(num_blocks, ser.max_block_id());
+    scoped_malloc_t<ser_buffer_t> buf = ser.malloc();
+    // The first half of the blocks got one more round of updates than the rest
+    repli_timestamp_t first_half_recency = ser.get_recency(1);
+    for (block_id_t id = 0; id < num_blocks; ++id) {
+        if (id % 7 == 0) {
+            EXPECT_TRUE(ser.get_delete_bit(id));
+            continue;
+        }
+        EXPECT_FALSE(ser.get_delete_bit(id));
+        if (id < num_blocks / 2) {
+            EXPECT_EQ(first_half_recency, ser.get_recency(id));
+        } else {
+            EXPECT_EQ(first_half_recency.longtime - 1, ser.get_recency(id).longtime);
+        }
+        counted_t<standard_block_token_t> token = ser.index_read(id);
+        ASSERT_TRUE(token.has());
+        ser.block_read(token, buf.get(), account.get());
+        block_id_t stored_id;
+        memcpy(&stored_id, buf->cache_data, sizeof(stored_id));
+        EXPECT_EQ(id, stored_id);
+    }
+}
+
+TEST(SerializerTest, LbaCheckpoint) {
+    run_in_thread_pool(run_LbaCheckpoint, 4);
+}
+
+/* `LbaCheckpointFallback` checks that if the newest LBA checkpoint is corrupted, the
+serializer still starts, from the checkpoint before it. */
+
+// Damages the data extents of the newest checkpoint that the newest metablock in
+// `file` refers to.
+void corrupt_newest_checkpoint(std::vector<char> *file) {
+    mb_manager_t::crc_metablock_t *newest = NULL;
+    const std::vector<int64_t> offsets = initial_metablock_offsets(
+        standard_serializer_t::static_config_t().extent_size());
+    for (auto it = offsets.begin(); it != offsets.end(); ++it) {
+        mb_manager_t::crc_metablock_t *mb
+            = reinterpret_cast<mb_manager_t::crc_metablock_t *>(file->data() + *it);
+        if (memcmp(mb->magic_marker, MB_MARKER_MAGIC, sizeof(MB_MARKER_MAGIC)) == 0
+            && mb->check_crc() && (newest == NULL || mb->version > newest->version)) {
+            newest = mb;
+        }
+    }
+    ASSERT_TRUE(newest != NULL);
+
+    const lba_checkpoint_metablock_t &checkpoint
+        = newest->metablock.lba_index_part.checkpoint;
+    ASSERT_NE(NULL_OFFSET, checkpoint.directory_offset);
+    ASSERT_NE(NULL_OFFSET, newest->metablock.lba_index_part.previous_checkpoint.directory_offset);
+    const lba_checkpoint_directory_t *directory
+        = reinterpret_cast<const lba_checkpoint_directory_t *>(
+            file->data() + checkpoint.directory_offset);
+    ASSERT_EQ(checkpoint.extents_count, directory->extents_count);
+    for (int32_t i = 0; i < directory->extents_count; ++i) {
+        (*file)[directory->extents[i].offset + offsetof(lba_extent_t, entries[0])] ^= 1;
+    }
+}
+
+void run_LbaCheckpointFallback() {
+    mock_file_opener_t file_opener;
+    standard_serializer_t::create(&file_opener, standard_serializer_t::static_config_t());
+
+    standard_serializer_t::dynamic_config_t config;
+    config.lba_checkpoint_min_entries = 1000;
+
+    const block_id_t num_blocks = 2000;
+    uint64_t round = 1;
+    {
+        standard_serializer_t ser(config, &file_opener, &get_global_perfmon_collection());
+        scoped_ptr_t<file_account_t> account(ser.make_io_account(CACHE_WRITES_IO_PRIORITY, UNLIMITED_OUTSTANDING_REQUESTS));
+        write_numbered_blocks(&ser, account.get(), num_blocks);
+
+        // Keep going until a second checkpoint has replaced the first one, which
+        // drops the LBA extents from before the first one.
+        while (get_lba_checkpoint_count() < 2) {
+            ASSERT_LT(round, 1000u);
+            touch_blocks(&ser, account.get(), num_blocks, make_recency(round));
+            ++round;
+        }
+    }
+
+    corrupt_newest_checkpoint(file_opener.file_data());
+
+    standard_serializer_t ser(config, &file_opener, &get_global_perfmon_collection());
+    scoped_ptr_t<file_account_t> account(ser.make_io_account(CACHE_READS_IO_PRIORITY, UNLIMITED_OUTSTANDING_REQUESTS));
+    ASSERT_EQ(num_blocks, ser.max_block_id());
+    scoped_malloc_t<ser_buffer_t> buf = ser.malloc();
+    for (block_id_t id = 0; id < num_blocks; ++id) {
+        EXPECT_FALSE(ser.get_delete_bit(id));
+        EXPECT_EQ(round - 1, ser.get_recency(id).longtime);
+        counted_t<standard_block_token_t> token = ser.index_read(id);
+        ASSERT_TRUE(token.has());
+        ser.block_read(token, buf.get(), account.get());
+        block_id_t stored_id;
+        memcpy(&stored_id, buf->cache_data, sizeof(stored_id));
+        EXPECT_EQ(id, stored_id);
+    }
+}
+
+TEST(SerializerTest, LbaCheckpointFallback) {
+    run_in_thread_pool(run_LbaCheckpointFallback, 4);
+}
+
+/* `LbaCheckpointBenchmark` measures how long it takes to start a serializer whose
+LBA has seen many updates, with and without LBA checkpoints. */
+
+double time_restart(bool use_checkpoints, block_id_t num_blocks, int rounds) {
+    mock_file_opener_t file_opener;
+    standard_serializer_t::create(&file_opener, standard_serializer_t::static_config_t());
+
+    standard_serializer_t::dynamic_config_t config;
+    if (!use_checkpoints) {
+        config.lba_checkpoint_min_entries = INT64_MAX;
+    }
+
+    {
+        standard_serializer_t ser(config, &file_opener, &get_global_perfmon_collection());
+        scoped_ptr_t<file_account_t> account(ser.make_io_account(CACHE_WRITES_IO_PRIORITY, UNLIMITED_OUTSTANDING_REQUESTS));
+        write_numbered_blocks(&ser, account.get(), num_blocks);
+        uint64_t round = 1;
+        while (static_cast<int>(round) <= rounds
+               || (use_checkpoints && get_lba_checkpoint_count() == 0)) {
+            touch_blocks(&ser, account.get(), num_blocks, make_recency(round));
+            ++round;
+        }
+    }
+
+    ticks_t start = get_ticks();
+    {
+        standard_serializer_t ser(config, &file_opener, &get_global_perfmon_collection());
+        EXPECT_EQ(num_blocks, ser.max_block_id());
+    }
+    return ticks_to_secs(get_ticks() - start);
+}
+
+void run_LbaCheckpointBenchmark() {
+    const block_id_t num_blocks = 10000;
+    const int rounds = 40;
+    double with_checkpoints = time_restart(true, num_blocks, rounds);
+    double without_checkpoints = time_restart(false, num_blocks, rounds);
+    printf("Restarting a serializer with %" PRIu64 " blocks, each updated %d times: "
+           "%.3f s with LBA checkpoints, %.3f s without\n",
+           num_blocks, rounds, with_checkpoints, without_checkpoints);
+    EXPECT_LT(with_checkpoints, without_checkpoints);
+}
+
+TEST(SerializerTest, DISABLED_LbaCheckpointBenchmark) {
+    run_in_thread_pool(run_LbaCheckpointBenchmark, 4);
+}
+
+
+/* `BlockCompression` checks that blocks written with compression turned on read
+back the same, also after the GC has moved them and after a restart. */
+
+// Even blocks compress well; odd blocks are noise and won't compress at all.
+void fill_test_block(block_id_t id, uint32_t round, char *data, uint32_t size) {
+    memset(data, 0, size);
+    if (id % 2 == 1) {
+        uint64_t x = id;
+        for (uint32_t i = 0; i < size; ++i) {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            data[i] = x >> 56;
+        }
+    }
+    memcpy(data, &id, sizeof(id));
+    memcpy(data + sizeof(id), &round, sizeof(round));
+}
+
+void write_test_blocks(serializer_t *ser, file_account_t *account,
+                       block_id_t end_block_id, uint32_t round) {
+    const block_size_t block_size = ser->get_block_size();
+    std::vector<index_write_op_t> ops;
+    for (block_id_t id = 0; id < end_block_id; ++id) {
+        scoped_malloc_t<ser_buffer_t> buf = ser->malloc();
+        fill_test_block(id, round, buf->cache_data, block_size.value());
+        counted_t<standard_block_token_t> token
+            = serializer_block_write(ser, buf.get(), block_size, id, account);
+        ops.push_back(index_write_op_t(id, token, make_recency(round)));
+    }
+    ser->index_write(ops, account);
+}
+
+void check_test_blocks(serializer_t *ser, file_account_t *account,
+                       block_id_t num_blocks, block_id_t rewritten_blocks,
+                       uint32_t last_round) {
+    const block_size_t block_size = ser->get_block_size();
+    scoped_malloc_t<ser_buffer_t> buf = ser->malloc();
+    scoped_array_t<char> expected(block_size.value());
+    for (block_id_t id = 0; id < num_blocks; ++id) {
+        const uint32_t round = id < rewritten_blocks ? last_round : 0;
+        counted_t<standard_block_token_t> token = ser->index_read(id);
+        ASSERT_TRUE(token.has());
+        ASSERT_EQ(block_size, token->block_size());
+        ser->block_read(token, buf.get(), account);
+        fill_test_block(id, round, expected.data(), block_size.value());
+        EXPECT_EQ(0, memcmp(expected.data(), buf->cache_data, block_size.value()))
+            << "block " << id;
+    }
+}
+
+void run_BlockCompression() {
+    mock_file_opener_t file_opener;
+    standard_serializer_t::create(&file_opener, standard_serializer_t::static_config_t());
+
+    standard_serializer_t::dynamic_config_t config;
+    config.compress_blocks = true;
+
+    const block_id_t num_blocks = 1000;
+    const block_id_t rewritten_blocks = 900;
+    uint32_t round = 0;
+    {
+        standard_serializer_t ser(config, &file_opener, &get_global_perfmon_collection());
+        scoped_ptr_t<file_account_t> account(ser.make_io_account(CACHE_WRITES_IO_PRIORITY,
+                                                                 UNLIMITED_OUTSTANDING_REQUESTS));
+        write_test_blocks(&ser, account.get(), num_blocks, round);
+
+        // Overwrite most of the blocks until the GC has had to move some of the
+        // others.
+        while (get_serializer_counter("serializer_data_extents_gced") == 0) {
+            ++round;
+            ASSERT_LT(round, 1000u);
+            write_test_blocks(&ser, account.get(), rewritten_blocks, round);
+        }
+        check_test_blocks(&ser, account.get(), num_blocks, rewritten_blocks, round);
+
+        const int64_t bytes_before = get_serializer_counter("serializer_bytes_before_compression");
+        const int64_t bytes_after = get_serializer_counter("serializer_bytes_after_compression");
+        EXPECT_LT(bytes_after, bytes_before * 3 / 4);
+        EXPECT_GT(bytes_after, bytes_before / 2);
+    }
+
+    // Reading compressed blocks doesn't depend on the setting.
+    config.compress_blocks = false;
+    standard_serializer_t ser(config, &file_opener, &get_global_perfmon_collection());
+    scoped_ptr_t<file_account_t> account(ser.make_io_account(CACHE_READS_IO_PRIORITY,
+                                                             UNLIMITED_OUTSTANDING_REQUESTS));
+    check_test_blocks(&ser, account.get(), num_blocks, rewritten_blocks, round);
+}
+
+TEST(SerializerTest, BlockCompression) {
+    run_in_thread_pool(run_BlockCompression, 4);
+}
 
 }  // namespace unittest
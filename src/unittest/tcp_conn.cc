@@ -0,0 +1,139 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include "errors.hpp"
+#include <boost/bind.hpp>
+
+#include "arch/io/network.hpp"
+#include "arch/runtime/coroutines.hpp"
+#include "concurrency/cond_var.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+class counting_write_callback_t : public tcp_conn_t::write_callback_t {
+public:
+    counting_write_callback_t() : count(0) { }
+    void on_write_done() { ++count; }
+    int count;
+};
+
+void accept_conn(scoped_ptr_t<tcp_conn_t> *conn_out, cond_t *accepted,
+                 scoped_ptr_t<tcp_conn_descriptor_t> &nconn) {  // NOLINT(runtime/references)
+    nconn->make_overcomplicated(conn_out);
+    accepted->pulse();
+}
+
+void run_WriteNocopy() {
+    scoped_ptr_t<tcp_conn_t> server_conn;
+    cond_t accepted;
+    std::set<ip_address_t> addresses;
+    addresses.insert(ip_address_t("127.0.0.1"));
+    tcp_listener_t listener(addresses, ANY_PORT,
+                            boost::bind(&accept_conn, &server_conn, &accepted, _1));
+
+    cond_t non_interruptor;
+    tcp_conn_t client_conn(ip_address_t("127.0.0.1"), listener.get_port(), &non_interruptor);
+    accepted.wait();
+
+    // Lots of small writes, mixed with buffered ones, which all have to come out
+    // in order however the write queue batches them up.
+    const int num_writes = 1000;
+    const std::string message = "0123456789";
+    counting_write_callback_t callback;
+    std::string expected;
+    for (int i = 0; i < num_writes; ++i) {
+        server_conn->write_nocopy(message.data(), message.size(), &callback, &non_interruptor);
+        expected += message;
+        if (i % 10 == 0) {
+            server_conn->write_buffered("|", 1, &non_interruptor);
+            expected += "|";
+        }
+    }
+    server_conn->flush_buffer(&non_interruptor);
+    EXPECT_EQ(num_writes, callback.count);
+
+    std::string received(expected.size(), '\0');
+    client_conn.read(&received[0], received.size(), &non_interruptor);
+    EXPECT_EQ(expected, received);
+
+    // The callback hears about data that never gets queued, too.
+    server_conn->shutdown_write();
+    EXPECT_THROW(server_conn->write_nocopy(message.data(), message.size(),
+                                           &callback, &non_interruptor),
+                 tcp_conn_write_closed_exc_t);
+    EXPECT_EQ(num_writes + 1, callback.count);
+}
+
+TEST(TCPConnTest, WriteNocopy) {
+    unittest::run_in_thread_pool(run_WriteNocopy);
+}
+
+void write_messages(tcp_conn_t *conn, const std::vector<std::string> *messages,
+                    cond_t *done) {
+    cond_t non_interruptor;
+    try {
+        for (size_t i = 0; i < messages->size(); ++i) {
+            uint32_t size = (*messages)[i].size();
+            conn->write_buffered(&size, sizeof(size), &non_interruptor);
+            conn->write_buffered((*messages)[i].data(), size, &non_interruptor);
+        }
+        conn->flush_buffer(&non_interruptor);
+    } catch (const tcp_conn_write_closed_exc_t &) {
+        // The reader gave up.
+    }
+    done->pulse();
+}
+
+void run_BufferedReads() {
+    scoped_ptr_t<tcp_conn_t> server_conn;
+    cond_t accepted;
+    std::set<ip_address_t> addresses;
+    addresses.insert(ip_address_t("127.0.0.1"));
+    tcp_listener_t listener(addresses, ANY_PORT,
+                            boost::bind(&accept_conn, &server_conn, &accepted, _1));
+
+    cond_t non_interruptor;
+    tcp_conn_t client_conn(ip_address_t("127.0.0.1"), listener.get_port(), &non_interruptor);
+    accepted.wait();
+
+    // Size-prefixed messages, from tiny ones to ones too big for any pooled read
+    // buffer, sent back to back so that reads pick up several at once.
+    std::vector<std::string> messages;
+    for (size_t size = 1; size <= 4 * MEGABYTE; size *= 4) {
+        std::string message(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            message[i] = 'a' + (i + size) % 26;
+        }
+        messages.push_back(message);
+    }
+    cond_t done_writing;
+    coro_t::spawn_sometime(boost::bind(&write_messages, &client_conn, &messages,
+                                       &done_writing));
+
+    for (size_t i = 0; i < messages.size(); ++i) {
+        uint32_t size;
+        server_conn->read(&size, sizeof(size), &non_interruptor);
+        EXPECT_EQ(messages[i].size(), size);
+        if (size != messages[i].size()) {
+            client_conn.shutdown_write();
+            break;
+        }
+        if (i % 2 == 0) {
+            const_charslice data = server_conn->peek(size, &non_interruptor);
+            EXPECT_EQ(messages[i], std::string(data.beg, size));
+            server_conn->pop(size, &non_interruptor);
+        } else {
+            std::string data(size, '\0');
+            server_conn->read(&data[0], size, &non_interruptor);
+            EXPECT_EQ(messages[i], data);
+        }
+    }
+    done_writing.wait();
+}
+
+TEST(TCPConnTest, BufferedReads) {
+    unittest::run_in_thread_pool(run_BufferedReads);
+}
+
+}  // namespace unittest
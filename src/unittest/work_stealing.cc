@@ -0,0 +1,68 @@
+// Copyright 2010-2013 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include "errors.hpp"
+#include <boost/bind.hpp>
+
+#include "arch/runtime/coroutines.hpp"
+#include "arch/runtime/runtime.hpp"
+#include "concurrency/cond_var.hpp"
+#include "unittest/unittest_utils.hpp"
+#include "utils.hpp"
+
+namespace unittest {
+
+const int num_busy_coros = 16;
+
+void spin_and_record(threadnum_t home_thread, int i, int *ran_on,
+                     int *num_done, cond_t *all_done) {
+    ran_on[i] = get_thread_id().threadnum;
+
+    // Keep this thread busy without ever giving it back to the event loop
+    const ticks_t start = get_ticks();
+    while (get_ticks() - start < 10 * MILLION) { }
+
+    on_thread_t rethreader(home_thread);
+    if (++*num_done == num_busy_coros) {
+        all_done->pulse();
+    }
+}
+
+void run_IdleThreadsStealWork() {
+    int ran_on[num_busy_coros];
+    int num_done = 0;
+    cond_t all_done;
+
+    for (int i = 0; i < num_busy_coros; ++i) {
+        coro_t::spawn_stealable(boost::bind(&spin_and_record, get_thread_id(), i,
+                                            ran_on, &num_done, &all_done));
+    }
+    all_done.wait();
+
+    int num_stolen = 0;
+    for (int i = 0; i < num_busy_coros; ++i) {
+        if (ran_on[i] != get_thread_id().threadnum) {
+            ++num_stolen;
+        }
+    }
+    EXPECT_GT(num_stolen, 0);
+}
+
+TEST(WorkStealingTest, IdleThreadsStealWork) {
+    unittest::run_in_thread_pool(run_IdleThreadsStealWork, 2);
+}
+
+void run_LeastLoadedThread() {
+    // Nobody has been busy yet, so any thread will do, but it must be one of the
+    // threads we asked about.
+    const threadnum_t thread = get_least_loaded_thread(2);
+    EXPECT_GE(thread.threadnum, 0);
+    EXPECT_LT(thread.threadnum, 2);
+    EXPECT_LE(get_thread_utilization(thread), 1.0);
+}
+
+TEST(WorkStealingTest, LeastLoadedThread) {
+    unittest::run_in_thread_pool(run_LeastLoadedThread, 2);
+}
+
+}  // namespace unittest